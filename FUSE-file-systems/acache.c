@@ -0,0 +1,107 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+
+/**
+ * CSC369 Assignment 4 - Inode attribute cache.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "acache.h"
+#include "bitmap.h"
+#include "util.h"
+
+/** Size of a cache line; entries never straddle one. */
+#define ACACHE_LINE 64
+
+
+/** Cached attributes of an inode. */
+typedef struct acache_entry {
+	uint64_t size;
+	int64_t  mtime_sec;
+	uint32_t mtime_nsec;
+	uint32_t mode;
+	uint32_t nlink;
+	/** Space taken in 512-byte units (see fs_inode_sectors()). */
+	uint32_t sectors;
+} acache_entry;
+
+static_assert(ACACHE_LINE % sizeof(acache_entry) == 0,
+              "acache_entry must divide a cache line");
+
+
+/** Copy the attributes of an inode into its entry. */
+static void fill_entry(const fs_ctx *fs, acache_entry *e,
+                       const vsfs_inode *inode)
+{
+	e->size = inode->i_size;
+	e->mtime_sec = inode->i_mtime.tv_sec;
+	e->mtime_nsec = inode->i_mtime.tv_nsec;
+	e->mode = inode->i_mode;
+	e->nlink = inode->i_nlink;
+	e->sectors = fs_inode_sectors(fs, inode);
+}
+
+bool acache_init(fs_ctx *fs)
+{
+	uint32_t ninodes = fs->sb->num_inodes;
+	size_t size = align_up(ninodes * sizeof(acache_entry), ACACHE_LINE);
+	acache_entry *entries = aligned_alloc(ACACHE_LINE, size);
+	if (entries == NULL) {
+		return false;
+	}
+	// Free inodes may be in inode table blocks that are not initialized
+	memset(entries, 0, size);
+	for (vsfs_ino_t ino = 0; ino < ninodes; ++ino) {
+		if (bitmap_isset(fs->ibmap, ninodes, ino)) {
+			fill_entry(fs, &entries[ino], &fs->itable[ino]);
+		}
+	}
+	fs->acache = entries;
+	return true;
+}
+
+void acache_destroy(fs_ctx *fs)
+{
+	free(fs->acache);
+	fs->acache = NULL;
+}
+
+void acache_update(fs_ctx *fs, const vsfs_inode *inode)
+{
+	if (fs->acache != NULL) {
+		assert(inode >= fs->itable &&
+		       inode < fs->itable + fs->sb->num_inodes);
+		fill_entry(fs, &fs->acache[inode - fs->itable], inode);
+	}
+}
+
+bool acache_getattr(const fs_ctx *fs, vsfs_ino_t ino, struct stat *st)
+{
+	if (fs->acache == NULL) {
+		return false;
+	}
+	const acache_entry *e = &fs->acache[ino];
+	st->st_mode = e->mode;
+	st->st_nlink = e->nlink;
+	st->st_size = e->size;
+	st->st_blocks = e->sectors;
+	st->st_mtim.tv_sec = e->mtime_sec;
+	st->st_mtim.tv_nsec = e->mtime_nsec;
+	return true;
+}
@@ -0,0 +1,68 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+
+/**
+ * CSC369 Assignment 4 - Inode attribute cache.
+ *
+ * getattr is by far the most frequent operation of stat-heavy workloads (e.g.
+ * builds), and reading its attributes from the inode table touches a whole
+ * inode in the mapped image, possibly faulting in an inode table page. The
+ * cache keeps a compact copy of the attributes that getattr returns (mode,
+ * link count, size, blocks and mtime) for every inode, 32 bytes each, so that
+ * a getattr reads a single cache line. It is filled from the inode table at
+ * mount, and every change to one of these attributes updates it right away,
+ * so it never has to be invalidated.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <sys/stat.h>
+
+#include "fs_ctx.h"
+#include "vsfs.h"
+
+
+/**
+ * Allocate the cache and fill it with the attributes of all the allocated
+ * inodes. The file system works without the cache.
+ *
+ * @param fs  pointer to the file system context.
+ * @return    true on success; false if out of memory.
+ */
+bool acache_init(fs_ctx *fs);
+
+/** Free the cache. */
+void acache_destroy(fs_ctx *fs);
+
+/**
+ * Update the cached attributes of an inode from the inode table. Must be
+ * called whenever the mode, link count, size, blocks or mtime of an inode
+ * change; does nothing if the cache is not allocated.
+ *
+ * @param fs     pointer to the file system context.
+ * @param inode  pointer to the inode in the inode table.
+ */
+void acache_update(fs_ctx *fs, const vsfs_inode *inode);
+
+/**
+ * Fill in the getattr fields of an allocated inode from the cache.
+ *
+ * @param fs   pointer to the file system context.
+ * @param ino  inode number.
+ * @param st   pointer to the stat structure; the other fields are left as is.
+ * @return     true on success; false if the cache is not allocated.
+ */
+bool acache_getattr(const fs_ctx *fs, vsfs_ino_t ino, struct stat *st);
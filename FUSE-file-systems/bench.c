@@ -0,0 +1,596 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+/**
+ * CSC369 Assignment 4 - vsfs microbenchmarks.
+ *
+ * Formats a temporary image with mkfs.vsfs for every benchmark and drives the
+ * file system in-process through libvsfs, timing every operation.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "benchutil.h"
+#include "dir.h"
+#include "libvsfs.h"
+#include "vsfs.h"
+
+/** Size of the files used by the I/O benchmarks (close to the maximum). */
+#define BENCH_FILE_SIZE (4u << 20)
+/** Number of passes over the directory in the readdir benchmark. */
+#define READDIR_PASSES 100
+/** Number of files looked up by the stat benchmark. */
+#define STAT_FILES 1000
+
+/** Command line options. */
+typedef struct bench_opts {
+	/** Directory for the temporary image. */
+	const char *tmp_dir;
+	/** Path to the mkfs.vsfs executable. */
+	char mkfs_path[PATH_MAX];
+	/** Image size in MiB. */
+	unsigned long size_mb;
+	/** Block size in bytes. */
+	unsigned long block_size;
+	/** Number of operations in the metadata benchmarks. */
+	unsigned long n_ops;
+	/** Amount of data in the I/O benchmarks in MiB. */
+	unsigned long data_mb;
+	/** Seed of the random offsets and file names. */
+	unsigned long seed;
+	/** Mount options. */
+	fs_opts mount;
+	/** Print results as CSV. */
+	bool csv;
+	/** List the benchmarks and exit. */
+	bool list;
+	/** Print help and exit. */
+	bool help;
+	/** Benchmarks to run (prefixes of names); all if there are none. */
+	char **names;
+	int n_names;
+
+} bench_opts;
+
+/** State of a running benchmark. */
+typedef struct bench_ctx {
+	fs_ctx fs;
+	const bench_opts *opts;
+	/** I/O size of the benchmark; 0 for metadata benchmarks. */
+	size_t io_size;
+	/** Random data to write; 2 * BENCH_FILE_SIZE bytes. */
+	char *buf;
+	/** Latency of each operation. */
+	lat_samples lat;
+	/** Total time of the timed operations in nanoseconds. */
+	uint64_t elapsed;
+	/** Bytes transferred by the timed operations. */
+	uint64_t bytes;
+	/** Random number generator state. */
+	uint64_t rng;
+} bench_ctx;
+
+/** A benchmark. */
+typedef struct bench {
+	const char *name;
+	/** Run the benchmark; returns 0 on success or -errno on error. */
+	int (*run)(bench_ctx *ctx);
+	/** I/O size; 0 for metadata benchmarks. */
+	size_t io_size;
+} bench;
+
+static const char *help_str = "\
+Usage: %s [options] [benchmark...]\n\
+\n\
+Run vsfs microbenchmarks in-process on a temporary image. Benchmarks are\n\
+selected by name prefix (e.g. \"seqread\"); all are run by default.\n\
+\n\
+Options:\n\
+    -d dir   directory for the temporary image (default: $TMPDIR or /tmp)\n\
+    -m path  mkfs.vsfs executable (default: next to this program)\n\
+    -s MiB   image size (default: 128)\n\
+    -b size  block size in bytes, 4096 to 65536 (default: 4096)\n\
+    -n num   number of operations in metadata benchmarks (default: 10000)\n\
+    -D MiB   amount of data in I/O benchmarks (default: 32)\n\
+    -o opts  comma-separated mount options: dedup, compress, verify, log\n\
+    -S seed  random seed (default: 1)\n\
+    -c       print results as CSV\n\
+    -l       list benchmarks and exit\n\
+    -h       print help and exit\n\
+";
+
+static void print_help(FILE *f, const char *progname)
+{
+	fprintf(f, help_str, progname);
+}
+
+
+/** Maximum number of entries in a directory. */
+static size_t dir_entries_max(uint32_t block_size)
+{
+	return (size_t)vsfs_max_file_blocks(block_size)
+	       * vsfs_dentries_per_block(block_size) - 2;
+}
+
+static bool parse_args(int argc, char *argv[], bench_opts *opts)
+{
+	int o;
+	while ((o = getopt(argc, argv, "d:m:s:b:n:D:o:S:clh")) != -1) {
+		switch (o) {
+			case 'd': opts->tmp_dir = optarg; break;
+			case 'm': snprintf(opts->mkfs_path, sizeof(opts->mkfs_path),
+			                   "%s", optarg); break;
+			case 's': opts->size_mb = strtoul(optarg, NULL, 10); break;
+			case 'b': opts->block_size = strtoul(optarg, NULL, 10); break;
+			case 'n': opts->n_ops   = strtoul(optarg, NULL, 10); break;
+			case 'D': opts->data_mb = strtoul(optarg, NULL, 10); break;
+			case 'S': opts->seed    = strtoul(optarg, NULL, 10); break;
+			case 'o':
+				if (!parse_mount_opts(optarg, &opts->mount)) {
+					return false;
+				}
+				break;
+
+			case 'c': opts->csv  = true; break;
+			case 'l': opts->list = true; break;
+			case 'h': opts->help = true; return true;// skip other arguments
+
+			case '?': return false;
+			default : assert(false);
+		}
+	}
+	opts->names = argv + optind;
+	opts->n_names = argc - optind;
+
+	if (opts->block_size > VSFS_BLOCK_SIZE_MAX ||
+	    !vsfs_block_size_valid(opts->block_size)) {
+		fprintf(stderr, "Block size must be a power of 2 from %u to %u\n",
+		        VSFS_BLOCK_SIZE_MIN, VSFS_BLOCK_SIZE_MAX);
+		return false;
+	}
+	size_t max_mb = (size_t)vsfs_blk_max(opts->block_size)
+	                * opts->block_size >> 20;
+	if (opts->size_mb == 0 || opts->size_mb > max_mb) {
+		fprintf(stderr, "Image size must be 1 to %zu MiB\n", max_mb);
+		return false;
+	}
+	size_t max_entries = dir_entries_max(opts->block_size);
+	if (opts->n_ops == 0 || opts->n_ops > max_entries ||
+	    opts->n_ops + 2 >= VSFS_INO_MAX) {
+		fprintf(stderr, "Number of operations must be 1 to %zu\n",
+		        max_entries);
+		return false;
+	}
+	if (opts->data_mb < BENCH_FILE_SIZE >> 20 ||
+	    opts->data_mb >= opts->size_mb) {
+		fprintf(stderr, "Data size must be at least %u MiB and less "
+		        "than the image size\n",
+		        BENCH_FILE_SIZE >> 20);
+		return false;
+	}
+	return true;
+}
+
+
+/** Get the next random number (xorshift64*). */
+static uint64_t rand_next(bench_ctx *ctx)
+{
+	ctx->rng ^= ctx->rng >> 12;
+	ctx->rng ^= ctx->rng << 25;
+	ctx->rng ^= ctx->rng >> 27;
+	return ctx->rng * 0x2545F4914F6CDD1Dull;
+}
+
+/** Record the latency of an operation that started at start (now_ns()). */
+static void record(bench_ctx *ctx, uint64_t start, uint64_t bytes)
+{
+	uint64_t lat = now_ns() - start;
+
+	// If out of memory, keep the totals; the percentiles use the samples so far
+	lat_add(&ctx->lat, lat);
+	ctx->elapsed += lat;
+	ctx->bytes += bytes;
+}
+
+/** Time an expression that returns 0 on success; return on failure. */
+#define TIMED(ctx, bytes, call)                                 \
+	do {                                                    \
+		uint64_t start_ = now_ns();                     \
+		int ret_ = (call);                              \
+		if (ret_ < 0) {                                 \
+			return ret_;                            \
+		}                                               \
+		record((ctx), start_, (bytes));                 \
+	} while (0)
+
+static void file_path(char *path, const char *prefix, unsigned long i)
+{
+	sprintf(path, "/%s%lu", prefix, i);
+}
+
+/** Create n empty files named prefix0..prefix<n-1>. */
+static int create_files(bench_ctx *ctx, const char *prefix, unsigned long n,
+                        bool timed)
+{
+	char path[VSFS_PATH_MAX];
+	for (unsigned long i = 0; i < n; ++i) {
+		file_path(path, prefix, i);
+		if (timed) {
+			TIMED(ctx, 0, fs_create(&ctx->fs, path, S_IFREG | 0644));
+		} else {
+			int ret = fs_create(&ctx->fs, path, S_IFREG | 0644);
+			if (ret != 0) {
+				return ret;
+			}
+		}
+	}
+	return 0;
+}
+
+/** Number of files in the I/O benchmarks. */
+static unsigned long io_files(const bench_opts *opts)
+{
+	return (opts->data_mb << 20) / BENCH_FILE_SIZE;
+}
+
+/**
+ * Get the contents of an I/O benchmark file. Every file starts at a different
+ * offset in the buffer, so that no two files have identical blocks.
+ */
+static const char *file_data(const bench_ctx *ctx, unsigned long i)
+{
+	return ctx->buf + i * sizeof(uint64_t) % BENCH_FILE_SIZE;
+}
+
+/** Write all the files of the I/O benchmarks sequentially. */
+static int write_files(bench_ctx *ctx, bool timed)
+{
+	char path[VSFS_PATH_MAX];
+	int ret = create_files(ctx, "d", io_files(ctx->opts), false);
+	if (ret != 0) {
+		return ret;
+	}
+	for (unsigned long i = 0; i < io_files(ctx->opts); ++i) {
+		file_path(path, "d", i);
+		for (size_t off = 0; off < BENCH_FILE_SIZE; off += ctx->io_size) {
+			const char *data = file_data(ctx, i) + off;
+			if (timed) {
+				TIMED(ctx, ctx->io_size,
+				      fs_write(&ctx->fs, path, data, ctx->io_size,
+				               off));
+			} else {
+				ssize_t n = fs_write(&ctx->fs, path, data,
+				                     ctx->io_size, off);
+				if (n < 0) {
+					return n;
+				}
+			}
+		}
+	}
+	return 0;
+}
+
+
+static int bench_create(bench_ctx *ctx)
+{
+	return create_files(ctx, "f", ctx->opts->n_ops, true);
+}
+
+static int bench_unlink(bench_ctx *ctx)
+{
+	char path[VSFS_PATH_MAX];
+	int ret = create_files(ctx, "f", ctx->opts->n_ops, false);
+	if (ret != 0) {
+		return ret;
+	}
+	for (unsigned long i = 0; i < ctx->opts->n_ops; ++i) {
+		file_path(path, "f", i);
+		TIMED(ctx, 0, fs_unlink(&ctx->fs, path));
+	}
+	return 0;
+}
+
+static int bench_stat(bench_ctx *ctx)
+{
+	char path[VSFS_PATH_MAX];
+	struct stat st;
+	int ret = create_files(ctx, "f", STAT_FILES, false);
+	if (ret != 0) {
+		return ret;
+	}
+	for (unsigned long i = 0; i < ctx->opts->n_ops; ++i) {
+		file_path(path, "f", rand_next(ctx) % STAT_FILES);
+		TIMED(ctx, 0, fs_getattr(&ctx->fs, path, &st));
+	}
+	return 0;
+}
+
+/** fs_readdir() callback that only counts the entries. */
+static int count_entry(void *data, const char *name, vsfs_ino_t ino)
+{
+	(void)name;// unused
+	(void)ino;// unused
+	(*(unsigned long *)data)++;
+	return 0;
+}
+
+static int bench_readdir(bench_ctx *ctx)
+{
+	int ret = create_files(ctx, "f", ctx->opts->n_ops, false);
+	if (ret != 0) {
+		return ret;
+	}
+	for (int i = 0; i < READDIR_PASSES; ++i) {
+		unsigned long count = 0;
+		TIMED(ctx, 0, fs_readdir(&ctx->fs, "/", count_entry, &count));
+		if (count != ctx->opts->n_ops + 2) {
+			return -EIO;
+		}
+	}
+	return 0;
+}
+
+static int bench_seqwrite(bench_ctx *ctx)
+{
+	return write_files(ctx, true);
+}
+
+static int bench_seqread(bench_ctx *ctx)
+{
+	char path[VSFS_PATH_MAX];
+	char *data = malloc(ctx->io_size);
+	int ret = data ? write_files(ctx, false) : -ENOMEM;
+
+	for (unsigned long i = 0; ret == 0 && i < io_files(ctx->opts); ++i) {
+		file_path(path, "d", i);
+		for (size_t off = 0; off < BENCH_FILE_SIZE; off += ctx->io_size) {
+			uint64_t start = now_ns();
+			ssize_t n = fs_read(&ctx->fs, path, data, ctx->io_size, off);
+			if (n != (ssize_t)ctx->io_size) {
+				ret = n < 0 ? n : -EIO;
+				break;
+			}
+			record(ctx, start, n);
+		}
+	}
+	free(data);
+	return ret;
+}
+
+/** Pick a random I/O-size-aligned location in the I/O benchmark files. */
+static void rand_io(bench_ctx *ctx, char *path, off_t *off)
+{
+	file_path(path, "d", rand_next(ctx) % io_files(ctx->opts));
+	*off = rand_next(ctx) % (BENCH_FILE_SIZE / ctx->io_size) * ctx->io_size;
+}
+
+static int bench_randwrite(bench_ctx *ctx)
+{
+	char path[VSFS_PATH_MAX];
+	off_t off;
+	int ret = write_files(ctx, false);
+	if (ret != 0) {
+		return ret;
+	}
+	size_t n_ops = (ctx->opts->data_mb << 20) / ctx->io_size;
+	for (size_t i = 0; i < n_ops; ++i) {
+		rand_io(ctx, path, &off);
+		// New contents, in case deduplication is enabled
+		const char *data = file_data(ctx, rand_next(ctx));
+		TIMED(ctx, ctx->io_size,
+		      fs_write(&ctx->fs, path, data, ctx->io_size, off));
+	}
+	return 0;
+}
+
+static int bench_randread(bench_ctx *ctx)
+{
+	char path[VSFS_PATH_MAX];
+	off_t off;
+	char *data = malloc(ctx->io_size);
+	int ret = data ? write_files(ctx, false) : -ENOMEM;
+
+	size_t n_ops = (ctx->opts->data_mb << 20) / ctx->io_size;
+	for (size_t i = 0; ret == 0 && i < n_ops; ++i) {
+		rand_io(ctx, path, &off);
+		uint64_t start = now_ns();
+		ssize_t n = fs_read(&ctx->fs, path, data, ctx->io_size, off);
+		if (n != (ssize_t)ctx->io_size) {
+			ret = n < 0 ? n : -EIO;
+			break;
+		}
+		record(ctx, start, n);
+	}
+	free(data);
+	return ret;
+}
+
+static int bench_truncate(bench_ctx *ctx)
+{
+	int ret = fs_create(&ctx->fs, "/t", S_IFREG | 0644);
+	if (ret != 0) {
+		return ret;
+	}
+	for (unsigned long i = 0; i < ctx->opts->n_ops; ++i) {
+		off_t size = rand_next(ctx) % (BENCH_FILE_SIZE + 1);
+		TIMED(ctx, 0, fs_truncate(&ctx->fs, "/t", size));
+	}
+	return 0;
+}
+
+#define KiB(n) ((size_t)(n) << 10)
+
+static const bench benchmarks[] = {
+	{ "create",         bench_create,    0 },
+	{ "unlink",         bench_unlink,    0 },
+	{ "stat",           bench_stat,      0 },
+	{ "readdir",        bench_readdir,   0 },
+	{ "truncate",       bench_truncate,  0 },
+	{ "seqwrite-4k",    bench_seqwrite,  KiB(4) },
+	{ "seqwrite-64k",   bench_seqwrite,  KiB(64) },
+	{ "seqwrite-1m",    bench_seqwrite,  KiB(1024) },
+	{ "seqread-4k",     bench_seqread,   KiB(4) },
+	{ "seqread-64k",    bench_seqread,   KiB(64) },
+	{ "seqread-1m",     bench_seqread,   KiB(1024) },
+	{ "randwrite-4k",   bench_randwrite, KiB(4) },
+	{ "randwrite-64k",  bench_randwrite, KiB(64) },
+	{ "randwrite-1m",   bench_randwrite, KiB(1024) },
+	{ "randread-4k",    bench_randread,  KiB(4) },
+	{ "randread-64k",   bench_randread,  KiB(64) },
+	{ "randread-1m",    bench_randread,  KiB(1024) },
+};
+
+#define NUM_BENCHMARKS (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+
+/** Check if a benchmark was selected on the command line. */
+static bool selected(const bench_opts *opts, const bench *b)
+{
+	if (opts->n_names == 0) {
+		return true;
+	}
+	for (int i = 0; i < opts->n_names; ++i) {
+		if (strncmp(b->name, opts->names[i], strlen(opts->names[i])) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static void print_header(const bench_opts *opts)
+{
+	if (opts->csv) {
+		printf("bench,ops,seconds,ops_per_sec,mib_per_sec,"
+		       "p50_us,p99_us,p999_us\n");
+	} else {
+		printf("%-14s %8s %12s %9s %10s %10s %10s\n", "bench", "ops",
+		       "ops/s", "MiB/s", "p50(us)", "p99(us)", "p999(us)");
+	}
+}
+
+static void print_result(const bench_opts *opts, const bench *b,
+                         bench_ctx *ctx)
+{
+	lat_samples *lat = &ctx->lat;
+	lat_sort(lat);
+	double secs = ctx->elapsed / 1e9;
+	double ops_s = secs > 0 ? lat->n / secs : 0;
+	double mib_s = secs > 0 ? ctx->bytes / secs / (1 << 20) : 0;
+
+	if (opts->csv) {
+		printf("%s,%zu,%.6f,%.1f,%.1f,%.3f,%.3f,%.3f\n", b->name,
+		       lat->n, secs, ops_s, mib_s, lat_percentile(lat, 0.5),
+		       lat_percentile(lat, 0.99), lat_percentile(lat, 0.999));
+	} else {
+		printf("%-14s %8zu %12.1f %9.1f %10.2f %10.2f %10.2f\n",
+		       b->name, lat->n, ops_s, mib_s, lat_percentile(lat, 0.5),
+		       lat_percentile(lat, 0.99), lat_percentile(lat, 0.999));
+	}
+	fflush(stdout);
+}
+
+/** Run one benchmark on a fresh image. */
+static bool run_bench(const bench_opts *opts, const bench *b, char *buf)
+{
+	char img_path[PATH_MAX];
+	unsigned long n_files = opts->n_ops > STAT_FILES ? opts->n_ops : STAT_FILES;
+	int fd = format_image(opts->tmp_dir, "vsfs-bench", opts->mkfs_path,
+	                      opts->size_mb, opts->block_size,
+	                      n_files + io_files(opts) + 16, img_path);
+	if (fd < 0) {
+		return false;
+	}
+
+	bench_ctx ctx = {
+		.opts = opts,
+		.io_size = b->io_size,
+		.buf = buf,
+		.rng = opts->seed * 0x9E3779B97F4A7C15ull | 1,
+	};
+	bool ok = fs_mount(&ctx.fs, img_path, &opts->mount);
+	if (ok) {
+		int ret = b->run(&ctx);
+		fs_unmount(&ctx.fs);
+		if (ret < 0) {
+			fprintf(stderr, "%s: %s\n", b->name, strerror(-ret));
+			ok = false;
+		} else if (ctx.lat.n > 0) {
+			print_result(opts, b, &ctx);
+		}
+	} else {
+		fprintf(stderr, "Failed to mount %s\n", img_path);
+	}
+
+	lat_free(&ctx.lat);
+	close(fd);
+	unlink(img_path);
+	return ok;
+}
+
+int main(int argc, char *argv[])
+{
+	bench_opts opts = {
+		.tmp_dir = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp",
+		.size_mb = 128,
+		.block_size = VSFS_BLOCK_SIZE_MIN,
+		.n_ops = 10000,
+		.data_mb = 32,
+		.seed = 1,
+	};
+	default_mkfs_path(opts.mkfs_path, sizeof(opts.mkfs_path), argv[0]);
+
+	if (!parse_args(argc, argv, &opts)) {
+		print_help(stderr, argv[0]);
+		return 1;
+	}
+	if (opts.help) {
+		print_help(stdout, argv[0]);
+		return 0;
+	}
+	if (opts.list) {
+		for (size_t i = 0; i < NUM_BENCHMARKS; ++i) {
+			printf("%s\n", benchmarks[i].name);
+		}
+		return 0;
+	}
+
+	// Incompressible contents, so that the I/O benchmarks measure the
+	// file system rather than the compressor when compression is enabled
+	char *buf = malloc(2 * BENCH_FILE_SIZE);
+	if (buf == NULL) {
+		perror("malloc");
+		return 1;
+	}
+	bench_ctx fill = { .rng = 0x1234567 };
+	for (size_t i = 0; i < 2 * BENCH_FILE_SIZE / sizeof(uint64_t); ++i) {
+		((uint64_t *)buf)[i] = rand_next(&fill);
+	}
+
+	int ret = 0;
+	print_header(&opts);
+	for (size_t i = 0; i < NUM_BENCHMARKS; ++i) {
+		if (selected(&opts, &benchmarks[i]) &&
+		    !run_bench(&opts, &benchmarks[i], buf)) {
+			ret = 1;
+		}
+	}
+	free(buf);
+	return ret;
+}
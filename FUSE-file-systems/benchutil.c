@@ -0,0 +1,146 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+/**
+ * CSC369 Assignment 4 - Helpers shared by vsfs-bench and vsfs-replay.
+ */
+
+#include <libgen.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "benchutil.h"
+
+
+bool lat_add(lat_samples *s, uint64_t ns)
+{
+	if (s->n == s->cap) {
+		size_t cap = s->cap ? s->cap * 2 : 4096;
+		uint64_t *p = realloc(s->lat, cap * sizeof(*p));
+		if (p == NULL) {
+			return false;
+		}
+		s->lat = p;
+		s->cap = cap;
+	}
+	s->lat[s->n++] = ns;
+	return true;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+void lat_sort(lat_samples *s)
+{
+	qsort(s->lat, s->n, sizeof(*s->lat), cmp_u64);
+}
+
+double lat_percentile(const lat_samples *s, double p)
+{
+	if (s->n == 0) {
+		return 0;
+	}
+	size_t i = (size_t)(p * s->n + 0.999999);
+	return s->lat[i > 0 ? i - 1 : 0] / 1000.0;
+}
+
+void lat_free(lat_samples *s)
+{
+	free(s->lat);
+	*s = (lat_samples){0};
+}
+
+
+bool parse_mount_opts(char *str, fs_opts *opts)
+{
+	char *saveptr;
+	for (char *o = strtok_r(str, ",", &saveptr); o != NULL;
+	     o = strtok_r(NULL, ",", &saveptr)) {
+		if (strcmp(o, "dedup") == 0) {
+			opts->dedup = true;
+		} else if (strcmp(o, "compress") == 0) {
+			opts->compress = true;
+		} else if (strcmp(o, "verify") == 0) {
+			opts->verify = true;
+		} else if (strcmp(o, "log") == 0) {
+			opts->log = true;
+		} else {
+			fprintf(stderr, "Unknown mount option: %s\n", o);
+			return false;
+		}
+	}
+	return true;
+}
+
+void default_mkfs_path(char *buf, size_t len, const char *argv0)
+{
+	char progdir[PATH_MAX];
+	snprintf(progdir, sizeof(progdir), "%s", argv0);
+	snprintf(buf, len, "%s/mkfs.vsfs", dirname(progdir));
+}
+
+int format_image(const char *dir, const char *name, const char *mkfs_path,
+                 unsigned long size_mb, uint32_t block_size,
+                 unsigned long n_inodes, char *path)
+{
+	snprintf(path, PATH_MAX, "%s/%s.XXXXXX", dir, name);
+	int fd = mkstemp(path);
+	if (fd < 0) {
+		perror(path);
+		return -1;
+	}
+	if (ftruncate(fd, (off_t)size_mb << 20) < 0) {
+		perror("ftruncate");
+		goto fail;
+	}
+
+	char inodes[32];
+	snprintf(inodes, sizeof(inodes), "%lu", n_inodes);
+	char bsize[32];
+	snprintf(bsize, sizeof(bsize), "%u", block_size);
+	fflush(stdout);// don't let the child write out buffered results
+	pid_t pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		goto fail;
+	}
+	if (pid == 0) {
+		if (freopen("/dev/null", "w", stdout) == NULL) {
+			_exit(127);
+		}
+		execl(mkfs_path, mkfs_path, "-f", "-b", bsize, "-i", inodes, path,
+		      (char *)NULL);
+		perror(mkfs_path);
+		_exit(127);
+	}
+	int status;
+	if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+	    WEXITSTATUS(status) != 0) {
+		fprintf(stderr, "%s failed\n", mkfs_path);
+		goto fail;
+	}
+	return fd;
+
+fail:
+	close(fd);
+	unlink(path);
+	return -1;
+}
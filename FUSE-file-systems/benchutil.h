@@ -0,0 +1,100 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+/**
+ * CSC369 Assignment 4 - Helpers shared by vsfs-bench and vsfs-replay.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "libvsfs.h"
+
+
+/** Latency samples in nanoseconds. */
+typedef struct lat_samples {
+	uint64_t *lat;
+	size_t n;
+	size_t cap;
+} lat_samples;
+
+/** Get the current time in nanoseconds. */
+static inline uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * Add a latency sample.
+ *
+ * @return  true on success; false if out of memory (the sample is lost).
+ */
+bool lat_add(lat_samples *s, uint64_t ns);
+
+/** Sort the samples; must be called before lat_percentile(). */
+void lat_sort(lat_samples *s);
+
+/**
+ * Get a percentile of the sorted samples.
+ *
+ * @param s  samples sorted with lat_sort().
+ * @param p  percentile, 0 < p <= 1.
+ * @return   latency in microseconds; 0 if there are no samples.
+ */
+double lat_percentile(const lat_samples *s, double p);
+
+/** Free the samples. */
+void lat_free(lat_samples *s);
+
+/**
+ * Parse a comma-separated list of mount options (dedup, compress, verify,
+ * log).
+ *
+ * @param str   option list; modified by the parser.
+ * @param opts  options to set.
+ * @return      true on success; false if an option is unknown.
+ */
+bool parse_mount_opts(char *str, fs_opts *opts);
+
+/**
+ * Get the path of the mkfs.vsfs executable in the same directory as a program.
+ *
+ * @param buf    buffer that receives the path.
+ * @param len    buffer size.
+ * @param argv0  path of the program (argv[0]).
+ */
+void default_mkfs_path(char *buf, size_t len, const char *argv0);
+
+/**
+ * Create a temporary image file and format it with mkfs.vsfs. The image
+ * should be removed with unlink() when it is no longer needed.
+ *
+ * @param dir        directory for the image.
+ * @param name       prefix of the image file name.
+ * @param mkfs_path  path to the mkfs.vsfs executable.
+ * @param size_mb    image size in MiB.
+ * @param block_size block size in bytes.
+ * @param n_inodes   number of inodes.
+ * @param path       buffer of PATH_MAX bytes that receives the image path.
+ * @return           open file descriptor of the image; -1 on failure.
+ */
+int format_image(const char *dir, const char *name, const char *mkfs_path,
+                 unsigned long size_mb, uint32_t block_size,
+                 unsigned long n_inodes, char *path);
@@ -77,6 +77,48 @@ int bitmap_alloc(bitmap_t *b, uint32_t nbits, uint32_t *index)
 	return -1;
 }
 
+// Same as bitmap_alloc(), but only considers the bits in [start, end).
+// Whole words are skipped when all their bits are in use.
+int bitmap_alloc_range(bitmap_t *b, uint32_t nbits, uint32_t start,
+                       uint32_t end, uint32_t *index)
+{
+	size_t *words = (size_t *)b;
+	assert(start <= end && end <= nbits);
+
+	uint32_t i = start;
+	while (i < end) {
+		uint32_t idx = i / bits_per_word;
+		size_t avail = ~words[idx] & (word_all_bits << (i % bits_per_word));
+
+		if (avail != 0) {
+			uint32_t bit = idx * bits_per_word + __builtin_ctzl(avail);
+			if (bit >= end) {
+				break;
+			}
+			words[idx] |= (size_t)1 << (bit % bits_per_word);
+			*index = bit;
+			return 0;
+		}
+		i = (idx + 1) * bits_per_word;
+	}
+	return -1;
+}
+
+// Count the unused bits in [start, end).
+uint32_t bitmap_count_free(bitmap_t *b, uint32_t nbits, uint32_t start,
+                           uint32_t end)
+{
+	uint32_t count = 0;
+	assert(start <= end && end <= nbits);
+
+	for (uint32_t i = start; i < end; ++i) {
+		if (!bitmap_isset(b, nbits, i)) {
+			count++;
+		}
+	}
+	return count;
+}
+
 // Marks the bit at the given index as available (0).
 // The supplied index must be less than the number of bits in the bitmap.
 // The bitmap at the supplied index must be marked allocated.
@@ -41,6 +41,15 @@ int bitmap_init(bitmap_t *b, uint32_t nbits);
 // Returns 0 on success and -1 if all bits are already marked as in-use.
 int bitmap_alloc(bitmap_t *b, uint32_t nbits, uint32_t *index);
 
+// Same as bitmap_alloc(), but only considers the bits in [start, end).
+// Requires start <= end <= nbits.
+int bitmap_alloc_range(bitmap_t *b, uint32_t nbits, uint32_t start,
+                       uint32_t end, uint32_t *index);
+
+// Count the unused bits in [start, end). Requires start <= end <= nbits.
+uint32_t bitmap_count_free(bitmap_t *b, uint32_t nbits, uint32_t start,
+                           uint32_t end);
+
 // Marks the bit at the given index as available (0).
 // The supplied index must be less than the number of bits in the bitmap.
 // The bitmap at the supplied index must be marked allocated.
@@ -0,0 +1,323 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+/**
+ * CSC369 Assignment 4 - Transparent compression of file data in clusters.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bitmap.h"
+#include "compress.h"
+#include "csum.h"
+#include "inode.h"
+#include "lz4.h"
+#include "refcount.h"
+#include "tail.h"
+#include "util.h"
+
+/** Number of decompressed clusters kept in memory. */
+#define CCACHE_SIZE 8
+
+/** Maximum size of the compressed data that saves at least one block. */
+static size_t max_compressed_size(const fs_ctx *fs)
+{
+	return fs_cluster_size(fs) - fs->block_size - sizeof(vsfs_cluster_hdr);
+}
+
+
+/** Cache of decompressed clusters. */
+typedef struct cluster_cache {
+	/** Block pointers of each cached cluster; all 0 if the entry is empty. */
+	vsfs_blk_t slots[CCACHE_SIZE][VSFS_CLUSTER_BLOCKS];
+	/** Next entry to replace (round-robin). */
+	unsigned int next;
+	/** Buffers of a cluster size for compressing and for gathering the
+	 *  compressed blocks (the cluster size depends on the block size). */
+	char *in;
+	char *out;
+	/** Decompressed data of each cached cluster. */
+	char data[];
+} cluster_cache;
+
+/** Get the cache, allocating it on first use; returns NULL if out of memory. */
+static cluster_cache *get_cache(fs_ctx *fs)
+{
+	if (fs->ccache == NULL) {
+		size_t csize = fs_cluster_size(fs);
+		cluster_cache *cache = calloc(1, sizeof(*cache)
+		                                 + (CCACHE_SIZE + 2) * csize);
+		if (cache == NULL) {
+			return NULL;
+		}
+		cache->in = cache->data + CCACHE_SIZE * csize;
+		cache->out = cache->in + csize;
+		fs->ccache = cache;
+	}
+	return fs->ccache;
+}
+
+
+/** Get the block pointers of a cluster (that lies within the file). */
+static void get_slots(fs_ctx *fs, const vsfs_inode *inode, vsfs_blk_t c,
+                      vsfs_blk_t *slots)
+{
+	for (vsfs_blk_t i = 0; i < VSFS_CLUSTER_BLOCKS; ++i) {
+		slots[i] = inode_get_block(fs, inode, c * VSFS_CLUSTER_BLOCKS + i);
+	}
+}
+
+bool compress_is_compressed(fs_ctx *fs, const vsfs_inode *inode, vsfs_blk_t c)
+{
+	vsfs_blk_t last = (c + 1) * VSFS_CLUSTER_BLOCKS - 1;
+	return last < inode->i_blocks && inode_get_block(fs, inode, last) == 0;
+}
+
+int compress_read(fs_ctx *fs, const vsfs_inode *inode, vsfs_blk_t c,
+                  const char **data)
+{
+	assert(compress_is_compressed(fs, inode, c));
+
+	cluster_cache *cache = get_cache(fs);
+	if (cache == NULL) {
+		return -ENOMEM;
+	}
+	size_t csize = fs_cluster_size(fs);
+
+	vsfs_blk_t slots[VSFS_CLUSTER_BLOCKS];
+	get_slots(fs, inode, c, slots);
+	for (unsigned int e = 0; e < CCACHE_SIZE; ++e) {
+		if (memcmp(cache->slots[e], slots, sizeof(slots)) == 0) {
+			*data = cache->data + e * csize;
+			return 0;
+		}
+	}
+
+	// The compressed data can be used in place if its blocks are
+	// contiguous in the image; otherwise gather it into a buffer
+	const char *src = block_addr(fs, slots[0]);
+	size_t size = fs->block_size;
+	bool contiguous = true;
+	for (vsfs_blk_t i = 1; slots[i] != 0; ++i) {
+		contiguous = contiguous && (slots[i] == slots[0] + i);
+		size += fs->block_size;
+	}
+	if (!contiguous) {
+		for (vsfs_blk_t i = 0; slots[i] != 0; ++i) {
+			memcpy(cache->out + i * fs->block_size,
+			       block_addr(fs, slots[i]), fs->block_size);
+		}
+		src = cache->out;
+	}
+
+	if (fs->verify) {
+		for (vsfs_blk_t i = 0; slots[i] != 0; ++i) {
+			if (!csum_is_dirty(fs, slots[i]) &&
+			    !csum_verify(fs, slots[i])) {
+				return -EIO;
+			}
+		}
+	}
+
+	const vsfs_cluster_hdr *hdr = (const vsfs_cluster_hdr *)src;
+	if (hdr->c_size > size - sizeof(*hdr)) {
+		return -EIO;
+	}
+
+	unsigned int e = cache->next;
+	cache->next = (e + 1) % CCACHE_SIZE;
+	memset(cache->slots[e], 0, sizeof(cache->slots[e]));
+	if (lz4_decompress(src + sizeof(*hdr), hdr->c_size,
+	                   cache->data + e * csize, csize) != (int)csize) {
+		return -EIO;
+	}
+	memcpy(cache->slots[e], slots, sizeof(slots));
+	*data = cache->data + e * csize;
+	return 0;
+}
+
+bool compress_cluster(fs_ctx *fs, vsfs_inode *inode, vsfs_blk_t c)
+{
+	vsfs_blk_t first = c * VSFS_CLUSTER_BLOCKS;
+	if (first + VSFS_CLUSTER_BLOCKS > inode->i_blocks ||
+	    tail_is_packed(inode, first + VSFS_CLUSTER_BLOCKS - 1)) {
+		return false;
+	}
+
+	// Compressing blocks shared with other files (e.g. a snapshot) would
+	// take more space, not less
+	vsfs_blk_t slots[VSFS_CLUSTER_BLOCKS];
+	get_slots(fs, inode, c, slots);
+	for (vsfs_blk_t i = 0; i < VSFS_CLUSTER_BLOCKS; ++i) {
+		if (slots[i] == 0 || rc_get(fs, slots[i]) > 1) {
+			return false;
+		}
+	}
+
+	cluster_cache *cache = get_cache(fs);
+	if (cache == NULL) {
+		return false;
+	}
+	char *in = cache->in, *out = cache->out;
+	for (vsfs_blk_t i = 0; i < VSFS_CLUSTER_BLOCKS; ++i) {
+		memcpy(in + i * fs->block_size, block_addr(fs, slots[i]),
+		       fs->block_size);
+	}
+	vsfs_cluster_hdr *hdr = (vsfs_cluster_hdr *)out;
+	hdr->c_size = lz4_compress(in, fs_cluster_size(fs), out + sizeof(*hdr),
+	                           max_compressed_size(fs));
+	if (hdr->c_size == 0) {
+		return false;
+	}
+
+	size_t size = sizeof(*hdr) + hdr->c_size;
+	vsfs_blk_t nblocks = div_round_up(size, fs->block_size);
+	memset(out + size, 0, nblocks * fs->block_size - size);
+
+	for (vsfs_blk_t i = 0; i < nblocks; ++i) {
+		// The blocks are not shared, so this doesn't allocate anything
+		vsfs_blk_t blk;
+		int ret = inode_write_block(fs, inode, first + i, &blk);
+		assert(ret == 0);
+		(void)ret;
+		memcpy(block_addr(fs, blk), out + i * fs->block_size,
+		       fs->block_size);
+	}
+	for (vsfs_blk_t i = nblocks; i < VSFS_CLUSTER_BLOCKS; ++i) {
+		inode_replace_block(fs, inode, first + i, 0);
+	}
+	return true;
+}
+
+void compress_file(fs_ctx *fs, vsfs_inode *inode)
+{
+	vsfs_blk_t nclusters = inode->i_blocks / VSFS_CLUSTER_BLOCKS;
+	for (vsfs_blk_t c = 0; c < nclusters; ++c) {
+		compress_cluster(fs, inode, c);
+	}
+}
+
+int compress_inflate(fs_ctx *fs, vsfs_inode *inode, vsfs_blk_t c)
+{
+	if (!compress_is_compressed(fs, inode, c)) {
+		return 0;
+	}
+
+	const char *cached;
+	int ret = compress_read(fs, inode, c, &cached);
+	if (ret != 0) {
+		return ret;
+	}
+	// The cache entry is dropped as soon as the blocks are modified
+	char *data = fs->ccache->in;
+	memcpy(data, cached, fs_cluster_size(fs));
+
+	// Allocate all the new blocks first, so that a failure leaves the
+	// cluster intact. Unshared blocks are reused in place.
+	vsfs_blk_t first = c * VSFS_CLUSTER_BLOCKS;
+	vsfs_blk_t slots[VSFS_CLUSTER_BLOCKS];
+	vsfs_blk_t fresh[VSFS_CLUSTER_BLOCKS] = {0};
+	get_slots(fs, inode, c, slots);
+	for (vsfs_blk_t i = 0; i < VSFS_CLUSTER_BLOCKS; ++i) {
+		if (slots[i] != 0 && rc_get(fs, slots[i]) == 1) {
+			continue;
+		}
+		ret = block_alloc(fs, inode_goal(fs, inode, first + i),
+		                  &fresh[i]);
+		if (ret != 0) {
+			while (i-- > 0) {
+				if (fresh[i] != 0) {
+					block_put(fs, fresh[i]);
+				}
+			}
+			return ret;
+		}
+	}
+
+	for (vsfs_blk_t i = 0; i < VSFS_CLUSTER_BLOCKS; ++i) {
+		vsfs_blk_t blk = fresh[i];
+		if (blk != 0) {
+			inode_replace_block(fs, inode, first + i, blk);
+		} else {
+			ret = inode_write_block(fs, inode, first + i, &blk);
+			assert(ret == 0);
+		}
+		memcpy(block_addr(fs, blk), data + i * fs->block_size,
+		       fs->block_size);
+	}
+	return 0;
+}
+
+int compress_inflate_range(fs_ctx *fs, vsfs_inode *inode, vsfs_blk_t idx,
+                           vsfs_blk_t count)
+{
+	if (count == 0) {
+		return 0;
+	}
+	vsfs_blk_t last = (idx + count - 1) / VSFS_CLUSTER_BLOCKS;
+	for (vsfs_blk_t c = idx / VSFS_CLUSTER_BLOCKS; c <= last; ++c) {
+		int ret = compress_inflate(fs, inode, c);
+		if (ret != 0) {
+			return ret;
+		}
+	}
+	return 0;
+}
+
+void compress_forget(fs_ctx *fs, vsfs_blk_t blk)
+{
+	cluster_cache *cache = fs->ccache;
+	if (cache == NULL) {
+		return;
+	}
+	for (unsigned int e = 0; e < CCACHE_SIZE; ++e) {
+		for (vsfs_blk_t i = 0; i < VSFS_CLUSTER_BLOCKS; ++i) {
+			if (cache->slots[e][i] == blk) {
+				memset(cache->slots[e], 0, sizeof(cache->slots[e]));
+				break;
+			}
+		}
+	}
+}
+
+void compress_destroy(fs_ctx *fs)
+{
+	free(fs->ccache);
+	fs->ccache = NULL;
+}
+
+void compress_stats(fs_ctx *fs, struct vsfs_compr_stats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+
+	for (vsfs_ino_t ino = 0; ino < fs->sb->num_inodes; ++ino) {
+		const vsfs_inode *inode = &fs->itable[ino];
+		if (!bitmap_isset(fs->ibmap, fs->sb->num_inodes, ino) ||
+		    !S_ISREG(inode->i_mode)) {
+			continue;
+		}
+
+		stats->logical_blocks += inode->i_blocks;
+		for (vsfs_blk_t i = 0; i < inode->i_blocks; ++i) {
+			if (inode_get_block(fs, inode, i) != 0) {
+				stats->stored_blocks++;
+			} else if (i % VSFS_CLUSTER_BLOCKS ==
+			           VSFS_CLUSTER_BLOCKS - 1) {
+				stats->compressed_clusters++;
+			}
+		}
+	}
+}
@@ -0,0 +1,119 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+/**
+ * CSC369 Assignment 4 - Transparent compression of file data in clusters.
+ *
+ * See VSFS_CLUSTER_BLOCKS in vsfs.h for the on-disk format. Compressed
+ * clusters are decompressed into a small in-memory cache on read. Before any
+ * part of a compressed cluster is modified, the whole cluster is expanded
+ * back into VSFS_CLUSTER_BLOCKS blocks (see compress_inflate()); files with
+ * the VSFS_INODE_COMPRESS flag are compressed again once a write reaches the
+ * end of a cluster.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "fs_ctx.h"
+#include "vsfs.h"
+
+
+/**
+ * Check if a cluster of a file is stored compressed.
+ *
+ * @param fs     pointer to the file system context.
+ * @param inode  pointer to the inode.
+ * @param c      cluster index.
+ * @return       true if the cluster is compressed.
+ */
+bool compress_is_compressed(fs_ctx *fs, const vsfs_inode *inode, vsfs_blk_t c);
+
+/**
+ * Get the uncompressed data of a compressed cluster.
+ *
+ * @param fs     pointer to the file system context.
+ * @param inode  pointer to the inode.
+ * @param c      index of a compressed cluster.
+ * @param data   pointer to the variable that receives a pointer to the
+ *               fs_cluster_size() bytes of data. The data is valid until the
+ *               next call to any of the compress_*() functions or until the
+ *               file is modified.
+ * @return       0 on success; -ENOMEM if the cache can't be allocated; -EIO
+ *               if the compressed data is corrupted (or its checksum doesn't
+ *               match, if fs->verify is set).
+ */
+int compress_read(fs_ctx *fs, const vsfs_inode *inode, vsfs_blk_t c,
+                  const char **data);
+
+/**
+ * Try to store a cluster of a file compressed. Only clusters that lie entirely
+ * within the file and don't share blocks with other files are compressed, and
+ * only if that saves at least one block.
+ *
+ * @param fs     pointer to the file system context.
+ * @param inode  pointer to the inode.
+ * @param c      cluster index.
+ * @return       true if the cluster is now compressed.
+ */
+bool compress_cluster(fs_ctx *fs, vsfs_inode *inode, vsfs_blk_t c);
+
+/**
+ * Try to compress all clusters of a file (see compress_cluster()).
+ *
+ * @param fs     pointer to the file system context.
+ * @param inode  pointer to the inode.
+ */
+void compress_file(fs_ctx *fs, vsfs_inode *inode);
+
+/**
+ * Expand a compressed cluster back into VSFS_CLUSTER_BLOCKS blocks so that
+ * its blocks can be modified individually. Does nothing if the cluster is not
+ * compressed (or is past the end of the file). The cluster is left unchanged
+ * on failure.
+ *
+ * @param fs     pointer to the file system context.
+ * @param inode  pointer to the inode.
+ * @param c      cluster index.
+ * @return       0 on success; -ENOSPC if there is not enough free space;
+ *               -EIO if the compressed data is corrupted.
+ */
+int compress_inflate(fs_ctx *fs, vsfs_inode *inode, vsfs_blk_t c);
+
+/**
+ * Expand all compressed clusters that overlap a range of file blocks.
+ *
+ * @param fs     pointer to the file system context.
+ * @param inode  pointer to the inode.
+ * @param idx    first file block index.
+ * @param count  number of blocks.
+ * @return       0 on success; -errno on error (see compress_inflate()).
+ */
+int compress_inflate_range(fs_ctx *fs, vsfs_inode *inode, vsfs_blk_t idx,
+                           vsfs_blk_t count);
+
+/** Drop cached data of a block that is about to be modified or freed. */
+void compress_forget(fs_ctx *fs, vsfs_blk_t blk);
+
+/** Destroy the decompressed cluster cache (if any). */
+void compress_destroy(fs_ctx *fs);
+
+/**
+ * Collect the compression statistics of the file system.
+ *
+ * @param fs     pointer to the file system context.
+ * @param stats  pointer to the struct that receives the statistics.
+ */
+void compress_stats(fs_ctx *fs, struct vsfs_compr_stats *stats);
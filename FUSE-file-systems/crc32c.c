@@ -0,0 +1,168 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+/**
+ * CSC369 Assignment 4 - CRC32C (Castagnoli) checksums.
+ *
+ * The crc32 instruction has a latency of 3 cycles but a throughput of 1 per
+ * cycle, so the hardware version splits the data into three streams that are
+ * processed in parallel. The CRCs of the streams are then combined by
+ * multiplying the first two by x^(8 * n) modulo the CRC polynomial (shifting
+ * them past the data that follows), which takes a single carry-less
+ * multiplication and one more crc32 instruction each.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "crc32c.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define CRC32C_HW 1
+#endif
+
+/** CRC32C polynomial (bit-reflected). */
+#define POLY 0x82F63B78u
+
+/** Length of each of the three hardware streams in bytes. */
+#define STREAM_LEN 1360
+
+
+// Unaligned load
+static inline uint64_t read64(const uint8_t *p)
+{
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+/** Slicing-by-8 tables; table[0] is the classic byte-at-a-time table. */
+static uint32_t table[8][256];
+
+/** Constants for combining the hardware streams. */
+static uint64_t shift_1, shift_2;
+
+/** Set if the CPU supports the instructions used by crc32c_hw(). */
+static bool have_hw;
+
+/** Compute x^n modulo the polynomial (bit-reflected). */
+static uint32_t xpow_mod(uint32_t n)
+{
+	uint32_t p = 1u << 31;// x^0
+	while (n-- > 0) {
+		p = (p & 1) ? (p >> 1) ^ POLY : p >> 1;
+	}
+	return p;
+}
+
+__attribute__((constructor))
+static void crc32c_init(void)
+{
+	for (uint32_t i = 0; i < 256; ++i) {
+		uint32_t c = i;
+		for (int k = 0; k < 8; ++k) {
+			c = (c & 1) ? (c >> 1) ^ POLY : c >> 1;
+		}
+		table[0][i] = c;
+	}
+	for (uint32_t i = 0; i < 256; ++i) {
+		for (int t = 1; t < 8; ++t) {
+			table[t][i] = (table[t - 1][i] >> 8) ^
+			              table[0][table[t - 1][i] & 0xff];
+		}
+	}
+
+	// A carry-less product of two reflected 32-bit values is off by a
+	// factor of x, and the final crc32 of the 64-bit product multiplies it
+	// by x^32; the constants compensate for both.
+	shift_1 = xpow_mod(8 * STREAM_LEN - 33);
+	shift_2 = xpow_mod(8 * 2 * STREAM_LEN - 33);
+
+#ifdef CRC32C_HW
+	__builtin_cpu_init();
+	have_hw = __builtin_cpu_supports("sse4.2") &&
+	          __builtin_cpu_supports("pclmul");
+#endif
+}
+
+uint32_t crc32c_sw(uint32_t crc, const void *data, size_t len)
+{
+	const uint8_t *p = (const uint8_t *)data;
+	crc = ~crc;
+
+	for (; len >= 8; len -= 8, p += 8) {
+		uint64_t v = read64(p) ^ crc;
+		crc = table[7][v & 0xff] ^ table[6][(v >> 8) & 0xff] ^
+		      table[5][(v >> 16) & 0xff] ^ table[4][(v >> 24) & 0xff] ^
+		      table[3][(v >> 32) & 0xff] ^ table[2][(v >> 40) & 0xff] ^
+		      table[1][(v >> 48) & 0xff] ^ table[0][v >> 56];
+	}
+	for (; len > 0; --len) {
+		crc = (crc >> 8) ^ table[0][(crc ^ *p++) & 0xff];
+	}
+	return ~crc;
+}
+
+#ifdef CRC32C_HW
+
+/** Multiply a CRC by x^(8 * n) given the matching shift_* constant. */
+__attribute__((target("sse4.2,pclmul")))
+static inline uint32_t crc_shift(uint32_t crc, uint64_t k)
+{
+	__m128i prod = _mm_clmulepi64_si128(_mm_cvtsi32_si128((int)crc),
+	                                    _mm_cvtsi64_si128((long long)k),
+	                                    0x00);
+	return (uint32_t)_mm_crc32_u64(0, (uint64_t)_mm_cvtsi128_si64(prod));
+}
+
+__attribute__((target("sse4.2,pclmul")))
+static uint32_t crc32c_hw(uint32_t crc, const void *data, size_t len)
+{
+	const uint8_t *p = (const uint8_t *)data;
+	uint64_t c0 = ~crc;
+
+	while (len >= 3 * STREAM_LEN) {
+		uint64_t c1 = 0, c2 = 0;
+		for (size_t i = 0; i < STREAM_LEN; i += 8) {
+			c0 = _mm_crc32_u64(c0, read64(p + i));
+			c1 = _mm_crc32_u64(c1, read64(p + STREAM_LEN + i));
+			c2 = _mm_crc32_u64(c2, read64(p + 2 * STREAM_LEN + i));
+		}
+		c0 = crc_shift((uint32_t)c0, shift_2) ^
+		     crc_shift((uint32_t)c1, shift_1) ^ c2;
+		p += 3 * STREAM_LEN;
+		len -= 3 * STREAM_LEN;
+	}
+
+	for (; len >= 8; len -= 8, p += 8) {
+		c0 = _mm_crc32_u64(c0, read64(p));
+	}
+	for (; len > 0; --len) {
+		c0 = _mm_crc32_u8((uint32_t)c0, *p++);
+	}
+	return ~(uint32_t)c0;
+}
+
+#endif// CRC32C_HW
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t len)
+{
+#ifdef CRC32C_HW
+	if (have_hw) {
+		return crc32c_hw(crc, data, len);
+	}
+#endif
+	return crc32c_sw(crc, data, len);
+}
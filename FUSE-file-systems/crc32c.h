@@ -0,0 +1,40 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+/**
+ * CSC369 Assignment 4 - CRC32C (Castagnoli) checksums.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/**
+ * Update a CRC32C with more data.
+ *
+ * Uses the SSE4.2 crc32 instruction (with three interleaved streams combined
+ * with PCLMULQDQ) when the CPU supports it, and a table-driven implementation
+ * otherwise. Both give identical results.
+ *
+ * @param crc   CRC32C of the preceding data; 0 for the first call.
+ * @param data  pointer to the data.
+ * @param len   data length in bytes.
+ * @return      CRC32C of the preceding data followed by this data.
+ */
+uint32_t crc32c(uint32_t crc, const void *data, size_t len);
+
+/** Table-driven implementation of crc32c(); used for testing. */
+uint32_t crc32c_sw(uint32_t crc, const void *data, size_t len);
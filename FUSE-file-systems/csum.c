@@ -0,0 +1,209 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+/**
+ * CSC369 Assignment 4 - Block checksums.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "crc32c.h"
+#include "itable.h"
+#include "csum.h"
+#include "refcount.h"
+
+/** Number of blocks the scrubber verifies while holding the lock. */
+#define SCRUB_BATCH 256
+
+
+/** Background scrubber state. */
+typedef struct scrubber {
+	pthread_t thread;
+	/** Signaled (under fs->lock) when the thread must stop. */
+	pthread_cond_t cond;
+	/** Seconds between passes. */
+	unsigned int interval;
+	/** Set when the thread must stop. */
+	bool stop;
+} scrubber;
+
+
+vsfs_csum_t csum_compute(const fs_ctx *fs, const void *data)
+{
+	return crc32c(0, data, fs->block_size);
+}
+
+/** Check if a block is covered by the checksum table. */
+static bool has_csum(const fs_ctx *fs, vsfs_blk_t blk)
+{
+	return blk < fs->sb->csum_region ||
+	       blk >= fs->sb->csum_region
+	              + vsfs_csum_blocks(vsfs_max_blocks(fs->sb),
+	                                 fs->block_size);
+}
+
+bool csum_verify(fs_ctx *fs, vsfs_blk_t blk)
+{
+	assert(has_csum(fs, blk));
+
+	vsfs_csum_t csum = csum_compute(fs, block_addr(fs, blk));
+	if (csum != fs->csumtable[blk]) {
+		fprintf(stderr, "vsfs: checksum mismatch in block %u: "
+		        "expected %08x, got %08x\n", blk, fs->csumtable[blk], csum);
+		return false;
+	}
+	return true;
+}
+
+uint32_t csum_check_metadata(fs_ctx *fs)
+{
+	uint32_t errors = 0;
+	for (vsfs_blk_t blk = 0; blk < fs->sb->data_region; ++blk) {
+		if (has_csum(fs, blk) && itable_block_ready(fs, blk) &&
+		    !csum_verify(fs, blk)) {
+			errors++;
+		}
+	}
+	return errors;
+}
+
+/** Update the checksum of a block, skipping the store if it is unchanged. */
+static void update_csum(fs_ctx *fs, vsfs_blk_t blk)
+{
+	vsfs_csum_t csum = csum_compute(fs, block_addr(fs, blk));
+	if (fs->csumtable[blk] != csum) {
+		fs->csumtable[blk] = csum;
+	}
+}
+
+void csum_commit(fs_ctx *fs)
+{
+	for (vsfs_blk_t blk = 0; blk < fs->sb->data_region; ++blk) {
+		if (has_csum(fs, blk) && itable_block_ready(fs, blk)) {
+			update_csum(fs, blk);
+		}
+	}
+
+	// Walk the dirty bitmap a word at a time; most of it is usually clear
+	const size_t bits = CHAR_BIT * sizeof(bitmap_t);
+	vsfs_blk_t nblocks = fs->sb->num_blocks;
+	for (vsfs_blk_t w = 0; w < div_round_up(nblocks, bits); ++w) {
+		bitmap_t word = fs->csum_dirty[w];
+		while (word != 0) {
+			vsfs_blk_t blk = w * bits + __builtin_ctzl(word);
+			word &= word - 1;
+			// Blocks freed since they were modified don't matter
+			if (bitmap_isset(fs->dbmap, nblocks, blk)) {
+				update_csum(fs, blk);
+			}
+		}
+		fs->csum_dirty[w] = 0;
+	}
+}
+
+uint32_t csum_scrub(fs_ctx *fs, vsfs_blk_t first, vsfs_blk_t count)
+{
+	uint32_t errors = 0;
+	vsfs_blk_t nblocks = fs->sb->num_blocks;
+
+	for (vsfs_blk_t blk = first; blk < first + count && blk < nblocks; ++blk) {
+		if (blk >= fs->sb->data_region &&
+		    bitmap_isset(fs->dbmap, nblocks, blk) &&
+		    !csum_is_dirty(fs, blk) && !csum_verify(fs, blk)) {
+			errors++;
+		}
+	}
+	return errors;
+}
+
+/** Scrubber thread body. */
+static void *scrubber_main(void *arg)
+{
+	fs_ctx *fs = (fs_ctx *)arg;
+	scrubber *s = fs->scrubber;
+
+	pthread_mutex_lock(&fs->lock);
+	while (!s->stop) {
+		struct timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += s->interval;
+		while (!s->stop &&
+		       pthread_cond_timedwait(&s->cond, &fs->lock, &deadline)
+		       != ETIMEDOUT) {
+			// Spurious wakeup - keep waiting
+		}
+		if (s->stop) {
+			break;
+		}
+
+		csum_commit(fs);
+		uint32_t errors = 0;
+		for (vsfs_blk_t blk = fs->sb->data_region;
+		     blk < fs->sb->num_blocks && !s->stop; blk += SCRUB_BATCH) {
+			errors += csum_scrub(fs, blk, SCRUB_BATCH);
+			// Let the file system operations in between batches
+			pthread_mutex_unlock(&fs->lock);
+			pthread_mutex_lock(&fs->lock);
+		}
+		if (errors != 0) {
+			fprintf(stderr, "vsfs: scrub found %u corrupted blocks\n",
+			        errors);
+		}
+	}
+	pthread_mutex_unlock(&fs->lock);
+	return NULL;
+}
+
+bool csum_scrubber_start(fs_ctx *fs, unsigned int interval)
+{
+	assert(fs->scrubber == NULL);
+
+	scrubber *s = calloc(1, sizeof(*s));
+	if (s == NULL) {
+		return false;
+	}
+	s->interval = interval;
+	pthread_cond_init(&s->cond, NULL);
+	fs->scrubber = s;
+
+	if (pthread_create(&s->thread, NULL, scrubber_main, fs) != 0) {
+		pthread_cond_destroy(&s->cond);
+		free(s);
+		fs->scrubber = NULL;
+		return false;
+	}
+	return true;
+}
+
+void csum_scrubber_stop(fs_ctx *fs)
+{
+	scrubber *s = fs->scrubber;
+	if (s == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&fs->lock);
+	s->stop = true;
+	pthread_cond_signal(&s->cond);
+	pthread_mutex_unlock(&fs->lock);
+	pthread_join(s->thread, NULL);
+
+	pthread_cond_destroy(&s->cond);
+	free(s);
+	fs->scrubber = NULL;
+}
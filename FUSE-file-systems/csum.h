@@ -0,0 +1,99 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+/**
+ * CSC369 Assignment 4 - Block checksums.
+ *
+ * Every block has a CRC32C in the checksum table (see vsfs_csum_blocks()).
+ * Checksums are not updated on every modification: modified data blocks are
+ * marked dirty and their checksums are recomputed by csum_commit(), which runs
+ * on fsync, periodically in the background scrubber, and on unmount. Metadata
+ * blocks are modified in place all over the code, so they are always treated
+ * as dirty while the file system is mounted and are recomputed on every
+ * commit. Blocks that are dirty can't be verified.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "bitmap.h"
+#include "fs_ctx.h"
+#include "vsfs.h"
+
+
+/** Compute the checksum of the contents of a block. */
+vsfs_csum_t csum_compute(const fs_ctx *fs, const void *data);
+
+/** Mark a data block as modified; must be called before it is modified. */
+static inline void csum_mark_dirty(fs_ctx *fs, vsfs_blk_t blk)
+{
+	bitmap_set(fs->csum_dirty, fs->sb->num_blocks, blk, true);
+}
+
+/** Check if the stored checksum of a block may be out of date. */
+static inline bool csum_is_dirty(fs_ctx *fs, vsfs_blk_t blk)
+{
+	return blk < fs->sb->data_region ||
+	       bitmap_isset(fs->csum_dirty, fs->sb->num_blocks, blk);
+}
+
+/**
+ * Verify the checksum of a block; a mismatch is reported on stderr.
+ *
+ * @param fs   pointer to the file system context.
+ * @param blk  block number; the block must not be dirty.
+ * @return     true if the checksum matches.
+ */
+bool csum_verify(fs_ctx *fs, vsfs_blk_t blk);
+
+/**
+ * Verify the checksums of all metadata blocks. Only meaningful before the
+ * file system is modified (e.g. at mount time).
+ *
+ * @param fs  pointer to the file system context.
+ * @return    number of blocks with mismatching checksums.
+ */
+uint32_t csum_check_metadata(fs_ctx *fs);
+
+/**
+ * Update the checksums of all metadata blocks and dirty data blocks.
+ *
+ * @param fs  pointer to the file system context.
+ */
+void csum_commit(fs_ctx *fs);
+
+/**
+ * Verify the checksums of the allocated, clean data blocks in a range.
+ *
+ * @param fs     pointer to the file system context.
+ * @param first  first block number.
+ * @param count  number of blocks.
+ * @return       number of blocks with mismatching checksums.
+ */
+uint32_t csum_scrub(fs_ctx *fs, vsfs_blk_t first, vsfs_blk_t count);
+
+/**
+ * Start the background scrubber thread. Every interval seconds it commits the
+ * checksums and verifies all allocated data blocks. The thread takes fs->lock
+ * while it works, in batches so that file system operations are not stalled.
+ *
+ * @param fs        pointer to the file system context.
+ * @param interval  seconds between scrubbing passes.
+ * @return          true on success; false if the thread can't be created.
+ */
+bool csum_scrubber_start(fs_ctx *fs, unsigned int interval);
+
+/** Stop the background scrubber thread (if it is running). */
+void csum_scrubber_stop(fs_ctx *fs);
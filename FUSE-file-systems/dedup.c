@@ -0,0 +1,126 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+/**
+ * CSC369 Assignment 4 - Content-hash block deduplication index.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bitmap.h"
+#include "dedup.h"
+#include "hash.h"
+#include "refcount.h"
+
+
+bool dedup_init(fs_ctx *fs)
+{
+	// Sized for growth up to max_blocks
+	uint32_t nblocks = vsfs_max_blocks(fs->sb);
+	dedup_index *idx = calloc(1, sizeof(*idx));
+	if (idx == NULL) {
+		return false;
+	}
+
+	// About one bucket per block keeps the chains short
+	uint32_t nbuckets = 1;
+	while (nbuckets < nblocks) {
+		nbuckets *= 2;
+	}
+	idx->mask = nbuckets - 1;
+	idx->buckets = calloc(nbuckets, sizeof(vsfs_blk_t));
+	idx->next = calloc(nblocks, sizeof(vsfs_blk_t));
+	idx->hashes = calloc(nblocks, sizeof(uint64_t));
+	idx->indexed = calloc(div_round_up(nblocks, CHAR_BIT * sizeof(bitmap_t)),
+	                      sizeof(bitmap_t));
+	fs->dedup = idx;
+
+	if (!idx->buckets || !idx->next || !idx->hashes || !idx->indexed) {
+		dedup_destroy(fs);
+		return false;
+	}
+	return true;
+}
+
+void dedup_destroy(fs_ctx *fs)
+{
+	dedup_index *idx = fs->dedup;
+	if (idx == NULL) {
+		return;
+	}
+	free(idx->buckets);
+	free(idx->next);
+	free(idx->hashes);
+	free(idx->indexed);
+	free(idx);
+	fs->dedup = NULL;
+}
+
+uint64_t dedup_hash(const fs_ctx *fs, const void *data)
+{
+	return xxh64(data, fs->block_size, 0);
+}
+
+bool dedup_find(fs_ctx *fs, const void *data, uint64_t hash, vsfs_blk_t *blk)
+{
+	dedup_index *idx = fs->dedup;
+
+	for (vsfs_blk_t b = idx->buckets[hash & idx->mask]; b != 0;
+	     b = idx->next[b]) {
+		// Equal hashes are only a hint; the contents must match
+		if (idx->hashes[b] == hash &&
+		    memcmp(block_addr(fs, b), data, fs->block_size) == 0) {
+			*blk = b;
+			return true;
+		}
+	}
+	return false;
+}
+
+void dedup_insert(fs_ctx *fs, vsfs_blk_t blk, uint64_t hash)
+{
+	dedup_index *idx = fs->dedup;
+	uint32_t nblocks = fs->sb->num_blocks;
+
+	// Block 0 (superblock) is used as the end of chain marker
+	assert(blk != 0);
+	if (bitmap_isset(idx->indexed, nblocks, blk)) {
+		dedup_forget(fs, blk);
+	}
+
+	vsfs_blk_t *head = &idx->buckets[hash & idx->mask];
+	idx->hashes[blk] = hash;
+	idx->next[blk] = *head;
+	*head = blk;
+	bitmap_set(idx->indexed, nblocks, blk, true);
+}
+
+void dedup_forget(fs_ctx *fs, vsfs_blk_t blk)
+{
+	dedup_index *idx = fs->dedup;
+	uint32_t nblocks = fs->sb->num_blocks;
+
+	if (!bitmap_isset(idx->indexed, nblocks, blk)) {
+		return;
+	}
+
+	vsfs_blk_t *link = &idx->buckets[idx->hashes[blk] & idx->mask];
+	while (*link != blk) {
+		assert(*link != 0);
+		link = &idx->next[*link];
+	}
+	*link = idx->next[blk];
+	bitmap_set(idx->indexed, nblocks, blk, false);
+}
@@ -0,0 +1,77 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+/**
+ * CSC369 Assignment 4 - Content-hash block deduplication index.
+ *
+ * The index maps the xxHash of a data block's contents to the block number.
+ * Blocks with identical contents are shared through their reference counts
+ * (see refcount.h), so a match is always confirmed by comparing the contents.
+ * The index lives in memory only; a block must be removed from it before it
+ * is modified in place or freed.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "fs_ctx.h"
+#include "vsfs.h"
+
+
+/** In-memory hash -> block index (chained hash table). */
+typedef struct dedup_index {
+	/** Number of buckets minus 1 (the number of buckets is a power of 2). */
+	uint32_t mask;
+	/** First block in each bucket's chain; 0 terminates a chain. */
+	vsfs_blk_t *buckets;
+	/** Next block in the chain, indexed by block number. */
+	vsfs_blk_t *next;
+	/** Content hash of each indexed block, indexed by block number. */
+	uint64_t *hashes;
+	/** Bitmap of indexed blocks. */
+	bitmap_t *indexed;
+} dedup_index;
+
+/**
+ * Create an empty deduplication index for the file system.
+ *
+ * @param fs  pointer to the file system context.
+ * @return    true on success; false if memory allocation failed.
+ */
+bool dedup_init(fs_ctx *fs);
+
+/** Destroy the deduplication index (if any). */
+void dedup_destroy(fs_ctx *fs);
+
+/** Hash the contents of a block. */
+uint64_t dedup_hash(const fs_ctx *fs, const void *data);
+
+/**
+ * Find an indexed block with the given contents.
+ *
+ * @param fs    pointer to the file system context.
+ * @param data  pointer to a block of data.
+ * @param hash  hash of the data (see dedup_hash()).
+ * @param blk   pointer to the variable that receives the block number.
+ * @return      true if a block with identical contents was found.
+ */
+bool dedup_find(fs_ctx *fs, const void *data, uint64_t hash, vsfs_blk_t *blk);
+
+/** Add a block with the given content hash to the index. */
+void dedup_insert(fs_ctx *fs, vsfs_blk_t blk, uint64_t hash);
+
+/** Remove a block from the index (if it is indexed). */
+void dedup_forget(fs_ctx *fs, vsfs_blk_t blk);
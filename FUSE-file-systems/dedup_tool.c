@@ -0,0 +1,212 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+/**
+ * CSC369 Assignment 4 - Offline vsfs block deduplication tool.
+ *
+ * Hashes every data block of every regular file (including snapshot files) in
+ * an unmounted image and makes files with identical blocks share one copy.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "bitmap.h"
+#include "dedup.h"
+#include "fs_ctx.h"
+#include "inode.h"
+#include "refcount.h"
+#include "stripe.h"
+
+/** Command line options. */
+typedef struct dedup_opts {
+	/** File system image file path. */
+	const char *img_path;
+	/** Print help and exit. */
+	bool help;
+	/** Only report the savings, don't modify the image. */
+	bool dry_run;
+
+} dedup_opts;
+
+/** Deduplication statistics. */
+typedef struct dedup_stats {
+	/** Number of regular files scanned. */
+	uint32_t files;
+	/** Number of file blocks scanned. */
+	uint32_t blocks;
+	/** Number of file blocks that duplicate another block. */
+	uint32_t dup_refs;
+	/** Number of blocks that are (or would be) freed. */
+	uint32_t freed;
+} dedup_stats;
+
+static const char *help_str = "\
+Usage: %s [options] image\n\
+\n\
+Deduplicate data blocks of an unmounted vsfs image: identical blocks of\n\
+regular files are replaced with references to a single copy.\n\
+\n\
+Options:\n\
+    -n      dry run - only report how much space would be saved\n\
+    -h      print help and exit\n\
+";
+
+static void print_help(FILE *f, const char *progname)
+{
+	fprintf(f, help_str, progname);
+}
+
+
+static bool parse_args(int argc, char *argv[], dedup_opts *opts)
+{
+	int o;
+	while ((o = getopt(argc, argv, "nh")) != -1) {
+		switch (o) {
+			case 'n': opts->dry_run = true; break;
+
+			case 'h': opts->help = true; return true;// skip other arguments
+
+			case '?': return false;
+			default : assert(false);
+		}
+	}
+
+	if (optind >= argc) {
+		fprintf(stderr, "Missing image path\n");
+		return false;
+	}
+	opts->img_path = argv[optind];
+	return true;
+}
+
+
+/**
+ * Deduplicate the blocks of one file.
+ *
+ * @param fs       pointer to the file system context.
+ * @param inode    pointer to the inode of a regular file.
+ * @param dups     bitmap of blocks already counted as duplicates (dry run).
+ * @param dry_run  don't modify the file.
+ * @param stats    statistics to update.
+ */
+static void dedup_file(fs_ctx *fs, vsfs_inode *inode, bitmap_t *dups,
+                       bool dry_run, dedup_stats *stats)
+{
+	uint32_t nblocks = fs->sb->num_blocks;
+
+	for (vsfs_blk_t i = 0; i < inode->i_blocks; ++i) {
+		vsfs_blk_t blk = inode_get_block(fs, inode, i);
+		vsfs_blk_t canon;
+
+		if (blk == 0) {
+			// Unused entry of a compressed cluster
+			continue;
+		}
+		const void *data = block_addr(fs, blk);
+
+		stats->blocks++;
+		if (bitmap_isset(fs->dedup->indexed, nblocks, blk)) {
+			// Already the canonical copy of its contents
+			continue;
+		}
+
+		uint64_t hash = dedup_hash(fs, data);
+		if (!dedup_find(fs, data, hash, &canon)) {
+			dedup_insert(fs, blk, hash);
+			continue;
+		}
+
+		stats->dup_refs++;
+		if (dry_run) {
+			// All references to the block would be replaced
+			if (!bitmap_isset(dups, nblocks, blk)) {
+				bitmap_set(dups, nblocks, blk, true);
+				stats->freed++;
+			}
+		} else if (block_ref(fs, canon)) {
+			inode_replace_block(fs, inode, i, canon);
+		}
+	}
+}
+
+
+int main(int argc, char *argv[])
+{
+	int ret = 1; // return value; 0 on success, 1 on failure
+	size_t fsize; // size of disk image file
+	void *image;  // pointer to mmap'd disk image file
+	dedup_opts opts = {0}; // options; defaults are all 0
+	fs_ctx fs = {0};
+	dedup_stats stats = {0};
+	bitmap_t *dups = NULL;
+
+	if (!parse_args(argc, argv, &opts)) {
+		// Invalid arguments, print help to stderr
+		print_help(stderr, argv[0]);
+		return 1;
+	}
+	if (opts.help) {
+		// Help requested, print it to stdout
+		print_help(stdout, argv[0]);
+		return 0;
+	}
+
+	// Map disk image file into memory
+	image = stripe_map_image(opts.img_path, &fsize);
+	if (image == NULL) {
+		return 1;
+	}
+	if (!fs_ctx_init(&fs, image, fsize)) {
+		fprintf(stderr, "%s: not a valid vsfs image\n", opts.img_path);
+		goto end;
+	}
+
+	size_t bitmap_words = div_round_up(fs.sb->num_blocks,
+	                                   CHAR_BIT * sizeof(bitmap_t));
+	dups = calloc(bitmap_words, sizeof(bitmap_t));
+	if (dups == NULL || !dedup_init(&fs)) {
+		perror("malloc");
+		goto end;
+	}
+
+	vsfs_blk_t free_before = fs.sb->free_blocks;
+	for (vsfs_ino_t ino = 0; ino < fs.sb->num_inodes; ++ino) {
+		vsfs_inode *inode = &fs.itable[ino];
+		if (bitmap_isset(fs.ibmap, fs.sb->num_inodes, ino) &&
+		    S_ISREG(inode->i_mode)) {
+			stats.files++;
+			dedup_file(&fs, inode, dups, opts.dry_run, &stats);
+		}
+	}
+	if (!opts.dry_run) {
+		stats.freed = fs.sb->free_blocks - free_before;
+	}
+
+	printf("%s: scanned %u blocks in %u files, %u duplicate blocks\n",
+	       opts.img_path, stats.blocks, stats.files, stats.dup_refs);
+	printf("%s %u blocks (%llu bytes)\n",
+	       opts.dry_run ? "would free" : "freed", stats.freed,
+	       (unsigned long long)stats.freed * fs.block_size);
+	ret = 0;
+
+end:
+	free(dups);
+	fs_ctx_destroy(&fs);
+	munmap(image, fsize);
+	return ret;
+}
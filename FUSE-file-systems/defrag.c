@@ -0,0 +1,194 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+/**
+ * CSC369 Assignment 4 - Defragmentation implementation.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bitmap.h"
+#include "defrag.h"
+#include "group.h"
+#include "inode.h"
+#include "refcount.h"
+#include "tail.h"
+#include "util.h"
+
+
+uint32_t defrag_fragments(fs_ctx *fs, const vsfs_inode *inode)
+{
+	uint32_t frags = 0;
+	vsfs_blk_t prev = 0;
+
+	for (vsfs_blk_t idx = 0; idx < inode->i_blocks; ++idx) {
+		vsfs_blk_t blk = inode_get_block(fs, inode, idx);
+		// A packed tail lives in a block shared with other files
+		if (blk == 0 || tail_is_packed(inode, idx)) {
+			continue;
+		}
+		if (prev == 0 || blk != prev + 1) {
+			frags++;
+		}
+		prev = blk;
+	}
+	return frags;
+}
+
+/** Find a run of len free blocks in [start, end); returns true if found. */
+static bool find_free_run(fs_ctx *fs, vsfs_blk_t start, vsfs_blk_t end,
+                          vsfs_blk_t len, vsfs_blk_t *run)
+{
+	vsfs_blk_t n = 0;
+	for (vsfs_blk_t blk = start; blk < end; ++blk) {
+		if (bitmap_isset(fs->dbmap, fs->sb->num_blocks, blk)) {
+			n = 0;
+		} else if (++n == len) {
+			*run = blk + 1 - len;
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * Collect the blocks of a file in the order they should be laid out: the
+ * indirect block, then the data blocks. A block that the file uses more than
+ * once (deduplicated) is only listed the first time.
+ */
+static int collect_blocks(fs_ctx *fs, const vsfs_inode *inode,
+                          vsfs_blk_t *from, vsfs_blk_t *count)
+{
+	bitmap_t *seen = calloc(div_round_up(fs->sb->num_blocks,
+	                                     CHAR_BIT * sizeof(bitmap_t)),
+	                        sizeof(bitmap_t));
+	if (seen == NULL) {
+		return -ENOMEM;
+	}
+
+	vsfs_blk_t n = 0;
+	if (inode->i_blocks > VSFS_NUM_DIRECT) {
+		from[n++] = inode->i_indirect;
+		bitmap_set(seen, fs->sb->num_blocks, inode->i_indirect, true);
+	}
+	for (vsfs_blk_t idx = 0; idx < inode->i_blocks; ++idx) {
+		vsfs_blk_t blk = inode_get_block(fs, inode, idx);
+		if (blk != 0 && !tail_is_packed(inode, idx) &&
+		    !bitmap_isset(seen, fs->sb->num_blocks, blk)) {
+			bitmap_set(seen, fs->sb->num_blocks, blk, true);
+			from[n++] = blk;
+		}
+	}
+	free(seen);
+	*count = n;
+	return 0;
+}
+
+int defrag_inode(fs_ctx *fs, vsfs_ino_t ino, struct vsfs_defrag_args *args)
+{
+	vsfs_inode *inode = &fs->itable[ino];
+	vsfs_blk_t count = 0;
+
+	args->blocks = 0;
+	for (vsfs_blk_t idx = 0; idx < inode->i_blocks; ++idx) {
+		if (inode_get_block(fs, inode, idx) != 0) {
+			args->blocks++;
+		}
+	}
+	args->fragments_before = defrag_fragments(fs, inode);
+	args->fragments_after = args->fragments_before;
+	args->moved = 0;
+	if ((args->flags & VSFS_DEFRAG_REPORT) || args->fragments_before <= 1) {
+		return 0;
+	}
+	// Blocks are placed by the time they are written in log mode
+	if (fs->lfs != NULL) {
+		return -EOPNOTSUPP;
+	}
+
+	// The file blocks and the indirect block
+	size_t max_count = vsfs_max_file_blocks(fs->block_size) + 1;
+	vsfs_blk_t *from = malloc(max_count * sizeof(*from));
+	vsfs_blk_t *to = malloc(max_count * sizeof(*to));
+	int ret = -ENOMEM;
+	if (from == NULL || to == NULL ||
+	    collect_blocks(fs, inode, from, &count) != 0) {
+		goto out;
+	}
+
+	// Search from the group of the inode to the end, then wrap around
+	vsfs_blk_t goal = group_first_block(fs, ino), run;
+	vsfs_blk_t wrap_end = goal + count - 1;
+	if (wrap_end > fs->sb->num_blocks) {
+		wrap_end = fs->sb->num_blocks;
+	}
+	if (!find_free_run(fs, goal, fs->sb->num_blocks, count, &run) &&
+	    !find_free_run(fs, fs->sb->data_region, wrap_end, count, &run)) {
+		ret = -ENOSPC;
+		goto out;
+	}
+
+	// The run is free, so each allocation gets exactly the goal block
+	for (vsfs_blk_t i = 0; i < count; ++i) {
+		ret = block_alloc(fs, run + i, &to[i]);
+		assert(ret == 0 && to[i] == run + i);
+	}
+	ret = inode_relocate_blocks(fs, from, to, count);
+	if (ret != 0) {
+		for (vsfs_blk_t i = 0; i < count; ++i) {
+			block_put(fs, to[i]);
+		}
+		goto out;
+	}
+	args->moved = count;
+	args->fragments_after = defrag_fragments(fs, inode);
+ out:
+	free(from);
+	free(to);
+	return ret;
+}
+
+void defrag_free_frag(fs_ctx *fs, struct vsfs_free_frag *frag)
+{
+	memset(frag, 0, sizeof(*frag));
+
+	vsfs_blk_t n = 0;
+	for (vsfs_blk_t blk = fs->sb->data_region; blk <= fs->sb->num_blocks;
+	     ++blk) {
+		if (blk < fs->sb->num_blocks &&
+		    !bitmap_isset(fs->dbmap, fs->sb->num_blocks, blk)) {
+			n++;
+			continue;
+		}
+		if (n == 0) {
+			continue;
+		}
+		// End of a free extent
+		frag->free_blocks += n;
+		frag->extents++;
+		if (n > frag->largest) {
+			frag->largest = n;
+		}
+		uint32_t bucket = 31 - __builtin_clz(n);
+		if (bucket >= VSFS_FRAG_BUCKETS) {
+			bucket = VSFS_FRAG_BUCKETS - 1;
+		}
+		frag->hist[bucket]++;
+		n = 0;
+	}
+}
@@ -0,0 +1,62 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+/**
+ * CSC369 Assignment 4 - Defragmentation.
+ *
+ * A file is defragmented by moving all of its blocks into one run of free
+ * blocks with inode_relocate_blocks(): the indirect block first, then the
+ * data blocks in file order, so that a sequential read touches consecutive
+ * blocks. The run is looked for starting at the first block of the group of
+ * the inode. A file is only moved if such a run exists (the blocks it uses
+ * now don't count as free), so the free space must be at least as large as
+ * the file.
+ */
+
+#pragma once
+
+#include "fs_ctx.h"
+#include "vsfs.h"
+
+
+/**
+ * Count the fragments (runs of contiguous blocks) of a file; unused entries
+ * of compressed clusters are skipped.
+ *
+ * @param fs     pointer to the file system context.
+ * @param inode  pointer to the inode.
+ * @return       number of fragments; 0 if the file has no blocks.
+ */
+uint32_t defrag_fragments(fs_ctx *fs, const vsfs_inode *inode);
+
+/**
+ * Defragment a regular file (see VSFS_IOC_DEFRAG); with VSFS_DEFRAG_REPORT in
+ * args->flags, only fill in the fragment counts. A file with one fragment is
+ * not moved.
+ *
+ * @param fs    pointer to the file system context.
+ * @param ino   inode number of a regular file.
+ * @param args  defragmentation flags; receives the result.
+ * @return      0 on success; -EOPNOTSUPP in log-structured mode; -ENOSPC if
+ *              there is no free run large enough; -ENOMEM if out of memory.
+ */
+int defrag_inode(fs_ctx *fs, vsfs_ino_t ino, struct vsfs_defrag_args *args);
+
+/**
+ * Get the free space fragmentation (see VSFS_IOC_FREE_FRAG).
+ *
+ * @param fs    pointer to the file system context.
+ * @param frag  pointer to the struct that receives the result.
+ */
+void defrag_free_frag(fs_ctx *fs, struct vsfs_free_frag *frag);
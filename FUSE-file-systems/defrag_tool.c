@@ -0,0 +1,304 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+/**
+ * CSC369 Assignment 4 - vsfs defragmentation tool.
+ *
+ * Reports the fragmentation of the files and of the free space, and moves the
+ * blocks of fragmented files into contiguous runs. Works either offline on an
+ * unmounted image (through libvsfs) or online on a directory in a mounted vsfs
+ * file system (through the VSFS_IOC_DEFRAG ioctl on each file).
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bitmap.h"
+#include "defrag.h"
+#include "fs_ctx.h"
+#include "stripe.h"
+
+/** Command line options. */
+typedef struct defrag_opts {
+	/** Image file or directory path. */
+	const char *path;
+	/** Print help and exit. */
+	bool help;
+	/** Only report the fragmentation, don't move any blocks. */
+	bool dry_run;
+	/** Print the fragment counts of every fragmented file. */
+	bool verbose;
+
+} defrag_opts;
+
+/** Defragmentation statistics. */
+typedef struct defrag_stats {
+	/** Number of regular files scanned, and of the fragmented ones. */
+	uint32_t files;
+	uint32_t fragmented;
+	/** Number of file blocks and fragments before and after. */
+	uint64_t blocks;
+	uint64_t frags_before;
+	uint64_t frags_after;
+	/** Number of files defragmented and of blocks moved. */
+	uint32_t defragmented;
+	uint64_t moved;
+	/** Number of files that could not be defragmented. */
+	uint32_t failed;
+} defrag_stats;
+
+static const char *help_str = "\
+Usage: %s [options] path\n\
+\n\
+Defragment the regular files of a vsfs file system: the blocks of each file\n\
+with more than one fragment are moved into one contiguous run of free blocks.\n\
+The path is either an unmounted image, or a directory in a mounted vsfs file\n\
+system (all the files under it are defragmented online).\n\
+\n\
+Options:\n\
+    -n      dry run - only report the fragmentation\n\
+    -v      print the fragment counts of every fragmented file\n\
+    -h      print help and exit\n\
+";
+
+static void print_help(FILE *f, const char *progname)
+{
+	fprintf(f, help_str, progname);
+}
+
+
+static bool parse_args(int argc, char *argv[], defrag_opts *opts)
+{
+	int o;
+	while ((o = getopt(argc, argv, "nvh")) != -1) {
+		switch (o) {
+			case 'n': opts->dry_run = true; break;
+			case 'v': opts->verbose = true; break;
+
+			case 'h': opts->help = true; return true;// skip other arguments
+
+			case '?': return false;
+			default : assert(false);
+		}
+	}
+
+	if (optind >= argc) {
+		fprintf(stderr, "Missing image or directory path\n");
+		return false;
+	}
+	opts->path = argv[optind];
+	return true;
+}
+
+
+/** Add the result for one file to the statistics and print it if asked. */
+static void account(const defrag_opts *opts, defrag_stats *stats,
+                    const char *name, const struct vsfs_defrag_args *args,
+                    int err)
+{
+	stats->files++;
+	stats->blocks += args->blocks;
+	stats->frags_before += args->fragments_before;
+	if (args->fragments_before > 1) {
+		stats->fragmented++;
+	}
+	if (err != 0) {
+		fprintf(stderr, "%s: %s\n", name, strerror(-err));
+		stats->failed++;
+		stats->frags_after += args->fragments_before;
+		return;
+	}
+	stats->frags_after += args->fragments_after;
+	if (args->moved > 0) {
+		stats->defragmented++;
+		stats->moved += args->moved;
+	}
+	if (opts->verbose && args->fragments_before > 1) {
+		if (opts->dry_run) {
+			printf("%s: %u blocks, %u fragments\n", name,
+			       args->blocks, args->fragments_before);
+		} else {
+			printf("%s: %u blocks, %u -> %u fragments\n", name,
+			       args->blocks, args->fragments_before,
+			       args->fragments_after);
+		}
+	}
+}
+
+static void print_report(const defrag_opts *opts, const defrag_stats *stats,
+                         const struct vsfs_free_frag *frag)
+{
+	printf("%s: %u files, %u fragmented; %llu blocks in %llu fragments",
+	       opts->path, stats->files, stats->fragmented,
+	       (unsigned long long)stats->blocks,
+	       (unsigned long long)stats->frags_before);
+	if (!opts->dry_run) {
+		printf(" -> %llu", (unsigned long long)stats->frags_after);
+	}
+	printf("\n");
+	if (!opts->dry_run) {
+		printf("defragmented %u files, moved %llu blocks",
+		       stats->defragmented, (unsigned long long)stats->moved);
+		if (stats->failed > 0) {
+			printf(", %u files failed", stats->failed);
+		}
+		printf("\n");
+	}
+
+	printf("free space: %u blocks in %u extents, largest %u blocks\n",
+	       frag->free_blocks, frag->extents, frag->largest);
+	for (int i = 0; i < VSFS_FRAG_BUCKETS; ++i) {
+		if (frag->hist[i] > 0) {
+			printf("  %6u-%u blocks: %u extents\n", 1u << i,
+			       (1u << (i + 1)) - 1, frag->hist[i]);
+		}
+	}
+}
+
+
+/** Defragment all regular files (including snapshot files) of an image. */
+static int defrag_offline(const defrag_opts *opts)
+{
+	size_t fsize;
+	void *image = stripe_map_image(opts->path, &fsize);
+	if (image == NULL) {
+		return 1;
+	}
+
+	int ret = 1;
+	fs_ctx fs = {0};
+	defrag_stats stats = {0};
+	struct vsfs_free_frag frag;
+	if (!fs_ctx_init(&fs, image, fsize)) {
+		fprintf(stderr, "%s: not a valid vsfs image\n", opts->path);
+		goto end;
+	}
+
+	for (vsfs_ino_t ino = 0; ino < fs.sb->num_inodes; ++ino) {
+		if (!bitmap_isset(fs.ibmap, fs.sb->num_inodes, ino) ||
+		    !S_ISREG(fs.itable[ino].i_mode)) {
+			continue;
+		}
+		struct vsfs_defrag_args args = {
+			.flags = opts->dry_run ? VSFS_DEFRAG_REPORT : 0,
+		};
+		char name[32];
+		snprintf(name, sizeof(name), "inode %u", ino);
+		account(opts, &stats, name, &args, defrag_inode(&fs, ino, &args));
+	}
+	defrag_free_frag(&fs, &frag);
+	print_report(opts, &stats, &frag);
+	ret = 0;
+
+end:
+	fs_ctx_destroy(&fs);
+	munmap(image, fsize);
+	return ret;
+}
+
+
+// nftw() callbacks have no argument for the state
+static const defrag_opts *walk_opts;
+static defrag_stats walk_stats;
+
+/** nftw() callback: defragment a regular file through the ioctl. */
+static int defrag_walk(const char *path, const struct stat *st, int type,
+                       struct FTW *ftw)
+{
+	(void)ftw;// unused
+
+	if (type != FTW_F || !S_ISREG(st->st_mode)) {
+		return 0;
+	}
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		perror(path);
+		walk_stats.failed++;
+		return 0;
+	}
+	struct vsfs_defrag_args args = {
+		.flags = walk_opts->dry_run ? VSFS_DEFRAG_REPORT : 0,
+	};
+	int err = ioctl(fd, VSFS_IOC_DEFRAG, &args) < 0 ? -errno : 0;
+	close(fd);
+	if (err == -ENOTTY) {
+		fprintf(stderr, "%s: not on a vsfs file system\n", path);
+		return 1;
+	}
+	account(walk_opts, &walk_stats, path, &args, err);
+	return 0;
+}
+
+/** Defragment the regular files under a directory of a mounted vsfs. */
+static int defrag_online(const defrag_opts *opts)
+{
+	walk_opts = opts;
+	if (nftw(opts->path, defrag_walk, 16, FTW_PHYS | FTW_MOUNT) != 0) {
+		return 1;
+	}
+
+	struct vsfs_free_frag frag;
+	int fd = open(opts->path, O_RDONLY);
+	if (fd < 0) {
+		perror(opts->path);
+		return 1;
+	}
+	int ret = ioctl(fd, VSFS_IOC_FREE_FRAG, &frag);
+	close(fd);
+	if (ret < 0) {
+		fprintf(stderr, "%s: %s\n", opts->path, strerror(errno));
+		return 1;
+	}
+	print_report(opts, &walk_stats, &frag);
+	return 0;
+}
+
+
+int main(int argc, char *argv[])
+{
+	defrag_opts opts = {0}; // options; defaults are all 0
+
+	if (!parse_args(argc, argv, &opts)) {
+		// Invalid arguments, print help to stderr
+		print_help(stderr, argv[0]);
+		return 1;
+	}
+	if (opts.help) {
+		// Help requested, print it to stdout
+		print_help(stdout, argv[0]);
+		return 0;
+	}
+
+	// A striped image is never a mount point
+	struct stat st;
+	if (stripe_is_set(opts.path)) {
+		return defrag_offline(&opts);
+	}
+	if (stat(opts.path, &st) != 0) {
+		perror(opts.path);
+		return 1;
+	}
+	return S_ISDIR(st.st_mode) ? defrag_online(&opts)
+	                           : defrag_offline(&opts);
+}
@@ -0,0 +1,179 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+/**
+ * CSC369 Assignment 4 - Directory helpers.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#include "acache.h"
+#include "csum.h"
+#include "dir.h"
+#include "inode.h"
+#include "refcount.h"
+
+
+/** Number of directory entries in a block. */
+static uint32_t dentries_per_block(const fs_ctx *fs)
+{
+	return vsfs_dentries_per_block(fs->block_size);
+}
+
+/** Get a pointer to the entries in a directory block. */
+static vsfs_dentry *dir_block(fs_ctx *fs, const vsfs_inode *dir, vsfs_blk_t i)
+{
+	return (vsfs_dentry *)block_addr(fs, inode_get_block(fs, dir, i));
+}
+
+/** Allocate a directory block with all entries unused and append it. */
+static int dir_grow(fs_ctx *fs, vsfs_inode *dir, vsfs_dentry **entries)
+{
+	vsfs_blk_t blk;
+	int ret = block_alloc(fs, inode_goal(fs, dir, dir->i_blocks), &blk);
+	if (ret != 0) {
+		return ret;
+	}
+	ret = inode_append_block(fs, dir, blk);
+	if (ret != 0) {
+		block_put(fs, blk);
+		// A directory at the maximum file size is out of space
+		return -ENOSPC;
+	}
+
+	*entries = (vsfs_dentry *)block_addr(fs, blk);
+	for (size_t j = 0; j < dentries_per_block(fs); ++j) {
+		(*entries)[j].ino = VSFS_INO_MAX;
+	}
+	dir->i_size += fs->block_size;
+	acache_update(fs, dir);
+	return 0;
+}
+
+int dir_init(fs_ctx *fs, vsfs_inode *dir, vsfs_ino_t self, vsfs_ino_t parent)
+{
+	assert(dir->i_blocks == 0);
+
+	vsfs_dentry *entries;
+	int ret = dir_grow(fs, dir, &entries);
+	if (ret != 0) {
+		return ret;
+	}
+	entries[0].ino = self;
+	strcpy(entries[0].name, ".");
+	entries[1].ino = parent;
+	strcpy(entries[1].name, "..");
+	return 0;
+}
+
+int dir_iterate(fs_ctx *fs, const vsfs_inode *dir, dir_iter_fn fn, void *data)
+{
+	for (vsfs_blk_t i = 0; i < dir->i_blocks; ++i) {
+		vsfs_dentry *entries = dir_block(fs, dir, i);
+		for (size_t j = 0; j < dentries_per_block(fs); ++j) {
+			if (entries[j].ino != VSFS_INO_MAX) {
+				int ret = fn(data, &entries[j]);
+				if (ret != 0) {
+					return ret;
+				}
+			}
+		}
+	}
+	return 0;
+}
+
+/** Find the entry with the given name; NULL if there is none. */
+static vsfs_dentry *dir_find(fs_ctx *fs, const vsfs_inode *dir,
+                             const char *name)
+{
+	for (vsfs_blk_t i = 0; i < dir->i_blocks; ++i) {
+		vsfs_dentry *entries = dir_block(fs, dir, i);
+		for (size_t j = 0; j < dentries_per_block(fs); ++j) {
+			if (entries[j].ino != VSFS_INO_MAX &&
+			    strcmp(entries[j].name, name) == 0) {
+				return &entries[j];
+			}
+		}
+	}
+	return NULL;
+}
+
+int dir_lookup(fs_ctx *fs, const vsfs_inode *dir, const char *name,
+               vsfs_ino_t *ino)
+{
+	vsfs_dentry *entry = dir_find(fs, dir, name);
+	if (entry == NULL) {
+		return -ENOENT;
+	}
+	*ino = entry->ino;
+	return 0;
+}
+
+int dir_add_entry(fs_ctx *fs, vsfs_inode *dir, const char *name,
+                  vsfs_ino_t ino)
+{
+	assert(strlen(name) < VSFS_NAME_MAX);
+
+	vsfs_dentry *entry = NULL;
+	for (vsfs_blk_t i = 0; i < dir->i_blocks && entry == NULL; ++i) {
+		vsfs_dentry *entries = dir_block(fs, dir, i);
+		for (size_t j = 0; j < dentries_per_block(fs); ++j) {
+			if (entries[j].ino == VSFS_INO_MAX) {
+				entry = &entries[j];
+				break;
+			}
+		}
+	}
+	if (entry == NULL) {
+		// All blocks are full
+		int ret = dir_grow(fs, dir, &entry);
+		if (ret != 0) {
+			return ret;
+		}
+	}
+
+	csum_mark_dirty(fs, block_num(fs, entry));
+	entry->ino = ino;
+	strcpy(entry->name, name);
+	clock_gettime(CLOCK_REALTIME, &dir->i_mtime);
+	acache_update(fs, dir);
+	return 0;
+}
+
+int dir_remove_entry(fs_ctx *fs, vsfs_inode *dir, const char *name)
+{
+	vsfs_dentry *entry = dir_find(fs, dir, name);
+	if (entry == NULL) {
+		return -ENOENT;
+	}
+	csum_mark_dirty(fs, block_num(fs, entry));
+	entry->ino = VSFS_INO_MAX;
+	clock_gettime(CLOCK_REALTIME, &dir->i_mtime);
+	acache_update(fs, dir);
+	return 0;
+}
+
+/** dir_iterate() callback that stops at the first non-dot entry. */
+static int not_dot(void *data, const vsfs_dentry *entry)
+{
+	(void)data;// unused
+	return strcmp(entry->name, ".") != 0 && strcmp(entry->name, "..") != 0;
+}
+
+bool dir_is_empty(fs_ctx *fs, const vsfs_inode *dir)
+{
+	return dir_iterate(fs, dir, not_dot, NULL) == 0;
+}
@@ -0,0 +1,86 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+/**
+ * CSC369 Assignment 4 - Directory helpers.
+ *
+ * A directory is a file made of blocks of fixed size vsfs_dentry entries.
+ * Unused entries have the inode number VSFS_INO_MAX.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "fs_ctx.h"
+#include "vsfs.h"
+
+
+/**
+ * Callback for dir_iterate(). Returning a non-zero value stops the iteration.
+ *
+ * @param data   opaque pointer passed to dir_iterate().
+ * @param entry  pointer to a used directory entry.
+ * @return       0 to continue; any other value to stop.
+ */
+typedef int (*dir_iter_fn)(void *data, const vsfs_dentry *entry);
+
+/**
+ * Initialize an empty directory with "." and ".." entries.
+ *
+ * @param fs      pointer to the file system context.
+ * @param dir     pointer to the directory inode (with no blocks).
+ * @param self    inode number of the directory.
+ * @param parent  inode number of the parent directory.
+ * @return        0 on success; -ENOSPC if a block can't be allocated.
+ */
+int dir_init(fs_ctx *fs, vsfs_inode *dir, vsfs_ino_t self, vsfs_ino_t parent);
+
+/**
+ * Call fn for each used entry in a directory (including "." and "..").
+ *
+ * @return  0 if all entries were visited; otherwise the value returned by fn.
+ */
+int dir_iterate(fs_ctx *fs, const vsfs_inode *dir, dir_iter_fn fn, void *data);
+
+/**
+ * Find a directory entry by name.
+ *
+ * @param fs    pointer to the file system context.
+ * @param dir   pointer to the directory inode.
+ * @param name  entry name.
+ * @param ino   pointer to the variable that receives the inode number.
+ * @return      0 on success; -ENOENT if there is no such entry.
+ */
+int dir_lookup(fs_ctx *fs, const vsfs_inode *dir, const char *name,
+               vsfs_ino_t *ino);
+
+/**
+ * Add an entry to a directory, growing the directory by a block if needed.
+ * Updates the directory mtime.
+ *
+ * @return  0 on success; -ENOSPC if the directory can't be extended.
+ */
+int dir_add_entry(fs_ctx *fs, vsfs_inode *dir, const char *name,
+                  vsfs_ino_t ino);
+
+/**
+ * Remove an entry from a directory. Updates the directory mtime.
+ *
+ * @return  0 on success; -ENOENT if there is no such entry.
+ */
+int dir_remove_entry(fs_ctx *fs, vsfs_inode *dir, const char *name);
+
+/** Check if a directory has no entries other than "." and "..". */
+bool dir_is_empty(fs_ctx *fs, const vsfs_inode *dir);
@@ -0,0 +1,270 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+/**
+ * CSC369 Assignment 4 - Discarding free blocks implementation.
+ */
+
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bitmap.h"
+#include "discard.h"
+#include "stripe.h"
+
+/** Seconds between background discard passes. */
+#define DISCARD_INTERVAL 1
+
+/** Maximum number of queued ranges; the thread is woken up at half. */
+#define DISCARD_QUEUE_MAX 256
+
+/** Range of freed blocks. */
+typedef struct discard_range {
+	vsfs_blk_t start;
+	vsfs_blk_t count;
+} discard_range;
+
+/** Discard queue and background thread state. */
+typedef struct discard_queue {
+	discard_range ranges[DISCARD_QUEUE_MAX];
+	uint32_t count;
+	/** Set when a freed block did not fit into the queue. */
+	bool overflow;
+	/** Set when punching holes failed; nothing is queued after that. */
+	bool failed;
+
+	/** Discard thread; only valid if running is true. */
+	pthread_t thread;
+	pthread_cond_t cond;
+	bool running;
+	bool stop;
+} discard_queue;
+
+
+bool discard_init(fs_ctx *fs)
+{
+	assert(fs->fd >= 0 || fs->stripe != NULL);
+	discard_queue *q = calloc(1, sizeof(*q));
+	if (q == NULL) {
+		return false;
+	}
+	pthread_cond_init(&q->cond, NULL);
+	fs->discard = q;
+	return true;
+}
+
+void discard_destroy(fs_ctx *fs)
+{
+	discard_queue *q = fs->discard;
+	if (q == NULL) {
+		return;
+	}
+	assert(!q->running);
+	pthread_cond_destroy(&q->cond);
+	free(q);
+	fs->discard = NULL;
+}
+
+
+void discard_block(fs_ctx *fs, vsfs_blk_t blk)
+{
+	discard_queue *q = fs->discard;
+	if (q == NULL || q->failed || q->overflow) {
+		return;
+	}
+
+	// Files are freed block by block in either direction
+	if (q->count > 0) {
+		discard_range *last = &q->ranges[q->count - 1];
+		if (last->start + last->count == blk) {
+			last->count++;
+			return;
+		}
+		if (blk + 1 == last->start) {
+			last->start--;
+			last->count++;
+			return;
+		}
+	}
+	if (q->count == DISCARD_QUEUE_MAX) {
+		q->overflow = true;
+		if (q->running) {
+			pthread_cond_signal(&q->cond);
+		}
+		return;
+	}
+	q->ranges[q->count++] = (discard_range){ blk, 1 };
+	if (q->count == DISCARD_QUEUE_MAX / 2 && q->running) {
+		pthread_cond_signal(&q->cond);
+	}
+}
+
+
+/** Punch a run of blocks out of the image file(s). */
+static int punch_blocks(fs_ctx *fs, vsfs_blk_t start, vsfs_blk_t count)
+{
+	if (fs->stripe != NULL) {
+		return stripe_punch(fs->stripe, fs->sb->stripe_unit,
+		                    (uint64_t)start << fs->block_shift,
+		                    (uint64_t)count << fs->block_shift);
+	}
+	if (fallocate(fs->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+	              (off_t)start << fs->block_shift,
+	              (off_t)count << fs->block_shift) != 0) {
+		return -errno;
+	}
+	return 0;
+}
+
+/**
+ * Punch out the free blocks in [start, end). The blocks that are allocated are
+ * skipped. Returns 0 on success or -errno.
+ */
+static int discard_range_free(fs_ctx *fs, vsfs_blk_t start, vsfs_blk_t end,
+                              uint64_t *discarded)
+{
+	vsfs_blk_t nblocks = fs->sb->num_blocks;
+	if (end > nblocks) {
+		end = nblocks;
+	}
+
+	vsfs_blk_t blk = start;
+	while (blk < end) {
+		if (bitmap_isset(fs->dbmap, nblocks, blk)) {
+			++blk;
+			continue;
+		}
+		vsfs_blk_t run = blk;
+		while (blk < end && !bitmap_isset(fs->dbmap, nblocks, blk)) {
+			++blk;
+		}
+		int ret = punch_blocks(fs, run, blk - run);
+		if (ret != 0) {
+			return ret;
+		}
+		*discarded += blk - run;
+	}
+	return 0;
+}
+
+int discard_free_blocks(fs_ctx *fs, uint64_t *discarded)
+{
+	*discarded = 0;
+	return discard_range_free(fs, fs->sb->data_region, fs->sb->num_blocks,
+	                          discarded);
+}
+
+
+/**
+ * Discard the queued ranges. Called with fs->lock held; the lock is released
+ * in between ranges.
+ */
+static void discard_queued(fs_ctx *fs)
+{
+	discard_queue *q = fs->discard;
+	discard_range batch[DISCARD_QUEUE_MAX];
+	uint32_t count = q->count;
+	bool overflow = q->overflow;
+
+	// New ranges can be queued while the lock is released
+	memcpy(batch, q->ranges, count * sizeof(batch[0]));
+	q->count = 0;
+	q->overflow = false;
+
+	uint64_t discarded = 0;
+	int ret = 0;
+	if (overflow) {
+		ret = discard_free_blocks(fs, &discarded);
+		count = 0;
+	}
+	for (uint32_t i = 0; ret == 0 && i < count; ++i) {
+		// Blocks allocated again since they were freed are skipped
+		ret = discard_range_free(fs, batch[i].start,
+		                         batch[i].start + batch[i].count,
+		                         &discarded);
+		pthread_mutex_unlock(&fs->lock);
+		pthread_mutex_lock(&fs->lock);
+	}
+	if (ret != 0 && !q->failed) {
+		fprintf(stderr, "Discarding free blocks failed: %s\n",
+		        strerror(-ret));
+		q->failed = true;
+		q->count = 0;
+	}
+}
+
+/** Discard thread body. */
+static void *discard_main(void *arg)
+{
+	fs_ctx *fs = (fs_ctx *)arg;
+	discard_queue *q = fs->discard;
+
+	pthread_mutex_lock(&fs->lock);
+	while (!q->stop) {
+		struct timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += DISCARD_INTERVAL;
+		while (!q->stop && q->count < DISCARD_QUEUE_MAX / 2 &&
+		       !q->overflow &&
+		       pthread_cond_timedwait(&q->cond, &fs->lock, &deadline)
+		       != ETIMEDOUT) {
+			// Spurious wakeup - keep waiting
+		}
+		discard_queued(fs);
+	}
+	// Nothing that is freed before unmount is left on the host
+	discard_queued(fs);
+	pthread_mutex_unlock(&fs->lock);
+	return NULL;
+}
+
+bool discard_start(fs_ctx *fs)
+{
+	discard_queue *q = fs->discard;
+	if (q == NULL) {
+		return true;
+	}
+	assert(!q->running);
+
+	q->stop = false;
+	q->running = true;
+	if (pthread_create(&q->thread, NULL, discard_main, fs) != 0) {
+		q->running = false;
+		return false;
+	}
+	return true;
+}
+
+void discard_stop(fs_ctx *fs)
+{
+	discard_queue *q = fs->discard;
+	if (q == NULL || !q->running) {
+		return;
+	}
+
+	pthread_mutex_lock(&fs->lock);
+	q->stop = true;
+	pthread_cond_signal(&q->cond);
+	pthread_mutex_unlock(&fs->lock);
+	pthread_join(q->thread, NULL);
+	q->running = false;
+}
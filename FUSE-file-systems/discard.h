@@ -0,0 +1,85 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+/**
+ * CSC369 Assignment 4 - Discarding free blocks.
+ *
+ * Freeing a block only clears its bit in the data bitmap; the image file keeps
+ * the host storage of its old contents. With discard enabled, the ranges of
+ * freed blocks are queued (adjacent blocks merged into one range) and a
+ * background thread punches them out of the image file with
+ * FALLOC_FL_PUNCH_HOLE, so that a sparse or thin-provisioned image gives the
+ * space back to the host. The thread punches a range with the file system lock
+ * held and skips the blocks that were allocated again since they were queued,
+ * so a block is never punched after new data is written to it. If the queue
+ * overflows, the thread discards all the free blocks instead.
+ *
+ * The same punching is used to discard all the free blocks at once (see
+ * VSFS_IOC_TRIM in vsfs.h and fstrim.vsfs).
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "fs_ctx.h"
+#include "vsfs.h"
+
+
+/**
+ * Allocate the discard queue. Discarding needs the image file(s) to be open
+ * (fs->fd or fs->stripe).
+ *
+ * @param fs  pointer to the file system context.
+ * @return    true on success; false if out of memory.
+ */
+bool discard_init(fs_ctx *fs);
+
+/** Free the discard queue; the thread must have been stopped. */
+void discard_destroy(fs_ctx *fs);
+
+/**
+ * Queue a block that has just been freed. Must be called with fs->lock held;
+ * does nothing if discard is disabled.
+ *
+ * @param fs   pointer to the file system context.
+ * @param blk  block number.
+ */
+void discard_block(fs_ctx *fs, vsfs_blk_t blk);
+
+/**
+ * Punch out all the free data blocks of the file system. Must be called with
+ * fs->lock held.
+ *
+ * @param fs         pointer to the file system context; fs->fd must be open.
+ * @param discarded  receives the number of blocks discarded.
+ * @return           0 on success; -errno if punching holes fails (e.g.
+ *                   -EOPNOTSUPP if the host file system does not support it).
+ */
+int discard_free_blocks(fs_ctx *fs, uint64_t *discarded);
+
+/**
+ * Start the background discard thread; does nothing if discard is disabled.
+ *
+ * @param fs  pointer to the file system context.
+ * @return    true on success; false if the thread could not be created.
+ */
+bool discard_start(fs_ctx *fs);
+
+/**
+ * Discard the blocks that are still queued and stop the background thread;
+ * does nothing if not started.
+ */
+void discard_stop(fs_ctx *fs);
@@ -16,21 +16,23 @@
  * CSC369 Assignment 4 - File system runtime context implementation.
  */
 
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "acache.h"
+#include "compress.h"
+#include "csum.h"
+#include "dedup.h"
+#include "discard.h"
 #include "fs_ctx.h"
+#include "group.h"
+#include "lcache.h"
+#include "lfs.h"
+#include "stats.h"
+#include "trace.h"
 
-/**
- * Initialize file system context.
- * 
- * @param fs     pointer to the context to initialize.
- * @param image  pointer to the start of the image.
- * @param size   image size in bytes.
- * @return       true on success; false on failure (e.g. invalid superblock).
- */
-bool fs_ctx_init(fs_ctx *fs, void *image, size_t size)
+void fs_ctx_set_image(fs_ctx *fs, void *image, size_t size)
 {
-	// Check if the file system image can be mounted and initialize its
-	// runtime state.
-
 	fs->image = image;
 	fs->size = size;
 
@@ -40,46 +42,153 @@ bool fs_ctx_init(fs_ctx *fs, void *image, size_t size)
 	 */
 	fs->sb = (vsfs_superblock *)image;
 
-	/** We're very trusting. If the magic number looks good, we'll go 
-	 *  ahead and mount the file system (and try to use it).
-	 *  You may want to add more sanity checking to make sure the disk
-	 *  image appears to be a valid VSFS file system.
-	 */
-	if (fs->sb->magic != VSFS_MAGIC) {
-		return false;
-	}
-	
 	/** VSFS Inode bitmap pointer 
 	 *  The block number of the inode bitmap is VSFS_IMAP_BLKNUM; 
 	 *  we multiply by the block size to get the offset in bytes from the 
          *  start of the mmap'd disk image.
 	 */ 
-	fs->ibmap = (bitmap_t *)(image + VSFS_IMAP_BLKNUM * VSFS_BLOCK_SIZE);
+	fs->ibmap = (bitmap_t *)(image + VSFS_IMAP_BLKNUM * fs->block_size);
 
 	/** VSFS Data block bitmap pointer
 	 *  Similar calculation as inode bitmap.
 	 */
-	fs->dbmap = (bitmap_t *)(image + VSFS_DMAP_BLKNUM * VSFS_BLOCK_SIZE);
+	fs->dbmap = (bitmap_t *)(image + VSFS_DMAP_BLKNUM * fs->block_size);
 
 	/** VSFS Inode table pointer
 	 *  Similar calculation as for bitmaps.
 	 */
-	fs->itable = (vsfs_inode *)(image + VSFS_ITBL_BLKNUM * VSFS_BLOCK_SIZE);
+	fs->itable = (vsfs_inode *)(image + VSFS_ITBL_BLKNUM * fs->block_size);
+
+	/** VSFS refcount table pointer
+	 *  The table starts right after the inode table; its location is
+	 *  recorded in the superblock.
+	 */
+	fs->rctable = (vsfs_rc_t *)(image +
+	                            (size_t)fs->sb->rc_region * fs->block_size);
+
+	/** VSFS checksum table pointer
+	 *  The table follows the refcount table.
+	 */
+	fs->csumtable = (vsfs_csum_t *)(image + (size_t)fs->sb->csum_region
+	                                        * fs->block_size);
 
-	// TODO: Initialize anything else that you add to the fs context.
-	
-	return false;
+	/** VSFS xattr table pointer
+	 *  The table follows the checksum table; old images have none.
+	 */
+	fs->xattrtable = fs->sb->xattr_region == 0 ? NULL :
+		(vsfs_blk_t *)(image + (size_t)fs->sb->xattr_region
+		                       * fs->block_size);
+}
+
+/**
+ * Initialize file system context.
+ * 
+ * @param fs     pointer to the context to initialize.
+ * @param image  pointer to the start of the image.
+ * @param size   image size in bytes.
+ * @return       true on success; false on failure (e.g. invalid superblock).
+ */
+bool fs_ctx_init(fs_ctx *fs, void *image, size_t size)
+{
+	// Check if the file system image can be mounted and initialize its
+	// runtime state.
+
+	fs->fd = -1;
+	fs->stripe = NULL;
+	fs->tail_blk = 0;
+	fs->tail_used = 0;
+
+	/** We're very trusting. If the magic number looks good, we'll go 
+	 *  ahead and mount the file system (and try to use it).
+	 *  You may want to add more sanity checking to make sure the disk
+	 *  image appears to be a valid VSFS file system.
+	 */
+	vsfs_superblock *sb = (vsfs_superblock *)image;
+	if (sb->magic != VSFS_MAGIC) {
+		return false;
+	}
+	uint32_t block_size = vsfs_block_size(sb);
+	if (!vsfs_block_size_valid(block_size)) {
+		fprintf(stderr, "Unsupported block size %u\n", block_size);
+		return false;
+	}
+	fs->block_size = block_size;
+	fs->block_shift = __builtin_ctz(block_size);
+	fs_ctx_set_image(fs, image, size);
+
+	if (fs->sb->size != size ||
+	    (size_t)fs->sb->num_blocks * block_size != size ||
+	    vsfs_max_blocks(fs->sb) < fs->sb->num_blocks ||
+	    vsfs_max_blocks(fs->sb) > vsfs_blk_max(block_size)) {
+		fprintf(stderr, "Superblock does not match the image size\n");
+		return false;
+	}
+	if (vsfs_stripe_count(fs->sb) > 1 &&
+	    (fs->sb->stripe_unit == 0 || fs->sb->stripe_unit % block_size != 0 ||
+	     size % ((size_t)fs->sb->stripe_unit * fs->sb->stripe_count) != 0)) {
+		fprintf(stderr, "Invalid stripe geometry\n");
+		return false;
+	}
+	vsfs_blk_t max_blocks = vsfs_max_blocks(fs->sb);
+	vsfs_blk_t csum_end = fs->sb->csum_region
+	                      + vsfs_csum_blocks(max_blocks, block_size);
+	vsfs_blk_t tables_end = fs->sb->xattr_region == 0 ? csum_end :
+		fs->sb->xattr_region + vsfs_xattr_blocks(fs->sb->num_inodes,
+		                                         block_size);
+	if (fs->sb->rc_region < VSFS_ITBL_BLKNUM ||
+	    fs->sb->rc_region + vsfs_rc_blocks(max_blocks, block_size)
+	    != fs->sb->csum_region ||
+	    (fs->sb->xattr_region != 0 && fs->sb->xattr_region != csum_end) ||
+	    tables_end != fs->sb->data_region ||
+	    fs->sb->data_region >= fs->sb->num_blocks ||
+	    fs->sb->itable_init > fs->sb->rc_region - VSFS_ITBL_BLKNUM) {
+		fprintf(stderr, "Invalid file system layout\n");
+		return false;
+	}
+
+	if (!group_init(fs)) {
+		return false;
+	}
+
+	// Sized for growth up to max_blocks
+	fs->csum_dirty = calloc(div_round_up(max_blocks,
+	                                     CHAR_BIT * sizeof(bitmap_t)),
+	                        sizeof(bitmap_t));
+	if (fs->csum_dirty == NULL) {
+		perror("calloc");
+		group_destroy(fs);
+		return false;
+	}
+	pthread_mutex_init(&fs->lock, NULL);
+
+	return true;
 }
 
 
 /**
  * Destroy file system context.
- * Must cleanup all the resources created in fs_ctx_init().
+ * Must cleanup all the resources created in fs_ctx_init(). Updates the block
+ * checksums, so it must be called before the image is unmapped.
  * 
  * @param fs     pointer to the context to clean up
  */
 void fs_ctx_destroy(fs_ctx *fs)
 {
 	//TODO: cleanup any other resources allocated in fs_ctx_init()
-	(void)fs;
+	if (fs->csum_dirty != NULL) {
+		// Bring the on-disk checksums up to date
+		csum_commit(fs);
+		free(fs->csum_dirty);
+		fs->csum_dirty = NULL;
+		pthread_mutex_destroy(&fs->lock);
+	}
+	dedup_destroy(fs);
+	discard_destroy(fs);
+	lfs_destroy(fs);
+	group_destroy(fs);
+	compress_destroy(fs);
+	lcache_destroy(fs);
+	acache_destroy(fs);
+	stats_destroy(fs);
+	trace_destroy(fs);
 }
@@ -19,13 +19,26 @@
 #pragma once
 
 //#include <stdlib.h>
+#include <pthread.h>
 #include <stddef.h>
 //#include <unistd.h>
 //#include <sys/types.h>
-#include "options.h"
 #include "vsfs.h"
 #include "bitmap.h"
 
+struct acache_entry;
+struct cluster_cache;
+struct block_groups;
+struct dedup_index;
+struct discard_queue;
+struct fs_stats;
+struct itable_initializer;
+struct lfs;
+struct lookup_cache;
+struct scrubber;
+struct stripe_set;
+struct trace;
+
 /**
  * Mounted file system runtime state - "fs context".
  */
@@ -34,6 +47,14 @@ typedef struct fs_ctx {
 	void *image;
 	/** Image size in bytes. */
 	size_t size;
+	/** Open image file (for resizing); -1 if the image is not a file. */
+	int fd;
+	/** Open member files of a striped image (stripe.h); NULL if not striped. */
+	struct stripe_set *stripe;
+	/** Block size in bytes (see vsfs_block_size()). */
+	uint32_t block_size;
+	/** log2(block_size); block offsets are computed with shifts and masks. */
+	uint32_t block_shift;
 	/** Pointer to the superblock in the mmap'd disk image */
 	vsfs_superblock *sb;
 	/** Pointer to the inode bitmap in the mmap'd disk image */
@@ -42,12 +63,86 @@ typedef struct fs_ctx {
 	bitmap_t *dbmap;
 	/** Pointer to the inode table in the mmap'd disk image */
 	vsfs_inode *itable;
+	/** Pointer to the refcount table in the mmap'd disk image */
+	vsfs_rc_t *rctable;
+	/** Pointer to the checksum table in the mmap'd disk image */
+	vsfs_csum_t *csumtable;
+	/** Pointer to the xattr table in the mmap'd disk image; NULL if none. */
+	vsfs_blk_t *xattrtable;
+	/** Data blocks modified since their checksums were updated (csum.h). */
+	bitmap_t *csum_dirty;
+	/** Block group counters (group.h). */
+	struct block_groups *groups;
+	/** Block deduplication index; NULL if deduplication is disabled. */
+	struct dedup_index *dedup;
+	/** Log-structured mode state (lfs.h); NULL in the normal mode. */
+	struct lfs *lfs;
+	/** Inode attribute cache (acache.h); NULL if not allocated. */
+	struct acache_entry *acache;
+	/** Path lookup cache (lcache.h); allocated on first use. */
+	struct lookup_cache *lcache;
+	/** Cache of decompressed clusters; allocated on first use. */
+	struct cluster_cache *ccache;
+	/** Block that new packed tails are appended to (tail.h); 0 if none. */
+	vsfs_blk_t tail_blk;
+	/** Number of bytes of tail_blk used by packed tails. */
+	uint32_t tail_used;
+	/** Set the VSFS_INODE_COMPRESS flag on new files. */
+	bool compress;
+	/** Verify the checksums of data blocks on read. */
+	bool verify;
+	/** Seconds between background scrubber passes; 0 disables it. */
+	unsigned int scrub_interval;
+	/** Background scrubber; NULL if it is not running. */
+	struct scrubber *scrubber;
+	/** Queue of freed blocks to discard (discard.h); NULL if disabled. */
+	struct discard_queue *discard;
+	/** Inode table initialization thread (itable.h); NULL if not started. */
+	struct itable_initializer *itinit;
+	/** Operation statistics (stats.h); NULL if not collected. */
+	struct fs_stats *stats;
+	/** Operation trace recorder (trace.h); NULL if not recording. */
+	struct trace *trace;
+	/**
+	 * Serializes file system operations (see libvsfs.h) with each other
+	 * and with the background scrubber.
+	 */
+	pthread_mutex_t lock;
 	
 	//TODO: other useful runtime state of the mounted file system should be
 	//       cached here (NOT in global variables in vsfs.c)
 
 } fs_ctx;
 
+/** Get the index of the file block that contains a byte offset. */
+static inline vsfs_blk_t fs_block_index(const fs_ctx *fs, uint64_t pos)
+{
+	return pos >> fs->block_shift;
+}
+
+/** Get the offset of a byte within its block. */
+static inline uint32_t fs_block_offset(const fs_ctx *fs, uint64_t pos)
+{
+	return pos & (fs->block_size - 1);
+}
+
+/** Get the size of a compression cluster in bytes (see VSFS_CLUSTER_BLOCKS). */
+static inline uint32_t fs_cluster_size(const fs_ctx *fs)
+{
+	return VSFS_CLUSTER_BLOCKS << fs->block_shift;
+}
+
+/**
+ * Get the space taken by an inode in 512-byte units, as reported in st_blocks:
+ * its data blocks and the indirect block.
+ */
+static inline uint64_t fs_inode_sectors(const fs_ctx *fs,
+                                        const vsfs_inode *inode)
+{
+	uint64_t blocks = inode->i_blocks + (inode->i_indirect != 0 ? 1 : 0);
+	return blocks << (fs->block_shift - 9);
+}
+
 /**
  * Initialize file system context.
  *
@@ -57,9 +152,20 @@ typedef struct fs_ctx {
  */
 bool fs_ctx_init(fs_ctx *fs, void *image, size_t size);
 
+/**
+ * Set the location and size of the image and the pointers into it. Used by
+ * fs_ctx_init() and when the image is remapped after growing.
+ *
+ * @param fs     pointer to the file system context.
+ * @param image  pointer to the start of the image.
+ * @param size   image size in bytes.
+ */
+void fs_ctx_set_image(fs_ctx *fs, void *image, size_t size);
+
 /**
  * Destroy file system context.
- * Must cleanup all the resources created in fs_ctx_init().
+ * Must cleanup all the resources created in fs_ctx_init(). Updates the block
+ * checksums, so it must be called before the image is unmapped.
  * 
  * @param fs     pointer to the context to clean up
  */
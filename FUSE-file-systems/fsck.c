@@ -0,0 +1,1297 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+/**
+ * CSC369 Assignment 4 - vsfs consistency checker.
+ *
+ * Checks an unmounted image in passes; the inode, directory and block passes
+ * are spread over a pool of worker threads:
+ *   1. inodes: mode, size, block map and xattr block of every allocated inode;
+ *      counts the references to every block;
+ *   2. blocks that must have a single owner (indirect blocks and directory
+ *      blocks) or that have too many references are copied for the extra
+ *      owners;
+ *   3. directory tree: walks all directories from the root and the snapshot
+ *      directory, checks the entries and counts the links to every inode;
+ *   4. link counts; inodes not reachable from the root are released;
+ *   5. blocks: the data bitmap and the refcount table are compared with the
+ *      references found in pass 1;
+ *   6. the superblock free counters and the checksums.
+ * Problems are only reported unless -y is given, in which case they are
+ * repaired in place. Block contents that can't be trusted are dropped rather
+ * than guessed: a block map is cut at the first invalid pointer, and a
+ * directory entry that refers to a free or invalid inode is removed.
+ */
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bitmap.h"
+#include "crc32c.h"
+#include "stripe.h"
+#include "vsfs.h"
+
+/** Exit status (same as e2fsck). */
+#define FSCK_OK         0
+#define FSCK_FIXED      1
+#define FSCK_UNCORRECTED 4
+#define FSCK_ERROR      8
+
+/** Number of inodes and blocks handed to a worker at a time; multiples of
+ *  the bitmap word size so that workers never update the same word. */
+#define INODE_CHUNK 256
+#define BLOCK_CHUNK 1024
+
+/** Inode state flags. */
+#define INODE_USED    0x1 // allocated, with a valid mode
+#define INODE_BAD     0x2 // allocated, invalid mode or uninitialized
+#define INODE_REACHED 0x4 // referenced by a directory entry
+
+/** Command line options. */
+typedef struct fsck_opts {
+	/** File system image file path. */
+	const char *img_path;
+	/** Number of worker threads. */
+	unsigned int threads;
+	/** Print help and exit. */
+	bool help;
+	/** Repair the problems found. */
+	bool repair;
+	/** Verify the checksums of all allocated data blocks. */
+	bool data_csums;
+
+} fsck_opts;
+
+static const char *help_str = "\
+Usage: %s [options] image\n\
+\n\
+Check the consistency of an unmounted vsfs image and optionally repair it.\n\
+A striped image is given as its files separated by ':' (see mkfs.vsfs -h);\n\
+a path that names an existing file is always a single image.\n\
+\n\
+Options:\n\
+    -y      repair the problems found (default: only report them)\n\
+    -c      also verify the checksums of all allocated data blocks\n\
+    -j num  number of threads (default: number of CPUs)\n\
+    -h      print help and exit\n\
+\n\
+Exit status: 0 - no problems found; 1 - all problems repaired; 4 - problems\n\
+left unrepaired; 8 - operational error.\n\
+";
+
+static void print_help(FILE *f, const char *progname)
+{
+	fprintf(f, help_str, progname);
+}
+
+
+static bool parse_args(int argc, char *argv[], fsck_opts *opts)
+{
+	int o;
+	while ((o = getopt(argc, argv, "ycj:h")) != -1) {
+		switch (o) {
+			case 'y': opts->repair = true; break;
+			case 'c': opts->data_csums = true; break;
+			case 'j': opts->threads = strtoul(optarg, NULL, 10);
+			          if (opts->threads == 0) {
+			                  fprintf(stderr, "Invalid number "
+			                          "of threads\n");
+			                  return false;
+			          }
+			          break;
+
+			case 'h': opts->help = true; return true;// skip other arguments
+
+			case '?': return false;
+			default : assert(false);
+		}
+	}
+
+	if (optind >= argc) {
+		fprintf(stderr, "Missing image path\n");
+		return false;
+	}
+	opts->img_path = argv[optind];
+	return true;
+}
+
+
+/** Pool of worker threads that all run the same job. */
+typedef struct pool {
+	pthread_t *threads;
+	unsigned int nthreads;
+	pthread_mutex_t lock;
+	pthread_cond_t start;
+	pthread_cond_t done;
+	/** Current job; every worker calls fn(arg) once. */
+	void (*fn)(void *arg);
+	void *arg;
+	/** Incremented for every job. */
+	unsigned long generation;
+	/** Number of workers still running the current job. */
+	unsigned int running;
+	bool stop;
+} pool;
+
+static void *pool_worker(void *arg)
+{
+	pool *p = (pool *)arg;
+	unsigned long seen = 0;
+
+	pthread_mutex_lock(&p->lock);
+	while (true) {
+		while (p->generation == seen && !p->stop) {
+			pthread_cond_wait(&p->start, &p->lock);
+		}
+		if (p->stop) {
+			break;
+		}
+		seen = p->generation;
+		pthread_mutex_unlock(&p->lock);
+
+		p->fn(p->arg);
+
+		pthread_mutex_lock(&p->lock);
+		if (--p->running == 0) {
+			pthread_cond_signal(&p->done);
+		}
+	}
+	pthread_mutex_unlock(&p->lock);
+	return NULL;
+}
+
+/** Start nthreads workers; returns false if no thread could be created. */
+static bool pool_init(pool *p, unsigned int nthreads)
+{
+	memset(p, 0, sizeof(*p));
+	p->threads = calloc(nthreads, sizeof(*p->threads));
+	if (p->threads == NULL) {
+		perror("calloc");
+		return false;
+	}
+	pthread_mutex_init(&p->lock, NULL);
+	pthread_cond_init(&p->start, NULL);
+	pthread_cond_init(&p->done, NULL);
+	for (unsigned int i = 0; i < nthreads; ++i) {
+		if (pthread_create(&p->threads[i], NULL, pool_worker, p) != 0) {
+			break;
+		}
+		p->nthreads++;
+	}
+	return p->nthreads > 0;
+}
+
+/** Run fn(arg) on every worker and wait for all of them to finish. */
+static void pool_run(pool *p, void (*fn)(void *arg), void *arg)
+{
+	pthread_mutex_lock(&p->lock);
+	p->fn = fn;
+	p->arg = arg;
+	p->running = p->nthreads;
+	p->generation++;
+	pthread_cond_broadcast(&p->start);
+	while (p->running > 0) {
+		pthread_cond_wait(&p->done, &p->lock);
+	}
+	pthread_mutex_unlock(&p->lock);
+}
+
+static void pool_destroy(pool *p)
+{
+	pthread_mutex_lock(&p->lock);
+	p->stop = true;
+	pthread_cond_broadcast(&p->start);
+	pthread_mutex_unlock(&p->lock);
+	for (unsigned int i = 0; i < p->nthreads; ++i) {
+		pthread_join(p->threads[i], NULL);
+	}
+	pthread_cond_destroy(&p->done);
+	pthread_cond_destroy(&p->start);
+	pthread_mutex_destroy(&p->lock);
+	free(p->threads);
+}
+
+
+/** Directory to visit in pass 3. */
+typedef struct dir_item {
+	vsfs_ino_t ino;
+	vsfs_ino_t parent;
+} dir_item;
+
+/** Checker state. */
+typedef struct fsck_ctx {
+	const fsck_opts *opts;
+	void *image;
+	/** Block size in bytes; set once the superblock is validated. */
+	uint32_t block_size;
+	vsfs_superblock *sb;
+	bitmap_t *ibmap;
+	bitmap_t *dbmap;
+	vsfs_inode *itable;
+	vsfs_rc_t *rctable;
+	vsfs_csum_t *csumtable;
+	/** xattr table; NULL if the image has none. */
+	vsfs_blk_t *xattrtable;
+	pool workers;
+
+	/** Inode state (INODE_*). */
+	uint8_t *istate;
+	/** Number of valid entries at the start of the block map of each
+	 *  inode; the rest of the map is ignored (and dropped when repairing). */
+	vsfs_blk_t *map_len;
+	/** Number of directory entries that refer to each inode. */
+	uint32_t *links;
+	/** Number of subdirectories of each directory. */
+	uint32_t *subdirs;
+	/** Number of references to each block. */
+	uint32_t *refs;
+	/** Blocks that must have a single owner (indirect and directory
+	 *  blocks). */
+	uint8_t *exclusive;
+	/** Data blocks modified by repairs; their checksums are updated. */
+	uint8_t *touched;
+
+	/** Directories to visit in pass 3 (a stack) and the number of
+	 *  directories being visited. */
+	dir_item *dirs;
+	uint32_t ndirs;
+	uint32_t active;
+	pthread_mutex_t dirs_lock;
+	pthread_cond_t dirs_cond;
+
+	/** Summary of pass 5. */
+	uint32_t leaked_blocks;
+	uint32_t unmarked_blocks;
+	uint32_t bad_refcounts;
+	uint32_t low_refcounts;
+	/** Number of data blocks with mismatching checksums. */
+	uint32_t bad_csums;
+
+	/** Number of problems found and repaired. */
+	uint32_t problems;
+	uint32_t fixed;
+	pthread_mutex_t out_lock;
+} fsck_ctx;
+
+
+/** Report a problem; fixed tells whether it was repaired. */
+static void problem(fsck_ctx *ctx, bool fixed, const char *fmt, ...)
+{
+	va_list args;
+
+	pthread_mutex_lock(&ctx->out_lock);
+	va_start(args, fmt);
+	vprintf(fmt, args);
+	va_end(args);
+	printf(fixed ? " - fixed\n" : "\n");
+	ctx->problems++;
+	if (fixed) {
+		ctx->fixed++;
+	}
+	pthread_mutex_unlock(&ctx->out_lock);
+}
+
+static void *block_addr(const fsck_ctx *ctx, vsfs_blk_t blk)
+{
+	return ctx->image + (size_t)blk * ctx->block_size;
+}
+
+/** Check if a block number may be used by a file. */
+static bool is_data_block(const fsck_ctx *ctx, vsfs_blk_t blk)
+{
+	return blk >= ctx->sb->data_region && blk < ctx->sb->num_blocks;
+}
+
+/**
+ * Check if an inode table block has been initialized (see itable_init in
+ * vsfs.h); true for all other blocks.
+ */
+static bool itable_block_ready(const fsck_ctx *ctx, vsfs_blk_t blk)
+{
+	uint32_t init = ctx->sb->itable_init;
+	return init == 0 || blk < VSFS_ITBL_BLKNUM + init ||
+	       blk >= ctx->sb->rc_region;
+}
+
+/** Check if a block has a valid entry in the checksum table. */
+static bool has_csum(const fsck_ctx *ctx, vsfs_blk_t blk)
+{
+	vsfs_blk_t csum_end = ctx->sb->csum_region
+	                      + vsfs_csum_blocks(vsfs_max_blocks(ctx->sb),
+	                                         ctx->block_size);
+	return (blk < ctx->sb->csum_region || blk >= csum_end) &&
+	       itable_block_ready(ctx, blk);
+}
+
+static vsfs_csum_t block_csum(const fsck_ctx *ctx, vsfs_blk_t blk)
+{
+	return crc32c(0, block_addr(ctx, blk), ctx->block_size);
+}
+
+/** Get a pointer to the block map entry idx of an inode. */
+static vsfs_blk_t *map_entry(fsck_ctx *ctx, vsfs_inode *inode, vsfs_blk_t idx)
+{
+	if (idx < VSFS_NUM_DIRECT) {
+		return &inode->i_direct[idx];
+	}
+	vsfs_blk_t *indirect = block_addr(ctx, inode->i_indirect);
+	return &indirect[idx - VSFS_NUM_DIRECT];
+}
+
+
+/** State of a parallel loop over [0, n) in chunks. */
+typedef struct loop {
+	fsck_ctx *ctx;
+	void (*fn)(fsck_ctx *ctx, uint32_t first, uint32_t end);
+	uint32_t n;
+	uint32_t chunk;
+	uint32_t next;
+} loop;
+
+static void loop_worker(void *arg)
+{
+	loop *l = (loop *)arg;
+	while (true) {
+		uint32_t first = __atomic_fetch_add(&l->next, l->chunk,
+		                                    __ATOMIC_RELAXED);
+		if (first >= l->n) {
+			break;
+		}
+		uint32_t end = l->n - first > l->chunk ? first + l->chunk : l->n;
+		l->fn(l->ctx, first, end);
+	}
+}
+
+/** Call fn on consecutive ranges of [0, n) on all workers. */
+static void parallel_for(fsck_ctx *ctx, uint32_t n, uint32_t chunk,
+                         void (*fn)(fsck_ctx *ctx, uint32_t first,
+                                    uint32_t end))
+{
+	loop l = { ctx, fn, n, chunk, 0 };
+	pool_run(&ctx->workers, loop_worker, &l);
+}
+
+
+/** Validate the superblock; the image can't be checked without it. */
+static bool check_superblock(fsck_ctx *ctx, size_t size)
+{
+	vsfs_superblock *sb = ctx->sb;
+
+	if (sb->magic != VSFS_MAGIC) {
+		fprintf(stderr, "%s: not a vsfs image\n", ctx->opts->img_path);
+		return false;
+	}
+	uint32_t bs = vsfs_block_size(sb);
+	if (!vsfs_block_size_valid(bs)) {
+		fprintf(stderr, "%s: unsupported block size %u\n",
+		        ctx->opts->img_path, bs);
+		return false;
+	}
+	if (sb->size != size || (size_t)sb->num_blocks * bs != size ||
+	    sb->num_blocks > vsfs_blk_max(bs) || sb->num_blocks < VSFS_BLK_MIN ||
+	    sb->num_inodes > VSFS_INO_MAX || sb->num_inodes <= VSFS_SNAP_INO ||
+	    vsfs_max_blocks(sb) < sb->num_blocks ||
+	    vsfs_max_blocks(sb) > vsfs_blk_max(bs)) {
+		fprintf(stderr, "%s: superblock does not match the image size\n",
+		        ctx->opts->img_path);
+		return false;
+	}
+	uint32_t itable_blocks = div_round_up(sb->num_inodes,
+	                                      vsfs_inodes_per_block(bs));
+	vsfs_blk_t max_blocks = vsfs_max_blocks(sb);
+	vsfs_blk_t csum_end = sb->csum_region + vsfs_csum_blocks(max_blocks, bs);
+	vsfs_blk_t tables_end = sb->xattr_region == 0 ? csum_end :
+		sb->xattr_region + vsfs_xattr_blocks(sb->num_inodes, bs);
+	if (sb->rc_region != VSFS_ITBL_BLKNUM + itable_blocks ||
+	    sb->csum_region != sb->rc_region + vsfs_rc_blocks(max_blocks, bs) ||
+	    (sb->xattr_region != 0 && sb->xattr_region != csum_end) ||
+	    sb->data_region != tables_end ||
+	    sb->data_region >= sb->num_blocks || sb->itable_init > itable_blocks) {
+		fprintf(stderr, "%s: invalid file system layout\n",
+		        ctx->opts->img_path);
+		return false;
+	}
+	uint32_t bpg = sb->blocks_per_group, ipg = sb->inodes_per_group;
+	if ((bpg != 0 || ipg != 0) &&
+	    (bpg == 0 || ipg == 0 || bpg % VSFS_GROUP_ALIGN != 0 ||
+	     ipg % VSFS_GROUP_ALIGN != 0 ||
+	     (uint64_t)ipg * div_round_up(sb->num_blocks, bpg) < sb->num_inodes)) {
+		fprintf(stderr, "%s: invalid block group geometry\n",
+		        ctx->opts->img_path);
+		return false;
+	}
+	if (vsfs_stripe_count(sb) > 1 &&
+	    (sb->stripe_unit == 0 || sb->stripe_unit % bs != 0 ||
+	     size % ((size_t)sb->stripe_unit * sb->stripe_count) != 0)) {
+		fprintf(stderr, "%s: invalid stripe geometry\n",
+		        ctx->opts->img_path);
+		return false;
+	}
+
+	ctx->block_size = bs;
+	ctx->ibmap = (bitmap_t *)block_addr(ctx, VSFS_IMAP_BLKNUM);
+	ctx->dbmap = (bitmap_t *)block_addr(ctx, VSFS_DMAP_BLKNUM);
+	ctx->itable = (vsfs_inode *)block_addr(ctx, VSFS_ITBL_BLKNUM);
+	ctx->rctable = (vsfs_rc_t *)block_addr(ctx, sb->rc_region);
+	ctx->csumtable = (vsfs_csum_t *)block_addr(ctx, sb->csum_region);
+	ctx->xattrtable = sb->xattr_region == 0 ? NULL :
+		(vsfs_blk_t *)block_addr(ctx, sb->xattr_region);
+	return true;
+}
+
+/** Verify the metadata checksums; must run before anything is repaired. */
+static void check_metadata_csums(fsck_ctx *ctx)
+{
+	uint32_t bad = 0;
+	for (vsfs_blk_t blk = 0; blk < ctx->sb->data_region; ++blk) {
+		if (has_csum(ctx, blk) &&
+		    block_csum(ctx, blk) != ctx->csumtable[blk]) {
+			bad++;
+		}
+	}
+	if (bad > 0) {
+		// Also the result of an unclean unmount; the checksums are
+		// recomputed after the repairs
+		problem(ctx, ctx->opts->repair, "%u metadata blocks have wrong "
+		        "checksums", bad);
+	}
+}
+
+
+/**
+ * Pass 1: check the block map of an inode and find the number of valid
+ * entries (map_len). Entry 0 is only valid in a compressed cluster of a
+ * regular file (see VSFS_CLUSTER_BLOCKS).
+ */
+static vsfs_blk_t check_block_map(fsck_ctx *ctx, vsfs_ino_t ino,
+                                  vsfs_inode *inode)
+{
+	bool dir = S_ISDIR(inode->i_mode);
+	vsfs_blk_t len = inode->i_blocks;
+	vsfs_blk_t max_len = vsfs_max_file_blocks(ctx->block_size);
+
+	if (len > max_len) {
+		problem(ctx, ctx->opts->repair, "inode %u: too many blocks (%u)",
+		        ino, len);
+		len = max_len;
+	}
+	if (len > VSFS_NUM_DIRECT && !is_data_block(ctx, inode->i_indirect)) {
+		problem(ctx, ctx->opts->repair, "inode %u: invalid indirect "
+		        "block %u", ino, inode->i_indirect);
+		len = VSFS_NUM_DIRECT;
+	}
+
+	bool zero_seen = false;
+	for (vsfs_blk_t idx = 0; idx < len; ++idx) {
+		vsfs_blk_t first = idx - idx % VSFS_CLUSTER_BLOCKS;
+		if (idx == first) {
+			zero_seen = false;
+		}
+		vsfs_blk_t blk = *map_entry(ctx, inode, idx);
+		bool ok;
+		if (blk != 0) {
+			// Nothing follows the 0 entries of a compressed cluster
+			ok = is_data_block(ctx, blk) && !zero_seen;
+		} else if (!zero_seen) {
+			// The first 0 entry ends the compressed data, which must
+			// fit into the blocks before it
+			const vsfs_cluster_hdr *hdr = idx == first ? NULL :
+				block_addr(ctx, *map_entry(ctx, inode, first));
+			ok = !dir && hdr != NULL &&
+			     first + VSFS_CLUSTER_BLOCKS <= len &&
+			     hdr->c_size <= (idx - first) * ctx->block_size
+			                    - sizeof(*hdr);
+			zero_seen = true;
+		} else {
+			ok = true;
+		}
+		if (!ok) {
+			problem(ctx, ctx->opts->repair, "inode %u: invalid block "
+			        "%u at index %u", ino, blk, idx);
+			// A compressed cluster can't be cut
+			return zero_seen ? first : idx;
+		}
+	}
+	return len;
+}
+
+/**
+ * Pass 1: check the packed tail of an inode (see VSFS_INODE_TAIL); len is the
+ * length of the valid part of the block map. An invalid tail is dropped with
+ * the last block when repairing; the size is then fixed by the caller.
+ */
+static void check_tail(fsck_ctx *ctx, vsfs_ino_t ino, vsfs_inode *inode,
+                       vsfs_blk_t *len)
+{
+	bool repair = ctx->opts->repair;
+
+	if (!(inode->i_flags & VSFS_INODE_TAIL)) {
+		return;
+	}
+	if (*len < inode->i_blocks || inode->i_blocks == 0) {
+		// The tail is already gone with the end of the block map
+		if (repair) {
+			inode->i_flags &= ~VSFS_INODE_TAIL;
+			inode->i_tail_off = 0;
+		}
+		return;
+	}
+
+	uint64_t start = (uint64_t)(inode->i_blocks - 1) * ctx->block_size;
+	if (S_ISREG(inode->i_mode) && inode->i_size > start &&
+	    inode->i_size - start + inode->i_tail_off <= ctx->block_size) {
+		return;
+	}
+	problem(ctx, repair, "inode %u: invalid packed tail at offset %u", ino,
+	        inode->i_tail_off);
+	if (repair) {
+		inode->i_flags &= ~VSFS_INODE_TAIL;
+		inode->i_tail_off = 0;
+		inode->i_blocks--;
+		if (inode->i_blocks <= VSFS_NUM_DIRECT) {
+			inode->i_indirect = 0;
+		}
+		*len = inode->i_blocks;
+	}
+}
+
+/** Compare two xattr names bytewise; a prefix of a name is ordered first. */
+static int xattr_name_cmp(const char *a, size_t a_len, const char *b,
+                          size_t b_len)
+{
+	int ret = memcmp(a, b, a_len < b_len ? a_len : b_len);
+	if (ret != 0) {
+		return ret;
+	}
+	return (a_len > b_len) - (a_len < b_len);
+}
+
+/**
+ * Pass 1: check the contents of an xattr block (see vsfs_xattr_hdr): all the
+ * descriptors must refer to the data after them within the block, and the
+ * names must be sorted (and so unique).
+ */
+static bool xattr_block_valid(const fsck_ctx *ctx, vsfs_blk_t blk)
+{
+	const vsfs_xattr_hdr *hdr = block_addr(ctx, blk);
+	const vsfs_xattr_entry *entries = (const vsfs_xattr_entry *)(hdr + 1);
+	uint32_t bs = ctx->block_size;
+
+	if (hdr->x_magic != VSFS_XATTR_MAGIC || hdr->x_count == 0 ||
+	    hdr->x_count > (bs - sizeof(*hdr)) / sizeof(*entries)) {
+		return false;
+	}
+	uint32_t data_start = sizeof(*hdr) + hdr->x_count * sizeof(*entries);
+	for (uint32_t i = 0; i < hdr->x_count; ++i) {
+		const vsfs_xattr_entry *e = &entries[i];
+		if (e->e_name_len == 0 || e->e_name_len > VSFS_XATTR_NAME_MAX ||
+		    e->e_name_off < data_start ||
+		    (uint32_t)e->e_name_off + e->e_name_len > bs ||
+		    e->e_value_off < data_start ||
+		    (uint32_t)e->e_value_off + e->e_value_len > bs) {
+			return false;
+		}
+		if (i > 0 &&
+		    xattr_name_cmp((const char *)hdr + e[-1].e_name_off,
+		                   e[-1].e_name_len,
+		                   (const char *)hdr + e->e_name_off,
+		                   e->e_name_len) >= 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Pass 1: check the xattr table entry of an inode and count the reference to
+ * its xattr block. An invalid block is dropped when repairing.
+ */
+static void check_xattrs(fsck_ctx *ctx, vsfs_ino_t ino, bool used)
+{
+	if (ctx->xattrtable == NULL || ctx->xattrtable[ino] == 0) {
+		return;
+	}
+	vsfs_blk_t blk = ctx->xattrtable[ino];
+	bool repair = ctx->opts->repair;
+
+	if (!used) {
+		problem(ctx, repair, "inode %u: free inode has xattr block %u",
+		        ino, blk);
+	} else if (!is_data_block(ctx, blk) || !xattr_block_valid(ctx, blk)) {
+		problem(ctx, repair, "inode %u: invalid xattr block %u", ino,
+		        blk);
+	} else {
+		__atomic_fetch_add(&ctx->refs[blk], 1, __ATOMIC_RELAXED);
+		return;
+	}
+	if (repair) {
+		ctx->xattrtable[ino] = 0;
+	}
+}
+
+/** Pass 1: check the allocated inodes in [first, end). */
+static void check_inodes(fsck_ctx *ctx, uint32_t first, uint32_t end)
+{
+	bool repair = ctx->opts->repair;
+
+	for (vsfs_ino_t ino = first; ino < end; ++ino) {
+		if (!bitmap_isset(ctx->ibmap, ctx->sb->num_inodes, ino)) {
+			check_xattrs(ctx, ino, false);
+			continue;
+		}
+		vsfs_inode *inode = &ctx->itable[ino];
+		vsfs_blk_t iblk = VSFS_ITBL_BLKNUM
+		                  + ino / vsfs_inodes_per_block(ctx->block_size);
+		if (!itable_block_ready(ctx, iblk)) {
+			problem(ctx, repair, "inode %u: allocated in the "
+			        "uninitialized part of the inode table", ino);
+			ctx->istate[ino] = INODE_BAD;
+			continue;
+		}
+		if (!S_ISREG(inode->i_mode) && !S_ISDIR(inode->i_mode)) {
+			// Released in pass 4; entries are removed in pass 3
+			problem(ctx, repair, "inode %u: invalid mode %o", ino,
+			        inode->i_mode);
+			ctx->istate[ino] = INODE_BAD;
+			continue;
+		}
+		ctx->istate[ino] = INODE_USED;
+		check_xattrs(ctx, ino, true);
+
+		vsfs_blk_t len = check_block_map(ctx, ino, inode);
+		if (len < inode->i_blocks && repair) {
+			inode->i_blocks = len;
+			if (len <= VSFS_NUM_DIRECT) {
+				inode->i_indirect = 0;
+			}
+		}
+		check_tail(ctx, ino, inode, &len);
+		ctx->map_len[ino] = len;
+
+		// Sizes are made to cover exactly the blocks in the map
+		uint64_t max_size = (uint64_t)inode->i_blocks * ctx->block_size;
+		if (S_ISDIR(inode->i_mode) ? inode->i_size != max_size :
+		    (inode->i_size + ctx->block_size - 1) / ctx->block_size
+		    != inode->i_blocks) {
+			problem(ctx, repair, "inode %u: size %llu does not match "
+			        "%u blocks", ino, (unsigned long long)inode->i_size,
+			        inode->i_blocks);
+			if (repair) {
+				inode->i_size = max_size;
+			}
+		}
+
+		for (vsfs_blk_t idx = 0; idx < len; ++idx) {
+			vsfs_blk_t blk = *map_entry(ctx, inode, idx);
+			if (blk != 0) {
+				__atomic_fetch_add(&ctx->refs[blk], 1,
+				                   __ATOMIC_RELAXED);
+				if (S_ISDIR(inode->i_mode)) {
+					__atomic_store_n(&ctx->exclusive[blk], 1,
+					                 __ATOMIC_RELAXED);
+				}
+			}
+		}
+		if (len > VSFS_NUM_DIRECT) {
+			__atomic_fetch_add(&ctx->refs[inode->i_indirect], 1,
+			                   __ATOMIC_RELAXED);
+			__atomic_store_n(&ctx->exclusive[inode->i_indirect], 1,
+			                 __ATOMIC_RELAXED);
+		}
+	}
+}
+
+/** Verify the checksums of the referenced data blocks in [first, end). */
+static void check_data_csums(fsck_ctx *ctx, uint32_t first, uint32_t end)
+{
+	for (vsfs_blk_t blk = first; blk < end; ++blk) {
+		if (blk < ctx->sb->data_region || ctx->refs[blk] == 0) {
+			continue;
+		}
+		vsfs_csum_t csum = block_csum(ctx, blk);
+		if (csum != ctx->csumtable[blk]) {
+			// The contents can't be restored; the checksum is made to
+			// match them so that reads don't keep failing
+			problem(ctx, ctx->opts->repair, "block %u: checksum "
+			        "mismatch: expected %08x, got %08x", blk,
+			        ctx->csumtable[blk], csum);
+			if (ctx->opts->repair) {
+				ctx->touched[blk] = 1;
+			}
+		}
+	}
+}
+
+
+/** Find a block that nothing refers to, starting from *cursor. */
+static bool find_free_block(fsck_ctx *ctx, vsfs_blk_t *cursor, vsfs_blk_t *blk)
+{
+	for (; *cursor < ctx->sb->num_blocks; ++*cursor) {
+		if (ctx->refs[*cursor] == 0) {
+			*blk = (*cursor)++;
+			return true;
+		}
+	}
+	return false;
+}
+
+/** Number of owners a block may have. */
+static uint32_t max_owners(const fsck_ctx *ctx, vsfs_blk_t blk)
+{
+	return ctx->exclusive[blk] ? 1 : VSFS_RC_MAX;
+}
+
+/**
+ * Pass 2: give an owner of a block with too many owners its own copy. The
+ * first owners (in inode order) keep the block. Returns false if there is no
+ * free block for the copy.
+ */
+static bool unshare_entry(fsck_ctx *ctx, vsfs_blk_t *entry, uint32_t *owners,
+                          vsfs_blk_t *cursor)
+{
+	vsfs_blk_t blk = *entry;
+	if (++owners[blk] <= max_owners(ctx, blk)) {
+		return true;
+	}
+
+	vsfs_blk_t copy;
+	if (!find_free_block(ctx, cursor, &copy)) {
+		return false;
+	}
+	memcpy(block_addr(ctx, copy), block_addr(ctx, blk), ctx->block_size);
+	ctx->refs[copy] = 1;
+	ctx->exclusive[copy] = ctx->exclusive[blk];
+	ctx->touched[copy] = 1;
+	ctx->refs[blk]--;
+	*entry = copy;
+	owners[copy] = 1;
+	return true;
+}
+
+/** Pass 2: find and (when repairing) resolve blocks with too many owners. */
+static void check_shared_blocks(fsck_ctx *ctx)
+{
+	uint32_t shared = 0;
+	for (vsfs_blk_t blk = ctx->sb->data_region; blk < ctx->sb->num_blocks;
+	     ++blk) {
+		if (ctx->refs[blk] > max_owners(ctx, blk)) {
+			problem(ctx, ctx->opts->repair, "block %u: %u owners, at "
+			        "most %u allowed", blk, ctx->refs[blk],
+			        max_owners(ctx, blk));
+			shared++;
+		}
+	}
+	if (shared == 0 || !ctx->opts->repair) {
+		return;
+	}
+
+	uint32_t *owners = calloc(ctx->sb->num_blocks, sizeof(*owners));
+	if (owners == NULL) {
+		problem(ctx, false, "out of memory; shared blocks not copied");
+		return;
+	}
+	vsfs_blk_t cursor = ctx->sb->data_region;
+	bool ok = true;
+	for (vsfs_ino_t ino = 0; ok && ino < ctx->sb->num_inodes; ++ino) {
+		if (ctx->istate[ino] != INODE_USED) {
+			continue;
+		}
+		vsfs_inode *inode = &ctx->itable[ino];
+		vsfs_blk_t len = ctx->map_len[ino];
+		if (ctx->xattrtable != NULL && ctx->xattrtable[ino] != 0) {
+			ok = unshare_entry(ctx, &ctx->xattrtable[ino], owners,
+			                   &cursor);
+		}
+		// The indirect block is copied first, so that its entries are
+		// updated in the copy
+		if (ok && len > VSFS_NUM_DIRECT) {
+			ok = unshare_entry(ctx, &inode->i_indirect, owners,
+			                   &cursor);
+		}
+		for (vsfs_blk_t idx = 0; ok && idx < len; ++idx) {
+			vsfs_blk_t *entry = map_entry(ctx, inode, idx);
+			if (*entry == 0) {
+				continue;
+			}
+			vsfs_blk_t old = *entry;
+			ok = unshare_entry(ctx, entry, owners, &cursor);
+			if (*entry != old && idx >= VSFS_NUM_DIRECT) {
+				ctx->touched[inode->i_indirect] = 1;
+			}
+		}
+	}
+	free(owners);
+	if (!ok) {
+		problem(ctx, false, "no free blocks left to copy shared blocks "
+		        "into");
+	}
+}
+
+
+/** Pass 3: queue a directory to visit. */
+static void push_dir(fsck_ctx *ctx, vsfs_ino_t ino, vsfs_ino_t parent)
+{
+	pthread_mutex_lock(&ctx->dirs_lock);
+	// Every directory is queued at most once (see INODE_REACHED)
+	assert(ctx->ndirs < ctx->sb->num_inodes);
+	ctx->dirs[ctx->ndirs++] = (dir_item){ ino, parent };
+	pthread_cond_signal(&ctx->dirs_cond);
+	pthread_mutex_unlock(&ctx->dirs_lock);
+}
+
+/** Pass 3: check that a special entry ("." or "..") refers to ino. */
+static void check_dot(fsck_ctx *ctx, vsfs_ino_t dir, vsfs_dentry *entry,
+                      const char *name, vsfs_ino_t ino, vsfs_blk_t blk)
+{
+	if (entry->ino == ino && strcmp(entry->name, name) == 0) {
+		return;
+	}
+	problem(ctx, ctx->opts->repair, "directory %u: \"%s\" entry should "
+	        "refer to %u", dir, name, ino);
+	if (ctx->opts->repair) {
+		entry->ino = ino;
+		strcpy(entry->name, name);
+		ctx->touched[blk] = 1;
+	}
+}
+
+/** Pass 3: check the name of an entry; returns NULL if it is valid. */
+static const char *bad_name(const vsfs_dentry *entry)
+{
+	if (memchr(entry->name, '\0', sizeof(entry->name)) == NULL) {
+		return "unterminated name";
+	}
+	if (entry->name[0] == '\0' || strchr(entry->name, '/') != NULL ||
+	    strcmp(entry->name, ".") == 0 || strcmp(entry->name, "..") == 0) {
+		return "invalid name";
+	}
+	return NULL;
+}
+
+/** Pass 3: check the entries of a directory and queue its subdirectories. */
+static void visit_dir(fsck_ctx *ctx, vsfs_ino_t ino, vsfs_ino_t parent)
+{
+	vsfs_inode *dir = &ctx->itable[ino];
+	vsfs_ino_t ninodes = ctx->sb->num_inodes;
+	size_t per_block = vsfs_dentries_per_block(ctx->block_size);
+
+	if (ctx->map_len[ino] == 0) {
+		problem(ctx, false, "directory %u has no blocks", ino);
+		return;
+	}
+	for (vsfs_blk_t idx = 0; idx < ctx->map_len[ino]; ++idx) {
+		vsfs_blk_t blk = *map_entry(ctx, dir, idx);
+		vsfs_dentry *entries = block_addr(ctx, blk);
+		for (size_t j = 0; j < per_block; ++j) {
+			vsfs_dentry *entry = &entries[j];
+			if (idx == 0 && j < 2) {
+				check_dot(ctx, ino, entry, j == 0 ? "." : "..",
+				          j == 0 ? ino : parent, blk);
+				continue;
+			}
+			if (entry->ino == VSFS_INO_MAX) {
+				continue;
+			}
+
+			vsfs_ino_t child = entry->ino;
+			const char *why = bad_name(entry);
+			if (why == NULL && (child >= ninodes ||
+			                    !(ctx->istate[child] & INODE_USED))) {
+				why = "refers to a free or invalid inode";
+			}
+			if (why == NULL && S_ISDIR(ctx->itable[child].i_mode)) {
+				uint8_t old = __atomic_fetch_or(&ctx->istate[child],
+				                                INODE_REACHED,
+				                                __ATOMIC_RELAXED);
+				if (old & INODE_REACHED) {
+					why = "second link to a directory";
+				} else {
+					ctx->subdirs[ino]++;
+					push_dir(ctx, child, ino);
+				}
+			} else if (why == NULL) {
+				__atomic_fetch_or(&ctx->istate[child], INODE_REACHED,
+				                  __ATOMIC_RELAXED);
+				__atomic_fetch_add(&ctx->links[child], 1,
+				                   __ATOMIC_RELAXED);
+			}
+
+			if (why != NULL) {
+				problem(ctx, ctx->opts->repair, "directory %u: "
+				        "entry %zu in block %u: %s", ino,
+				        idx * per_block + j, blk, why);
+				if (ctx->opts->repair) {
+					entry->ino = VSFS_INO_MAX;
+					ctx->touched[blk] = 1;
+				}
+			}
+		}
+	}
+}
+
+/** Pass 3 worker: visit queued directories until all have been visited. */
+static void walk_worker(void *arg)
+{
+	fsck_ctx *ctx = (fsck_ctx *)arg;
+
+	pthread_mutex_lock(&ctx->dirs_lock);
+	while (true) {
+		while (ctx->ndirs == 0 && ctx->active > 0) {
+			pthread_cond_wait(&ctx->dirs_cond, &ctx->dirs_lock);
+		}
+		if (ctx->ndirs == 0) {
+			break;
+		}
+		dir_item item = ctx->dirs[--ctx->ndirs];
+		ctx->active++;
+		pthread_mutex_unlock(&ctx->dirs_lock);
+
+		visit_dir(ctx, item.ino, item.parent);
+
+		pthread_mutex_lock(&ctx->dirs_lock);
+		if (--ctx->active == 0 && ctx->ndirs == 0) {
+			// Wake up the idle workers so that they can finish
+			pthread_cond_broadcast(&ctx->dirs_cond);
+		}
+	}
+	pthread_mutex_unlock(&ctx->dirs_lock);
+}
+
+/** Pass 3: walk the directory tree from the root and the snapshot directory. */
+static bool check_tree(fsck_ctx *ctx)
+{
+	vsfs_ino_t roots[] = { VSFS_ROOT_INO, VSFS_SNAP_INO };
+	for (size_t i = 0; i < sizeof(roots) / sizeof(roots[0]); ++i) {
+		vsfs_ino_t ino = roots[i];
+		if (!(ctx->istate[ino] & INODE_USED) ||
+		    !S_ISDIR(ctx->itable[ino].i_mode)) {
+			problem(ctx, false, "%s directory (inode %u) is damaged",
+			        ino == VSFS_ROOT_INO ? "root" : "snapshot", ino);
+			return false;
+		}
+		ctx->istate[ino] |= INODE_REACHED;
+	}
+
+	// The parent of the snapshot directory is the root directory, but it
+	// is not listed there and does not add to its link count
+	push_dir(ctx, VSFS_SNAP_INO, VSFS_ROOT_INO);
+	push_dir(ctx, VSFS_ROOT_INO, VSFS_ROOT_INO);
+	pool_run(&ctx->workers, walk_worker, ctx);
+	return true;
+}
+
+
+/** Pass 4: drop the references held by an inode. */
+static void release_blocks(fsck_ctx *ctx, vsfs_ino_t ino)
+{
+	vsfs_inode *inode = &ctx->itable[ino];
+	vsfs_blk_t len = ctx->map_len[ino];
+
+	for (vsfs_blk_t idx = 0; idx < len; ++idx) {
+		vsfs_blk_t blk = *map_entry(ctx, inode, idx);
+		if (blk != 0) {
+			__atomic_fetch_sub(&ctx->refs[blk], 1, __ATOMIC_RELAXED);
+		}
+	}
+	if (len > VSFS_NUM_DIRECT) {
+		__atomic_fetch_sub(&ctx->refs[inode->i_indirect], 1,
+		                   __ATOMIC_RELAXED);
+	}
+	if (ctx->xattrtable != NULL && ctx->xattrtable[ino] != 0) {
+		__atomic_fetch_sub(&ctx->refs[ctx->xattrtable[ino]], 1,
+		                   __ATOMIC_RELAXED);
+	}
+}
+
+/** Pass 4: check the link counts and release the unreachable inodes. */
+static void check_links(fsck_ctx *ctx, uint32_t first, uint32_t end)
+{
+	bool repair = ctx->opts->repair;
+
+	for (vsfs_ino_t ino = first; ino < end; ++ino) {
+		uint8_t state = ctx->istate[ino];
+		vsfs_inode *inode = &ctx->itable[ino];
+
+		if (state == INODE_USED) {
+			problem(ctx, repair, "inode %u is not referenced by any "
+			        "directory", ino);
+			if (repair) {
+				release_blocks(ctx, ino);
+			}
+		}
+		if (state == INODE_USED || state == INODE_BAD) {
+			if (repair) {
+				memset(inode, 0, sizeof(*inode));
+				if (ctx->xattrtable != NULL) {
+					ctx->xattrtable[ino] = 0;
+				}
+				bitmap_set(ctx->ibmap, ctx->sb->num_inodes, ino,
+				           false);
+			}
+			continue;
+		}
+		if (state == 0) {
+			continue;
+		}
+
+		uint32_t nlink = S_ISDIR(inode->i_mode) ? 2 + ctx->subdirs[ino]
+		                                        : ctx->links[ino];
+		if (inode->i_nlink != nlink) {
+			problem(ctx, repair, "inode %u: link count %u, should be "
+			        "%u", ino, inode->i_nlink, nlink);
+			if (repair) {
+				inode->i_nlink = nlink;
+			}
+		}
+	}
+}
+
+
+/** Pass 5: compare the data bitmap and the refcounts in [first, end). */
+static void check_blocks(fsck_ctx *ctx, uint32_t first, uint32_t end)
+{
+	vsfs_blk_t nblocks = ctx->sb->num_blocks;
+	bool repair = ctx->opts->repair;
+	uint32_t leaked = 0, unmarked = 0, bad_rc = 0, low_rc = 0;
+
+	for (vsfs_blk_t blk = first; blk < end; ++blk) {
+		bool meta = blk < ctx->sb->data_region;
+		uint32_t refs = meta ? 0 : ctx->refs[blk];
+		bool used = meta || refs > 0;
+
+		if (bitmap_isset(ctx->dbmap, nblocks, blk) != used) {
+			if (used) {
+				unmarked++;
+			} else {
+				leaked++;
+			}
+			if (repair) {
+				bitmap_set(ctx->dbmap, nblocks, blk, used);
+			}
+		}
+		vsfs_rc_t rc = refs < VSFS_RC_MAX ? refs : VSFS_RC_MAX;
+		if (ctx->rctable[blk] != rc) {
+			bad_rc++;
+			if (ctx->rctable[blk] < rc) {
+				low_rc++;
+			}
+			if (repair) {
+				ctx->rctable[blk] = rc;
+			}
+		}
+	}
+
+	__atomic_fetch_add(&ctx->leaked_blocks, leaked, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&ctx->unmarked_blocks, unmarked, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&ctx->bad_refcounts, bad_rc, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&ctx->low_refcounts, low_rc, __ATOMIC_RELAXED);
+}
+
+/** Pass 5 summary. */
+static void report_blocks(fsck_ctx *ctx)
+{
+	bool repair = ctx->opts->repair;
+
+	if (ctx->leaked_blocks > 0) {
+		problem(ctx, repair, "%u orphaned blocks marked in use but not "
+		        "referenced", ctx->leaked_blocks);
+	}
+	if (ctx->unmarked_blocks > 0) {
+		problem(ctx, repair, "%u referenced blocks marked free (could be "
+		        "allocated twice)", ctx->unmarked_blocks);
+	}
+	if (ctx->bad_refcounts > 0) {
+		problem(ctx, repair, "%u wrong reference counts (%u too low, so "
+		        "the blocks could be freed while in use)",
+		        ctx->bad_refcounts, ctx->low_refcounts);
+	}
+}
+
+
+/** Pass 6: check the superblock free counters against the bitmaps. */
+static void check_counters(fsck_ctx *ctx)
+{
+	vsfs_superblock *sb = ctx->sb;
+	bool repair = ctx->opts->repair;
+
+	uint32_t free_inodes = bitmap_count_free(ctx->ibmap, sb->num_inodes, 0,
+	                                         sb->num_inodes);
+	if (sb->free_inodes != free_inodes) {
+		problem(ctx, repair, "superblock: %u free inodes, should be %u",
+		        sb->free_inodes, free_inodes);
+		if (repair) {
+			sb->free_inodes = free_inodes;
+		}
+	}
+	uint32_t free_blocks = bitmap_count_free(ctx->dbmap, sb->num_blocks, 0,
+	                                         sb->num_blocks);
+	if (sb->free_blocks != free_blocks) {
+		problem(ctx, repair, "superblock: %u free blocks, should be %u",
+		        sb->free_blocks, free_blocks);
+		if (repair) {
+			sb->free_blocks = free_blocks;
+		}
+	}
+}
+
+/** Pass 6: update the checksums of the metadata and the repaired blocks. */
+static void update_csums(fsck_ctx *ctx, uint32_t first, uint32_t end)
+{
+	for (vsfs_blk_t blk = first; blk < end; ++blk) {
+		if (has_csum(ctx, blk) &&
+		    (blk < ctx->sb->data_region || ctx->touched[blk])) {
+			ctx->csumtable[blk] = block_csum(ctx, blk);
+		}
+	}
+}
+
+
+/** Allocate the per-inode and per-block state. */
+static bool alloc_state(fsck_ctx *ctx)
+{
+	uint32_t ninodes = ctx->sb->num_inodes, nblocks = ctx->sb->num_blocks;
+
+	ctx->istate = calloc(ninodes, sizeof(*ctx->istate));
+	ctx->map_len = calloc(ninodes, sizeof(*ctx->map_len));
+	ctx->links = calloc(ninodes, sizeof(*ctx->links));
+	ctx->subdirs = calloc(ninodes, sizeof(*ctx->subdirs));
+	ctx->dirs = calloc(ninodes, sizeof(*ctx->dirs));
+	ctx->refs = calloc(nblocks, sizeof(*ctx->refs));
+	ctx->exclusive = calloc(nblocks, sizeof(*ctx->exclusive));
+	ctx->touched = calloc(nblocks, sizeof(*ctx->touched));
+	if (ctx->istate == NULL || ctx->map_len == NULL || ctx->links == NULL ||
+	    ctx->subdirs == NULL || ctx->dirs == NULL || ctx->refs == NULL ||
+	    ctx->exclusive == NULL || ctx->touched == NULL) {
+		perror("calloc");
+		return false;
+	}
+	return true;
+}
+
+static void free_state(fsck_ctx *ctx)
+{
+	free(ctx->istate);
+	free(ctx->map_len);
+	free(ctx->links);
+	free(ctx->subdirs);
+	free(ctx->dirs);
+	free(ctx->refs);
+	free(ctx->exclusive);
+	free(ctx->touched);
+}
+
+/** Run all the passes; returns false if the check could not be completed. */
+static bool fsck(fsck_ctx *ctx)
+{
+	uint32_t ninodes = ctx->sb->num_inodes, nblocks = ctx->sb->num_blocks;
+
+	check_metadata_csums(ctx);
+	parallel_for(ctx, ninodes, INODE_CHUNK, check_inodes);
+	if (ctx->opts->data_csums) {
+		parallel_for(ctx, nblocks, BLOCK_CHUNK, check_data_csums);
+	}
+	check_shared_blocks(ctx);
+	if (!check_tree(ctx)) {
+		return false;
+	}
+	parallel_for(ctx, ninodes, INODE_CHUNK, check_links);
+	parallel_for(ctx, nblocks, BLOCK_CHUNK, check_blocks);
+	report_blocks(ctx);
+	check_counters(ctx);
+	if (ctx->opts->repair && ctx->problems > 0) {
+		parallel_for(ctx, nblocks, BLOCK_CHUNK, update_csums);
+	}
+	return true;
+}
+
+
+int main(int argc, char *argv[])
+{
+	int ret = FSCK_ERROR; // exit status
+	size_t fsize; // size of disk image file
+	fsck_opts opts = {0}; // options; defaults are all 0
+	fsck_ctx ctx = {0};
+
+	if (!parse_args(argc, argv, &opts)) {
+		// Invalid arguments, print help to stderr
+		print_help(stderr, argv[0]);
+		return FSCK_ERROR;
+	}
+	if (opts.help) {
+		// Help requested, print it to stdout
+		print_help(stdout, argv[0]);
+		return FSCK_OK;
+	}
+	if (opts.threads == 0) {
+		long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+		opts.threads = ncpus > 0 ? ncpus : 1;
+	}
+
+	// Map disk image file into memory
+	ctx.opts = &opts;
+	ctx.image = stripe_map_image(opts.img_path, &fsize);
+	if (ctx.image == NULL) {
+		return FSCK_ERROR;
+	}
+	ctx.sb = (vsfs_superblock *)ctx.image;
+	if (!check_superblock(&ctx, fsize)) {
+		ret = FSCK_UNCORRECTED;
+		goto end;
+	}
+	if (!alloc_state(&ctx)) {
+		goto end;
+	}
+	if (!pool_init(&ctx.workers, opts.threads)) {
+		fprintf(stderr, "Failed to start the worker threads\n");
+		goto end;
+	}
+	pthread_mutex_init(&ctx.out_lock, NULL);
+	pthread_mutex_init(&ctx.dirs_lock, NULL);
+	pthread_cond_init(&ctx.dirs_cond, NULL);
+
+	struct timespec start, finish;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	bool complete = fsck(&ctx);
+	clock_gettime(CLOCK_MONOTONIC, &finish);
+
+	pool_destroy(&ctx.workers);
+	pthread_cond_destroy(&ctx.dirs_cond);
+	pthread_mutex_destroy(&ctx.dirs_lock);
+	pthread_mutex_destroy(&ctx.out_lock);
+
+	vsfs_superblock *sb = ctx.sb;
+	printf("%s: %u/%u inodes, %u/%u blocks used; %u problems, %u fixed "
+	       "(%.3f s, %u threads)\n", opts.img_path,
+	       sb->num_inodes - sb->free_inodes, sb->num_inodes,
+	       sb->num_blocks - sb->free_blocks, sb->num_blocks, ctx.problems,
+	       ctx.fixed, (finish.tv_sec - start.tv_sec)
+	                  + (finish.tv_nsec - start.tv_nsec) / 1e9,
+	       opts.threads);
+	if (!complete || ctx.fixed < ctx.problems) {
+		ret = FSCK_UNCORRECTED;
+	} else {
+		ret = ctx.problems > 0 ? FSCK_FIXED : FSCK_OK;
+	}
+
+end:
+	free_state(&ctx);
+	munmap(ctx.image, fsize);
+	return ret;
+}
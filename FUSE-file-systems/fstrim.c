@@ -0,0 +1,212 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+/**
+ * CSC369 Assignment 4 - vsfs free space trimming tool.
+ *
+ * Punches all the free blocks of a vsfs file system out of its image file, so
+ * that the host reclaims their storage. Works either offline on an unmounted
+ * image (through libvsfs) or online on a directory in a mounted vsfs file
+ * system (through the VSFS_IOC_TRIM ioctl).
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "discard.h"
+#include "fs_ctx.h"
+#include "stripe.h"
+
+/** Command line options. */
+typedef struct fstrim_opts {
+	/** Image file or directory path. */
+	const char *path;
+	/** Print help and exit. */
+	bool help;
+	/** Print the host storage used by the image before and after. */
+	bool verbose;
+
+} fstrim_opts;
+
+static const char *help_str = "\
+Usage: %s [options] path\n\
+\n\
+Discard the free blocks of a vsfs file system: punch them out of the image\n\
+file so that the host reclaims their storage. The path is either an unmounted\n\
+image, or a directory in a mounted vsfs file system.\n\
+\n\
+Options:\n\
+    -v      print the host storage used by the image before and after\n\
+            (offline only)\n\
+    -h      print help and exit\n\
+";
+
+static void print_help(FILE *f, const char *progname)
+{
+	fprintf(f, help_str, progname);
+}
+
+
+static bool parse_args(int argc, char *argv[], fstrim_opts *opts)
+{
+	int o;
+	while ((o = getopt(argc, argv, "vh")) != -1) {
+		switch (o) {
+			case 'v': opts->verbose = true; break;
+
+			case 'h': opts->help = true; return true;// skip other arguments
+
+			case '?': return false;
+			default : assert(false);
+		}
+	}
+
+	if (optind >= argc) {
+		fprintf(stderr, "Missing image or directory path\n");
+		return false;
+	}
+	opts->path = argv[optind];
+	return true;
+}
+
+
+/** Get the host storage used by a file in KiB. */
+static unsigned long long host_kib(int fd)
+{
+	struct stat st;
+	return fstat(fd, &st) == 0 ? (unsigned long long)st.st_blocks / 2 : 0;
+}
+
+/** Get the host storage used by an image in KiB; see host_kib(). */
+static unsigned long long image_kib(const fs_ctx *fs)
+{
+	if (fs->stripe == NULL) {
+		return host_kib(fs->fd);
+	}
+	unsigned long long kib = 0;
+	for (unsigned int i = 0; i < fs->stripe->count; ++i) {
+		kib += host_kib(fs->stripe->fds[i]);
+	}
+	return kib;
+}
+
+/** Discard the free blocks of an unmounted image. */
+static int fstrim_offline(const fstrim_opts *opts)
+{
+	size_t fsize;
+	void *image = stripe_map_image(opts->path, &fsize);
+	if (image == NULL) {
+		return 1;
+	}
+
+	int ret = 1;
+	fs_ctx fs = {0};
+	if (!fs_ctx_init(&fs, image, fsize)) {
+		fprintf(stderr, "%s: not a valid vsfs image\n", opts->path);
+		goto end;
+	}
+	if (stripe_is_set(opts->path)) {
+		fs.stripe = stripe_open(opts->path);
+		if (fs.stripe == NULL) {
+			goto end;
+		}
+	} else if ((fs.fd = open(opts->path, O_RDWR)) < 0) {
+		perror(opts->path);
+		goto end;
+	}
+
+	unsigned long long before = image_kib(&fs);
+	uint64_t discarded;
+	int err = discard_free_blocks(&fs, &discarded);
+	if (err != 0) {
+		fprintf(stderr, "%s: %s\n", opts->path, strerror(-err));
+		goto end;
+	}
+	uint64_t bytes = discarded << fs.block_shift;
+	printf("%s: %llu bytes (%llu KiB) trimmed\n", opts->path,
+	       (unsigned long long)bytes, (unsigned long long)bytes / 1024);
+	if (opts->verbose) {
+		printf("host storage: %llu KiB -> %llu KiB\n", before,
+		       image_kib(&fs));
+	}
+	ret = 0;
+
+end:
+	fs_ctx_destroy(&fs);
+	munmap(image, fsize);
+	if (fs.fd >= 0) {
+		close(fs.fd);
+	}
+	stripe_close(fs.stripe);
+	return ret;
+}
+
+/** Discard the free blocks of a mounted vsfs that contains a directory. */
+static int fstrim_online(const fstrim_opts *opts)
+{
+	int fd = open(opts->path, O_RDONLY);
+	if (fd < 0) {
+		perror(opts->path);
+		return 1;
+	}
+	uint64_t discarded;
+	int ret = ioctl(fd, VSFS_IOC_TRIM, &discarded);
+	close(fd);
+	if (ret < 0) {
+		fprintf(stderr, "%s: %s\n", opts->path,
+		        errno == ENOTTY ? "not on a vsfs file system"
+		                        : strerror(errno));
+		return 1;
+	}
+	printf("%s: %llu bytes (%llu KiB) trimmed\n", opts->path,
+	       (unsigned long long)discarded,
+	       (unsigned long long)discarded / 1024);
+	return 0;
+}
+
+
+int main(int argc, char *argv[])
+{
+	fstrim_opts opts = {0}; // options; defaults are all 0
+
+	if (!parse_args(argc, argv, &opts)) {
+		// Invalid arguments, print help to stderr
+		print_help(stderr, argv[0]);
+		return 1;
+	}
+	if (opts.help) {
+		// Help requested, print it to stdout
+		print_help(stdout, argv[0]);
+		return 0;
+	}
+
+	// A striped image is never a mount point
+	struct stat st;
+	if (stripe_is_set(opts.path)) {
+		return fstrim_offline(&opts);
+	}
+	if (stat(opts.path, &st) != 0) {
+		perror(opts.path);
+		return 1;
+	}
+	return S_ISDIR(st.st_mode) ? fstrim_online(&opts)
+	                           : fstrim_offline(&opts);
+}
@@ -0,0 +1,259 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+/**
+ * CSC369 Assignment 4 - Block groups and locality-aware allocation.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bitmap.h"
+#include "group.h"
+
+
+/** Get the range of blocks [*start, *end) of a group. */
+static void group_blocks(const fs_ctx *fs, uint32_t g, vsfs_blk_t *start,
+                         vsfs_blk_t *end)
+{
+	vsfs_blk_t bpg = fs->groups->blocks_per_group;
+	*start = g * bpg;
+	*end = *start + bpg < fs->sb->num_blocks ? *start + bpg
+	                                         : fs->sb->num_blocks;
+}
+
+/** Get the range of inodes [*start, *end) of a group; may be empty. */
+static void group_inodes(const fs_ctx *fs, uint32_t g, vsfs_ino_t *start,
+                         vsfs_ino_t *end)
+{
+	uint64_t first = (uint64_t)g * fs->groups->inodes_per_group;
+	uint64_t last = first + fs->groups->inodes_per_group;
+	uint32_t ninodes = fs->sb->num_inodes;
+
+	*start = first < ninodes ? first : ninodes;
+	*end = last < ninodes ? last : ninodes;
+}
+
+bool group_init(fs_ctx *fs)
+{
+	vsfs_superblock *sb = fs->sb;
+	vsfs_blk_t bpg = sb->blocks_per_group;
+	uint32_t ipg = sb->inodes_per_group;
+
+	if (bpg == 0 && ipg == 0) {
+		// Formatted without block groups - a single group
+		bpg = vsfs_max_blocks(sb);
+		ipg = sb->num_inodes;
+	} else if (bpg % VSFS_GROUP_ALIGN != 0 || ipg % VSFS_GROUP_ALIGN != 0 ||
+	           bpg == 0 || ipg == 0 ||
+	           (uint64_t)ipg * div_round_up(sb->num_blocks, bpg)
+	           < sb->num_inodes) {
+		fprintf(stderr, "Invalid block group geometry\n");
+		return false;
+	}
+
+	// Room for the groups of all the blocks the image can grow to
+	uint32_t count = div_round_up(sb->num_blocks, bpg);
+	uint32_t max_count = div_round_up(vsfs_max_blocks(sb), bpg);
+	block_groups *groups = calloc(1, sizeof(*groups)
+	                                 + max_count * sizeof(groups->desc[0]));
+	if (groups == NULL) {
+		perror("calloc");
+		return false;
+	}
+	groups->count = count;
+	groups->blocks_per_group = bpg;
+	groups->inodes_per_group = ipg;
+	fs->groups = groups;
+
+	for (uint32_t g = 0; g < count; ++g) {
+		group_desc *desc = &groups->desc[g];
+		vsfs_blk_t bstart, bend;
+		vsfs_ino_t istart, iend;
+
+		group_blocks(fs, g, &bstart, &bend);
+		desc->free_blocks = bitmap_count_free(fs->dbmap, sb->num_blocks,
+		                                      bstart, bend);
+		group_inodes(fs, g, &istart, &iend);
+		desc->free_inodes = bitmap_count_free(fs->ibmap, sb->num_inodes,
+		                                      istart, iend);
+		for (vsfs_ino_t ino = istart; ino < iend; ++ino) {
+			if (bitmap_isset(fs->ibmap, sb->num_inodes, ino) &&
+			    S_ISDIR(fs->itable[ino].i_mode)) {
+				desc->dirs++;
+			}
+		}
+	}
+	return true;
+}
+
+void group_grow(fs_ctx *fs, vsfs_blk_t old_blocks)
+{
+	block_groups *groups = fs->groups;
+	vsfs_blk_t nblocks = fs->sb->num_blocks;
+
+	// The added blocks are free; the new groups have no inodes
+	for (vsfs_blk_t blk = old_blocks; blk < nblocks; ++blk) {
+		groups->desc[blk / groups->blocks_per_group].free_blocks++;
+	}
+	groups->count = div_round_up(nblocks, groups->blocks_per_group);
+}
+
+void group_destroy(fs_ctx *fs)
+{
+	free(fs->groups);
+	fs->groups = NULL;
+}
+
+vsfs_blk_t group_first_block(fs_ctx *fs, vsfs_ino_t ino)
+{
+	vsfs_blk_t start, end;
+	group_blocks(fs, ino / fs->groups->inodes_per_group, &start, &end);
+	return start > fs->sb->data_region ? start : fs->sb->data_region;
+}
+
+
+bool group_alloc_block(fs_ctx *fs, vsfs_blk_t goal, vsfs_blk_t *blk)
+{
+	block_groups *groups = fs->groups;
+	vsfs_blk_t nblocks = fs->sb->num_blocks;
+
+	if (goal >= nblocks) {
+		goal = 0;
+	}
+	uint32_t first = goal / groups->blocks_per_group;
+	for (uint32_t i = 0; i < groups->count; ++i) {
+		uint32_t g = (first + i) % groups->count;
+		if (groups->desc[g].free_blocks == 0) {
+			continue;
+		}
+
+		// Search the goal's group from the goal to the end first, then
+		// wrap around; other groups are searched from the start
+		vsfs_blk_t start, end;
+		group_blocks(fs, g, &start, &end);
+		vsfs_blk_t from = i == 0 ? goal : start;
+		if (bitmap_alloc_range(fs->dbmap, nblocks, from, end, blk) == 0 ||
+		    bitmap_alloc_range(fs->dbmap, nblocks, start, from, blk) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+
+/**
+ * Find the first group starting from a given one that has at least min_inodes
+ * free inodes (and at least one) and at least min_blocks free blocks.
+ */
+static bool find_group(const block_groups *groups, uint32_t first,
+                       uint32_t min_inodes, uint32_t min_blocks,
+                       uint32_t *group)
+{
+	for (uint32_t i = 0; i < groups->count; ++i) {
+		uint32_t g = (first + i) % groups->count;
+		const group_desc *desc = &groups->desc[g];
+		if (desc->free_inodes > 0 && desc->free_inodes >= min_inodes &&
+		    desc->free_blocks >= min_blocks) {
+			*group = g;
+			return true;
+		}
+	}
+	return false;
+}
+
+/** Choose the group for a new directory (Orlov allocator). */
+static bool find_group_dir(fs_ctx *fs, vsfs_ino_t parent, uint32_t *group)
+{
+	block_groups *groups = fs->groups;
+	uint32_t n = groups->count;
+	uint32_t parent_group = parent / groups->inodes_per_group;
+	uint32_t avg_inodes = fs->sb->free_inodes / n;
+	uint32_t avg_blocks = fs->sb->free_blocks / n;
+
+	if (parent == VSFS_ROOT_INO) {
+		// Spread top-level directories (which are likely to be unrelated)
+		// over the groups with more free space than average, preferring
+		// the ones with the fewest directories
+		uint32_t best_dirs = UINT32_MAX;
+		for (uint32_t i = 0; i < n; ++i) {
+			uint32_t g = (groups->next_top + i) % n;
+			const group_desc *desc = &groups->desc[g];
+			if (desc->free_inodes > 0 &&
+			    desc->free_inodes >= avg_inodes &&
+			    desc->free_blocks >= avg_blocks &&
+			    desc->dirs < best_dirs) {
+				best_dirs = desc->dirs;
+				*group = g;
+			}
+		}
+		if (best_dirs != UINT32_MAX) {
+			groups->next_top = (*group + 1) % n;
+			return true;
+		}
+	} else {
+		// Keep subdirectories with their parent, unless its group already
+		// has too many directories or too little free space
+		uint32_t ndirs = 0;
+		for (uint32_t g = 0; g < n; ++g) {
+			ndirs += groups->desc[g].dirs;
+		}
+		uint32_t max_dirs = ndirs / n + groups->inodes_per_group / 16;
+		uint32_t ireserve = groups->inodes_per_group / 4;
+		uint32_t breserve = groups->blocks_per_group / 4;
+		uint32_t min_inodes = avg_inodes > ireserve ? avg_inodes - ireserve
+		                                            : 1;
+		uint32_t min_blocks = avg_blocks > breserve ? avg_blocks - breserve
+		                                            : 1;
+		for (uint32_t i = 0; i < n; ++i) {
+			uint32_t g = (parent_group + i) % n;
+			const group_desc *desc = &groups->desc[g];
+			if (desc->dirs < max_dirs &&
+			    desc->free_inodes >= min_inodes &&
+			    desc->free_blocks >= min_blocks) {
+				*group = g;
+				return true;
+			}
+		}
+	}
+
+	// Any group with an average number of free inodes, then any at all
+	return find_group(groups, parent_group, avg_inodes, 0, group) ||
+	       find_group(groups, parent_group, 1, 0, group);
+}
+
+/** Choose the group for a new file: the one of its parent if possible. */
+static bool find_group_file(fs_ctx *fs, vsfs_ino_t parent, uint32_t *group)
+{
+	block_groups *groups = fs->groups;
+	uint32_t parent_group = parent / groups->inodes_per_group;
+
+	return find_group(groups, parent_group, 1, 1, group) ||
+	       find_group(groups, parent_group, 1, 0, group);
+}
+
+bool group_alloc_inode(fs_ctx *fs, vsfs_ino_t parent, bool dir,
+                       vsfs_ino_t *ino)
+{
+	uint32_t g;
+	if (!(dir ? find_group_dir(fs, parent, &g)
+	          : find_group_file(fs, parent, &g))) {
+		return false;
+	}
+
+	vsfs_ino_t start, end;
+	group_inodes(fs, g, &start, &end);
+	return bitmap_alloc_range(fs->ibmap, fs->sb->num_inodes, start, end,
+	                          ino) == 0;
+}
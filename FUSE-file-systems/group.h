@@ -0,0 +1,127 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+/**
+ * CSC369 Assignment 4 - Block groups and locality-aware allocation.
+ *
+ * The groups are described in vsfs.h. Their free inode, free block and
+ * directory counts are not stored on disk; they are rebuilt from the bitmaps
+ * and the inode table at mount time and kept up to date by inode_alloc(),
+ * inode_free(), block_alloc() and block_put().
+ *
+ * Inodes are placed with a simplified version of the Orlov allocator of ext2:
+ * top-level directories are spread across the groups that have more free
+ * inodes and blocks than average, choosing the one with the fewest
+ * directories; other directories stay in the group of their parent unless it
+ * is crowded; files go to the group of their parent directory. Data blocks are
+ * allocated at or after a goal block (usually the block that follows the
+ * previous block of the file, or the start of the group of the inode), in the
+ * same group if possible.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "fs_ctx.h"
+#include "vsfs.h"
+
+
+/** Block group counters. */
+typedef struct group_desc {
+	uint32_t free_inodes;
+	uint32_t free_blocks;
+	/** Number of allocated directory inodes. */
+	uint32_t dirs;
+} group_desc;
+
+/** Block group state. */
+typedef struct block_groups {
+	/** Number of groups. */
+	uint32_t count;
+	vsfs_blk_t blocks_per_group;
+	uint32_t inodes_per_group;
+	/** Group to start the search for the next top-level directory from. */
+	uint32_t next_top;
+	/** Counters of each group. */
+	group_desc desc[];
+} block_groups;
+
+/**
+ * Validate the group geometry in the superblock and build the group counters
+ * (allocate fs->groups). Images formatted without groups are treated as a
+ * single group.
+ *
+ * @param fs  pointer to the file system context.
+ * @return    true on success; false if the geometry is invalid or out of
+ *            memory.
+ */
+bool group_init(fs_ctx *fs);
+
+/**
+ * Account for the blocks added by growing the file system (see resize.h):
+ * extend the last group and add new groups (without inodes).
+ *
+ * @param fs          pointer to the file system context.
+ * @param old_blocks  number of blocks before growing.
+ */
+void group_grow(fs_ctx *fs, vsfs_blk_t old_blocks);
+
+/** Free fs->groups. */
+void group_destroy(fs_ctx *fs);
+
+/** Get the counters of the group that contains a block. */
+static inline group_desc *block_group(fs_ctx *fs, vsfs_blk_t blk)
+{
+	return &fs->groups->desc[blk / fs->groups->blocks_per_group];
+}
+
+/** Get the counters of the group that contains an inode. */
+static inline group_desc *inode_group(fs_ctx *fs, vsfs_ino_t ino)
+{
+	return &fs->groups->desc[ino / fs->groups->inodes_per_group];
+}
+
+/**
+ * Get the first data block of the group that contains an inode; used as the
+ * allocation goal for the first block of a file.
+ */
+vsfs_blk_t group_first_block(fs_ctx *fs, vsfs_ino_t ino);
+
+/**
+ * Allocate a block in the data bitmap as close after the goal as possible:
+ * in the goal's group first, then in the following groups. Used by
+ * block_alloc(), which updates the counters.
+ *
+ * @param fs    pointer to the file system context.
+ * @param goal  preferred block number; 0 if there is no preference.
+ * @param blk   pointer to the variable that receives the block number.
+ * @return      true on success; false if there are no free blocks.
+ */
+bool group_alloc_block(fs_ctx *fs, vsfs_blk_t goal, vsfs_blk_t *blk);
+
+/**
+ * Allocate an inode in the inode bitmap in the group chosen for a new file or
+ * directory in the parent directory. Used by inode_alloc(), which updates the
+ * counters.
+ *
+ * @param fs      pointer to the file system context.
+ * @param parent  inode number of the parent directory.
+ * @param dir     true if the new inode is a directory.
+ * @param ino     pointer to the variable that receives the inode number.
+ * @return        true on success; false if there are no free inodes.
+ */
+bool group_alloc_inode(fs_ctx *fs, vsfs_ino_t parent, bool dir,
+                       vsfs_ino_t *ino);
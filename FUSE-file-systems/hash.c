@@ -0,0 +1,118 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+/**
+ * CSC369 Assignment 4 - Fast non-cryptographic hash of block contents.
+ *
+ * This is the XXH64 algorithm by Yann Collet (see the xxHash specification).
+ */
+
+#include <string.h>
+
+#include "hash.h"
+
+static const uint64_t prime1 = 0x9E3779B185EBCA87ull;
+static const uint64_t prime2 = 0xC2B2AE3D27D4EB4Full;
+static const uint64_t prime3 = 0x165667B19E3779F9ull;
+static const uint64_t prime4 = 0x85EBCA77C2B2AE63ull;
+static const uint64_t prime5 = 0x27D4EB2F165667C5ull;
+
+
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+// Unaligned little-endian loads
+static inline uint64_t read64(const uint8_t *p)
+{
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint32_t read32(const uint8_t *p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint64_t xxh64_round(uint64_t acc, uint64_t input)
+{
+	acc += input * prime2;
+	acc = rotl64(acc, 31);
+	return acc * prime1;
+}
+
+static inline uint64_t xxh64_merge(uint64_t acc, uint64_t val)
+{
+	acc ^= xxh64_round(0, val);
+	return acc * prime1 + prime4;
+}
+
+uint64_t xxh64(const void *data, size_t len, uint64_t seed)
+{
+	const uint8_t *p = (const uint8_t *)data;
+	const uint8_t *end = p + len;
+	uint64_t h;
+
+	if (len >= 32) {
+		uint64_t v1 = seed + prime1 + prime2;
+		uint64_t v2 = seed + prime2;
+		uint64_t v3 = seed;
+		uint64_t v4 = seed - prime1;
+
+		// Four independent lanes per 32-byte stripe
+		do {
+			v1 = xxh64_round(v1, read64(p));
+			v2 = xxh64_round(v2, read64(p + 8));
+			v3 = xxh64_round(v3, read64(p + 16));
+			v4 = xxh64_round(v4, read64(p + 24));
+			p += 32;
+		} while (p + 32 <= end);
+
+		h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) +
+		    rotl64(v4, 18);
+		h = xxh64_merge(h, v1);
+		h = xxh64_merge(h, v2);
+		h = xxh64_merge(h, v3);
+		h = xxh64_merge(h, v4);
+	} else {
+		h = seed + prime5;
+	}
+	h += len;
+
+	for (; p + 8 <= end; p += 8) {
+		h ^= xxh64_round(0, read64(p));
+		h = rotl64(h, 27) * prime1 + prime4;
+	}
+	if (p + 4 <= end) {
+		h ^= (uint64_t)read32(p) * prime1;
+		h = rotl64(h, 23) * prime2 + prime3;
+		p += 4;
+	}
+	for (; p < end; ++p) {
+		h ^= *p * prime5;
+		h = rotl64(h, 11) * prime1;
+	}
+
+	// Final avalanche
+	h ^= h >> 33;
+	h *= prime2;
+	h ^= h >> 29;
+	h *= prime3;
+	h ^= h >> 32;
+	return h;
+}
@@ -0,0 +1,36 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+/**
+ * CSC369 Assignment 4 - Fast non-cryptographic hash of block contents.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/**
+ * Compute the 64-bit xxHash (XXH64) of a buffer.
+ *
+ * The main loop keeps four independent accumulators, so the multiplications of
+ * consecutive 8-byte lanes execute in parallel.
+ *
+ * @param data  pointer to the data.
+ * @param len   data length in bytes.
+ * @param seed  hash seed.
+ * @return      hash value.
+ */
+uint64_t xxh64(const void *data, size_t len, uint64_t seed);
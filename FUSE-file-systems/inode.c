@@ -0,0 +1,431 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+/**
+ * CSC369 Assignment 4 - Inode block map helpers.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "acache.h"
+#include "bitmap.h"
+#include "compress.h"
+#include "csum.h"
+#include "dedup.h"
+#include "group.h"
+#include "inode.h"
+#include "itable.h"
+#include "refcount.h"
+#include "tail.h"
+#include "xattr.h"
+
+
+/** Get a pointer to the indirect block of an inode. */
+static vsfs_blk_t *indirect_block(fs_ctx *fs, const vsfs_inode *inode)
+{
+	assert(inode->i_blocks > VSFS_NUM_DIRECT);
+	return (vsfs_blk_t *)block_addr(fs, inode->i_indirect);
+}
+
+vsfs_blk_t inode_get_block(fs_ctx *fs, const vsfs_inode *inode,
+                           vsfs_blk_t idx)
+{
+	assert(idx < inode->i_blocks);
+
+	if (idx < VSFS_NUM_DIRECT) {
+		return inode->i_direct[idx];
+	}
+	return indirect_block(fs, inode)[idx - VSFS_NUM_DIRECT];
+}
+
+/**
+ * Replace the block at index idx (must be less than i_blocks). A packed tail
+ * at that index becomes a regular block.
+ */
+static void inode_set_block(fs_ctx *fs, vsfs_inode *inode, vsfs_blk_t idx,
+                            vsfs_blk_t blk)
+{
+	assert(idx < inode->i_blocks);
+
+	if (tail_is_packed(inode, idx)) {
+		inode->i_flags &= ~VSFS_INODE_TAIL;
+		inode->i_tail_off = 0;
+	}
+
+	if (idx < VSFS_NUM_DIRECT) {
+		inode->i_direct[idx] = blk;
+	} else {
+		csum_mark_dirty(fs, inode->i_indirect);
+		indirect_block(fs, inode)[idx - VSFS_NUM_DIRECT] = blk;
+	}
+}
+
+vsfs_blk_t inode_goal(fs_ctx *fs, const vsfs_inode *inode, vsfs_blk_t idx)
+{
+	assert(inode >= fs->itable && inode < fs->itable + fs->sb->num_inodes);
+
+	// Entries of compressed clusters may be 0
+	for (vsfs_blk_t i = idx < inode->i_blocks ? idx : inode->i_blocks;
+	     i > 0; --i) {
+		vsfs_blk_t prev = inode_get_block(fs, inode, i - 1);
+		if (prev != 0) {
+			return prev + 1;
+		}
+	}
+	return group_first_block(fs, inode - fs->itable);
+}
+
+int inode_append_block(fs_ctx *fs, vsfs_inode *inode, vsfs_blk_t blk)
+{
+	vsfs_blk_t idx = inode->i_blocks;
+
+	if (idx >= vsfs_max_file_blocks(fs->block_size)) {
+		return -EFBIG;
+	}
+	if (idx == VSFS_NUM_DIRECT) {
+		// First block that goes through the indirect block
+		int ret = block_alloc(fs, inode_goal(fs, inode, idx),
+		                      &inode->i_indirect);
+		if (ret != 0) {
+			return ret;
+		}
+	}
+
+	inode->i_blocks++;
+	inode_set_block(fs, inode, idx, blk);
+	acache_update(fs, inode);
+	return 0;
+}
+
+/** Remove the last block from the block map and drop its reference. */
+static void inode_remove_last_block(fs_ctx *fs, vsfs_inode *inode)
+{
+	assert(inode->i_blocks > 0);
+
+	vsfs_blk_t blk = inode_get_block(fs, inode, inode->i_blocks - 1);
+	if (blk != 0) {
+		block_put(fs, blk);
+	}
+	if (inode->i_flags & VSFS_INODE_TAIL) {
+		inode->i_flags &= ~VSFS_INODE_TAIL;
+		inode->i_tail_off = 0;
+	}
+	inode->i_blocks--;
+	if (inode->i_blocks == VSFS_NUM_DIRECT) {
+		// The indirect block is no longer used
+		block_put(fs, inode->i_indirect);
+		inode->i_indirect = 0;
+	}
+	acache_update(fs, inode);
+}
+
+void inode_replace_block(fs_ctx *fs, vsfs_inode *inode, vsfs_blk_t idx,
+                         vsfs_blk_t blk)
+{
+	vsfs_blk_t old = inode_get_block(fs, inode, idx);
+
+	inode_set_block(fs, inode, idx, blk);
+	if (old != 0) {
+		block_put(fs, old);
+	}
+}
+
+int inode_write_block(fs_ctx *fs, vsfs_inode *inode, vsfs_blk_t idx,
+                      vsfs_blk_t *blk)
+{
+	if (tail_is_packed(inode, idx)) {
+		// Packed tails are never modified in place
+		return tail_unpack(fs, inode, blk);
+	}
+
+	vsfs_blk_t old = inode_get_block(fs, inode, idx);
+	assert(old != 0);
+
+	// A shared block is replaced with a private copy to break the sharing.
+	// In log mode, every block is: the new contents go to the log head. An
+	// unshared block is modified in place if there's no space for the copy.
+	if (rc_get(fs, old) > 1 || fs->lfs != NULL) {
+		vsfs_blk_t copy;
+		int ret = block_alloc(fs, inode_goal(fs, inode, idx), &copy);
+		if (ret == 0) {
+			memcpy(block_addr(fs, copy), block_addr(fs, old),
+			       fs->block_size);
+			inode_set_block(fs, inode, idx, copy);
+			block_put(fs, old);
+			*blk = copy;
+			return 0;
+		}
+		if (rc_get(fs, old) > 1) {
+			return ret;
+		}
+	}
+
+	// The contents are about to change
+	if (fs->dedup != NULL) {
+		dedup_forget(fs, old);
+	}
+	compress_forget(fs, old);
+	csum_mark_dirty(fs, old);
+	*blk = old;
+	return 0;
+}
+
+int inode_resize(fs_ctx *fs, vsfs_inode *inode, uint64_t size)
+{
+	return inode_extend(fs, inode, size, size);
+}
+
+int inode_extend(fs_ctx *fs, vsfs_inode *inode, uint64_t size,
+                 uint64_t zero_end)
+{
+	uint64_t max_size = (uint64_t)vsfs_max_file_blocks(fs->block_size)
+	                    << fs->block_shift;
+	if (size > max_size) {
+		return -EFBIG;
+	}
+
+	vsfs_blk_t nblocks = (size + fs->block_size - 1) / fs->block_size;
+	vsfs_blk_t old_blocks = inode->i_blocks;
+	uint32_t tail = inode->i_size % fs->block_size;
+
+	if (nblocks < old_blocks && nblocks % VSFS_CLUSTER_BLOCKS != 0) {
+		// A compressed cluster can't lose only some of its blocks
+		int ret = compress_inflate(fs, inode,
+		                           nblocks / VSFS_CLUSTER_BLOCKS);
+		if (ret != 0) {
+			return ret;
+		}
+	}
+
+	if (size > inode->i_size && tail != 0) {
+		// The last block may contain stale data past the old EOF (e.g.
+		// after shrinking); the part that becomes part of the file is
+		// zeroed. It is made writable even if nothing is zeroed, so that
+		// writing the rest of the range can't fail.
+		uint64_t end = (uint64_t)old_blocks << fs->block_shift;
+		if (end > zero_end) {
+			end = zero_end;
+		}
+		vsfs_blk_t blk;
+		int ret = compress_inflate(fs, inode,
+		                           (old_blocks - 1) / VSFS_CLUSTER_BLOCKS);
+		if (ret == 0) {
+			ret = inode_write_block(fs, inode, old_blocks - 1, &blk);
+		}
+		if (ret != 0) {
+			return ret;
+		}
+		if (end > inode->i_size) {
+			memset(block_addr(fs, blk) + tail, 0, end - inode->i_size);
+		}
+	}
+
+	while (inode->i_blocks < nblocks) {
+		vsfs_blk_t blk;
+		int ret = block_alloc(fs, inode_goal(fs, inode, inode->i_blocks),
+		                      &blk);
+		if (ret == 0) {
+			uint64_t start = (uint64_t)inode->i_blocks
+			                 << fs->block_shift;
+			if (start < zero_end) {
+				memset(block_addr(fs, blk), 0,
+				       zero_end - start < fs->block_size ?
+				       zero_end - start : fs->block_size);
+			}
+			ret = inode_append_block(fs, inode, blk);
+			if (ret != 0) {
+				block_put(fs, blk);
+			}
+		}
+		if (ret != 0) {
+			// Roll back the blocks allocated so far
+			while (inode->i_blocks > old_blocks) {
+				inode_remove_last_block(fs, inode);
+			}
+			return ret;
+		}
+	}
+	while (inode->i_blocks > nblocks) {
+		inode_remove_last_block(fs, inode);
+	}
+
+	inode->i_size = size;
+	acache_update(fs, inode);
+	return 0;
+}
+
+int inode_clone_blocks(fs_ctx *fs, vsfs_inode *dst, vsfs_blk_t dst_idx,
+                       const vsfs_inode *src, vsfs_blk_t src_idx,
+                       vsfs_blk_t count)
+{
+	assert(dst != src);
+	assert(dst_idx <= dst->i_blocks);
+	assert(src_idx + count <= src->i_blocks);
+
+	for (vsfs_blk_t i = 0; i < count; ++i) {
+		vsfs_blk_t blk = inode_get_block(fs, src, src_idx + i);
+		vsfs_blk_t idx = dst_idx + i;
+		bool packed = tail_is_packed(src, src_idx + i);
+
+		if (blk != 0 && !block_ref(fs, blk)) {
+			// Too many references to this block - copy it instead
+			vsfs_blk_t copy;
+			int ret = block_alloc(fs, inode_goal(fs, dst, idx),
+			                      &copy);
+			if (ret != 0) {
+				return ret;
+			}
+			if (packed) {
+				// Only the tail is copied, to the start
+				uint32_t len = tail_length(fs, src);
+				memcpy(block_addr(fs, copy), block_addr(fs, blk)
+				       + src->i_tail_off, len);
+				memset(block_addr(fs, copy) + len, 0,
+				       fs->block_size - len);
+				packed = false;
+			} else {
+				memcpy(block_addr(fs, copy), block_addr(fs, blk),
+				       fs->block_size);
+			}
+			blk = copy;
+		}
+
+		if (idx < dst->i_blocks) {
+			inode_replace_block(fs, dst, idx, blk);
+		} else {
+			int ret = inode_append_block(fs, dst, blk);
+			if (ret != 0) {
+				if (blk != 0) {
+					block_put(fs, blk);
+				}
+				return ret;
+			}
+		}
+		if (packed) {
+			// A packed tail can only be cloned as the last block
+			assert(idx + 1 == dst->i_blocks);
+			dst->i_flags |= VSFS_INODE_TAIL;
+			dst->i_tail_off = src->i_tail_off;
+		}
+	}
+	return 0;
+}
+
+/** Make a block pointer refer to the new location of a relocated block. */
+static bool remap(vsfs_blk_t *ptr, const vsfs_blk_t *fwd)
+{
+	if (*ptr != 0 && fwd[*ptr] != 0) {
+		*ptr = fwd[*ptr];
+		return true;
+	}
+	return false;
+}
+
+int inode_relocate_blocks(fs_ctx *fs, const vsfs_blk_t *from,
+                          const vsfs_blk_t *to, vsfs_blk_t count)
+{
+	// New location of each block; 0 if it is not relocated
+	vsfs_blk_t *fwd = calloc(fs->sb->num_blocks, sizeof(*fwd));
+	if (fwd == NULL) {
+		return -ENOMEM;
+	}
+	for (vsfs_blk_t i = 0; i < count; ++i) {
+		assert(rc_get(fs, from[i]) > 0 && rc_get(fs, to[i]) == 1);
+		memcpy(block_addr(fs, to[i]), block_addr(fs, from[i]),
+		       fs->block_size);
+		fwd[from[i]] = to[i];
+	}
+
+	for (vsfs_ino_t ino = 0; ino < fs->sb->num_inodes; ++ino) {
+		if (!bitmap_isset(fs->ibmap, fs->sb->num_inodes, ino)) {
+			continue;
+		}
+		if (fs->xattrtable != NULL) {
+			remap(&fs->xattrtable[ino], fwd);
+		}
+		vsfs_inode *inode = &fs->itable[ino];
+		vsfs_blk_t ndirect = inode->i_blocks < VSFS_NUM_DIRECT ?
+		                     inode->i_blocks : VSFS_NUM_DIRECT;
+		for (vsfs_blk_t idx = 0; idx < ndirect; ++idx) {
+			remap(&inode->i_direct[idx], fwd);
+		}
+		if (inode->i_blocks <= VSFS_NUM_DIRECT) {
+			continue;
+		}
+		// The indirect block is moved first, so that the entries are
+		// updated in the new copy
+		remap(&inode->i_indirect, fwd);
+		vsfs_blk_t *entries = indirect_block(fs, inode);
+		for (vsfs_blk_t idx = VSFS_NUM_DIRECT; idx < inode->i_blocks;
+		     ++idx) {
+			if (remap(&entries[idx - VSFS_NUM_DIRECT], fwd)) {
+				csum_mark_dirty(fs, inode->i_indirect);
+			}
+		}
+	}
+	// New tails still go to the tail block at its new location
+	remap(&fs->tail_blk, fwd);
+	free(fwd);
+
+	// The new blocks take over the references of the old ones
+	for (vsfs_blk_t i = 0; i < count; ++i) {
+		fs->rctable[to[i]] = fs->rctable[from[i]];
+		fs->rctable[from[i]] = 1;
+		block_put(fs, from[i]);
+	}
+	return 0;
+}
+
+int inode_alloc(fs_ctx *fs, mode_t mode, vsfs_ino_t parent, vsfs_ino_t *ino)
+{
+	if (!group_alloc_inode(fs, parent, S_ISDIR(mode), ino)) {
+		return -ENOSPC;
+	}
+	fs->sb->free_inodes--;
+	group_desc *group = inode_group(fs, *ino);
+	group->free_inodes--;
+	if (S_ISDIR(mode)) {
+		group->dirs++;
+	}
+
+	itable_prepare(fs, *ino);
+	vsfs_inode *inode = &fs->itable[*ino];
+	memset(inode, 0, sizeof(*inode));
+	inode->i_mode = mode;
+	inode->i_nlink = 1;
+	clock_gettime(CLOCK_REALTIME, &inode->i_mtime);
+	acache_update(fs, inode);
+	return 0;
+}
+
+void inode_free(fs_ctx *fs, vsfs_ino_t ino)
+{
+	vsfs_inode *inode = &fs->itable[ino];
+
+	int ret = inode_resize(fs, inode, 0);
+	assert(ret == 0);// shrinking never fails
+	(void)ret;
+	xattr_release(fs, ino);
+
+	bitmap_free(fs->ibmap, fs->sb->num_inodes, ino);
+	fs->sb->free_inodes++;
+	group_desc *group = inode_group(fs, ino);
+	group->free_inodes++;
+	if (S_ISDIR(inode->i_mode)) {
+		group->dirs--;
+	}
+}
@@ -0,0 +1,183 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+/**
+ * CSC369 Assignment 4 - Inode block map helpers.
+ *
+ * A file with i_blocks blocks uses i_direct[] for the first VSFS_NUM_DIRECT
+ * blocks; the i_indirect block is allocated only while i_blocks is larger than
+ * VSFS_NUM_DIRECT. Every block in the map holds a reference (see refcount.h),
+ * except for the 0 entries of compressed clusters (see compress.h).
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "fs_ctx.h"
+#include "vsfs.h"
+
+
+/**
+ * Get the physical block number of a file block.
+ *
+ * @param fs     pointer to the file system context.
+ * @param inode  pointer to the inode.
+ * @param idx    file block index; must be less than inode->i_blocks.
+ * @return       block number.
+ */
+vsfs_blk_t inode_get_block(fs_ctx *fs, const vsfs_inode *inode,
+                           vsfs_blk_t idx);
+
+/**
+ * Get the allocation goal for file block idx (see block_alloc()): the block
+ * after the closest preceding block of the file, or the first data block of
+ * the block group of the inode if there is none.
+ *
+ * @param fs     pointer to the file system context.
+ * @param inode  pointer to the inode in the inode table.
+ * @param idx    file block index; may be equal to inode->i_blocks.
+ * @return       goal block number.
+ */
+vsfs_blk_t inode_goal(fs_ctx *fs, const vsfs_inode *inode, vsfs_blk_t idx);
+
+/**
+ * Append a block to the block map of an inode, allocating the indirect block
+ * if needed. The reference held by the caller is transferred to the inode.
+ *
+ * @param fs     pointer to the file system context.
+ * @param inode  pointer to the inode.
+ * @param blk    block number.
+ * @return       0 on success; -EFBIG if the file is already at the maximum
+ *               size; -ENOSPC if the indirect block can't be allocated.
+ */
+int inode_append_block(fs_ctx *fs, vsfs_inode *inode, vsfs_blk_t blk);
+
+/**
+ * Replace a file block with another block and drop the reference to the old
+ * one. The reference held by the caller is transferred to the inode. Either
+ * block may be 0 (an unused entry of a compressed cluster).
+ *
+ * @param fs     pointer to the file system context.
+ * @param inode  pointer to the inode.
+ * @param idx    file block index; must be less than inode->i_blocks.
+ * @param blk    new block number.
+ */
+void inode_replace_block(fs_ctx *fs, vsfs_inode *inode, vsfs_blk_t idx,
+                         vsfs_blk_t blk);
+
+/**
+ * Get a file block for writing. If the block is shared with other files, it
+ * is replaced with a private copy first (copy-on-write). In log mode (see
+ * lfs.h), any block is replaced with a copy at the log head if there is space.
+ * The block must not be part of a compressed cluster (see compress_inflate()).
+ *
+ * @param fs     pointer to the file system context.
+ * @param inode  pointer to the inode.
+ * @param idx    file block index; must be less than inode->i_blocks.
+ * @param blk    pointer to the variable that receives the block number.
+ * @return       0 on success; -ENOSPC if the copy can't be allocated.
+ */
+int inode_write_block(fs_ctx *fs, vsfs_inode *inode, vsfs_blk_t idx,
+                      vsfs_blk_t *blk);
+
+/**
+ * Change the size of a file. New blocks are allocated and filled with zeros
+ * up to the new end of file when growing (the rest of the last block is
+ * undefined, like any data past the end of file); blocks past the new end of
+ * file are released when shrinking.
+ * A compressed cluster that ends up partially past the end of file (or holds
+ * the old end of file when growing) is expanded first. The size is left
+ * unchanged on failure. Shrinking to a multiple of the cluster size (e.g. 0)
+ * never fails.
+ *
+ * @param fs     pointer to the file system context.
+ * @param inode  pointer to the inode.
+ * @param size   new size in bytes.
+ * @return       0 on success; -EFBIG if size exceeds the maximum file size;
+ *               -ENOSPC if there is not enough free space.
+ */
+int inode_resize(fs_ctx *fs, vsfs_inode *inode, uint64_t size);
+
+/**
+ * Grow a file for a write that ends at the new size. Same as inode_resize(),
+ * except that only the new range before zero_end is filled with zeros: an
+ * append writes the rest right away, so its cost depends on the length of the
+ * data and not on the block size. The caller must not leave any of the range
+ * [zero_end, size) unwritten.
+ *
+ * @param fs        pointer to the file system context.
+ * @param inode     pointer to the inode.
+ * @param size      new size in bytes.
+ * @param zero_end  end of the range to zero-fill; at most size.
+ * @return          0 on success; -errno on error (see inode_resize()).
+ */
+int inode_extend(fs_ctx *fs, vsfs_inode *inode, uint64_t size,
+                 uint64_t zero_end);
+
+/**
+ * Share a range of blocks of one file with another file (reflink). Blocks of
+ * dst in the range are replaced; dst grows as needed, in which case dst_idx
+ * may be at most dst->i_blocks. The sizes of the files are not changed.
+ * Compressed clusters must not be split by the range; the caller expands them
+ * first if needed (see compress_inflate()).
+ *
+ * @param fs       pointer to the file system context.
+ * @param dst      pointer to the destination inode.
+ * @param dst_idx  first destination block index.
+ * @param src      pointer to the source inode; must differ from dst.
+ * @param src_idx  first source block index.
+ * @param count    number of blocks; src_idx + count <= src->i_blocks.
+ * @return         0 on success; -errno on error.
+ */
+int inode_clone_blocks(fs_ctx *fs, vsfs_inode *dst, vsfs_blk_t dst_idx,
+                       const vsfs_inode *src, vsfs_blk_t src_idx,
+                       vsfs_blk_t count);
+
+/**
+ * Move blocks to new locations: copy the contents of each block from[i] to
+ * to[i] and make every block pointer of every inode (including the indirect
+ * block pointers) that refers to from[i] refer to to[i] instead. Each to[i]
+ * must be freshly allocated with block_alloc(); it takes over the reference
+ * count of from[i], which is freed.
+ *
+ * @param fs     pointer to the file system context.
+ * @param from   blocks to move; must be data blocks with references.
+ * @param to     new locations.
+ * @param count  number of blocks.
+ * @return       0 on success; -ENOMEM if out of memory (nothing is moved).
+ */
+int inode_relocate_blocks(fs_ctx *fs, const vsfs_blk_t *from,
+                          const vsfs_blk_t *to, vsfs_blk_t count);
+
+/**
+ * Allocate and initialize an inode: no blocks, a link count of 1 and the
+ * current time as mtime. The inode is placed in a block group chosen for the
+ * parent directory (see group_alloc_inode()).
+ *
+ * @param fs      pointer to the file system context.
+ * @param mode    file mode.
+ * @param parent  inode number of the parent directory.
+ * @param ino     pointer to the variable that receives the inode number.
+ * @return        0 on success; -ENOSPC if there are no free inodes.
+ */
+int inode_alloc(fs_ctx *fs, mode_t mode, vsfs_ino_t parent, vsfs_ino_t *ino);
+
+/**
+ * Release all blocks of an inode and free it.
+ *
+ * @param fs   pointer to the file system context.
+ * @param ino  inode number.
+ */
+void inode_free(fs_ctx *fs, vsfs_ino_t ino);
@@ -0,0 +1,120 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+/**
+ * CSC369 Assignment 4 - Lazy inode table initialization.
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "itable.h"
+#include "refcount.h"
+
+/** Number of inode table blocks initialized at a time by the thread. */
+#define ITABLE_INIT_BATCH 16
+
+/** Background initialization thread state. */
+typedef struct itable_initializer {
+	pthread_t thread;
+	/** Set when the thread must stop. */
+	bool stop;
+} itable_initializer;
+
+
+/**
+ * Zero the next count blocks of the inode table that are not initialized.
+ * Returns false if the whole table is initialized now.
+ */
+static bool zero_blocks(fs_ctx *fs, uint32_t count)
+{
+	uint32_t init = fs->sb->itable_init;
+	uint32_t total = itable_blocks(fs);
+	if (init == 0 || init == total) {
+		return false;
+	}
+
+	uint32_t end = total - init > count ? init + count : total;
+	// Blocks before the data region are metadata; their checksums are
+	// recomputed on every commit
+	memset(block_addr(fs, VSFS_ITBL_BLKNUM + init), 0,
+	       (size_t)(end - init) * fs->block_size);
+	fs->sb->itable_init = end;
+	return end < total;
+}
+
+void itable_prepare(fs_ctx *fs, vsfs_ino_t ino)
+{
+	uint32_t blk = ino / vsfs_inodes_per_block(fs->block_size);
+	uint32_t init = fs->sb->itable_init;
+
+	if (init != 0 && blk >= init) {
+		zero_blocks(fs, blk + 1 - init);
+	}
+}
+
+
+/** Background initialization thread body. */
+static void *initializer_main(void *arg)
+{
+	fs_ctx *fs = (fs_ctx *)arg;
+	itable_initializer *it = fs->itinit;
+
+	pthread_mutex_lock(&fs->lock);
+	while (!it->stop && zero_blocks(fs, ITABLE_INIT_BATCH)) {
+		// Let the file system operations in between batches
+		pthread_mutex_unlock(&fs->lock);
+		pthread_mutex_lock(&fs->lock);
+	}
+	pthread_mutex_unlock(&fs->lock);
+	return NULL;
+}
+
+bool itable_init_start(fs_ctx *fs)
+{
+	assert(fs->itinit == NULL);
+	uint32_t init = fs->sb->itable_init;
+	if (init == 0 || init == itable_blocks(fs)) {
+		return true;
+	}
+
+	itable_initializer *it = calloc(1, sizeof(*it));
+	if (it == NULL) {
+		return false;
+	}
+	fs->itinit = it;
+	if (pthread_create(&it->thread, NULL, initializer_main, fs) != 0) {
+		fs->itinit = NULL;
+		free(it);
+		return false;
+	}
+	return true;
+}
+
+void itable_init_stop(fs_ctx *fs)
+{
+	itable_initializer *it = fs->itinit;
+	if (it == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&fs->lock);
+	it->stop = true;
+	pthread_mutex_unlock(&fs->lock);
+	pthread_join(it->thread, NULL);
+	free(it);
+	fs->itinit = NULL;
+}
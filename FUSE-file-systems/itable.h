@@ -0,0 +1,71 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+/**
+ * CSC369 Assignment 4 - Lazy inode table initialization.
+ *
+ * mkfs.vsfs only zeroes the start of the inode table (see itable_init in
+ * vsfs.h). The rest is initialized in order: up to the block of an inode when
+ * the inode is allocated, and by a background thread in small batches while
+ * the file system is mounted, so that formatting doesn't have to write the
+ * whole table and an idle file system still completes it soon after mount.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "fs_ctx.h"
+#include "vsfs.h"
+
+
+/** Number of blocks in the inode table. */
+static inline uint32_t itable_blocks(const fs_ctx *fs)
+{
+	return fs->sb->rc_region - VSFS_ITBL_BLKNUM;
+}
+
+/**
+ * Check if a metadata block has been initialized: true for every block except
+ * the inode table blocks past itable_init. The contents and checksums of the
+ * blocks that are not initialized are meaningless.
+ */
+static inline bool itable_block_ready(const fs_ctx *fs, vsfs_blk_t blk)
+{
+	uint32_t init = fs->sb->itable_init;
+	return init == 0 || blk < VSFS_ITBL_BLKNUM + init ||
+	       blk >= fs->sb->rc_region;
+}
+
+/**
+ * Make sure that the inode table block that holds an inode is initialized,
+ * zeroing all the blocks before it that are not. Used by inode_alloc().
+ *
+ * @param fs   pointer to the file system context.
+ * @param ino  inode number.
+ */
+void itable_prepare(fs_ctx *fs, vsfs_ino_t ino);
+
+/**
+ * Start the background thread that initializes the rest of the inode table;
+ * does nothing if the table is already initialized. The thread exits when it
+ * is done.
+ *
+ * @param fs  pointer to the file system context.
+ * @return    true on success; false if the thread could not be created.
+ */
+bool itable_init_start(fs_ctx *fs);
+
+/** Stop the background initialization thread; does nothing if not started. */
+void itable_init_stop(fs_ctx *fs);
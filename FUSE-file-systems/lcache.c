@@ -0,0 +1,131 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+
+/**
+ * CSC369 Assignment 4 - Path lookup cache.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash.h"
+#include "lcache.h"
+
+/** Number of sets; a power of 2. */
+#define LCACHE_SETS 128
+/** Number of entries in a set. */
+#define LCACHE_WAYS 4
+
+
+/** Cached path. */
+typedef struct lcache_entry {
+	/** Hash of the path; the entry is empty if path[0] is 0. */
+	uint64_t hash;
+	/** Value of lookup_cache.clock when the entry was last used. */
+	uint64_t used;
+	vsfs_ino_t ino;
+	char path[VSFS_PATH_MAX];
+} lcache_entry;
+
+/** Path lookup cache. */
+typedef struct lookup_cache {
+	/** Incremented on every hit and insertion. */
+	uint64_t clock;
+	lcache_entry sets[LCACHE_SETS][LCACHE_WAYS];
+} lookup_cache;
+
+
+/** Get the set of a path with the given hash. */
+static lcache_entry *get_set(lookup_cache *cache, uint64_t hash)
+{
+	return cache->sets[hash & (LCACHE_SETS - 1)];
+}
+
+bool lcache_find(fs_ctx *fs, const char *path, vsfs_ino_t *ino)
+{
+	lookup_cache *cache = fs->lcache;
+	if (cache == NULL) {
+		return false;
+	}
+
+	size_t len = strlen(path);
+	uint64_t hash = xxh64(path, len, 0);
+	lcache_entry *set = get_set(cache, hash);
+	for (unsigned int w = 0; w < LCACHE_WAYS; ++w) {
+		if (set[w].hash == hash && memcmp(set[w].path, path, len + 1) == 0) {
+			set[w].used = ++cache->clock;
+			*ino = set[w].ino;
+			return true;
+		}
+	}
+	return false;
+}
+
+void lcache_insert(fs_ctx *fs, const char *path, vsfs_ino_t ino)
+{
+	if (fs->lcache == NULL) {
+		fs->lcache = calloc(1, sizeof(*fs->lcache));
+		if (fs->lcache == NULL) {
+			return;
+		}
+	}
+	lookup_cache *cache = fs->lcache;
+
+	size_t len = strlen(path);
+	assert(len < VSFS_PATH_MAX);
+	uint64_t hash = xxh64(path, len, 0);
+	lcache_entry *set = get_set(cache, hash);
+
+	// Empty entries have never been used, so they are the least recent
+	lcache_entry *victim = &set[0];
+	for (unsigned int w = 1; w < LCACHE_WAYS; ++w) {
+		if (set[w].used < victim->used) {
+			victim = &set[w];
+		}
+	}
+	victim->hash = hash;
+	victim->used = ++cache->clock;
+	victim->ino = ino;
+	memcpy(victim->path, path, len + 1);
+}
+
+void lcache_forget(fs_ctx *fs, vsfs_ino_t ino)
+{
+	lookup_cache *cache = fs->lcache;
+	if (cache == NULL) {
+		return;
+	}
+	for (unsigned int s = 0; s < LCACHE_SETS; ++s) {
+		for (unsigned int w = 0; w < LCACHE_WAYS; ++w) {
+			lcache_entry *e = &cache->sets[s][w];
+			if (e->path[0] != '\0' && e->ino == ino) {
+				memset(e, 0, sizeof(*e));
+			}
+		}
+	}
+}
+
+void lcache_clear(fs_ctx *fs)
+{
+	if (fs->lcache != NULL) {
+		memset(fs->lcache, 0, sizeof(*fs->lcache));
+	}
+}
+
+void lcache_destroy(fs_ctx *fs)
+{
+	free(fs->lcache);
+	fs->lcache = NULL;
+}
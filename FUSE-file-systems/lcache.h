@@ -0,0 +1,72 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+
+/**
+ * CSC369 Assignment 4 - Path lookup cache.
+ *
+ * Every operation names its file by path, and resolving a path scans every
+ * directory on it, so repeated reads and writes of the same file in a large
+ * directory spend most of their time in directory scans. The cache maps
+ * recently resolved paths to their inode numbers. It is set-associative: a
+ * path can only be in the set picked by its hash, and the least recently used
+ * entry of the set is replaced. Only successful lookups are cached.
+ *
+ * A cached path stays valid until its directory entry is removed: removing a
+ * file forgets its inode; removing a directory (or a snapshot, which removes a
+ * whole tree) clears the cache. Creating entries, and changing the size or the
+ * blocks of a file, never invalidates it.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "fs_ctx.h"
+#include "vsfs.h"
+
+
+/**
+ * Look up a path in the cache. Must be called with fs->lock held.
+ *
+ * @param fs    pointer to the file system context.
+ * @param path  absolute path; shorter than VSFS_PATH_MAX.
+ * @param ino   pointer to the variable that receives the inode number.
+ * @return      true if the path is cached; false otherwise.
+ */
+bool lcache_find(fs_ctx *fs, const char *path, vsfs_ino_t *ino);
+
+/**
+ * Add a resolved path to the cache, replacing the least recently used entry
+ * of its set. Does nothing if the cache can't be allocated.
+ *
+ * @param fs    pointer to the file system context.
+ * @param path  absolute path; shorter than VSFS_PATH_MAX.
+ * @param ino   inode number that the path refers to.
+ */
+void lcache_insert(fs_ctx *fs, const char *path, vsfs_ino_t ino);
+
+/**
+ * Drop all the cached paths of an inode (e.g. when it is unlinked).
+ *
+ * @param fs   pointer to the file system context.
+ * @param ino  inode number.
+ */
+void lcache_forget(fs_ctx *fs, vsfs_ino_t ino);
+
+/** Drop all the cached paths. */
+void lcache_clear(fs_ctx *fs);
+
+/** Free the cache. */
+void lcache_destroy(fs_ctx *fs);
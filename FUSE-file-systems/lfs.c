@@ -0,0 +1,345 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+/**
+ * CSC369 Assignment 4 - Log-structured write mode.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "bitmap.h"
+#include "inode.h"
+#include "lfs.h"
+#include "refcount.h"
+
+/** Seconds between background cleaner passes. */
+#define LFS_CLEAN_INTERVAL 1
+
+/** Log-structured mode state. */
+typedef struct lfs {
+	/** Number of segments; the last one may be shorter. */
+	uint32_t num_segs;
+	/** Number of allocated blocks in each segment. */
+	uint16_t *live;
+	/** Number of segments with no allocated blocks. */
+	uint32_t free_segs;
+	/** Next block to allocate and the end of the current segment. */
+	vsfs_blk_t head;
+	vsfs_blk_t head_end;
+	/** Segment to start the search for the next free segment from. */
+	uint32_t next_seg;
+
+	/** The cleaner wakes up when free_segs drops below low and cleans
+	 *  until it reaches high. */
+	uint32_t low;
+	uint32_t high;
+	/** The last cleaning pass found no victim; the cleaner waits for blocks
+	 *  to be freed before it tries again. */
+	bool stuck;
+	/** Cleaner thread; only valid if running is true. */
+	pthread_t thread;
+	pthread_cond_t cond;
+	bool running;
+	bool stop;
+
+	uint64_t cleaned;
+	uint64_t moved;
+} lfs;
+
+
+/** Get the first block and the number of blocks of a segment. */
+static vsfs_blk_t seg_start(uint32_t seg)
+{
+	return seg * LFS_SEG_BLOCKS;
+}
+
+static vsfs_blk_t seg_size(const fs_ctx *fs, uint32_t seg)
+{
+	vsfs_blk_t end = seg_start(seg) + LFS_SEG_BLOCKS;
+	return (end < fs->sb->num_blocks ? end : fs->sb->num_blocks)
+	       - seg_start(seg);
+}
+
+/**
+ * Set the cleaner thresholds for the number of segments. Only the segments
+ * past the metadata can be freed, so the thresholds are kept below their
+ * number; a file system with fewer than two of them is never cleaned.
+ */
+static void set_thresholds(fs_ctx *fs, lfs *l)
+{
+	uint32_t meta_segs = div_round_up(fs->sb->data_region, LFS_SEG_BLOCKS);
+	uint32_t data_segs = l->num_segs > meta_segs ? l->num_segs - meta_segs
+	                                             : 0;
+	l->low = l->num_segs / 16 > 2 ? l->num_segs / 16 : 2;
+	if (l->low > data_segs / 2) {
+		l->low = data_segs / 2;
+	}
+	l->high = l->low * 2;
+}
+
+bool lfs_init(fs_ctx *fs)
+{
+	lfs *l = calloc(1, sizeof(*l));
+	if (l == NULL) {
+		return false;
+	}
+	vsfs_blk_t nblocks = fs->sb->num_blocks;
+	l->num_segs = div_round_up(nblocks, LFS_SEG_BLOCKS);
+	// Sized for growth up to max_blocks
+	l->live = calloc(div_round_up(vsfs_max_blocks(fs->sb), LFS_SEG_BLOCKS),
+	                 sizeof(*l->live));
+	if (l->live == NULL) {
+		free(l);
+		return false;
+	}
+
+	for (vsfs_blk_t blk = 0; blk < nblocks; ++blk) {
+		if (bitmap_isset(fs->dbmap, nblocks, blk)) {
+			l->live[blk / LFS_SEG_BLOCKS]++;
+		}
+	}
+	for (uint32_t seg = 0; seg < l->num_segs; ++seg) {
+		if (l->live[seg] == 0) {
+			l->free_segs++;
+		}
+	}
+	set_thresholds(fs, l);
+	pthread_cond_init(&l->cond, NULL);
+	fs->lfs = l;
+	return true;
+}
+
+void lfs_destroy(fs_ctx *fs)
+{
+	lfs *l = fs->lfs;
+	if (l == NULL) {
+		return;
+	}
+	lfs_cleaner_stop(fs);
+	pthread_cond_destroy(&l->cond);
+	free(l->live);
+	free(l);
+	fs->lfs = NULL;
+}
+
+
+void lfs_grow(fs_ctx *fs)
+{
+	lfs *l = fs->lfs;
+	uint32_t num_segs = div_round_up(fs->sb->num_blocks, LFS_SEG_BLOCKS);
+
+	// A partial last segment that was free stays free; the added ones are
+	l->free_segs += num_segs - l->num_segs;
+	l->num_segs = num_segs;
+	l->stuck = false;
+	set_thresholds(fs, l);
+}
+
+
+/** Make the next free segment the log head; returns false if there is none. */
+static bool open_segment(fs_ctx *fs)
+{
+	lfs *l = fs->lfs;
+	for (uint32_t i = 0; i < l->num_segs; ++i) {
+		uint32_t seg = (l->next_seg + i) % l->num_segs;
+		if (l->live[seg] == 0) {
+			l->head = seg_start(seg);
+			l->head_end = l->head + seg_size(fs, seg);
+			l->next_seg = (seg + 1) % l->num_segs;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool lfs_alloc(fs_ctx *fs, vsfs_blk_t *blk)
+{
+	lfs *l = fs->lfs;
+	vsfs_blk_t nblocks = fs->sb->num_blocks;
+
+	// The head segment was free when it was opened, but the cleaner may have
+	// allocated blocks in it since (when the log had no free segment)
+	while (l->head < l->head_end && bitmap_isset(fs->dbmap, nblocks, l->head)) {
+		l->head++;
+	}
+	if (l->head < l->head_end || open_segment(fs)) {
+		*blk = l->head++;
+		bitmap_set(fs->dbmap, nblocks, *blk, true);
+	} else if (bitmap_alloc(fs->dbmap, nblocks, blk) != 0) {
+		return false;
+	}
+
+	uint32_t seg = *blk / LFS_SEG_BLOCKS;
+	if (l->live[seg]++ == 0) {
+		l->free_segs--;
+	}
+	if (l->free_segs < l->low && l->running) {
+		pthread_cond_signal(&l->cond);
+	}
+	return true;
+}
+
+void lfs_freed(fs_ctx *fs, vsfs_blk_t blk)
+{
+	lfs *l = fs->lfs;
+	uint32_t seg = blk / LFS_SEG_BLOCKS;
+
+	assert(l->live[seg] > 0);
+	if (--l->live[seg] == 0) {
+		l->free_segs++;
+	}
+	// Any segment may have become a victim now
+	l->stuck = false;
+}
+
+
+/** Check if a segment is the current log head. */
+static bool is_head(const lfs *l, uint32_t seg)
+{
+	return l->head < l->head_end && l->head / LFS_SEG_BLOCKS == seg;
+}
+
+/** Pick the segment to clean; returns false if there is none. */
+static bool pick_victim(fs_ctx *fs, uint32_t *victim)
+{
+	lfs *l = fs->lfs;
+	uint32_t best = LFS_SEG_BLOCKS + 1;
+
+	for (uint32_t seg = 0; seg < l->num_segs; ++seg) {
+		// Segments with metadata blocks can't be emptied
+		if (seg_start(seg) < fs->sb->data_region || is_head(l, seg)) {
+			continue;
+		}
+		uint32_t live = l->live[seg];
+		if (live > 0 && live * 4 <= seg_size(fs, seg) * 3 && live < best) {
+			best = live;
+			*victim = seg;
+		}
+	}
+	return best <= LFS_SEG_BLOCKS;
+}
+
+bool lfs_clean(fs_ctx *fs)
+{
+	lfs *l = fs->lfs;
+	uint32_t seg;
+	if (!pick_victim(fs, &seg)) {
+		return false;
+	}
+
+	vsfs_blk_t from[LFS_SEG_BLOCKS], to[LFS_SEG_BLOCKS];
+	vsfs_blk_t count = 0;
+	vsfs_blk_t start = seg_start(seg), end = start + seg_size(fs, seg);
+	for (vsfs_blk_t blk = start; blk < end; ++blk) {
+		if (bitmap_isset(fs->dbmap, fs->sb->num_blocks, blk)) {
+			from[count++] = blk;
+		}
+	}
+
+	// New locations at the log head (never in the victim, unless there are
+	// no free segments left and the allocation falls back to any free block)
+	bool ok = true;
+	vsfs_blk_t n = 0;
+	while (ok && n < count) {
+		ok = block_alloc(fs, 0, &to[n]) == 0;
+		if (ok) {
+			ok = to[n] < start || to[n] >= end;
+			++n;
+		}
+	}
+	if (ok && inode_relocate_blocks(fs, from, to, count) == 0) {
+		l->cleaned++;
+		l->moved += count;
+		return true;
+	}
+	for (vsfs_blk_t i = 0; i < n; ++i) {
+		block_put(fs, to[i]);
+	}
+	return false;
+}
+
+
+/** Cleaner thread body. */
+static void *cleaner_main(void *arg)
+{
+	fs_ctx *fs = (fs_ctx *)arg;
+	lfs *l = fs->lfs;
+
+	pthread_mutex_lock(&fs->lock);
+	while (!l->stop) {
+		struct timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += LFS_CLEAN_INTERVAL;
+		// A cleaner that is stuck waits for a whole interval (during
+		// which blocks may be freed) rather than spinning with the lock
+		while (!l->stop && (l->free_segs >= l->low || l->stuck) &&
+		       pthread_cond_timedwait(&l->cond, &fs->lock, &deadline)
+		       != ETIMEDOUT) {
+			// Spurious wakeup - keep waiting
+		}
+
+		while (!l->stop && !l->stuck && l->free_segs < l->high) {
+			if (!lfs_clean(fs)) {
+				l->stuck = true;
+				break;
+			}
+			// Let the file system operations in between segments
+			pthread_mutex_unlock(&fs->lock);
+			pthread_mutex_lock(&fs->lock);
+		}
+	}
+	pthread_mutex_unlock(&fs->lock);
+	return NULL;
+}
+
+bool lfs_cleaner_start(fs_ctx *fs)
+{
+	lfs *l = fs->lfs;
+	assert(!l->running);
+
+	l->stop = false;
+	l->running = true;
+	if (pthread_create(&l->thread, NULL, cleaner_main, fs) != 0) {
+		l->running = false;
+		return false;
+	}
+	return true;
+}
+
+void lfs_cleaner_stop(fs_ctx *fs)
+{
+	lfs *l = fs->lfs;
+	if (l == NULL || !l->running) {
+		return;
+	}
+
+	pthread_mutex_lock(&fs->lock);
+	l->stop = true;
+	pthread_cond_signal(&l->cond);
+	pthread_mutex_unlock(&fs->lock);
+	pthread_join(l->thread, NULL);
+	l->running = false;
+}
+
+void lfs_get_stats(fs_ctx *fs, lfs_stats *stats)
+{
+	lfs *l = fs->lfs;
+	stats->segments = l->num_segs;
+	stats->free_segments = l->free_segs;
+	stats->cleaned = l->cleaned;
+	stats->moved = l->moved;
+}
@@ -0,0 +1,122 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+/**
+ * CSC369 Assignment 4 - Log-structured write mode.
+ *
+ * The image is divided into segments of LFS_SEG_BLOCKS blocks. In log mode,
+ * data blocks are allocated sequentially from the current segment (the "log
+ * head"), and the next segment is only taken once it is completely free.
+ * Overwrites of file data don't modify blocks in place either: the new
+ * contents go to a new block at the log head (see inode_write_block()). Small
+ * random writes thus turn into large sequential ones.
+ *
+ * Overwritten blocks leave holes in older segments. A background cleaner
+ * picks the segments with the fewest live blocks, moves their live blocks to
+ * the log head (see inode_relocate_blocks()) and so makes them free again.
+ * If there are no free segments, blocks are allocated wherever they are free
+ * until the cleaner catches up.
+ *
+ * The on-disk format is the same as in the normal mode; the segment usage is
+ * rebuilt from the data bitmap at mount time. Inodes, indirect blocks and
+ * directory entries are still updated in place: the inode table plays the
+ * role of the inode map.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "fs_ctx.h"
+#include "vsfs.h"
+
+
+/** Number of blocks in a segment (256 KiB with 4K blocks, 4 MiB with 64K). */
+#define LFS_SEG_BLOCKS 64
+
+/** Log-structured mode statistics. */
+typedef struct lfs_stats {
+	/** Number of segments and completely free segments. */
+	uint32_t segments;
+	uint32_t free_segments;
+	/** Number of segments cleaned and live blocks moved by the cleaner. */
+	uint64_t cleaned;
+	uint64_t moved;
+} lfs_stats;
+
+/**
+ * Enable the log-structured mode (allocate fs->lfs).
+ *
+ * @param fs  pointer to the file system context.
+ * @return    true on success; false if out of memory.
+ */
+bool lfs_init(fs_ctx *fs);
+
+/** Stop the cleaner (if running) and free fs->lfs. */
+void lfs_destroy(fs_ctx *fs);
+
+/**
+ * Start the background segment cleaner.
+ *
+ * @param fs  pointer to the file system context.
+ * @return    true on success; false if the thread could not be created.
+ */
+bool lfs_cleaner_start(fs_ctx *fs);
+
+/** Stop the background segment cleaner; does nothing if it is not running. */
+void lfs_cleaner_stop(fs_ctx *fs);
+
+/**
+ * Allocate a block in the data bitmap at the log head. Used by block_alloc()
+ * in log mode.
+ *
+ * @param fs   pointer to the file system context.
+ * @param blk  pointer to the variable that receives the block number.
+ * @return     true on success; false if there are no free blocks.
+ */
+bool lfs_alloc(fs_ctx *fs, vsfs_blk_t *blk);
+
+/**
+ * Account for a block released to the data bitmap. Used by block_put() in
+ * log mode.
+ *
+ * @param fs   pointer to the file system context.
+ * @param blk  block number.
+ */
+void lfs_freed(fs_ctx *fs, vsfs_blk_t blk);
+
+/**
+ * Add the segments of the blocks added by growing the file system (see
+ * resize.h); fs->lfs must not be NULL.
+ *
+ * @param fs  pointer to the file system context.
+ */
+void lfs_grow(fs_ctx *fs);
+
+/**
+ * Clean one segment: move its live blocks to the log head. The segment with
+ * the fewest live blocks is chosen among the ones that are at most 3/4 full.
+ *
+ * @param fs  pointer to the file system context.
+ * @return    true if a segment was cleaned; false if there was none to clean
+ *            or there was not enough space.
+ */
+bool lfs_clean(fs_ctx *fs);
+
+/**
+ * Get the log-structured mode statistics. Must be called with fs->lock held;
+ * fs->lfs must not be NULL.
+ */
+void lfs_get_stats(fs_ctx *fs, lfs_stats *stats);
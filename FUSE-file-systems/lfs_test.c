@@ -0,0 +1,100 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+
+/**
+ * CSC369 Assignment 4 - Log-structured mode regression test.
+ *
+ * Mounts small log-structured images that the segment cleaner can't make any
+ * progress on (one freshly formatted with two segments, one filled up) and
+ * checks that file system operations still complete after the cleaner has
+ * run. A cleaner that keeps the file system lock forever hangs the test until
+ * the alarm kills it.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "benchutil.h"
+#include "libvsfs.h"
+#include "vsfs.h"
+
+/** Seconds to wait for the cleaner to run (see LFS_CLEAN_INTERVAL). */
+#define CLEANER_WAIT 3
+/** Seconds after which the test is considered hung. */
+#define TEST_TIMEOUT 60
+
+
+/**
+ * Mount a new log-structured image, optionally fill it up, let the cleaner
+ * run and check that an operation completes.
+ *
+ * @return  true on success; false on failure.
+ */
+static bool run_case(const char *mkfs_path, unsigned long size_mb,
+                     uint32_t block_size, bool fill)
+{
+	const char *tmp_dir = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+	char img_path[PATH_MAX];
+	int fd = format_image(tmp_dir, "vsfs-lfs-test", mkfs_path, size_mb,
+	                      block_size, 256, img_path);
+	if (fd < 0) {
+		return false;
+	}
+
+	static fs_ctx fs;
+	fs_opts opts = { .log = true };
+	bool ok = fs_mount(&fs, img_path, &opts) && fs_start(&fs);
+	if (ok && fill) {
+		static char buf[VSFS_BLOCK_SIZE_MAX];
+		memset(buf, 1, sizeof(buf));
+		for (unsigned int i = 0; ; ++i) {
+			char path[32];
+			snprintf(path, sizeof(path), "/f%u", i);
+			if (fs_create(&fs, path, S_IFREG | 0644) != 0 ||
+			    fs_write(&fs, path, buf, sizeof(buf), 0) < 0) {
+				break;
+			}
+		}
+	}
+	if (ok) {
+		sleep(CLEANER_WAIT);
+		struct stat st;
+		ok = fs_getattr(&fs, "/", &st) == 0;
+		fs_unmount(&fs);
+	}
+	printf("%s: %luM image, %u-byte blocks%s\n", ok ? "PASS" : "FAIL",
+	       size_mb, block_size, fill ? ", full" : "");
+
+	close(fd);
+	unlink(img_path);
+	return ok;
+}
+
+int main(int argc, char *argv[])
+{
+	(void)argc;// unused
+	char mkfs_path[PATH_MAX];
+	default_mkfs_path(mkfs_path, sizeof(mkfs_path), argv[0]);
+
+	alarm(TEST_TIMEOUT);
+	bool ok = run_case(mkfs_path, 1, 4096, false);
+	ok = run_case(mkfs_path, 8, 65536, false) && ok;
+	ok = run_case(mkfs_path, 8, 65536, true) && ok;
+	ok = run_case(mkfs_path, 3, 4096, true) && ok;
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,1194 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+/**
+ * CSC369 Assignment 4 - vsfs library implementation.
+ */
+
+#include <libgen.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libvsfs.h"
+#include "util.h"
+#include "acache.h"
+#include "bitmap.h"
+#include "map.h"
+#include "compress.h"
+#include "csum.h"
+#include "dedup.h"
+#include "defrag.h"
+#include "discard.h"
+#include "dir.h"
+#include "inode.h"
+#include "itable.h"
+#include "lcache.h"
+#include "lfs.h"
+#include "refcount.h"
+#include "resize.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "stripe.h"
+#include "tail.h"
+#include "trace.h"
+#include "xattr.h"
+
+
+bool fs_mount(fs_ctx *fs, const char *img_path, const fs_opts *opts)
+{
+	size_t size;
+	void *image;
+
+	// Map the disk image file (or the files of a striped image) into
+	// memory; fs_ctx_init() checks the size against the actual block size
+	image = stripe_map_image(img_path, &size);
+	if (image == NULL) {
+		return false;
+	}
+
+	if (!fs_ctx_init(fs, image, size)) {
+		munmap(image, size);
+		return false;
+	}
+	if (opts->dedup && !dedup_init(fs)) {
+		fprintf(stderr, "Failed to allocate the deduplication index\n");
+		fs_ctx_destroy(fs);
+		munmap(image, size);
+		return false;
+	}
+	if (opts->log && !lfs_init(fs)) {
+		fprintf(stderr, "Failed to allocate the segment usage table\n");
+		fs_ctx_destroy(fs);
+		munmap(image, size);
+		return false;
+	}
+	// getattr reads the inode table if the cache can't be allocated
+	if (!acache_init(fs)) {
+		fprintf(stderr, "Failed to allocate the attribute cache\n");
+	}
+	// Statistics are optional; the file system works without them
+	if (!stats_init(fs)) {
+		fprintf(stderr, "Failed to allocate the operation statistics\n");
+	}
+	// The trace log is opened now, relative to the current directory
+	if (opts->trace != NULL && !trace_init(fs, opts->trace)) {
+		fprintf(stderr, "Failed to start recording the trace\n");
+		fs_ctx_destroy(fs);
+		munmap(image, size);
+		return false;
+	}
+	fs->compress = opts->compress;
+	fs->verify = opts->verify;
+	fs->scrub_interval = opts->scrub;
+
+	// Checksums of metadata are only up to date after a clean unmount
+	if (fs->verify && csum_check_metadata(fs) != 0) {
+		fprintf(stderr, "Metadata checksums don't match; the image is "
+		        "corrupted or was not unmounted cleanly\n");
+	}
+	// Kept open for growing the image and punching holes in it; the file
+	// system works without it. Striped images can't grow.
+	if (stripe_is_set(img_path)) {
+		fs->stripe = stripe_open(img_path);
+	} else if ((fs->fd = open(img_path, O_RDWR)) < 0) {
+		perror(img_path);
+	}
+	if ((fs->fd >= 0 || fs->stripe != NULL) &&
+	    opts->discard && !discard_init(fs)) {
+		fprintf(stderr, "Failed to allocate the discard queue\n");
+	}
+	return true;
+}
+
+bool fs_start(fs_ctx *fs)
+{
+	if (fs->scrub_interval != 0 &&
+	    !csum_scrubber_start(fs, fs->scrub_interval)) {
+		fprintf(stderr, "Failed to start the scrubber thread\n");
+		return false;
+	}
+	if (!itable_init_start(fs)) {
+		fprintf(stderr, "Failed to start the inode table initialization "
+		        "thread\n");
+		return false;
+	}
+	if (fs->lfs != NULL && !lfs_cleaner_start(fs)) {
+		fprintf(stderr, "Failed to start the segment cleaner thread\n");
+		return false;
+	}
+	if (!discard_start(fs)) {
+		fprintf(stderr, "Failed to start the discard thread\n");
+		return false;
+	}
+	if (!trace_start(fs)) {
+		fprintf(stderr, "Failed to start the trace writer thread\n");
+		return false;
+	}
+	return true;
+}
+
+void fs_unmount(fs_ctx *fs)
+{
+	if (fs->image) {
+		csum_scrubber_stop(fs);
+		itable_init_stop(fs);
+		lfs_cleaner_stop(fs);
+		discard_stop(fs);
+		fs_ctx_destroy(fs);
+		munmap(fs->image, fs->size);
+		fs->image = NULL;
+		if (fs->fd >= 0) {
+			close(fs->fd);
+			fs->fd = -1;
+		}
+		stripe_close(fs->stripe);
+		fs->stripe = NULL;
+	}
+}
+
+
+/* Looks up the inode number for the element at the end of the path
+ * if it exists.  Returns 0 on success or -errno on error; see fs_lookup().
+ */
+static int path_lookup(fs_ctx *fs, const char *path, vsfs_ino_t *ino) {
+	if(path[0] != '/') {
+		fprintf(stderr, "Not an absolute path\n");
+		return -EINVAL;
+	}
+	if(strlen(path) >= VSFS_PATH_MAX){
+		return -ENAMETOOLONG;
+	}
+
+	if(lcache_find(fs, path, ino)){
+		return 0;
+	}
+
+	char path_str[VSFS_PATH_MAX];
+	char *saveptr;
+	vsfs_ino_t curr_inum = VSFS_ROOT_INO;
+
+	strcpy(path_str, path);
+	for(char *token = strtok_r(path_str, "/", &saveptr); token != NULL;
+	    token = strtok_r(NULL, "/", &saveptr)){
+		vsfs_inode *dir_inode = &(fs->itable[curr_inum]);
+		if(!S_ISDIR(dir_inode->i_mode)){
+			return -ENOTDIR;
+		}
+		if(strlen(token) >= VSFS_NAME_MAX){
+			return -ENAMETOOLONG;
+		}
+		if(curr_inum == VSFS_ROOT_INO && strcmp(token, VSFS_SNAP_NAME) == 0){
+			curr_inum = VSFS_SNAP_INO;
+			continue;
+		}
+		int ret = dir_lookup(fs, dir_inode, token, &curr_inum);
+		if(ret != 0){
+			return ret;
+		}
+	}
+
+	lcache_insert(fs, path, curr_inum);
+	*ino = curr_inum;
+	return 0;
+}
+
+/* Looks up a regular file; directories fail with EISDIR. */
+static int file_lookup(fs_ctx *fs, const char *path, vsfs_inode **inode)
+{
+	vsfs_ino_t inum;
+	int ret = path_lookup(fs, path, &inum);
+	if (ret != 0) {
+		return ret;
+	}
+	if (S_ISDIR(fs->itable[inum].i_mode)) {
+		return -EISDIR;
+	}
+	*inode = &fs->itable[inum];
+	return 0;
+}
+
+/* Returns true if the path is inside a snapshot. Snapshots are read-only. */
+static bool in_snapshot(const char *path)
+{
+	size_t len = strlen("/" VSFS_SNAP_NAME "/");
+	return strncmp(path, "/" VSFS_SNAP_NAME "/", len) == 0;
+}
+
+/* Splits a path into the parent directory path and the final component.
+ * Both buffers must be at least VSFS_PATH_MAX bytes long, and so must be the
+ * path (check it with path_lookup() first).
+ */
+static void split_path(const char *path, char *parent, char *name)
+{
+	char path_str[VSFS_PATH_MAX];
+
+	strcpy(path_str, path);
+	strcpy(name, basename(path_str));
+	strcpy(path_str, path);
+	strcpy(parent, dirname(path_str));
+}
+
+
+static int do_statfs(fs_ctx *fs, struct statvfs *st)
+{
+	vsfs_superblock *sb = fs->sb; /* Get ptr to superblock from context */
+
+	memset(st, 0, sizeof(*st));
+	st->f_bsize   = fs->block_size;    /* Filesystem block size */
+	st->f_frsize  = fs->block_size;    /* Fragment size */
+	// The rest of required fields are filled based on the information
+	// stored in the superblock.
+        st->f_blocks = sb->num_blocks;     /* Size of fs in f_frsize units */
+        st->f_bfree  = sb->free_blocks;    /* Number of free blocks */
+        st->f_bavail = sb->free_blocks;    /* Free blocks for unpriv users */
+	st->f_files  = sb->num_inodes;     /* Number of inodes */
+        st->f_ffree  = sb->free_inodes;    /* Number of free inodes */
+        st->f_favail = sb->free_inodes;    /* Free inodes for unpriv users */
+
+	st->f_namemax = VSFS_NAME_MAX;     /* Maximum filename length */
+
+	return 0;
+}
+
+static int do_getattr(fs_ctx *fs, const char *path, struct stat *st)
+{
+	memset(st, 0, sizeof(*st));
+	vsfs_inode *inode;
+	vsfs_ino_t inum;
+	int ret = path_lookup(fs, path, &inum);
+	if(ret < 0){
+		return ret;
+	}
+	if (acache_getattr(fs, inum, st)) {
+		return 0;
+	}
+	inode = (vsfs_inode *) &(fs->itable[inum]);
+	st->st_blocks = fs_inode_sectors(fs, inode);
+	st->st_mode = inode->i_mode;
+	st->st_nlink = inode->i_nlink;
+	st->st_size = inode->i_size;
+	st->st_mtim = inode->i_mtime;
+
+	return 0;
+
+}
+
+
+/** State of fs_readdir() passed to readdir_entry(). */
+typedef struct readdir_ctx {
+	fs_readdir_fn fn;
+	void *data;
+} readdir_ctx;
+
+/** dir_iterate() callback that passes one entry to the fs_readdir() caller. */
+static int readdir_entry(void *data, const vsfs_dentry *entry)
+{
+	readdir_ctx *ctx = (readdir_ctx *)data;
+
+	if(ctx->fn(ctx->data, entry->name, entry->ino) != 0){
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+static int do_readdir(fs_ctx *fs, const char *path, fs_readdir_fn fn,
+                      void *data)
+{
+	vsfs_inode *dir_inode;
+	vsfs_ino_t inum;
+	int ret = path_lookup(fs, path, &inum);
+	if(ret < 0){
+		return ret;
+	}
+	dir_inode = &(fs->itable[inum]);
+	if(!S_ISDIR(dir_inode->i_mode)){
+		return -ENOTDIR;
+	}
+
+	readdir_ctx ctx = { fn, data };
+	return dir_iterate(fs, dir_inode, readdir_entry, &ctx);
+}
+
+
+static int do_mkdir(fs_ctx *fs, const char *path, mode_t mode)
+{
+	mode = mode | S_IFDIR;
+	if (strlen(path) >= VSFS_PATH_MAX) return -ENAMETOOLONG;
+
+	//NOTE: creating a directory in the snapshot directory takes a
+	//      snapshot of the whole file system under that name
+	char parent[VSFS_PATH_MAX];
+	char name[VSFS_PATH_MAX];
+	split_path(path, parent, name);
+	if (strcmp(parent, "/" VSFS_SNAP_NAME) == 0) {
+		return snapshot_create(fs, name);
+	}
+	if (in_snapshot(path)) {
+		return -EROFS;
+	}
+
+	//the directory must not exist yet, but its parent must
+	vsfs_ino_t inum;
+	vsfs_ino_t dir_inum;
+	int ret = path_lookup(fs, path, &inum);
+	if(ret == 0){
+		return -EEXIST;
+	}
+	if(ret != -ENOENT){
+		return ret;
+	}
+	ret = path_lookup(fs, parent, &dir_inum);
+	if(ret != 0){
+		return ret;
+	}
+	vsfs_inode *dir_inode = &(fs->itable[dir_inum]);
+	if(!S_ISDIR(dir_inode->i_mode)){
+		return -ENOTDIR;
+	}
+
+	//the group of the new directory is chosen by the Orlov allocator
+	ret = inode_alloc(fs, mode, dir_inum, &inum);
+	if(ret != 0){
+		return ret;
+	}
+	vsfs_inode *new_dir = &(fs->itable[inum]);
+	new_dir->i_nlink = 2;
+	acache_update(fs, new_dir);
+
+	ret = dir_init(fs, new_dir, inum, dir_inum);
+	if(ret == 0){
+		ret = dir_add_entry(fs, dir_inode, name, inum);
+	}
+	if(ret != 0){
+		inode_free(fs, inum);
+		return ret;
+	}
+
+	//".." of the new directory refers to the parent
+	dir_inode->i_nlink++;
+	acache_update(fs, dir_inode);
+	return 0;
+}
+
+static int do_rmdir(fs_ctx *fs, const char *path)
+{
+	if (strlen(path) >= VSFS_PATH_MAX) return -ENAMETOOLONG;
+
+	//NOTE: removing a directory in the snapshot directory deletes that
+	//      snapshot, even though it is not empty
+	char parent[VSFS_PATH_MAX];
+	char name[VSFS_PATH_MAX];
+	split_path(path, parent, name);
+	if (strcmp(parent, "/" VSFS_SNAP_NAME) == 0) {
+		// The whole tree of the snapshot is gone
+		lcache_clear(fs);
+		return snapshot_delete(fs, name);
+	}
+	if (strcmp(path, "/" VSFS_SNAP_NAME) == 0) {
+		return -EBUSY;
+	}
+	if (in_snapshot(path)) {
+		return -EROFS;
+	}
+
+	vsfs_ino_t inum;
+	vsfs_ino_t dir_inum;
+	int ret = path_lookup(fs, path, &inum);
+	if(ret != 0){
+		return ret;
+	}
+	vsfs_inode *inode = &(fs->itable[inum]);
+	if(!S_ISDIR(inode->i_mode)){
+		return -ENOTDIR;
+	}
+	if(inum == VSFS_ROOT_INO){
+		return -EBUSY;
+	}
+	if(!dir_is_empty(fs, inode)){
+		return -ENOTEMPTY;
+	}
+
+	path_lookup(fs, parent, &dir_inum);
+	vsfs_inode *dir_inode = &(fs->itable[dir_inum]);
+	dir_remove_entry(fs, dir_inode, name);
+	dir_inode->i_nlink--;
+	acache_update(fs, dir_inode);
+
+	//paths through the directory (e.g. "dir/..") are cached too
+	lcache_clear(fs);
+	inode_free(fs, inum);
+	return 0;
+}
+
+static int do_create(fs_ctx *fs, const char *path, mode_t mode)
+{
+	if((mode & S_IFMT) != 0 && !S_ISREG(mode)){
+		return -EINVAL;
+	}
+	mode |= S_IFREG;
+
+	char directory[VSFS_PATH_MAX];
+	char file_name[VSFS_PATH_MAX];
+	vsfs_ino_t dir_inum;
+	vsfs_inode *dir_inode;
+
+	if(in_snapshot(path)){
+		return -EROFS;
+	}
+
+	//the file must not exist yet, but its directory must
+	vsfs_ino_t inum;
+	int ret = path_lookup(fs, path, &inum);
+	if(ret == 0){
+		return -EEXIST;
+	}
+	if(ret != -ENOENT){
+		return ret;
+	}
+	split_path(path, directory, file_name);
+	ret = path_lookup(fs, directory, &dir_inum);
+	if(ret != 0){
+		return ret;
+	}
+	dir_inode = &(fs->itable[dir_inum]);
+	if(!S_ISDIR(dir_inode->i_mode)){
+		return -ENOTDIR;
+	}
+
+	//allocate new inode
+	ret = inode_alloc(fs, mode, dir_inum, &inum);
+	if(ret != 0){
+		return ret;
+	}
+	if(fs->compress){
+		fs->itable[inum].i_flags |= VSFS_INODE_COMPRESS;
+	}
+
+	//add the entry, growing the directory if all its blocks are full
+	ret = dir_add_entry(fs, dir_inode, file_name, inum);
+	if(ret != 0){
+		//undo the inode allocation
+		inode_free(fs, inum);
+		return ret;
+	}
+	return 0;
+}
+
+static int do_unlink(fs_ctx *fs, const char *path)
+{
+	char directory[VSFS_PATH_MAX];
+	char file_name[VSFS_PATH_MAX];
+	vsfs_ino_t dir_inum;
+	vsfs_ino_t file_inum;
+	vsfs_inode *dir_inode;
+	vsfs_inode *file_inode;
+
+	if(in_snapshot(path)){
+		return -EROFS;
+	}
+
+	//get file info
+	int ret = path_lookup(fs, path, &file_inum);
+	if(ret < 0){
+		return ret;
+	}
+	file_inode = &(fs->itable[file_inum]);
+	if(S_ISDIR(file_inode->i_mode)){
+		return -EISDIR;
+	}
+
+	//get dir info
+	split_path(path, directory, file_name);
+	path_lookup(fs, directory, &dir_inum);
+	dir_inode = &(fs->itable[dir_inum]);
+
+	//empty the entry in directory
+	dir_remove_entry(fs, dir_inode, file_name);
+	lcache_forget(fs, file_inum);
+
+	//release the data blocks and the inode once the last link is gone;
+	//blocks shared with other files stay allocated until their last
+	//reference is dropped
+	if(--file_inode->i_nlink == 0){
+		inode_free(fs, file_inum);
+	}
+	acache_update(fs, file_inode);
+
+	return 0;
+}
+
+static int do_utimens(fs_ctx *fs, const char *path,
+                      const struct timespec times[2])
+{
+	vsfs_inode *ino = NULL;
+
+	// 0. Check if there is actually anything to be done.
+	if (in_snapshot(path)) {
+		return -EROFS;
+	}
+
+	// 1. Find the inode for the final component in path
+	vsfs_ino_t inum;
+	int ret = path_lookup(fs, path, &inum);
+	if (ret != 0) {
+		return ret;
+	}
+	ino = &(fs->itable[inum]);
+	if (times[1].tv_nsec == UTIME_OMIT) {
+		// Nothing to do.
+		return 0;
+	}
+
+	// 2. Update the mtime for that inode.
+	if (times[1].tv_nsec == UTIME_NOW) {
+		if (clock_gettime(CLOCK_REALTIME, &(ino->i_mtime)) != 0) {
+			// clock_gettime should not fail, unless you give it a
+			// bad pointer to a timespec.
+			assert(false);
+		}
+	} else {
+		ino->i_mtime = times[1];
+	}
+	acache_update(fs, ino);
+
+	return 0;
+}
+
+static int do_truncate(fs_ctx *fs, const char *path, off_t size)
+{
+	vsfs_inode *inode;
+	if(size < 0){
+		return -EINVAL;
+	}
+	if(in_snapshot(path)){
+		return -EROFS;
+	}
+	int ret = file_lookup(fs, path, &inode);
+	if(ret != 0){
+		return ret;
+	}
+
+	//blocks past the new end are released (or only unreferenced, if they
+	//are shared with a clone); new blocks are zero-filled
+	ret = inode_resize(fs, inode, (uint64_t)size);
+	if(ret != 0){
+		return ret;
+	}
+	clock_gettime(CLOCK_REALTIME, &(inode->i_mtime));
+	acache_update(fs, inode);
+	return 0;
+}
+
+static ssize_t do_read(fs_ctx *fs, const char *path, char *buf, size_t size,
+                       off_t offset)
+{
+	vsfs_inode *inode;
+	if(offset < 0){
+		return -EINVAL;
+	}
+	int ret = file_lookup(fs, path, &inode);
+	if(ret != 0){
+		return ret;
+	}
+
+	if(inode->i_size <= (uint64_t) offset){ //read nothing
+		return 0;
+	}
+	if(inode->i_size < offset + size){ //read size is larger than file size
+		size = inode->i_size - offset;
+	}
+
+	size_t done = 0;
+	while(done < size){
+		uint64_t pos = offset + done;
+		size_t chunk = fs->block_size - fs_block_offset(fs, pos);
+		if(chunk > size - done){
+			chunk = size - done;
+		}
+		vsfs_blk_t cluster = pos / fs_cluster_size(fs);
+		if(compress_is_compressed(fs, inode, cluster)){
+			const char *data;
+			ret = compress_read(fs, inode, cluster, &data);
+			if(ret != 0){
+				return done > 0 ? (ssize_t)done : ret;
+			}
+			memcpy(buf + done, data + pos % fs_cluster_size(fs), chunk);
+		}else{
+			vsfs_blk_t blk = inode_get_block(fs, inode, fs_block_index(fs, pos));
+			if(fs->verify && !csum_is_dirty(fs, blk) && !csum_verify(fs, blk)){
+				return done > 0 ? (ssize_t)done : -EIO;
+			}
+			vsfs_blk_t idx = fs_block_index(fs, pos);
+			memcpy(buf + done, block_addr(fs, blk) + tail_offset(inode, idx)
+			       + fs_block_offset(fs, pos), chunk);
+		}
+		done += chunk;
+	}
+	return size;
+}
+
+/**
+ * Overwrite a whole file block, sharing an existing block with identical
+ * contents instead if the deduplication index has one.
+ *
+ * @param fs     pointer to the file system context.
+ * @param inode  pointer to the inode.
+ * @param idx    file block index; must be less than inode->i_blocks.
+ * @param data   a block of new data.
+ * @return       0 on success; -errno on error.
+ */
+static int write_block_dedup(fs_ctx *fs, vsfs_inode *inode, vsfs_blk_t idx,
+                             const char *data)
+{
+	uint64_t hash = dedup_hash(fs, data);
+	vsfs_blk_t blk;
+
+	if (dedup_find(fs, data, hash, &blk)) {
+		if (blk == inode_get_block(fs, inode, idx) &&
+		    !tail_is_packed(inode, idx)) {
+			// Same contents are already there
+			return 0;
+		}
+		if (block_ref(fs, blk)) {
+			inode_replace_block(fs, inode, idx, blk);
+			return 0;
+		}
+	}
+
+	int ret = inode_write_block(fs, inode, idx, &blk);
+	if (ret != 0) {
+		return ret;
+	}
+	memcpy(block_addr(fs, blk), data, fs->block_size);
+	dedup_insert(fs, blk, hash);
+	return 0;
+}
+
+static ssize_t do_write(fs_ctx *fs, const char *path, const char *buf,
+                        size_t size, off_t offset)
+{
+	vsfs_inode *inode;
+	if(offset < 0){
+		return -EINVAL;
+	}
+	if(in_snapshot(path)){
+		return -EROFS;
+	}
+	int ret = file_lookup(fs, path, &inode);
+	if(ret != 0){
+		return ret;
+	}
+
+	//first byte whose cluster may need to be (re)compressed
+	uint64_t start = inode->i_size < (uint64_t)offset ? inode->i_size : (uint64_t)offset;
+
+	if(inode->i_size < offset + size){ //extend file, zero-filling any hole
+		//writing past the old EOF can't fail once the file is extended,
+		//so an append only zero-fills the hole before it
+		uint64_t zero_end = inode->i_size <= (uint64_t)offset ? (uint64_t)offset : offset + size;
+		ret = inode_extend(fs, inode, offset + size, zero_end);
+		if(ret != 0){
+			return ret;
+		}
+	}
+
+	size_t done = 0;
+	while(done < size){
+		uint64_t pos = offset + done;
+		size_t chunk = fs->block_size - fs_block_offset(fs, pos);
+		if(chunk > size - done){
+			chunk = size - done;
+		}
+		//a compressed cluster is expanded before any of its blocks is modified
+		ret = compress_inflate(fs, inode, pos / fs_cluster_size(fs));
+		if(ret == 0 && fs->dedup != NULL && chunk == fs->block_size){
+			ret = write_block_dedup(fs, inode, fs_block_index(fs, pos), buf + done);
+		}else if(ret == 0){
+			//blocks shared with a clone are copied before they are modified
+			vsfs_blk_t blk;
+			ret = inode_write_block(fs, inode, fs_block_index(fs, pos), &blk);
+			if(ret == 0){
+				memcpy(block_addr(fs, blk) + fs_block_offset(fs, pos), buf + done, chunk);
+			}
+		}
+		if(ret != 0){
+			return done > 0 ? (ssize_t)done : ret;
+		}
+		done += chunk;
+	}
+	if(inode->i_flags & VSFS_INODE_COMPRESS){
+		//compress the clusters that this write (or the hole before it) has
+		//filled up to the end
+		uint32_t csize = fs_cluster_size(fs);
+		for(uint64_t c = start / csize; (c + 1) * csize <= offset + size; c++){
+			compress_cluster(fs, inode, c);
+		}
+	}
+	clock_gettime(CLOCK_REALTIME, &(inode->i_mtime));
+	acache_update(fs, inode);
+	return size;
+}
+
+static int do_release(fs_ctx *fs, const char *path)
+{
+	//files in snapshots are never written
+	if(in_snapshot(path)){
+		return 0;
+	}
+	vsfs_inode *inode;
+	int ret = file_lookup(fs, path, &inode);
+	if(ret != 0){
+		return ret;
+	}
+	tail_pack(fs, inode);
+	return 0;
+}
+
+
+static int do_fsync(fs_ctx *fs)
+{
+	csum_commit(fs);
+	// Get all the disks of a striped image writing before waiting for one
+	if (fs->stripe != NULL) {
+		stripe_writeback(fs->stripe);
+	}
+	if (msync(fs->image, fs->size, MS_SYNC) < 0) {
+		return -EIO;
+	}
+	return 0;
+}
+
+
+/** Expand the compressed clusters that are cut by the ends of a block range. */
+static int inflate_range_ends(fs_ctx *fs, vsfs_inode *inode, vsfs_blk_t idx,
+                              vsfs_blk_t count)
+{
+	int ret = 0;
+	if (idx % VSFS_CLUSTER_BLOCKS != 0) {
+		ret = compress_inflate(fs, inode, idx / VSFS_CLUSTER_BLOCKS);
+	}
+	if (ret == 0 && (idx + count) % VSFS_CLUSTER_BLOCKS != 0) {
+		ret = compress_inflate(fs, inode,
+		                       (idx + count) / VSFS_CLUSTER_BLOCKS);
+	}
+	return ret;
+}
+
+static int do_clone(fs_ctx *fs, const char *path,
+                    const struct vsfs_clone_args *args)
+{
+	if (strnlen(args->src_path, VSFS_PATH_MAX) >= VSFS_PATH_MAX) {
+		return -ENAMETOOLONG;
+	}
+	if (in_snapshot(path)) {
+		return -EROFS;
+	}
+
+	vsfs_ino_t src_inum, dst_inum;
+	int ret = path_lookup(fs, args->src_path, &src_inum);
+	if (ret == 0) {
+		ret = path_lookup(fs, path, &dst_inum);
+	}
+	if (ret < 0) {
+		return ret;
+	}
+	vsfs_inode *src = &fs->itable[src_inum];
+	vsfs_inode *dst = &fs->itable[dst_inum];
+
+	if (!S_ISREG(src->i_mode) || !S_ISREG(dst->i_mode) ||
+	    src_inum == dst_inum) {
+		return -EINVAL;
+	}
+
+	uint64_t len = args->src_length;
+	if (len == 0 && args->src_offset <= src->i_size) {
+		len = src->i_size - args->src_offset;
+	}
+	// The range must start on a block boundary and end either on a block
+	// boundary or at the source EOF; a partial last block can only become
+	// the last block of the destination.
+	if (!is_aligned(args->src_offset, fs->block_size) ||
+	    !is_aligned(args->dest_offset, fs->block_size) ||
+	    args->src_offset + len > src->i_size) {
+		return -EINVAL;
+	}
+	if (!is_aligned(len, fs->block_size) &&
+	    (args->src_offset + len != src->i_size ||
+	     args->dest_offset + len < dst->i_size)) {
+		return -EINVAL;
+	}
+	if (len == 0) {
+		return 0;
+	}
+	if (args->dest_offset + len >
+	    (uint64_t)vsfs_max_file_blocks(fs->block_size) << fs->block_shift) {
+		return -EFBIG;
+	}
+
+	// Fill the gap before the range with zeros
+	if (dst->i_size < args->dest_offset) {
+		ret = inode_resize(fs, dst, args->dest_offset);
+		if (ret != 0) {
+			return ret;
+		}
+	}
+
+	// Compressed clusters can only be shared whole and at the same position
+	// within a cluster; expand the ones that the range would split
+	vsfs_blk_t src_idx = fs_block_index(fs, args->src_offset);
+	vsfs_blk_t dst_idx = fs_block_index(fs, args->dest_offset);
+	vsfs_blk_t count = div_round_up(len, fs->block_size);
+	if (src_idx % VSFS_CLUSTER_BLOCKS == dst_idx % VSFS_CLUSTER_BLOCKS) {
+		ret = inflate_range_ends(fs, src, src_idx, count);
+	} else {
+		ret = compress_inflate_range(fs, src, src_idx, count);
+	}
+	if (ret == 0) {
+		ret = inflate_range_ends(fs, dst, dst_idx, count);
+	}
+	if (ret == 0) {
+		ret = inode_clone_blocks(fs, dst, dst_idx, src, src_idx, count);
+	}
+	if (ret != 0) {
+		// Drop the blocks appended past the destination EOF
+		inode_resize(fs, dst, dst->i_size);
+		return ret;
+	}
+
+	if (dst->i_size < args->dest_offset + len) {
+		dst->i_size = args->dest_offset + len;
+	}
+	clock_gettime(CLOCK_REALTIME, &(dst->i_mtime));
+	acache_update(fs, dst);
+	return 0;
+}
+
+static int do_getflags(fs_ctx *fs, const char *path, uint32_t *flags)
+{
+	vsfs_ino_t inum;
+	int ret = path_lookup(fs, path, &inum);
+	if (ret != 0) {
+		return ret;
+	}
+	*flags = fs->itable[inum].i_flags & VSFS_INODE_USER_FLAGS;
+	return 0;
+}
+
+static int do_setflags(fs_ctx *fs, const char *path, uint32_t flags)
+{
+	if (in_snapshot(path)) {
+		return -EROFS;
+	}
+	vsfs_ino_t inum;
+	int ret = path_lookup(fs, path, &inum);
+	if (ret != 0) {
+		return ret;
+	}
+	vsfs_inode *inode = &fs->itable[inum];
+
+	if (!S_ISREG(inode->i_mode) || (flags & ~VSFS_INODE_USER_FLAGS) != 0) {
+		return -EINVAL;
+	}
+
+	uint32_t old_flags = inode->i_flags;
+	inode->i_flags = flags | (old_flags & ~VSFS_INODE_USER_FLAGS);
+	if ((flags & VSFS_INODE_COMPRESS) && !(old_flags & VSFS_INODE_COMPRESS)) {
+		compress_file(fs, inode);
+	}
+	return 0;
+}
+
+static ssize_t do_getxattr(fs_ctx *fs, const char *path, const char *name,
+                           char *value, size_t size)
+{
+	vsfs_ino_t inum;
+	int ret = path_lookup(fs, path, &inum);
+	if (ret != 0) {
+		return ret;
+	}
+	return xattr_get(fs, inum, name, value, size);
+}
+
+static int do_setxattr(fs_ctx *fs, const char *path, const char *name,
+                       const char *value, size_t size, int flags)
+{
+	if (in_snapshot(path)) {
+		return -EROFS;
+	}
+	vsfs_ino_t inum;
+	int ret = path_lookup(fs, path, &inum);
+	if (ret != 0) {
+		return ret;
+	}
+	return xattr_set(fs, inum, name, value, size, flags);
+}
+
+static ssize_t do_listxattr(fs_ctx *fs, const char *path, char *list,
+                            size_t size)
+{
+	vsfs_ino_t inum;
+	int ret = path_lookup(fs, path, &inum);
+	if (ret != 0) {
+		return ret;
+	}
+	return xattr_list(fs, inum, list, size);
+}
+
+static int do_removexattr(fs_ctx *fs, const char *path, const char *name)
+{
+	if (in_snapshot(path)) {
+		return -EROFS;
+	}
+	vsfs_ino_t inum;
+	int ret = path_lookup(fs, path, &inum);
+	if (ret != 0) {
+		return ret;
+	}
+	return xattr_remove(fs, inum, name);
+}
+
+static int do_defrag(fs_ctx *fs, const char *path,
+                     struct vsfs_defrag_args *args)
+{
+	vsfs_ino_t inum;
+	int ret = path_lookup(fs, path, &inum);
+	if (ret != 0) {
+		return ret;
+	}
+	if (!S_ISREG(fs->itable[inum].i_mode) ||
+	    (args->flags & ~VSFS_DEFRAG_REPORT) != 0) {
+		return -EINVAL;
+	}
+	return defrag_inode(fs, inum, args);
+}
+
+static int do_grow(fs_ctx *fs, uint64_t size)
+{
+	// Blocks freed by the cleaner or the scrubber are not affected; they
+	// only run with the lock held
+	return resize_grow(fs, size);
+}
+
+static int do_trim(fs_ctx *fs, uint64_t *discarded)
+{
+	uint64_t blocks = 0;
+	if (fs->fd < 0 && fs->stripe == NULL) {
+		return -EOPNOTSUPP;
+	}
+	int ret = discard_free_blocks(fs, &blocks);
+	*discarded = blocks << fs->block_shift;
+	return ret;
+}
+
+
+// Entry points. Each operation runs with the file system lock held, so that
+// concurrent callers and the background scrubber never see a half-done update.
+// The recorded latency includes waiting for the lock. Operations are traced
+// with the lock still held, so the trace has them in the order they ran in; the
+// last five arguments are the trace_rec fields (see trace.h).
+
+#define LOCKED(fs, type, op, call, path, path2, offset, size, arg)           \
+	do {                                                                 \
+		uint64_t start_ = stats_now();                               \
+		pthread_mutex_lock(&(fs)->lock);                             \
+		type ret_ = (call);                                          \
+		trace_record((fs), (op), start_, ret_, (path), (path2),      \
+		             (offset), (size), (arg));                       \
+		pthread_mutex_unlock(&(fs)->lock);                           \
+		stats_record((fs), (op), start_, ret_);                      \
+		return ret_;                                                 \
+	} while (0)
+
+int fs_lookup(fs_ctx *fs, const char *path, vsfs_ino_t *ino)
+{
+	LOCKED(fs, int, STATS_OP_LOOKUP, path_lookup(fs, path, ino),
+	       path, NULL, 0, 0, 0);
+}
+
+int fs_statfs(fs_ctx *fs, struct statvfs *st)
+{
+	LOCKED(fs, int, STATS_OP_STATFS, do_statfs(fs, st),
+	       NULL, NULL, 0, 0, 0);
+}
+
+int fs_getattr(fs_ctx *fs, const char *path, struct stat *st)
+{
+	LOCKED(fs, int, STATS_OP_GETATTR, do_getattr(fs, path, st),
+	       path, NULL, 0, 0, 0);
+}
+
+int fs_readdir(fs_ctx *fs, const char *path, fs_readdir_fn fn, void *data)
+{
+	LOCKED(fs, int, STATS_OP_READDIR, do_readdir(fs, path, fn, data),
+	       path, NULL, 0, 0, 0);
+}
+
+int fs_mkdir(fs_ctx *fs, const char *path, mode_t mode)
+{
+	LOCKED(fs, int, STATS_OP_MKDIR, do_mkdir(fs, path, mode),
+	       path, NULL, 0, 0, mode);
+}
+
+int fs_rmdir(fs_ctx *fs, const char *path)
+{
+	LOCKED(fs, int, STATS_OP_RMDIR, do_rmdir(fs, path),
+	       path, NULL, 0, 0, 0);
+}
+
+int fs_create(fs_ctx *fs, const char *path, mode_t mode)
+{
+	LOCKED(fs, int, STATS_OP_CREATE, do_create(fs, path, mode),
+	       path, NULL, 0, 0, mode);
+}
+
+int fs_unlink(fs_ctx *fs, const char *path)
+{
+	LOCKED(fs, int, STATS_OP_UNLINK, do_unlink(fs, path),
+	       path, NULL, 0, 0, 0);
+}
+
+int fs_utimens(fs_ctx *fs, const char *path, const struct timespec times[2])
+{
+	LOCKED(fs, int, STATS_OP_UTIMENS, do_utimens(fs, path, times),
+	       path, NULL, times[1].tv_sec, times[1].tv_nsec, 0);
+}
+
+int fs_truncate(fs_ctx *fs, const char *path, off_t size)
+{
+	LOCKED(fs, int, STATS_OP_TRUNCATE, do_truncate(fs, path, size),
+	       path, NULL, size, 0, 0);
+}
+
+ssize_t fs_read(fs_ctx *fs, const char *path, char *buf, size_t size,
+                off_t offset)
+{
+	LOCKED(fs, ssize_t, STATS_OP_READ, do_read(fs, path, buf, size, offset),
+	       path, NULL, offset, size, 0);
+}
+
+ssize_t fs_write(fs_ctx *fs, const char *path, const char *buf, size_t size,
+                 off_t offset)
+{
+	LOCKED(fs, ssize_t, STATS_OP_WRITE, do_write(fs, path, buf, size, offset),
+	       path, NULL, offset, size, 0);
+}
+
+int fs_release(fs_ctx *fs, const char *path)
+{
+	LOCKED(fs, int, STATS_OP_RELEASE, do_release(fs, path),
+	       path, NULL, 0, 0, 0);
+}
+
+int fs_fsync(fs_ctx *fs)
+{
+	LOCKED(fs, int, STATS_OP_FSYNC, do_fsync(fs),
+	       NULL, NULL, 0, 0, 0);
+}
+
+int fs_clone(fs_ctx *fs, const char *path, const struct vsfs_clone_args *args)
+{
+	LOCKED(fs, int, STATS_OP_CLONE, do_clone(fs, path, args),
+	       path, args->src_path, args->dest_offset, args->src_length,
+	       args->src_offset);
+}
+
+int fs_getflags(fs_ctx *fs, const char *path, uint32_t *flags)
+{
+	LOCKED(fs, int, STATS_OP_GETFLAGS, do_getflags(fs, path, flags),
+	       path, NULL, 0, 0, 0);
+}
+
+int fs_setflags(fs_ctx *fs, const char *path, uint32_t flags)
+{
+	LOCKED(fs, int, STATS_OP_SETFLAGS, do_setflags(fs, path, flags),
+	       path, NULL, 0, 0, flags);
+}
+
+ssize_t fs_getxattr(fs_ctx *fs, const char *path, const char *name,
+                    char *value, size_t size)
+{
+	LOCKED(fs, ssize_t, STATS_OP_GETXATTR,
+	       do_getxattr(fs, path, name, value, size),
+	       path, name, 0, size, 0);
+}
+
+int fs_setxattr(fs_ctx *fs, const char *path, const char *name,
+                const char *value, size_t size, int flags)
+{
+	LOCKED(fs, int, STATS_OP_SETXATTR,
+	       do_setxattr(fs, path, name, value, size, flags),
+	       path, name, 0, size, flags);
+}
+
+ssize_t fs_listxattr(fs_ctx *fs, const char *path, char *list, size_t size)
+{
+	LOCKED(fs, ssize_t, STATS_OP_LISTXATTR,
+	       do_listxattr(fs, path, list, size),
+	       path, NULL, 0, size, 0);
+}
+
+int fs_removexattr(fs_ctx *fs, const char *path, const char *name)
+{
+	LOCKED(fs, int, STATS_OP_REMOVEXATTR, do_removexattr(fs, path, name),
+	       path, name, 0, 0, 0);
+}
+
+void fs_compr_stats(fs_ctx *fs, struct vsfs_compr_stats *stats)
+{
+	uint64_t start = stats_now();
+	pthread_mutex_lock(&fs->lock);
+	compress_stats(fs, stats);
+	trace_record(fs, STATS_OP_COMPR_STATS, start, 0, NULL, NULL, 0, 0, 0);
+	pthread_mutex_unlock(&fs->lock);
+	stats_record(fs, STATS_OP_COMPR_STATS, start, 0);
+}
+
+int fs_defrag(fs_ctx *fs, const char *path, struct vsfs_defrag_args *args)
+{
+	LOCKED(fs, int, STATS_OP_DEFRAG, do_defrag(fs, path, args),
+	       path, NULL, 0, 0, args->flags);
+}
+
+int fs_grow(fs_ctx *fs, uint64_t size)
+{
+	LOCKED(fs, int, STATS_OP_GROW, do_grow(fs, size),
+	       NULL, NULL, size, 0, 0);
+}
+
+int fs_trim(fs_ctx *fs, uint64_t *discarded)
+{
+	LOCKED(fs, int, STATS_OP_TRIM, do_trim(fs, discarded),
+	       NULL, NULL, 0, 0, 0);
+}
+
+void fs_free_frag(fs_ctx *fs, struct vsfs_free_frag *frag)
+{
+	uint64_t start = stats_now();
+	pthread_mutex_lock(&fs->lock);
+	defrag_free_frag(fs, frag);
+	trace_record(fs, STATS_OP_FREE_FRAG, start, 0, NULL, NULL, 0, 0, 0);
+	pthread_mutex_unlock(&fs->lock);
+	stats_record(fs, STATS_OP_FREE_FRAG, start, 0);
+}
+
+char *fs_get_stats(fs_ctx *fs, size_t *len)
+{
+	return stats_format(fs, len);
+}
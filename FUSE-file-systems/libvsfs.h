@@ -0,0 +1,574 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+/**
+ * CSC369 Assignment 4 - vsfs library interface.
+ *
+ * The file system operations, independent of FUSE. vsfs.c is a FUSE adapter
+ * on top of these functions; other programs can link libvsfs.a and drive a
+ * file system image in-process.
+ *
+ * All path arguments are absolute paths within the vsfs file system and start
+ * with a '/' that corresponds to the vsfs root directory. Paths to directories
+ * (except for the root directory - "/") do not end in a trailing '/'.
+ *
+ * Every operation takes the file system lock (fs_ctx.lock), so the functions
+ * can be called from multiple threads; the operations are serialized. The
+ * count, latency and bytes transferred of every operation are recorded (see
+ * stats.h and fs_get_stats()).
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/types.h>
+
+#include "fs_ctx.h"
+#include "vsfs.h"
+
+
+/** Mount options. */
+typedef struct fs_opts {
+	/** Deduplicate identical data blocks on write. */
+	bool dedup;
+	/** Compress the data of new files. */
+	bool compress;
+	/** Verify block checksums on read. */
+	bool verify;
+	/** Log-structured write mode (lfs.h). */
+	bool log;
+	/** Give freed blocks back to the host (discard.h). */
+	bool discard;
+	/** Seconds between background scrubber passes; 0 disables it. */
+	unsigned int scrub;
+	/** Record all operations to this trace log file (trace.h); optional. */
+	const char *trace;
+} fs_opts;
+
+/**
+ * Mount a file system image.
+ *
+ * Maps the image file into memory and initializes the context. Background
+ * work (the scrubber, the segment cleaner, the discard thread and the trace
+ * writer) is not started until fs_start() is called.
+ *
+ * @param fs        file system context to initialize.
+ * @param img_path  path to the image file.
+ * @param opts      mount options.
+ * @return          true on success; false on failure.
+ */
+bool fs_mount(fs_ctx *fs, const char *img_path, const fs_opts *opts);
+
+/**
+ * Start the background work of a mounted file system.
+ *
+ * @param fs  pointer to the file system context.
+ * @return    true on success; false if a thread could not be started.
+ */
+bool fs_start(fs_ctx *fs);
+
+/**
+ * Unmount the file system: stop the background work, bring the checksums up
+ * to date and unmap the image. Must cleanup all the resources created in
+ * fs_mount() and fs_start().
+ *
+ * @param fs  pointer to the file system context.
+ */
+void fs_unmount(fs_ctx *fs);
+
+/**
+ * Look up the inode number of the element at the end of a path.
+ *
+ * The hidden snapshot directory is found by name in the root directory even
+ * though it has no entry there.
+ *
+ * Errors:
+ *   EINVAL        the path is not an absolute path.
+ *   ENAMETOOLONG  the path or one of its components is too long.
+ *   ENOENT        a component of the path does not exist.
+ *   ENOTDIR       a component of the path prefix is not a directory.
+ *
+ * @param fs    pointer to the file system context.
+ * @param path  path to a file or directory.
+ * @param ino   pointer to the variable that receives the inode number.
+ * @return      0 on success; -errno on error.
+ */
+int fs_lookup(fs_ctx *fs, const char *path, vsfs_ino_t *ino);
+
+/**
+ * Get file system statistics.
+ *
+ * Same as the statvfs() system call. The f_fsid and f_flag fields are 0.
+ *
+ * @param fs  pointer to the file system context.
+ * @param st  pointer to the struct statvfs that receives the result.
+ * @return    0 on success; -errno on error.
+ */
+int fs_statfs(fs_ctx *fs, struct statvfs *st);
+
+/**
+ * Get file or directory attributes.
+ *
+ * Same as the lstat() system call. Only st_mode, st_nlink, st_size, st_blocks
+ * (in 512-byte units, including the indirect block) and st_mtim are set.
+ *
+ * Errors: see fs_lookup().
+ *
+ * @param fs    pointer to the file system context.
+ * @param path  path to a file or directory.
+ * @param st    pointer to the struct stat that receives the result.
+ * @return      0 on success; -errno on error.
+ */
+int fs_getattr(fs_ctx *fs, const char *path, struct stat *st);
+
+/**
+ * Callback of fs_readdir(), called for each directory entry.
+ *
+ * @param data  user data passed to fs_readdir().
+ * @param name  entry name.
+ * @param ino   inode number of the entry.
+ * @return      0 to continue; nonzero to stop with an ENOMEM error.
+ */
+typedef int (*fs_readdir_fn)(void *data, const char *name, vsfs_ino_t ino);
+
+/**
+ * Read a directory.
+ *
+ * Errors:
+ *   ENOMEM   the callback failed.
+ *   ENOTDIR  the path is not a directory.
+ *   Lookup errors; see fs_lookup().
+ *
+ * @param fs    pointer to the file system context.
+ * @param path  path to the directory.
+ * @param fn    function to call for each directory entry.
+ * @param data  user data passed to fn.
+ * @return      0 on success; -errno on error.
+ */
+int fs_readdir(fs_ctx *fs, const char *path, fs_readdir_fn fn, void *data);
+
+/**
+ * Create a directory.
+ *
+ * Only supported in the snapshot directory, where it creates a snapshot of the
+ * whole file system under the given name (see snapshot.h).
+ *
+ * Errors:
+ *   ENOSYS  the path is not in the snapshot directory.
+ *   ENOSPC  not enough free space in the file system.
+ *   EEXIST  a snapshot with this name already exists.
+ *   EROFS   the path is in a snapshot.
+ *
+ * @param fs    pointer to the file system context.
+ * @param path  path to the directory to create.
+ * @param mode  file mode bits.
+ * @return      0 on success; -errno on error.
+ */
+int fs_mkdir(fs_ctx *fs, const char *path, mode_t mode);
+
+/**
+ * Remove a directory.
+ *
+ * Only supported in the snapshot directory, where it deletes that snapshot
+ * even though it is not empty.
+ *
+ * Errors:
+ *   ENOSYS  the path is not in the snapshot directory.
+ *   ENOENT  the snapshot does not exist.
+ *   EBUSY   the path is the snapshot directory itself.
+ *   EROFS   the path is in a snapshot.
+ *
+ * @param fs    pointer to the file system context.
+ * @param path  path to the directory to remove.
+ * @return      0 on success; -errno on error.
+ */
+int fs_rmdir(fs_ctx *fs, const char *path);
+
+/**
+ * Create a file.
+ *
+ * Errors:
+ *   EINVAL  mode is not a regular file mode.
+ *   EEXIST  the path already exists.
+ *   ENOMEM  not enough memory (e.g. a malloc() call failed).
+ *   ENOSPC  not enough free space in the file system.
+ *   EROFS   the path is in a snapshot.
+ *   Lookup errors for the parent directory; see fs_lookup().
+ *
+ * @param fs    pointer to the file system context.
+ * @param path  path to the file to create.
+ * @param mode  file mode bits; the file type bits may be omitted.
+ * @return      0 on success; -errno on error.
+ */
+int fs_create(fs_ctx *fs, const char *path, mode_t mode);
+
+/**
+ * Remove a file.
+ *
+ * The data blocks are released with the last link, or only unreferenced if
+ * they are shared with a clone or a snapshot.
+ *
+ * Errors:
+ *   EISDIR  the path is a directory.
+ *   EROFS   the path is in a snapshot.
+ *   Lookup errors; see fs_lookup().
+ *
+ * @param fs    pointer to the file system context.
+ * @param path  path to the file to remove.
+ * @return      0 on success; -errno on error.
+ */
+int fs_unlink(fs_ctx *fs, const char *path);
+
+/**
+ * Change the modification time of a file or directory.
+ *
+ * Same as the utimensat() system call, but only the modification time
+ * (times[1]) is used.
+ *
+ * Errors:
+ *   EROFS  the path is in a snapshot.
+ *   Lookup errors; see fs_lookup().
+ *
+ * @param fs     pointer to the file system context.
+ * @param path   path to the file or directory.
+ * @param times  timestamps array. See "man 2 utimensat" for details.
+ * @return       0 on success; -errno on failure.
+ */
+int fs_utimens(fs_ctx *fs, const char *path, const struct timespec times[2]);
+
+/**
+ * Change the size of a file.
+ *
+ * If the file is extended, the new range at the end is filled with zeros.
+ *
+ * Errors:
+ *   EINVAL  the size is negative.
+ *   EISDIR  the path is a directory.
+ *   ENOMEM  not enough memory (e.g. a malloc() call failed).
+ *   ENOSPC  not enough free space in the file system.
+ *   EFBIG   the size exceeds the maximum file size.
+ *   EROFS   the path is in a snapshot.
+ *   EIO     compressed data is corrupted.
+ *   Lookup errors; see fs_lookup().
+ *
+ * @param fs    pointer to the file system context.
+ * @param path  path to the file to set the size.
+ * @param size  new file size in bytes.
+ * @return      0 on success; -errno on error.
+ */
+int fs_truncate(fs_ctx *fs, const char *path, off_t size);
+
+/**
+ * Read data from a file.
+ *
+ * Same as the pread() system call: returns exactly the number of bytes
+ * requested except on EOF. Ranges that have not been written to read as zeros.
+ *
+ * Errors:
+ *   EINVAL  the offset is negative.
+ *   EISDIR  the path is a directory.
+ *   ENOMEM  not enough memory to decompress the data.
+ *   EIO     compressed data is corrupted, or a checksum doesn't match (if
+ *           checksum verification is enabled).
+ *   Lookup errors; see fs_lookup().
+ *
+ * @param fs      pointer to the file system context.
+ * @param path    path to the file to read from.
+ * @param buf     pointer to the buffer that receives the data.
+ * @param size    buffer size (number of bytes requested).
+ * @param offset  offset from the beginning of the file to read from.
+ * @return        number of bytes read on success; 0 if offset is beyond EOF;
+ *                -errno on error.
+ */
+ssize_t fs_read(fs_ctx *fs, const char *path, char *buf, size_t size,
+                off_t offset);
+
+/**
+ * Write data to a file.
+ *
+ * Same as the pwrite() system call: returns exactly the number of bytes
+ * requested except on error. If the offset is beyond EOF, the file is extended
+ * and the hole is filled with zeros.
+ *
+ * Errors:
+ *   EINVAL  the offset is negative.
+ *   EISDIR  the path is a directory.
+ *   ENOMEM  not enough memory (e.g. a malloc() call failed).
+ *   ENOSPC  not enough free space in the file system.
+ *   EFBIG   write would exceed the maximum file size.
+ *   EROFS   the path is in a snapshot.
+ *   EIO     compressed data is corrupted.
+ *   Lookup errors; see fs_lookup().
+ *
+ * @param fs      pointer to the file system context.
+ * @param path    path to the file to write to.
+ * @param buf     pointer to the buffer containing the data.
+ * @param size    buffer size (number of bytes requested).
+ * @param offset  offset from the beginning of the file to write to.
+ * @return        number of bytes written on success; -errno on error.
+ */
+ssize_t fs_write(fs_ctx *fs, const char *path, const char *buf, size_t size,
+                 off_t offset);
+
+/**
+ * Finish writing a file: called when the last open file descriptor of a file
+ * that was opened for writing is closed. A small tail of the file is packed
+ * into a block shared with the tails of other files (see tail.h); failing to
+ * pack it is not an error. Nothing is done for files in snapshots.
+ *
+ * Errors:
+ *   Lookup errors; see fs_lookup().
+ *
+ * @param fs    pointer to the file system context.
+ * @param path  path to the file.
+ * @return      0 on success; -errno on error.
+ */
+int fs_release(fs_ctx *fs, const char *path);
+
+/**
+ * Flush the file system to the image file, after the block checksums are
+ * brought up to date.
+ *
+ * Errors:
+ *   EIO  writing the image failed.
+ *
+ * @param fs  pointer to the file system context.
+ * @return    0 on success; -errno on error.
+ */
+int fs_fsync(fs_ctx *fs);
+
+/**
+ * Share a range of another file with a file (reflink).
+ *
+ * See struct vsfs_clone_args in vsfs.h. No data is copied: the destination
+ * references the source blocks, which are copied on the first write to either
+ * file (see inode_write_block()).
+ *
+ * Errors:
+ *   EINVAL        the offsets or the length are not properly aligned, the
+ *                 range is past the source EOF, or source and destination are
+ *                 the same file or not regular files.
+ *   ENAMETOOLONG  the source path is too long.
+ *   EROFS         the destination is in a snapshot.
+ *   ENOSPC        not enough free space in the file system.
+ *   EFBIG         the clone would exceed the maximum file size.
+ *   EIO           compressed data is corrupted.
+ *   Lookup errors for either path; see fs_lookup().
+ *
+ * @param fs    pointer to the file system context.
+ * @param path  path to the destination file.
+ * @param args  clone arguments.
+ * @return      0 on success; -errno on error.
+ */
+int fs_clone(fs_ctx *fs, const char *path, const struct vsfs_clone_args *args);
+
+/**
+ * Get the inode flags (VSFS_INODE_*) of a file.
+ *
+ * Errors: see fs_lookup().
+ *
+ * @param fs     pointer to the file system context.
+ * @param path   path to the file.
+ * @param flags  pointer to the variable that receives the flags.
+ * @return       0 on success; -errno on error.
+ */
+int fs_getflags(fs_ctx *fs, const char *path, uint32_t *flags);
+
+/**
+ * Set the inode flags of a file. Setting VSFS_INODE_COMPRESS compresses the
+ * existing data of the file.
+ *
+ * Errors:
+ *   EINVAL  unknown flags, or the path is not a regular file.
+ *   EROFS   the path is in a snapshot.
+ *   Lookup errors; see fs_lookup().
+ *
+ * @param fs     pointer to the file system context.
+ * @param path   path to the file.
+ * @param flags  new inode flags.
+ * @return       0 on success; -errno on error.
+ */
+int fs_setflags(fs_ctx *fs, const char *path, uint32_t flags);
+
+/**
+ * Get the value of an extended attribute of a file or directory (see xattr.h).
+ *
+ * Same as the getxattr() system call: if size is 0, only the length of the
+ * value is returned.
+ *
+ * Errors:
+ *   ENODATA  the file has no such attribute.
+ *   ERANGE   the buffer is too small for the value.
+ *   ENOTSUP  the image has no xattr table.
+ *   EIO      the xattr block is corrupted, or its checksum doesn't match (if
+ *            checksum verification is enabled).
+ *   Lookup errors; see fs_lookup().
+ *
+ * @param fs     pointer to the file system context.
+ * @param path   path to the file.
+ * @param name   attribute name.
+ * @param value  pointer to the buffer that receives the value.
+ * @param size   buffer size.
+ * @return       length of the value on success; -errno on error.
+ */
+ssize_t fs_getxattr(fs_ctx *fs, const char *path, const char *name,
+                    char *value, size_t size);
+
+/**
+ * Set an extended attribute of a file or directory.
+ *
+ * Same as the setxattr() system call. All the attributes of a file (names,
+ * values and an 8-byte descriptor each) must fit into a single block.
+ *
+ * Errors:
+ *   EEXIST   XATTR_CREATE is given and the attribute exists.
+ *   ENODATA  XATTR_REPLACE is given and the attribute doesn't exist.
+ *   EINVAL   the name is empty.
+ *   ERANGE   the name is longer than VSFS_XATTR_NAME_MAX.
+ *   ENOSPC   the attributes don't fit into a block, or not enough free space
+ *            in the file system.
+ *   ENOTSUP  the image has no xattr table.
+ *   EROFS    the path is in a snapshot.
+ *   EIO      the xattr block is corrupted.
+ *   Lookup errors; see fs_lookup().
+ *
+ * @param fs     pointer to the file system context.
+ * @param path   path to the file.
+ * @param name   attribute name.
+ * @param value  pointer to the value.
+ * @param size   length of the value.
+ * @param flags  XATTR_CREATE, XATTR_REPLACE or 0.
+ * @return       0 on success; -errno on error.
+ */
+int fs_setxattr(fs_ctx *fs, const char *path, const char *name,
+                const char *value, size_t size, int flags);
+
+/**
+ * List the extended attributes of a file or directory.
+ *
+ * Same as the listxattr() system call: the names are returned one after
+ * another, each null-terminated; if size is 0, only their total length is
+ * returned.
+ *
+ * Errors:
+ *   ERANGE   the buffer is too small for the names.
+ *   ENOTSUP  the image has no xattr table.
+ *   EIO      the xattr block is corrupted.
+ *   Lookup errors; see fs_lookup().
+ *
+ * @param fs    pointer to the file system context.
+ * @param path  path to the file.
+ * @param list  pointer to the buffer that receives the names.
+ * @param size  buffer size.
+ * @return      total length of the names on success; -errno on error.
+ */
+ssize_t fs_listxattr(fs_ctx *fs, const char *path, char *list, size_t size);
+
+/**
+ * Remove an extended attribute of a file or directory.
+ *
+ * Errors:
+ *   ENODATA  the file has no such attribute.
+ *   ENOSPC   the attributes are shared with a snapshot and can't be copied.
+ *   ENOTSUP  the image has no xattr table.
+ *   EROFS    the path is in a snapshot.
+ *   EIO      the xattr block is corrupted.
+ *   Lookup errors; see fs_lookup().
+ *
+ * @param fs    pointer to the file system context.
+ * @param path  path to the file.
+ * @param name  attribute name.
+ * @return      0 on success; -errno on error.
+ */
+int fs_removexattr(fs_ctx *fs, const char *path, const char *name);
+
+/**
+ * Get the compression statistics of the file system.
+ *
+ * @param fs     pointer to the file system context.
+ * @param stats  pointer to the struct that receives the result.
+ */
+void fs_compr_stats(fs_ctx *fs, struct vsfs_compr_stats *stats);
+
+/**
+ * Defragment a regular file, or only report its fragmentation; see
+ * VSFS_IOC_DEFRAG in vsfs.h.
+ *
+ * Errors:
+ *   EINVAL      the path is not a regular file, or unknown flags.
+ *   EOPNOTSUPP  the file system is mounted in log-structured mode.
+ *   ENOSPC      there is no run of free blocks large enough for the file.
+ *   ENOMEM      out of memory.
+ *   Lookup errors; see fs_lookup().
+ *
+ * @param fs    pointer to the file system context.
+ * @param path  path to the file.
+ * @param args  defragmentation flags; receives the result.
+ * @return      0 on success; -errno on error.
+ */
+int fs_defrag(fs_ctx *fs, const char *path, struct vsfs_defrag_args *args);
+
+/**
+ * Get the free space fragmentation of the file system.
+ *
+ * @param fs    pointer to the file system context.
+ * @param frag  pointer to the struct that receives the result.
+ */
+void fs_free_frag(fs_ctx *fs, struct vsfs_free_frag *frag);
+
+/**
+ * Grow the mounted file system; see VSFS_IOC_GROW in vsfs.h and resize.h.
+ *
+ * Errors:
+ *   EINVAL      the size is not a multiple of the block size or is not larger
+ *               than the current size.
+ *   EFBIG       the size is larger than the file system was formatted to
+ *               grow to (mkfs.vsfs -M).
+ *   EOPNOTSUPP  the image file could not be opened for resizing.
+ *   Errors from ftruncate() and mremap(), e.g. ENOSPC.
+ *
+ * @param fs    pointer to the file system context.
+ * @param size  new image size in bytes.
+ * @return      0 on success; -errno on error.
+ */
+int fs_grow(fs_ctx *fs, uint64_t size);
+
+/**
+ * Discard all the free blocks of the file system; see VSFS_IOC_TRIM in vsfs.h
+ * and discard.h.
+ *
+ * Errors:
+ *   EOPNOTSUPP  the image file could not be opened, or the host file system
+ *               does not support punching holes.
+ *   Other errors from fallocate().
+ *
+ * @param fs         pointer to the file system context.
+ * @param discarded  receives the number of bytes discarded.
+ * @return           0 on success; -errno on error.
+ */
+int fs_trim(fs_ctx *fs, uint64_t *discarded);
+
+/**
+ * Get the operation statistics of the file system as text: a line per
+ * operation with its count, errors, bytes transferred and latency, followed
+ * by the latency histograms.
+ *
+ * @param fs   pointer to the file system context.
+ * @param len  pointer to the variable that receives the text length.
+ * @return     text that must be freed by the caller; NULL if out of memory.
+ */
+char *fs_get_stats(fs_ctx *fs, size_t *len);
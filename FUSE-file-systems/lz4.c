@@ -0,0 +1,221 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+/**
+ * CSC369 Assignment 4 - LZ4 block compression.
+ *
+ * This is the LZ4 block format by Yann Collet: a sequence of (literals, match)
+ * pairs, each starting with a token byte that holds both lengths, followed by
+ * a 2-byte match offset. The compressor is a simple greedy one with a single
+ * hash table probe per position.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "lz4.h"
+
+/** Minimum match length. */
+#define MIN_MATCH 4
+/** The last match must start at least this many bytes before the end. */
+#define MF_LIMIT 12
+/** The last bytes of the input are always literals. */
+#define LAST_LITERALS 5
+/** Maximum match offset. */
+#define MAX_OFFSET 65535
+
+#define HASH_LOG 12
+#define HASH_SIZE (1 << HASH_LOG)
+
+
+// Unaligned loads
+static inline uint32_t read32(const uint8_t *p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint32_t hash32(uint32_t v)
+{
+	return (v * 2654435761u) >> (32 - HASH_LOG);
+}
+
+/** Write the extra bytes of a length that doesn't fit into a token nibble. */
+static uint8_t *write_length(uint8_t *op, size_t len)
+{
+	for (; len >= 255; len -= 255) {
+		*op++ = 255;
+	}
+	*op++ = (uint8_t)len;
+	return op;
+}
+
+/** Maximum encoded size of a sequence (without the match length bytes). */
+static inline size_t sequence_size(size_t lit_len)
+{
+	return 1 + lit_len / 255 + 1 + lit_len + 2;
+}
+
+size_t lz4_compress(const void *src, size_t src_size, void *dst,
+                    size_t dst_cap)
+{
+	const uint8_t *in = (const uint8_t *)src;
+	uint8_t *op = (uint8_t *)dst;
+	uint8_t *oend = op + dst_cap;
+	// Input positions + 1; 0 is an empty entry
+	uint32_t table[HASH_SIZE] = {0};
+	size_t anchor = 0;
+	size_t i = 0;
+
+	while (src_size >= MF_LIMIT && i + MF_LIMIT <= src_size) {
+		uint32_t v = read32(in + i);
+		uint32_t h = hash32(v);
+		size_t ref = table[h];
+		table[h] = (uint32_t)(i + 1);
+
+		if (ref == 0 || i - (ref - 1) > MAX_OFFSET ||
+		    read32(in + ref - 1) != v) {
+			// Skip faster through data that doesn't compress
+			i += 1 + ((i - anchor) >> 6);
+			continue;
+		}
+		ref--;
+
+		// Extend the match backwards over the pending literals
+		while (i > anchor && ref > 0 && in[i - 1] == in[ref - 1]) {
+			i--;
+			ref--;
+		}
+		size_t len = MIN_MATCH;
+		while (i + len < src_size - LAST_LITERALS &&
+		       in[i + len] == in[ref + len]) {
+			len++;
+		}
+
+		size_t lit_len = i - anchor;
+		size_t match_len = len - MIN_MATCH;
+		if (sequence_size(lit_len) + match_len / 255 + 1 >
+		    (size_t)(oend - op)) {
+			return 0;
+		}
+
+		uint8_t *token = op++;
+		*token = (uint8_t)((lit_len < 15 ? lit_len : 15) << 4);
+		if (lit_len >= 15) {
+			op = write_length(op, lit_len - 15);
+		}
+		memcpy(op, in + anchor, lit_len);
+		op += lit_len;
+
+		size_t offset = i - ref;
+		*op++ = (uint8_t)offset;
+		*op++ = (uint8_t)(offset >> 8);
+		*token |= (uint8_t)(match_len < 15 ? match_len : 15);
+		if (match_len >= 15) {
+			op = write_length(op, match_len - 15);
+		}
+
+		i += len;
+		anchor = i;
+	}
+
+	// The last sequence only has literals
+	size_t lit_len = src_size - anchor;
+	if (sequence_size(lit_len) - 2 > (size_t)(oend - op)) {
+		return 0;
+	}
+	*op++ = (uint8_t)((lit_len < 15 ? lit_len : 15) << 4);
+	if (lit_len >= 15) {
+		op = write_length(op, lit_len - 15);
+	}
+	memcpy(op, in + anchor, lit_len);
+	op += lit_len;
+
+	return op - (uint8_t *)dst;
+}
+
+/** Read the extra bytes of a length; returns false on truncated input. */
+static bool read_length(const uint8_t **ip, const uint8_t *iend, size_t *len)
+{
+	uint8_t b;
+	do {
+		if (*ip >= iend) {
+			return false;
+		}
+		b = *(*ip)++;
+		*len += b;
+	} while (b == 255);
+	return true;
+}
+
+long lz4_decompress(const void *src, size_t src_size, void *dst,
+                    size_t dst_cap)
+{
+	const uint8_t *ip = (const uint8_t *)src;
+	const uint8_t *iend = ip + src_size;
+	uint8_t *op = (uint8_t *)dst;
+	uint8_t *oend = op + dst_cap;
+
+	while (ip < iend) {
+		uint8_t token = *ip++;
+
+		size_t lit_len = token >> 4;
+		if (lit_len == 15 && !read_length(&ip, iend, &lit_len)) {
+			return -1;
+		}
+		if (lit_len > (size_t)(iend - ip) || lit_len > (size_t)(oend - op)) {
+			return -1;
+		}
+		memcpy(op, ip, lit_len);
+		ip += lit_len;
+		op += lit_len;
+		if (ip == iend) {
+			// Last sequence
+			break;
+		}
+
+		if (iend - ip < 2) {
+			return -1;
+		}
+		size_t offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if (offset == 0 || offset > (size_t)(op - (uint8_t *)dst)) {
+			return -1;
+		}
+
+		size_t len = token & 15;
+		if (len == 15 && !read_length(&ip, iend, &len)) {
+			return -1;
+		}
+		len += MIN_MATCH;
+		if (len > (size_t)(oend - op)) {
+			return -1;
+		}
+
+		const uint8_t *match = op - offset;
+		if (offset >= len) {
+			memcpy(op, match, len);
+			op += len;
+		} else {
+			// Overlapping match repeats the last offset bytes
+			while (len-- > 0) {
+				*op++ = *match++;
+			}
+		}
+	}
+
+	return op - (uint8_t *)dst;
+}
@@ -0,0 +1,48 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+/**
+ * CSC369 Assignment 4 - LZ4 block compression.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+
+/**
+ * Compress a buffer into the LZ4 block format.
+ *
+ * @param src       pointer to the data to compress.
+ * @param src_size  data size in bytes.
+ * @param dst       pointer to the buffer that receives the compressed data.
+ * @param dst_cap   size of the dst buffer in bytes.
+ * @return          compressed size in bytes; 0 if it doesn't fit into dst.
+ */
+size_t lz4_compress(const void *src, size_t src_size, void *dst,
+                    size_t dst_cap);
+
+/**
+ * Decompress an LZ4 block. Malformed input is detected and never causes
+ * accesses outside of the buffers.
+ *
+ * @param src       pointer to the compressed data.
+ * @param src_size  compressed data size in bytes.
+ * @param dst       pointer to the buffer that receives the data.
+ * @param dst_cap   size of the dst buffer in bytes.
+ * @return          decompressed size in bytes; -1 if the input is malformed
+ *                  or doesn't fit into dst.
+ */
+long lz4_decompress(const void *src, size_t src_size, void *dst,
+                    size_t dst_cap);
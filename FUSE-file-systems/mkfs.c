@@ -16,15 +16,23 @@
  * CSC369 Assignment 4 - vsfs formatting tool.
  */
 
+#define _GNU_SOURCE
+
+#include <fcntl.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 #include <sys/mman.h>
 #include "vsfs.h"
 #include "bitmap.h"
+#include "crc32c.h"
 #include "map.h"
+#include "populate.h"
+#include "stripe.h"
+#include "util.h"
 
 /** Command line options. */
 typedef struct mkfs_opts {
@@ -32,6 +40,20 @@ typedef struct mkfs_opts {
 	const char *img_path;
 	/** Number of inodes. */
 	size_t n_inodes;
+	/** Block size in bytes. */
+	size_t block_size;
+	/** Number of blocks in a block group. */
+	size_t blocks_per_group;
+	/** Host directory to copy into the image; NULL if none. */
+	const char *src_dir;
+	/** Number of threads that copy file data from src_dir. */
+	unsigned threads;
+	/** Number of blocks the file system can grow to; 0 for the default. */
+	size_t max_blocks;
+	/** Stripe unit in bytes of a striped image; 0 for the default. */
+	size_t stripe_unit;
+	/** Number of image files (set by main()); more than 1 if striped. */
+	unsigned stripe_count;
 
 	/** Print help and exit. */
 	bool help;
@@ -46,27 +68,66 @@ static const char *help_str = "\
 Usage: %s options image\n\
 \n\
 Format the image file into vsfs file system. The file must exist and\n\
-its size must be a multiple of vsfs block size - %zu bytes.\n\
+its size must be a multiple of the vsfs block size.\n\
+\n\
+The image can be striped over several files of the same size (e.g. on\n\
+different disks) by giving their paths separated by '%c' as the image,\n\
+e.g. /disk0/img%c/disk1/img. The same path must then be used to mount\n\
+or check the file system. A path that names an existing file is always a\n\
+single image, even if it contains '%c'.\n\
 \n\
 Options:\n\
     -i num  number of inodes; required argument\n\
+    -b size block size in bytes; a power of 2 from %d to %d\n\
+            (default: %d)\n\
+    -g num  number of blocks in a block group; a multiple of %d\n\
+            (default: %d)\n\
+    -d dir  copy the files and directories in dir into the image\n\
+    -j num  number of threads that copy file data for -d\n\
+            (default: number of CPUs)\n\
+    -M num  maximum number of blocks the file system can be grown to\n\
+            (default: 16 times the image size, at most 8 times the\n\
+            block size; the image size if it is striped)\n\
+    -S size stripe unit in bytes of a striped image; a multiple of\n\
+            the block size and the page size (default: %d)\n\
     -h      print help and exit\n\
     -f      force format - overwrite existing vsfs file system\n\
-    -z      zero out image contents\n\
+    -z      zero out image contents (otherwise the inode table is\n\
+            initialized lazily by the mounted file system)\n\
 ";
 
+/** Default stripe unit of a striped image. */
+#define STRIPE_UNIT_DEFAULT (512 * 1024)
+
 static void print_help(FILE *f, const char *progname)
 {
-	fprintf(f, help_str, progname, VSFS_BLOCK_SIZE);
+	fprintf(f, help_str, progname, STRIPE_SEP, STRIPE_SEP, STRIPE_SEP,
+	        VSFS_BLOCK_SIZE_MIN, VSFS_BLOCK_SIZE_MAX, VSFS_BLOCK_SIZE_MIN,
+	        VSFS_GROUP_ALIGN, VSFS_BLOCKS_PER_GROUP, STRIPE_UNIT_DEFAULT);
 }
 
 
 static bool parse_args(int argc, char *argv[], mkfs_opts *opts)
 {
 	char o;
-	while ((o = getopt(argc, argv, "i:hfvz")) != -1) {
+	while ((o = getopt(argc, argv, "i:b:g:d:j:M:S:hfvz")) != -1) {
 		switch (o) {
 			case 'i': opts->n_inodes = strtoul(optarg, NULL, 10); break;
+			case 'b': opts->block_size = strtoul(optarg, NULL, 10); break;
+			case 'g': opts->blocks_per_group = strtoul(optarg, NULL, 10);
+			          break;
+			case 'd': opts->src_dir = optarg; break;
+			case 'j': opts->threads = strtoul(optarg, NULL, 10);
+			          if (opts->threads == 0) {
+			                  fprintf(stderr, "Invalid number "
+			                          "of threads\n");
+			                  return false;
+			          }
+			          break;
+			case 'M': opts->max_blocks = strtoul(optarg, NULL, 10);
+			          break;
+			case 'S': opts->stripe_unit = strtoul(optarg, NULL, 10);
+			          break;
 
 			case 'h': opts->help  = true; return true;// skip other arguments
 			case 'f': opts->force = true; break;
@@ -87,6 +148,34 @@ static bool parse_args(int argc, char *argv[], mkfs_opts *opts)
 		fprintf(stderr, "Missing or invalid number of inodes\n");
 		return false;
 	}
+	if (opts->threads == 0) {
+		long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+		opts->threads = ncpus > 0 ? ncpus : 1;
+	}
+	if (opts->block_size == 0) {
+		opts->block_size = VSFS_BLOCK_SIZE_MIN;
+	}
+	if (opts->block_size > VSFS_BLOCK_SIZE_MAX ||
+	    !vsfs_block_size_valid(opts->block_size)) {
+		fprintf(stderr, "Invalid block size\n");
+		return false;
+	}
+	if (opts->blocks_per_group == 0) {
+		opts->blocks_per_group = VSFS_BLOCKS_PER_GROUP;
+	}
+	if (opts->blocks_per_group % VSFS_GROUP_ALIGN != 0 ||
+	    opts->blocks_per_group > vsfs_blk_max(opts->block_size)) {
+		fprintf(stderr, "Invalid number of blocks per group\n");
+		return false;
+	}
+	if (opts->stripe_unit == 0) {
+		opts->stripe_unit = STRIPE_UNIT_DEFAULT;
+	}
+	if (opts->stripe_unit % opts->block_size != 0 ||
+	    opts->stripe_unit > UINT32_MAX) {
+		fprintf(stderr, "Invalid stripe unit\n");
+		return false;
+	}
 	return true;
 }
 
@@ -106,13 +195,54 @@ static bool vsfs_is_present(void *image)
 }
 
 
+/**
+ * Initialize an empty directory with '.' and '..' entries.
+ *
+ * @param image   pointer to the start of the mmap'd image.
+ * @param bs      block size in bytes.
+ * @param dir     pointer to the directory inode (in inode table).
+ * @param self    inode number of the directory.
+ * @param parent  inode number of the parent directory.
+ * @param blk     data block for the directory entries (already allocated).
+ * @return        true on success; false on error.
+ */
+static bool init_dir(void *image, uint32_t bs, vsfs_inode *dir,
+                     vsfs_ino_t self, vsfs_ino_t parent, vsfs_blk_t blk)
+{
+	vsfs_dentry *entries = (vsfs_dentry *)(image + (size_t)blk * bs);
+
+	memset(dir, 0, sizeof(*dir));
+	dir->i_mode = S_IFDIR | 0777;
+	dir->i_blocks = 1;
+	dir->i_nlink = 2;
+	dir->i_size = bs;
+	dir->i_direct[0] = blk;
+	if (clock_gettime(CLOCK_REALTIME, &(dir->i_mtime)) != 0) {
+		perror("clock_gettime");
+		return false;
+	}
+
+	entries[0].ino = self;
+	entries[1].ino = parent;
+	strcpy(entries[0].name, ".");
+	strcpy(entries[1].name, "..");
+
+	// Initialize other dir entries in block to invalid / unused state
+	// Since 0 is a valid inode, use VSFS_INO_MAX to indicate invalid.
+	int num_entry_one_block = vsfs_dentries_per_block(bs);
+	for(int j = 2; j < num_entry_one_block; j++){
+		entries[j].ino = VSFS_INO_MAX;
+	}
+	return true;
+}
+
+
 /**
  * Format the image into vsfs.
  *
  * NOTE: Must update mtime of the root directory.
  *
- * @param fd     open file descriptor for the disk image file
- * @param buf    scratch buffer of at least VSFS_BLOCK_SIZE bytes
+ * @param image  pointer to the start of the mmap'd image.
  * @param size   image file size in bytes.
  * @param opts   command line options.
  * @return       true on success;
@@ -128,28 +258,48 @@ static bool mkfs(void *image, size_t size, mkfs_opts *opts)
 	bitmap_t        *ibmap;    // ptr to inode bitmap in mmap'd disk image
 	bitmap_t        *dbmap;    // ptr to data block bitmap in mmap'd image
 	vsfs_inode      *itable;   // ptr to inode table in mmap'd image
+	vsfs_rc_t       *rctable;  // ptr to refcount table in mmap'd image
+	vsfs_csum_t     *csumtable;// ptr to checksum table in mmap'd image
 
-	vsfs_inode  *root_ino;     // ptr to root inode (in inode table)
-	vsfs_dentry *root_entries; // ptr to root dir data block in mmap'd image
 	
-	vsfs_blk_t nblks = size / VSFS_BLOCK_SIZE;
-	uint32_t   inodes_per_block = VSFS_BLOCK_SIZE / sizeof(vsfs_inode);
+	uint32_t   bs = opts->block_size;
+	vsfs_blk_t nblks = size / bs;
+	uint32_t   inodes_per_block = vsfs_inodes_per_block(bs);
+	vsfs_blk_t blk_max = vsfs_blk_max(bs);
 	bool       ret = false;
 	
-	if (opts->n_inodes >= VSFS_INO_MAX) {
+	if (opts->n_inodes >= VSFS_INO_MAX || opts->n_inodes <= VSFS_SNAP_INO) {
 		return false;
 	}
 
-	if (nblks > VSFS_BLK_MAX || nblks < VSFS_BLK_MIN) {
+	if (size % bs != 0 || nblks > blk_max || nblks < VSFS_BLK_MIN) {
+		return false;
+	}
+
+	// The refcount and checksum tables are sized for the largest size the
+	// file system can be grown to
+	// Striped images can't grow
+	vsfs_blk_t max_blks = opts->max_blocks;
+	if (max_blks == 0 && opts->stripe_count > 1) {
+		max_blks = nblks;
+	} else if (max_blks == 0) {
+		max_blks = (uint64_t)nblks * 16 < blk_max ? nblks * 16 : blk_max;
+	}
+	if (opts->max_blocks > blk_max || max_blks < nblks) {
+		fprintf(stderr, "Invalid maximum number of blocks\n");
 		return false;
 	}
 
+	// An existing file system stays invalid until the new one is complete
+	sb = (vsfs_superblock *)image;
+	sb->magic = 0;
+
 	// Initialize inode bitmap in memory (write to disk happens at munmap).
 	// First set all bits to 1, then use bitmap_init to clear the bits
 	// for the given number of inodes in the file system.
 	
-	ibmap = (bitmap_t *)(image + VSFS_IMAP_BLKNUM * VSFS_BLOCK_SIZE);	
-	memset(ibmap, 0xff, VSFS_BLOCK_SIZE);
+	ibmap = (bitmap_t *)(image + VSFS_IMAP_BLKNUM * bs);	
+	memset(ibmap, 0xff, bs);
 	bitmap_init(ibmap, opts->n_inodes);
       
 	
@@ -157,8 +307,8 @@ static bool mkfs(void *image, size_t size, mkfs_opts *opts)
 	// First set all bits to 1, then use bitmap_init to clear the bits
 	// for the given number of blocks in the file system.
 	
-	dbmap = (bitmap_t *)(image + VSFS_DMAP_BLKNUM * VSFS_BLOCK_SIZE);
-	memset(dbmap, 0xff, VSFS_BLOCK_SIZE);
+	dbmap = (bitmap_t *)(image + VSFS_DMAP_BLKNUM * bs);
+	memset(dbmap, 0xff, bs);
 	bitmap_init(dbmap, nblks);
 
 	// Mark first 3 blocks (superblock, inode bitmap, data bitmap) allocated.
@@ -166,62 +316,110 @@ static bool mkfs(void *image, size_t size, mkfs_opts *opts)
 	bitmap_set(dbmap, nblks, VSFS_IMAP_BLKNUM, true); // inode bitmap block
 	bitmap_set(dbmap, nblks, VSFS_DMAP_BLKNUM, true); // data bitmap block
 	
-	// TODO: Calculate size of inode table and mark inode table blocks allocated.
-	int num_inodes_table_blocks = opts->n_inodes / inodes_per_block;
-	//int size_inode_table = VSFS_BLOCK_SIZE * num_inodes_table_blocks;
-	for(int i = VSFS_ITBL_BLKNUM; i < (num_inodes_table_blocks + VSFS_ITBL_BLKNUM) ; i++){
+	// Calculate size of inode table, refcount table, checksum table and
+	// xattr table and mark their blocks allocated. Each table follows the
+	// previous one.
+	uint32_t num_itable_blocks = div_round_up(opts->n_inodes,
+	                                          inodes_per_block);
+	vsfs_blk_t rc_region = VSFS_ITBL_BLKNUM + num_itable_blocks;
+	vsfs_blk_t csum_region = rc_region + vsfs_rc_blocks(max_blks, bs);
+	vsfs_blk_t xattr_region = csum_region + vsfs_csum_blocks(max_blks, bs);
+	vsfs_blk_t data_region = xattr_region
+	                         + vsfs_xattr_blocks(opts->n_inodes, bs);
+	if (data_region + 2 > nblks) {
+		// No room left for the root and snapshot directories
+		return false;
+	}
+	for (vsfs_blk_t i = VSFS_ITBL_BLKNUM; i < data_region; i++) {
 		bitmap_set(dbmap, nblks, i, true);
 	}
-	
+
+	// Split the blocks into groups, and the inodes evenly between them
+	uint32_t num_groups = div_round_up(nblks, opts->blocks_per_group);
+	// Groups don't share inode table blocks; with the smallest block size
+	// that is the same as VSFS_GROUP_ALIGN
+	uint32_t inodes_per_group = align_up(div_round_up(opts->n_inodes,
+	                                                  num_groups),
+	                                     inodes_per_block);
+
+	// Only the first inode table block (root and snapshot directories) is
+	// initialized now; the mounted file system zeroes the rest on demand. A
+	// zeroed image is initialized already.
+	uint32_t itable_init = opts->zero ? 0 : 1;
+	if (!opts->zero) {
+		memset(image + VSFS_ITBL_BLKNUM * bs, 0, bs);
+	}
+
+	// All blocks start out unreferenced
+	rctable = (vsfs_rc_t *)(image + (size_t)rc_region * bs);
+	memset(rctable, 0, (size_t)vsfs_rc_blocks(max_blks, bs) * bs);
+	csumtable = (vsfs_csum_t *)(image + (size_t)csum_region * bs);
+	memset(csumtable, 0, (size_t)vsfs_csum_blocks(max_blks, bs) * bs);
+	// No inode has extended attributes
+	memset(image + (size_t)xattr_region * bs, 0,
+	       (size_t)(data_region - xattr_region) * bs);
 
 	// TODO: Initialize the root directory.
 	// 1. Mark root directory inode allocated in inode bitmap
+	//    The hidden snapshot directory is created the same way.
 	bitmap_set(ibmap, opts->n_inodes, VSFS_ROOT_INO, true);
+	bitmap_set(ibmap, opts->n_inodes, VSFS_SNAP_INO, true);
 
 	// 2. Initialize fields of root dir inode (the mtime is done for you)
-	itable = (vsfs_inode *)(image + VSFS_ITBL_BLKNUM * VSFS_BLOCK_SIZE);	
-	root_ino = &itable[VSFS_ROOT_INO];
-	root_ino->i_mode = S_IFDIR | 0777;
-	root_ino->i_blocks = 1;
-	root_ino->i_nlink = 2;
-	root_ino->i_size = VSFS_BLOCK_SIZE;
-	
-	if (clock_gettime(CLOCK_REALTIME, &(root_ino->i_mtime)) != 0) {
-		perror("clock_gettime");
-		goto out;
-	}
-	
 	// 3. Allocate a data block for root directory; record it in root inode
-	root_entries = (vsfs_dentry *) (image + VSFS_BLOCK_SIZE * (VSFS_ITBL_BLKNUM + num_inodes_table_blocks));
-	bitmap_set(dbmap, nblks, VSFS_BLOCK_SIZE * (VSFS_ITBL_BLKNUM + num_inodes_table_blocks), true);
-	root_ino->i_direct[0] = VSFS_ITBL_BLKNUM + num_inodes_table_blocks;
-	
+	//    The first data blocks are used; each is referenced once.
 	// 4. Create '.' and '..' entries in root dir data block.
-	root_entries[0].ino = VSFS_ROOT_INO;
-	root_entries[1].ino = VSFS_ROOT_INO;
-	strcpy(root_entries[0].name, ".");
-	strcpy(root_entries[1].name, "..");
-
-	
-	// 5. Initialize other dir entries in block to invalid / unused state
-	//    Since 0 is a valid inode, use VSFS_INO_MAX to indicate invalid.
-	int num_entry_one_block = VSFS_BLOCK_SIZE / sizeof(vsfs_dentry);
-	for(int j = 2; j < num_entry_one_block; j++){
-		root_entries[j].ino = VSFS_INO_MAX;
+	itable = (vsfs_inode *)(image + VSFS_ITBL_BLKNUM * bs);	
+	for (vsfs_blk_t blk = data_region; blk < data_region + 2; blk++) {
+		bitmap_set(dbmap, nblks, blk, true);
+		rctable[blk] = 1;
+	}
+	if (!init_dir(image, bs, &itable[VSFS_ROOT_INO], VSFS_ROOT_INO,
+	              VSFS_ROOT_INO, data_region) ||
+	    !init_dir(image, bs, &itable[VSFS_SNAP_INO], VSFS_SNAP_INO,
+	              VSFS_ROOT_INO, data_region + 1)) {
+		goto out;
 	}
-
-	
 	
 	// TODO: Initialize fields of superblock after everything else succeeds.
-	// Set start of data region to first block after inode table.
-	sb = (vsfs_superblock *) image;
-	sb->magic = VSFS_MAGIC;
+	// Set start of data region to first block after refcount table.
 	sb->size = size;
 	sb->num_inodes = opts->n_inodes;
-	sb->free_inodes = sb->num_inodes--;
+	sb->free_inodes = sb->num_inodes - 2;
 	sb->num_blocks = nblks;
-	sb->free_blocks = nblks - 3 - (int) num_inodes_table_blocks;
-	sb->data_region = VSFS_ITBL_BLKNUM + num_inodes_table_blocks;
+	sb->free_blocks = nblks - data_region - 2;
+	sb->data_region = data_region;
+	sb->rc_region = rc_region;
+	sb->csum_region = csum_region;
+	sb->blocks_per_group = opts->blocks_per_group;
+	sb->inodes_per_group = inodes_per_group;
+	sb->itable_init = itable_init;
+	sb->max_blocks = max_blks;
+	sb->block_size = bs;
+	sb->xattr_region = xattr_region;
+	sb->stripe_unit = opts->stripe_count > 1 ? opts->stripe_unit : 0;
+	sb->stripe_count = opts->stripe_count;
+
+	// Copy the source directory tree; this also checksums the data blocks
+	if (opts->src_dir != NULL && !populate(image, opts->src_dir,
+	                                       opts->threads)) {
+		goto out;
+	}
+	// Only a complete image is marked as formatted, so that a failed
+	// populate doesn't leave a mountable half-written one behind
+	sb->magic = VSFS_MAGIC;
+
+	// Checksum the initialized metadata blocks and the two directory blocks
+	vsfs_blk_t itable_end = sb->itable_init == 0
+	                      ? rc_region : VSFS_ITBL_BLKNUM + sb->itable_init;
+	for (vsfs_blk_t blk = 0; blk < data_region + 2; blk++) {
+		if (blk >= itable_end && blk < rc_region) {
+			continue;
+		}
+		if (blk < csum_region || blk >= xattr_region) {
+			csumtable[blk] = crc32c(0, image + (size_t)blk * bs, bs);
+		}
+	}
 	
 	ret = true;
  out:
@@ -229,9 +427,53 @@ static bool mkfs(void *image, size_t size, mkfs_opts *opts)
 }
 
 
+/**
+ * Zero the contents of a file without writing them: deallocate its blocks,
+ * or have the file system zero the range if it can't punch holes.
+ *
+ * @param fd    open file descriptor.
+ * @param size  file size in bytes.
+ * @return      true on success; false if not supported (or on error).
+ */
+static bool zero_fd(int fd, size_t size)
+{
+	return fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+	                 0, size) == 0 ||
+	       fallocate(fd, FALLOC_FL_ZERO_RANGE, 0, size) == 0;
+}
+
+/**
+ * Zero the contents of the image file(s); see zero_fd().
+ *
+ * @param path  image file path, or member file paths of a striped image.
+ * @param size  image size in bytes.
+ * @return      true on success; false if not supported (or on error).
+ */
+static bool zero_file(const char *path, size_t size)
+{
+	stripe_set *set = stripe_is_set(path) ? stripe_open(path) : NULL;
+	if (set != NULL) {
+		bool ret = true;
+		for (unsigned int i = 0; i < set->count && ret; ++i) {
+			ret = zero_fd(set->fds[i], size / set->count);
+		}
+		stripe_close(set);
+		return ret;
+	}
+
+	int fd = open(path, O_RDWR);
+	if (fd < 0) {
+		return false;
+	}
+	bool ret = zero_fd(fd, size);
+	close(fd);
+	return ret;
+}
+
+
 int main(int argc, char *argv[])
 {
-	int ret; // return value; 0 on success, 1 on failure
+	int ret = 1; // return value; 0 on success, 1 on failure
 	size_t fsize; // size of disk image file 
 	void *image;  // pointer to mmap'd disk image file
 	mkfs_opts opts = {0}; // options; defaults are all 0
@@ -248,8 +490,19 @@ int main(int argc, char *argv[])
 		return 0;
 	}
 
-	// Map disk image file into memory
-	image = map_file(opts.img_path, VSFS_BLOCK_SIZE, &fsize);
+	// Map disk image file (or the files of a striped image) into memory
+	opts.stripe_count = 1;
+	if (stripe_is_set(opts.img_path)) {
+		stripe_set *set = stripe_open(opts.img_path);
+		if (set == NULL) {
+			return 1;
+		}
+		opts.stripe_count = set->count;
+		image = stripe_map(set, opts.stripe_unit, &fsize);
+		stripe_close(set);
+	} else {
+		image = map_file(opts.img_path, opts.block_size, &fsize);
+	}
 	if (image == NULL) {
 		return 1;
 	}
@@ -261,8 +514,11 @@ int main(int argc, char *argv[])
 	}
 
 	if (opts.zero) {
-		// Fill buffer with zeros
-		memset(image, 0, fsize);
+		// Let the file system zero the image (the mapping sees the new
+		// contents); write the zeros ourselves if it can't
+		if (!zero_file(opts.img_path, fsize)) {
+			memset(image, 0, fsize);
+		}
 	}
 	
 	if (!mkfs(image, fsize, &opts)) {
@@ -31,6 +31,13 @@
 static const struct fuse_opt opt_spec[] = {
 	VSFS_OPT("-h"    , help),
 	VSFS_OPT("--help", help),
+	VSFS_OPT("dedup" , dedup),
+	VSFS_OPT("compress", compress),
+	VSFS_OPT("verify", verify),
+	VSFS_OPT("log", log),
+	VSFS_OPT("discard", discard),
+	{ "scrub=%u", offsetof(vsfs_opts, scrub), 0 },
+	{ "trace=%s", offsetof(vsfs_opts, trace), 0 },
 	FUSE_OPT_END
 };
 
@@ -39,11 +46,27 @@ Usage: %s image mountpoint [options]\n\
 \n\
 Mount vsfs image file under mount point directory. Use fusermount(1) to \n\
 unmount. Only single-threaded mount is supported; -s FUSE option is implied.\n\
+A striped image is given as its files separated by ':' (see mkfs.vsfs -h);\n\
+a path that names an existing file is always a single image.\n\
 \n\
 general options:\n\
     -o opt,[opt...]        mount options\n\
     -h   --help            print help\n\
 \n\
+vsfs options:\n\
+    -o dedup               share identical data blocks written through this\n\
+                           mount (see also vsfs-dedup)\n\
+    -o compress            compress the data of files created through this\n\
+                           mount (see also vsfsctl compress)\n\
+    -o verify              verify block checksums when reading file data\n\
+    -o log                 log-structured writes: allocate blocks sequentially\n\
+                           and write modified data to new blocks\n\
+    -o discard             punch freed blocks out of the image file in the\n\
+                           background (see also fstrim.vsfs)\n\
+    -o scrub=SECONDS       verify all block checksums in the background\n\
+                           every SECONDS seconds\n\
+    -o trace=FILE          record all operations to FILE (see vsfs-replay)\n\
+\n\
 ";
 
 // Callback for fuse_opt_parse()
@@ -29,6 +29,20 @@ typedef struct vsfs_opts {
 	const char *img_path;
 	/** Print help and exit. FUSE option. */
 	int help;
+	/** Deduplicate identical data blocks on write. */
+	int dedup;
+	/** Compress the data of new files. */
+	int compress;
+	/** Verify block checksums on read. */
+	int verify;
+	/** Log-structured write mode. */
+	int log;
+	/** Punch freed blocks out of the image file. */
+	int discard;
+	/** Seconds between background scrubber passes; 0 disables it. */
+	unsigned int scrub;
+	/** Operation trace log file path; NULL if not recording. */
+	const char *trace;
 
 } vsfs_opts;
 
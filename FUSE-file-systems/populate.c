@@ -0,0 +1,875 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+/**
+ * CSC369 Assignment 4 - Populating a new image from a host directory.
+ */
+
+#include <assert.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bitmap.h"
+#include "crc32c.h"
+#include "populate.h"
+#include "util.h"
+
+
+/** Block group free space counters (see group.h). */
+typedef struct pop_group {
+	uint32_t free_inodes;
+	uint32_t free_blocks;
+	uint32_t dirs;
+} pop_group;
+
+/** Regular file whose data is copied by the worker threads. */
+typedef struct pop_file {
+	/** Host path. */
+	char *path;
+	vsfs_ino_t ino;
+} pop_file;
+
+/** Populate state. */
+typedef struct pop_ctx {
+	void *image;
+	/** Block size in bytes. */
+	uint32_t block_size;
+	vsfs_superblock *sb;
+	bitmap_t *ibmap;
+	bitmap_t *dbmap;
+	vsfs_inode *itable;
+	vsfs_rc_t *rctable;
+	vsfs_csum_t *csumtable;
+
+	/** Block groups; a single group on images without them. */
+	uint32_t ngroups;
+	uint32_t blocks_per_group;
+	uint32_t inodes_per_group;
+	pop_group *groups;
+
+	/** Tail block that packed tails are added to (see VSFS_INODE_TAIL). */
+	vsfs_blk_t tail_blk;
+	/** Number of bytes of tail_blk used. */
+	uint32_t tail_used;
+
+	/** Files to copy. */
+	pop_file *files;
+	size_t nfiles;
+	size_t files_cap;
+
+	/** Next file to copy; shared by the worker threads. */
+	size_t next;
+	/** Set by a worker thread when a copy fails. */
+	bool failed;
+} pop_ctx;
+
+
+static void *block_addr(const pop_ctx *ctx, vsfs_blk_t blk)
+{
+	return (char *)ctx->image + (size_t)blk * ctx->block_size;
+}
+
+static void update_csum(pop_ctx *ctx, vsfs_blk_t blk)
+{
+	ctx->csumtable[blk] = crc32c(0, block_addr(ctx, blk), ctx->block_size);
+}
+
+/** Get the range of block numbers [*start, *end) in a group. */
+static void group_blocks(const pop_ctx *ctx, uint32_t g, vsfs_blk_t *start,
+                         vsfs_blk_t *end)
+{
+	*start = g * ctx->blocks_per_group;
+	*end = *start + ctx->blocks_per_group;
+	if (*end > ctx->sb->num_blocks) {
+		*end = ctx->sb->num_blocks;
+	}
+}
+
+/** Get the range of inode numbers [*start, *end) in a group (may be empty). */
+static void group_inodes(const pop_ctx *ctx, uint32_t g, vsfs_ino_t *start,
+                         vsfs_ino_t *end)
+{
+	uint32_t n = ctx->sb->num_inodes;
+	*start = g * ctx->inodes_per_group;
+	*end = *start + ctx->inodes_per_group;
+	if (*start > n) {
+		*start = n;
+	}
+	if (*end > n) {
+		*end = n;
+	}
+}
+
+static bool init_groups(pop_ctx *ctx)
+{
+	vsfs_superblock *sb = ctx->sb;
+	if (sb->blocks_per_group == 0) {
+		ctx->ngroups = 1;
+		ctx->blocks_per_group = sb->num_blocks;
+		ctx->inodes_per_group = sb->num_inodes;
+	} else {
+		ctx->ngroups = div_round_up(sb->num_blocks, sb->blocks_per_group);
+		ctx->blocks_per_group = sb->blocks_per_group;
+		ctx->inodes_per_group = sb->inodes_per_group;
+	}
+
+	ctx->groups = calloc(ctx->ngroups, sizeof(*ctx->groups));
+	if (ctx->groups == NULL) {
+		perror("calloc");
+		return false;
+	}
+	for (uint32_t g = 0; g < ctx->ngroups; ++g) {
+		vsfs_blk_t bstart, bend;
+		vsfs_ino_t istart, iend;
+
+		group_blocks(ctx, g, &bstart, &bend);
+		group_inodes(ctx, g, &istart, &iend);
+		ctx->groups[g].free_blocks = bitmap_count_free(ctx->dbmap,
+		                                 sb->num_blocks, bstart, bend);
+		ctx->groups[g].free_inodes = bitmap_count_free(ctx->ibmap,
+		                                 sb->num_inodes, istart, iend);
+	}
+	// The root directory
+	ctx->groups[0].dirs = 1;
+	return true;
+}
+
+
+/** Make sure that the inode table block of an inode is initialized. */
+static void prepare_inode(pop_ctx *ctx, vsfs_ino_t ino)
+{
+	uint32_t blk = ino / vsfs_inodes_per_block(ctx->block_size);
+	uint32_t init = ctx->sb->itable_init;
+
+	if (init != 0 && blk >= init) {
+		memset(block_addr(ctx, VSFS_ITBL_BLKNUM + init), 0,
+		       (size_t)(blk + 1 - init) * ctx->block_size);
+		ctx->sb->itable_init = blk + 1;
+	}
+}
+
+/**
+ * Allocate an inode. Top-level directories go to the group with the most
+ * free blocks (the fewest directories among equals); other inodes to the
+ * group of the parent directory, or the next group with free inodes.
+ */
+static bool alloc_inode(pop_ctx *ctx, vsfs_ino_t parent, bool dir,
+                        vsfs_ino_t *ino)
+{
+	uint32_t g = parent / ctx->inodes_per_group;
+
+	if (dir && parent == VSFS_ROOT_INO) {
+		uint32_t best = ctx->ngroups;
+		for (uint32_t i = 0; i < ctx->ngroups; ++i) {
+			pop_group *desc = &ctx->groups[i];
+			if (desc->free_inodes == 0) {
+				continue;
+			}
+			if (best == ctx->ngroups ||
+			    desc->free_blocks > ctx->groups[best].free_blocks ||
+			    (desc->free_blocks == ctx->groups[best].free_blocks &&
+			     desc->dirs < ctx->groups[best].dirs)) {
+				best = i;
+			}
+		}
+		g = best;
+	} else {
+		uint32_t i = 0;
+		while (i < ctx->ngroups && ctx->groups[g].free_inodes == 0) {
+			g = (g + 1) % ctx->ngroups;
+			++i;
+		}
+		if (i == ctx->ngroups) {
+			g = ctx->ngroups;
+		}
+	}
+	if (g == ctx->ngroups) {
+		fprintf(stderr, "Not enough inodes\n");
+		return false;
+	}
+
+	vsfs_ino_t start, end;
+	group_inodes(ctx, g, &start, &end);
+	if (bitmap_alloc_range(ctx->ibmap, ctx->sb->num_inodes, start, end,
+	                       ino) != 0) {
+		assert(false);
+		return false;
+	}
+	ctx->groups[g].free_inodes--;
+	if (dir) {
+		ctx->groups[g].dirs++;
+	}
+	ctx->sb->free_inodes--;
+
+	prepare_inode(ctx, *ino);
+	memset(&ctx->itable[*ino], 0, sizeof(vsfs_inode));
+	return true;
+}
+
+/**
+ * Allocate a data block, preferably the goal block or the next free block
+ * after it in the same group, then in the following groups.
+ */
+static bool alloc_block(pop_ctx *ctx, vsfs_blk_t goal, vsfs_blk_t *blk)
+{
+	vsfs_superblock *sb = ctx->sb;
+	if (goal < sb->data_region || goal >= sb->num_blocks) {
+		goal = sb->data_region;
+	}
+
+	uint32_t g = goal / ctx->blocks_per_group;
+	for (uint32_t i = 0; i <= ctx->ngroups; ++i) {
+		uint32_t cur = (g + i) % ctx->ngroups;
+		if (ctx->groups[cur].free_blocks == 0) {
+			continue;
+		}
+
+		vsfs_blk_t start, end;
+		group_blocks(ctx, cur, &start, &end);
+		if (i == 0) {
+			start = goal;
+		}
+		if (bitmap_alloc_range(ctx->dbmap, sb->num_blocks, start, end,
+		                       blk) == 0) {
+			ctx->groups[cur].free_blocks--;
+			sb->free_blocks--;
+			ctx->rctable[*blk] = 1;
+			return true;
+		}
+	}
+	fprintf(stderr, "Not enough space in the image\n");
+	return false;
+}
+
+/** Get a pointer to the block map entry idx of an inode. */
+static vsfs_blk_t *map_entry(const pop_ctx *ctx, vsfs_inode *inode,
+                             vsfs_blk_t idx)
+{
+	if (idx < VSFS_NUM_DIRECT) {
+		return &inode->i_direct[idx];
+	}
+	vsfs_blk_t *indirect = block_addr(ctx, inode->i_indirect);
+	return &indirect[idx - VSFS_NUM_DIRECT];
+}
+
+/** Check if file block idx of an inode is a packed tail. */
+static bool is_packed(const vsfs_inode *inode, vsfs_blk_t idx)
+{
+	return (inode->i_flags & VSFS_INODE_TAIL) && idx + 1 == inode->i_blocks;
+}
+
+/** Place the tail of a file (of len bytes) into the current tail block. */
+static bool alloc_tail(pop_ctx *ctx, vsfs_inode *inode, vsfs_blk_t goal,
+                       uint32_t len, vsfs_blk_t *blk)
+{
+	if (ctx->tail_blk == 0 || ctx->tail_used + len > ctx->block_size ||
+	    ctx->rctable[ctx->tail_blk] == VSFS_RC_MAX) {
+		if (!alloc_block(ctx, goal, &ctx->tail_blk)) {
+			return false;
+		}
+		memset(block_addr(ctx, ctx->tail_blk), 0, ctx->block_size);
+		ctx->tail_used = 0;
+	} else {
+		ctx->rctable[ctx->tail_blk]++;
+	}
+	*blk = ctx->tail_blk;
+	inode->i_flags |= VSFS_INODE_TAIL;
+	inode->i_tail_off = ctx->tail_used;
+	ctx->tail_used += len;
+	return true;
+}
+
+/**
+ * Extend an inode to nblocks blocks. The new blocks follow the last block of
+ * the inode (or start in the group of the inode), and the indirect block is
+ * allocated in front of them so that the data stays contiguous. If tail is
+ * true, the last block is a packed tail instead (see alloc_tail()).
+ */
+static bool grow_inode(pop_ctx *ctx, vsfs_ino_t ino, vsfs_blk_t nblocks,
+                       bool tail)
+{
+	vsfs_inode *inode = &ctx->itable[ino];
+	if (nblocks > vsfs_max_file_blocks(ctx->block_size)) {
+		// Checked by count_dir(), unless the file has grown since
+		fprintf(stderr, "File is too large\n");
+		return false;
+	}
+
+	vsfs_blk_t goal = inode->i_blocks > 0
+	                ? *map_entry(ctx, inode, inode->i_blocks - 1) + 1
+	                : (ino / ctx->inodes_per_group) * ctx->blocks_per_group;
+	if (nblocks > VSFS_NUM_DIRECT && inode->i_indirect == 0) {
+		if (!alloc_block(ctx, goal, &inode->i_indirect)) {
+			return false;
+		}
+		memset(block_addr(ctx, inode->i_indirect), 0, ctx->block_size);
+		goal = inode->i_indirect + 1;
+	}
+
+	for (vsfs_blk_t idx = inode->i_blocks; idx < nblocks; ++idx) {
+		vsfs_blk_t blk;
+		if (tail && idx + 1 == nblocks) {
+			uint32_t len = inode->i_size
+			               - (uint64_t)idx * ctx->block_size;
+			if (!alloc_tail(ctx, inode, goal, len, &blk)) {
+				return false;
+			}
+		} else if (!alloc_block(ctx, goal, &blk)) {
+			return false;
+		}
+		*map_entry(ctx, inode, idx) = blk;
+		inode->i_blocks = idx + 1;
+		goal = blk + 1;
+	}
+	return true;
+}
+
+static bool add_file(pop_ctx *ctx, const char *path, vsfs_ino_t ino)
+{
+	if (ctx->nfiles == ctx->files_cap) {
+		size_t cap = ctx->files_cap ? ctx->files_cap * 2 : 64;
+		pop_file *files = realloc(ctx->files, cap * sizeof(*files));
+		if (files == NULL) {
+			perror("realloc");
+			return false;
+		}
+		ctx->files = files;
+		ctx->files_cap = cap;
+	}
+
+	char *copy = strdup(path);
+	if (copy == NULL) {
+		perror("strdup");
+		return false;
+	}
+	ctx->files[ctx->nfiles++] = (pop_file){ .path = copy, .ino = ino };
+	return true;
+}
+
+
+/** Directory entry read from the host directory. */
+typedef struct host_entry {
+	char *name;
+	struct stat st;
+} host_entry;
+
+static int compare_entries(const void *a, const void *b)
+{
+	return strcmp(((const host_entry *)a)->name,
+	              ((const host_entry *)b)->name);
+}
+
+static void free_entries(host_entry *entries, size_t n)
+{
+	for (size_t i = 0; i < n; ++i) {
+		free(entries[i].name);
+	}
+	free(entries);
+}
+
+/**
+ * Read the regular files and subdirectories of a host directory, sorted by
+ * name; other entries are skipped with a warning.
+ */
+static bool read_host_dir(const char *path, bool root, host_entry **entries,
+                          size_t *count)
+{
+	DIR *dir = opendir(path);
+	if (dir == NULL) {
+		perror(path);
+		return false;
+	}
+
+	host_entry *list = NULL;
+	size_t n = 0, cap = 0;
+	bool ret = false;
+	struct dirent *de;
+	char child[PATH_MAX];
+
+	errno = 0;
+	while ((de = readdir(dir)) != NULL) {
+		if (strcmp(de->d_name, ".") == 0 ||
+		    strcmp(de->d_name, "..") == 0) {
+			continue;
+		}
+		if (snprintf(child, sizeof(child), "%s/%s", path, de->d_name)
+		    >= (int)sizeof(child)) {
+			fprintf(stderr, "%s/%s: path is too long\n", path,
+			        de->d_name);
+			goto out;
+		}
+		if (root && strcmp(de->d_name, VSFS_SNAP_NAME) == 0) {
+			fprintf(stderr, "Skipping %s: reserved name\n", child);
+			continue;
+		}
+		if (strlen(de->d_name) >= VSFS_NAME_MAX) {
+			fprintf(stderr, "%s: name is too long\n", child);
+			goto out;
+		}
+
+		struct stat st;
+		if (lstat(child, &st) != 0) {
+			perror(child);
+			goto out;
+		}
+		if (!S_ISREG(st.st_mode) && !S_ISDIR(st.st_mode)) {
+			fprintf(stderr, "Skipping %s: not a regular file or "
+			        "directory\n", child);
+			continue;
+		}
+
+		if (n == cap) {
+			cap = cap ? cap * 2 : 16;
+			host_entry *tmp = realloc(list, cap * sizeof(*list));
+			if (tmp == NULL) {
+				perror("realloc");
+				goto out;
+			}
+			list = tmp;
+		}
+		list[n].name = strdup(de->d_name);
+		if (list[n].name == NULL) {
+			perror("strdup");
+			goto out;
+		}
+		list[n++].st = st;
+		errno = 0;
+	}
+	if (errno != 0) {
+		perror(path);
+		goto out;
+	}
+
+	if (n > 0) {
+		qsort(list, n, sizeof(*list), compare_entries);
+	}
+	*entries = list;
+	*count = n;
+	list = NULL;
+	ret = true;
+ out:
+	if (list != NULL) {
+		free_entries(list, n);
+	}
+	closedir(dir);
+	return ret;
+}
+
+/** Set the fields of a new inode from the attributes of a host file. */
+static void init_inode(vsfs_inode *inode, const struct stat *st)
+{
+	inode->i_mode = st->st_mode & (S_IFMT | 07777);
+	inode->i_nlink = S_ISDIR(st->st_mode) ? 2 : 1;
+	inode->i_mtime = st->st_mtim;
+	if (S_ISREG(st->st_mode)) {
+		inode->i_size = st->st_size;
+	}
+}
+
+/** Number of inodes and data blocks needed to copy a host directory tree. */
+typedef struct pop_need {
+	uint64_t inodes;
+	uint64_t blocks;
+	/** Packed tails in the current tail block and their total length, as
+	 *  they will be placed by alloc_tail(). */
+	uint32_t tails;
+	uint32_t tail_used;
+} pop_need;
+
+/** Get the number of data blocks of a file, including the indirect block. */
+static uint64_t file_blocks(uint64_t nblocks)
+{
+	return nblocks + (nblocks > VSFS_NUM_DIRECT ? 1 : 0);
+}
+
+/** Account for a packed tail of len bytes instead of a block of its own. */
+static void count_tail(pop_need *need, uint32_t block_size, uint32_t len)
+{
+	if (need->tails == 0 || need->tail_used + len > block_size ||
+	    need->tails == VSFS_RC_MAX) {
+		need->tails = 0;
+		need->tail_used = 0;
+	} else {
+		// Shares the current tail block
+		need->blocks--;
+	}
+	need->tails++;
+	need->tail_used += len;
+}
+
+/**
+ * Count the inodes and data blocks needed to copy the contents of a host
+ * directory (including the directory blocks), checking that every file and
+ * directory fits in an inode. Nothing is written to the image, so populate()
+ * can fail before the image is modified.
+ */
+static bool count_dir(const pop_ctx *ctx, const char *path, bool root,
+                      pop_need *need)
+{
+	host_entry *entries;
+	size_t n;
+	if (!read_host_dir(path, root, &entries, &n)) {
+		return false;
+	}
+
+	bool ret = false;
+	uint32_t bs = ctx->block_size;
+	vsfs_blk_t max_blocks = vsfs_max_file_blocks(bs);
+	uint32_t dentries_per_block = vsfs_dentries_per_block(bs);
+	if (n + 2 > (size_t)max_blocks * dentries_per_block) {
+		fprintf(stderr, "%s: too many entries\n", path);
+		goto out;
+	}
+	need->blocks += file_blocks(div_round_up(n + 2, dentries_per_block));
+
+	char child[PATH_MAX];
+	for (size_t i = 0; i < n; ++i) {
+		const struct stat *st = &entries[i].st;
+
+		// Checked by read_host_dir()
+		snprintf(child, sizeof(child), "%s/%s", path, entries[i].name);
+		need->inodes++;
+		if (S_ISDIR(st->st_mode)) {
+			if (!count_dir(ctx, child, false, need)) {
+				goto out;
+			}
+		} else if (st->st_size > (off_t)max_blocks * bs) {
+			fprintf(stderr, "%s: file is too large\n", child);
+			goto out;
+		} else {
+			vsfs_blk_t nblocks = div_round_up(st->st_size, bs);
+			need->blocks += file_blocks(nblocks);
+			if (vsfs_tail_packable(bs, st->st_size)) {
+				count_tail(need, bs, st->st_size
+				           - (uint64_t)(nblocks - 1) * bs);
+			}
+		}
+	}
+	ret = true;
+ out:
+	free_entries(entries, n);
+	return ret;
+}
+
+/**
+ * Copy the contents of a host directory into a directory inode that is
+ * already allocated; the data of the regular files is only planned (blocks
+ * allocated) and copied later by copy_files().
+ */
+static bool populate_dir(pop_ctx *ctx, const char *path, vsfs_ino_t ino,
+                         vsfs_ino_t parent)
+{
+	host_entry *entries;
+	size_t n;
+	if (!read_host_dir(path, ino == VSFS_ROOT_INO, &entries, &n)) {
+		return false;
+	}
+
+	bool ret = false;
+	vsfs_inode *dir = &ctx->itable[ino];
+	uint32_t bs = ctx->block_size;
+	uint32_t dentries_per_block = vsfs_dentries_per_block(bs);
+	if (!grow_inode(ctx, ino, div_round_up(n + 2, dentries_per_block),
+	                false)) {
+		goto out;
+	}
+	dir->i_size = (uint64_t)dir->i_blocks * bs;
+
+	for (vsfs_blk_t i = 0; i < dir->i_blocks; ++i) {
+		vsfs_dentry *block = block_addr(ctx, *map_entry(ctx, dir, i));
+		for (size_t j = 0; j < dentries_per_block; ++j) {
+			block[j].ino = VSFS_INO_MAX;
+		}
+	}
+	vsfs_dentry *first = block_addr(ctx, dir->i_direct[0]);
+	first[0].ino = ino;
+	strcpy(first[0].name, ".");
+	first[1].ino = parent;
+	strcpy(first[1].name, "..");
+
+	char child[PATH_MAX];
+	for (size_t i = 0; i < n; ++i) {
+		const struct stat *st = &entries[i].st;
+		bool is_dir = S_ISDIR(st->st_mode);
+		vsfs_ino_t child_ino;
+
+		// Checked by read_host_dir()
+		snprintf(child, sizeof(child), "%s/%s", path, entries[i].name);
+		if (!alloc_inode(ctx, ino, is_dir, &child_ino)) {
+			goto out;
+		}
+		init_inode(&ctx->itable[child_ino], st);
+
+		vsfs_blk_t k = i + 2;
+		vsfs_dentry *block = block_addr(ctx, *map_entry(ctx, dir,
+		                                 k / dentries_per_block));
+		vsfs_dentry *entry = &block[k % dentries_per_block];
+		entry->ino = child_ino;
+		strcpy(entry->name, entries[i].name);
+
+		if (is_dir) {
+			dir->i_nlink++;
+			if (!populate_dir(ctx, child, child_ino, ino)) {
+				goto out;
+			}
+		} else {
+			vsfs_blk_t nblocks = div_round_up(st->st_size, bs);
+			bool tail = vsfs_tail_packable(bs, st->st_size);
+			if (!grow_inode(ctx, child_ino, nblocks, tail) ||
+			    (nblocks > 0 && !add_file(ctx, child, child_ino))) {
+				goto out;
+			}
+		}
+	}
+	ret = true;
+ out:
+	free_entries(entries, n);
+	return ret;
+}
+
+
+/**
+ * Read up to len bytes at offset off of a file into buf; returns the number
+ * of bytes read (less than len at the end of the file), or -1 on error.
+ */
+static ssize_t read_full(int fd, void *buf, size_t len, off_t off)
+{
+	size_t done = 0;
+	while (done < len) {
+		ssize_t ret = pread(fd, (char *)buf + done, len - done,
+		                    off + done);
+		if (ret < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		if (ret == 0) {
+			break;
+		}
+		done += ret;
+	}
+	return done;
+}
+
+/**
+ * Copy the data of a file into its blocks, one contiguous run of blocks with
+ * a single read; a packed tail is read into its place in the tail block. A
+ * file that got shorter since it was planned is padded with zeros; one that
+ * got longer is truncated.
+ */
+static bool copy_file(pop_ctx *ctx, const pop_file *file)
+{
+	int fd = open(file->path, O_RDONLY);
+	if (fd < 0) {
+		perror(file->path);
+		return false;
+	}
+
+	vsfs_inode *inode = &ctx->itable[file->ino];
+	bool ret = false;
+	vsfs_blk_t idx = 0;
+	while (idx < inode->i_blocks) {
+		vsfs_blk_t blk = *map_entry(ctx, inode, idx);
+		off_t off = (off_t)idx * ctx->block_size;
+		if (is_packed(inode, idx)) {
+			// Other threads fill other parts of the tail block; its
+			// checksum is computed by update_map_csums()
+			size_t len = inode->i_size - off;
+			char *data = (char *)block_addr(ctx, blk)
+			             + inode->i_tail_off;
+			ssize_t done = read_full(fd, data, len, off);
+			if (done < 0) {
+				perror(file->path);
+				goto out;
+			}
+			memset(data + done, 0, len - done);
+			break;
+		}
+
+		vsfs_blk_t n = 1;
+		while (idx + n < inode->i_blocks &&
+		       !is_packed(inode, idx + n) &&
+		       *map_entry(ctx, inode, idx + n) == blk + n) {
+			++n;
+		}
+
+		size_t len = (size_t)n * ctx->block_size;
+		if ((uint64_t)off + len > inode->i_size) {
+			len = inode->i_size - off;
+		}
+		void *data = block_addr(ctx, blk);
+		ssize_t done = read_full(fd, data, len, off);
+		if (done < 0) {
+			perror(file->path);
+			goto out;
+		}
+		memset((char *)data + done, 0,
+		       (size_t)n * ctx->block_size - done);
+
+		for (vsfs_blk_t i = 0; i < n; ++i) {
+			update_csum(ctx, blk + i);
+		}
+		idx += n;
+	}
+	ret = true;
+ out:
+	close(fd);
+	return ret;
+}
+
+/** Worker thread body: copy files until there are none left. */
+static void *copy_main(void *arg)
+{
+	pop_ctx *ctx = (pop_ctx *)arg;
+
+	while (!__atomic_load_n(&ctx->failed, __ATOMIC_RELAXED)) {
+		size_t i = __atomic_fetch_add(&ctx->next, 1, __ATOMIC_RELAXED);
+		if (i >= ctx->nfiles) {
+			break;
+		}
+		if (!copy_file(ctx, &ctx->files[i])) {
+			__atomic_store_n(&ctx->failed, true, __ATOMIC_RELAXED);
+		}
+	}
+	return NULL;
+}
+
+/** Copy the data of all planned files using a number of threads. */
+static bool copy_files(pop_ctx *ctx, unsigned threads)
+{
+	if (ctx->nfiles == 0) {
+		return true;
+	}
+	if (threads > ctx->nfiles) {
+		threads = ctx->nfiles;
+	}
+
+	pthread_t *tids = calloc(threads, sizeof(*tids));
+	unsigned started = 0;
+	if (tids == NULL) {
+		perror("calloc");
+		return false;
+	}
+	// The calling thread is one of the workers
+	while (started + 1 < threads &&
+	       pthread_create(&tids[started], NULL, copy_main, ctx) == 0) {
+		++started;
+	}
+	copy_main(ctx);
+	for (unsigned i = 0; i < started; ++i) {
+		pthread_join(tids[i], NULL);
+	}
+	free(tids);
+	return !ctx->failed;
+}
+
+/** Update the checksums of the directory, indirect and tail blocks. */
+static void update_map_csums(pop_ctx *ctx)
+{
+	for (vsfs_ino_t ino = 0; ino < ctx->sb->num_inodes; ++ino) {
+		if (!bitmap_isset(ctx->ibmap, ctx->sb->num_inodes, ino)) {
+			continue;
+		}
+		vsfs_inode *inode = &ctx->itable[ino];
+		if (S_ISDIR(inode->i_mode)) {
+			for (vsfs_blk_t i = 0; i < inode->i_blocks; ++i) {
+				update_csum(ctx, *map_entry(ctx, inode, i));
+			}
+		}
+		if (inode->i_indirect != 0) {
+			update_csum(ctx, inode->i_indirect);
+		}
+		if (inode->i_flags & VSFS_INODE_TAIL) {
+			update_csum(ctx, *map_entry(ctx, inode,
+			                            inode->i_blocks - 1));
+		}
+	}
+}
+
+
+bool populate(void *image, const char *src, unsigned threads)
+{
+	pop_ctx ctx = {
+		.image     = image,
+		.block_size = vsfs_block_size((vsfs_superblock *)image),
+		.sb        = (vsfs_superblock *)image,
+	};
+	ctx.ibmap = block_addr(&ctx, VSFS_IMAP_BLKNUM);
+	ctx.dbmap = block_addr(&ctx, VSFS_DMAP_BLKNUM);
+	ctx.itable = block_addr(&ctx, VSFS_ITBL_BLKNUM);
+	ctx.rctable = block_addr(&ctx, ctx.sb->rc_region);
+	ctx.csumtable = block_addr(&ctx, ctx.sb->csum_region);
+
+	struct stat st;
+	if (stat(src, &st) != 0) {
+		perror(src);
+		return false;
+	}
+	if (!S_ISDIR(st.st_mode)) {
+		fprintf(stderr, "%s: not a directory\n", src);
+		return false;
+	}
+
+	// Check that the whole tree fits before anything is written
+	pop_need need = { 0 };
+	if (!count_dir(&ctx, src, true, &need)) {
+		return false;
+	}
+	// The root directory already has its first block
+	need.blocks -= ctx.itable[VSFS_ROOT_INO].i_blocks;
+	if (need.inodes > ctx.sb->free_inodes) {
+		fprintf(stderr, "Not enough inodes: %s needs %lu, the image "
+		        "has %u\n", src, need.inodes, ctx.sb->free_inodes);
+		return false;
+	}
+	if (need.blocks > ctx.sb->free_blocks) {
+		fprintf(stderr, "Not enough space in the image: %s needs %lu "
+		        "blocks, the image has %u\n", src, need.blocks,
+		        ctx.sb->free_blocks);
+		return false;
+	}
+
+	if (!init_groups(&ctx)) {
+		return false;
+	}
+
+	bool ret = false;
+	// Plan the whole tree first (inodes, directories and block maps), so
+	// that the file data can be copied in any order
+	if (!populate_dir(&ctx, src, VSFS_ROOT_INO, VSFS_ROOT_INO) ||
+	    !copy_files(&ctx, threads)) {
+		goto out;
+	}
+	// The root directory takes the attributes of the source directory
+	ctx.itable[VSFS_ROOT_INO].i_mode = S_IFDIR | (st.st_mode & 07777);
+	ctx.itable[VSFS_ROOT_INO].i_mtime = st.st_mtim;
+	update_map_csums(&ctx);
+	ret = true;
+ out:
+	for (size_t i = 0; i < ctx.nfiles; ++i) {
+		free(ctx.files[i].path);
+	}
+	free(ctx.files);
+	free(ctx.groups);
+	return ret;
+}
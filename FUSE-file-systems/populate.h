@@ -0,0 +1,46 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+/**
+ * CSC369 Assignment 4 - Populating a new image from a host directory.
+ *
+ * Used by mkfs.vsfs -d: the directory tree is copied straight into the mapped
+ * image instead of through a mount. Inodes are placed like the mounted file
+ * system places them (top-level directories spread across the block groups,
+ * everything else in the group of the parent directory), and the blocks of
+ * each file are allocated as one contiguous run where possible, with the
+ * indirect block in front of the data. File data is then read directly into
+ * the image by a number of threads in parallel.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "vsfs.h"
+
+
+/**
+ * Copy the regular files and directories in a host directory into the root
+ * directory of a freshly formatted image. Other file types are skipped with a
+ * warning. The checksums of all the data blocks (but not of the metadata) are
+ * updated. The tree is checked against the free inodes and blocks and the
+ * file size limit before anything is written to the image.
+ *
+ * @param image    pointer to the start of the mmap'd image.
+ * @param src      host directory path.
+ * @param threads  number of threads that copy the file data.
+ * @return         true on success; false on error (e.g. out of space).
+ */
+bool populate(void *image, const char *src, unsigned threads);
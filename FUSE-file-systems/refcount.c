@@ -0,0 +1,79 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+/**
+ * CSC369 Assignment 4 - Data block allocation and reference counting.
+ */
+
+#include <errno.h>
+
+#include "bitmap.h"
+#include "compress.h"
+#include "csum.h"
+#include "dedup.h"
+#include "discard.h"
+#include "group.h"
+#include "lfs.h"
+#include "refcount.h"
+
+
+int block_alloc(fs_ctx *fs, vsfs_blk_t goal, vsfs_blk_t *blk)
+{
+	if (fs->lfs != NULL ? !lfs_alloc(fs, blk) :
+	    !group_alloc_block(fs, goal, blk)) {
+		return -ENOSPC;
+	}
+	assert(fs->rctable[*blk] == 0);
+	fs->rctable[*blk] = 1;
+	fs->sb->free_blocks--;
+	block_group(fs, *blk)->free_blocks--;
+	// The caller fills in the contents
+	csum_mark_dirty(fs, *blk);
+	return 0;
+}
+
+bool block_ref(fs_ctx *fs, vsfs_blk_t blk)
+{
+	assert(bitmap_isset(fs->dbmap, fs->sb->num_blocks, blk));
+	assert(fs->rctable[blk] > 0);
+
+	if (fs->rctable[blk] == VSFS_RC_MAX) {
+		return false;
+	}
+	fs->rctable[blk]++;
+	return true;
+}
+
+void block_put(fs_ctx *fs, vsfs_blk_t blk)
+{
+	assert(fs->rctable[blk] > 0);
+
+	if (--fs->rctable[blk] == 0) {
+		if (fs->dedup != NULL) {
+			dedup_forget(fs, blk);
+		}
+		compress_forget(fs, blk);
+		bitmap_free(fs->dbmap, fs->sb->num_blocks, blk);
+		fs->sb->free_blocks++;
+		block_group(fs, blk)->free_blocks++;
+		if (fs->lfs != NULL) {
+			lfs_freed(fs, blk);
+		}
+		discard_block(fs, blk);
+		if (blk == fs->tail_blk) {
+			// All tails in it are gone (tail.h)
+			fs->tail_blk = 0;
+		}
+	}
+}
@@ -0,0 +1,79 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+/**
+ * CSC369 Assignment 4 - Data block allocation and reference counting.
+ *
+ * Data blocks can be shared between files (e.g. after a clone), so they are
+ * allocated and released through these functions instead of directly through
+ * the data bitmap. A block is returned to the bitmap when its reference count
+ * drops to 0.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "fs_ctx.h"
+#include "vsfs.h"
+
+
+/** Get the reference count of a block. */
+static inline vsfs_rc_t rc_get(const fs_ctx *fs, vsfs_blk_t blk)
+{
+	assert(blk < fs->sb->num_blocks);
+	return fs->rctable[blk];
+}
+
+/**
+ * Allocate a data block. The new block has a reference count of 1.
+ *
+ * @param fs    pointer to the file system context.
+ * @param goal  block to allocate close to (see group_alloc_block() and
+ *              inode_goal()); 0 if there is no preference. Ignored in log
+ *              mode.
+ * @param blk   pointer to the variable that receives the block number.
+ * @return      0 on success; -ENOSPC if there are no free blocks.
+ */
+int block_alloc(fs_ctx *fs, vsfs_blk_t goal, vsfs_blk_t *blk);
+
+/**
+ * Take another reference to an allocated data block.
+ *
+ * @param fs   pointer to the file system context.
+ * @param blk  block number.
+ * @return     true on success; false if the reference count would overflow.
+ */
+bool block_ref(fs_ctx *fs, vsfs_blk_t blk);
+
+/**
+ * Drop a reference to a data block; free the block if it was the last one.
+ *
+ * @param fs   pointer to the file system context.
+ * @param blk  block number.
+ */
+void block_put(fs_ctx *fs, vsfs_blk_t blk);
+
+/** Get a pointer to the contents of a block in the mmap'd image. */
+static inline void *block_addr(const fs_ctx *fs, vsfs_blk_t blk)
+{
+	return fs->image + ((size_t)blk << fs->block_shift);
+}
+
+/** Get the number of the block that contains an address in the image. */
+static inline vsfs_blk_t block_num(const fs_ctx *fs, const void *addr)
+{
+	return (vsfs_blk_t)(((const char *)addr - (const char *)fs->image)
+	                    >> fs->block_shift);
+}
@@ -0,0 +1,632 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+/**
+ * CSC369 Assignment 4 - vsfs trace replayer.
+ *
+ * Re-executes an operation trace recorded with "-o trace=FILE" in-process
+ * through libvsfs on a temporary image (freshly formatted or a copy of a base
+ * image) and compares the throughput and latencies with the recorded ones.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "benchutil.h"
+#include "libvsfs.h"
+#include "stats.h"
+#include "trace.h"
+#include "vsfs.h"
+
+/** Command line options. */
+typedef struct replay_opts {
+	/** Trace log file path. */
+	const char *trace_path;
+	/** Base image to replay on (a copy of it); NULL to format a new one. */
+	const char *base_path;
+	/** Directory for the temporary image. */
+	const char *tmp_dir;
+	/** Path to the mkfs.vsfs executable. */
+	char mkfs_path[PATH_MAX];
+	/** Image size in MiB. */
+	unsigned long size_mb;
+	/** Number of inodes; 0 to derive it from the trace. */
+	unsigned long n_inodes;
+	/** Mount options. */
+	fs_opts mount;
+	/** Reproduce the recorded timing of the operations. */
+	bool timing;
+	/** Print results as CSV. */
+	bool csv;
+	/** Print help and exit. */
+	bool help;
+
+} replay_opts;
+
+/** Results of one operation type. */
+typedef struct op_result {
+	/** Number of operations that failed when replayed. */
+	uint64_t errors;
+	/** Number of operations with a result different from the recorded. */
+	uint64_t mismatches;
+	/** Bytes read or written when replayed. */
+	uint64_t bytes;
+	/** Recorded and replayed latencies. */
+	lat_samples rec;
+	lat_samples lat;
+} op_result;
+
+/** State of a replay. */
+typedef struct replay_ctx {
+	fs_ctx fs;
+	const replay_opts *opts;
+	/** Data to write; VSFS_BLOCK_SIZE_MIN bytes more than the largest I/O. */
+	char *buf;
+	size_t buf_size;
+	/** Buffer for reads. */
+	char *read_buf;
+	/** Recorded time span and wall clock time of the replay in ns. */
+	uint64_t rec_span;
+	uint64_t wall;
+	op_result ops[STATS_OP_COUNT];
+} replay_ctx;
+
+static const char *help_str = "\
+Usage: %s [options] trace\n\
+\n\
+Replay a trace recorded with \"vsfs -o trace=FILE\" in-process on a temporary\n\
+image and compare the replayed latencies with the recorded ones. Operations\n\
+run back to back unless -t is given.\n\
+\n\
+Options:\n\
+    -b image  replay on a copy of this image (e.g. a copy of the traced image\n\
+              taken before recording) instead of a newly formatted one\n\
+    -d dir    directory for the temporary image (default: $TMPDIR or /tmp)\n\
+    -m path   mkfs.vsfs executable (default: next to this program)\n\
+    -s MiB    size of a newly formatted image (default: 128)\n\
+    -i num    number of inodes in a newly formatted image\n\
+              (default: enough for the files created in the trace)\n\
+    -o opts   comma-separated mount options: dedup, compress, verify, log\n\
+    -t        reproduce the recorded timing of the operations\n\
+    -c        print results as CSV\n\
+    -h        print help and exit\n\
+";
+
+static void print_help(FILE *f, const char *progname)
+{
+	fprintf(f, help_str, progname);
+}
+
+static bool parse_args(int argc, char *argv[], replay_opts *opts)
+{
+	int o;
+	while ((o = getopt(argc, argv, "b:d:m:s:i:o:tch")) != -1) {
+		switch (o) {
+			case 'b': opts->base_path = optarg; break;
+			case 'd': opts->tmp_dir   = optarg; break;
+			case 'm': snprintf(opts->mkfs_path, sizeof(opts->mkfs_path),
+			                   "%s", optarg); break;
+			case 's': opts->size_mb  = strtoul(optarg, NULL, 10); break;
+			case 'i': opts->n_inodes = strtoul(optarg, NULL, 10); break;
+			case 'o':
+				if (!parse_mount_opts(optarg, &opts->mount)) {
+					return false;
+				}
+				break;
+
+			case 't': opts->timing = true; break;
+			case 'c': opts->csv    = true; break;
+			case 'h': opts->help   = true; return true;// skip other arguments
+
+			case '?': return false;
+			default : assert(false);
+		}
+	}
+
+	if (optind != argc - 1) {
+		fprintf(stderr, "Missing or extra trace file argument\n");
+		return false;
+	}
+	opts->trace_path = argv[optind];
+
+	// Replay images use the default block size
+	size_t max_mb = (size_t)vsfs_blk_max(VSFS_BLOCK_SIZE_MIN)
+	                * VSFS_BLOCK_SIZE_MIN >> 20;
+	if (opts->size_mb == 0 || opts->size_mb > max_mb) {
+		fprintf(stderr, "Image size must be 1 to %zu MiB\n", max_mb);
+		return false;
+	}
+	if (opts->n_inodes >= VSFS_INO_MAX) {
+		fprintf(stderr, "Number of inodes must be less than %u\n",
+		        VSFS_INO_MAX);
+		return false;
+	}
+	return true;
+}
+
+
+/**
+ * Read the next record of a trace.
+ *
+ * @param f    trace file positioned at a record.
+ * @param rec  buffer of sizeof(trace_rec) + 2 * VSFS_PATH_MAX bytes.
+ * @return     1 if a record was read; 0 at the end of the trace; -1 if the
+ *             trace is corrupted.
+ */
+static int read_rec(FILE *f, trace_rec *rec)
+{
+	size_t n = fread(rec, 1, sizeof(*rec), f);
+	if (n == 0 && feof(f)) {
+		return 0;
+	}
+	if (n != sizeof(*rec) || rec->len % sizeof(uint64_t) != 0 ||
+	    rec->len > sizeof(*rec) + 2 * VSFS_PATH_MAX ||
+	    rec->path_len >= VSFS_PATH_MAX || rec->path2_len >= VSFS_PATH_MAX ||
+	    sizeof(*rec) + rec->path_len + rec->path2_len + 2 > rec->len ||
+	    rec->op >= STATS_OP_COUNT) {
+		return -1;
+	}
+	if (fread(rec->paths, rec->len - sizeof(*rec), 1, f) != 1) {
+		return -1;
+	}
+	rec->paths[rec->path_len] = '\0';
+	rec->paths[rec->path_len + rec->path2_len + 1] = '\0';
+	return 1;
+}
+
+/** Open a trace and check its header; returns NULL on failure. */
+static FILE *open_trace(const char *path)
+{
+	FILE *f = fopen(path, "r");
+	if (f == NULL) {
+		perror(path);
+		return NULL;
+	}
+	trace_header hdr;
+	if (fread(&hdr, sizeof(hdr), 1, f) != 1 ||
+	    memcmp(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic)) != 0) {
+		fprintf(stderr, "%s is not a vsfs trace\n", path);
+		fclose(f);
+		return NULL;
+	}
+	return f;
+}
+
+/**
+ * Scan a trace for the number of inodes a new image needs (the number of files
+ * and directories created, plus the root and some slack) and the largest I/O
+ * size.
+ *
+ * @return  true on success; false if the trace is corrupted.
+ */
+static bool scan_trace(FILE *f, trace_rec *rec, unsigned long *n_inodes,
+                       size_t *max_io)
+{
+	int ret;
+	*n_inodes = 16;
+	*max_io = 0;
+	while ((ret = read_rec(f, rec)) > 0) {
+		if (rec->op == STATS_OP_CREATE || rec->op == STATS_OP_MKDIR) {
+			++*n_inodes;
+		} else if ((rec->op == STATS_OP_READ ||
+		            rec->op == STATS_OP_WRITE ||
+		            rec->op == STATS_OP_GETXATTR ||
+		            rec->op == STATS_OP_SETXATTR ||
+		            rec->op == STATS_OP_LISTXATTR) && rec->size > *max_io) {
+			*max_io = rec->size;
+		}
+	}
+	if (*n_inodes >= VSFS_INO_MAX) {
+		*n_inodes = VSFS_INO_MAX - 1;
+	}
+	return ret == 0;
+}
+
+/** Copy the base image into an open temporary image file. */
+static bool copy_image(const char *base_path, int fd)
+{
+	int in = open(base_path, O_RDONLY);
+	if (in < 0) {
+		perror(base_path);
+		return false;
+	}
+
+	static char buf[1 << 16];
+	ssize_t n;
+	while ((n = read(in, buf, sizeof(buf))) > 0) {
+		if (write(fd, buf, n) != n) {
+			perror("write");
+			close(in);
+			return false;
+		}
+	}
+	if (n < 0) {
+		perror(base_path);
+	}
+	close(in);
+	return n == 0;
+}
+
+/**
+ * Allocate the I/O buffers and fill the write buffer with pseudo-random
+ * (incompressible) data.
+ */
+static bool alloc_bufs(replay_ctx *ctx, size_t max_io)
+{
+	ctx->buf_size = max_io + VSFS_BLOCK_SIZE_MIN;
+	ctx->buf = malloc(ctx->buf_size);
+	ctx->read_buf = malloc(max_io + 1);
+	if (ctx->buf == NULL || ctx->read_buf == NULL) {
+		return false;
+	}
+	uint64_t x = 0x9E3779B97F4A7C15ull;
+	for (size_t i = 0; i + sizeof(x) <= ctx->buf_size; i += sizeof(x)) {
+		x ^= x >> 12;
+		x ^= x << 25;
+		x ^= x >> 27;
+		uint64_t r = x * 0x2545F4914F6CDD1Dull;
+		memcpy(ctx->buf + i, &r, sizeof(r));
+	}
+	return true;
+}
+
+/** fs_readdir() callback that ignores the entries. */
+static int skip_entry(void *data, const char *name, vsfs_ino_t ino)
+{
+	(void)data;// unused
+	(void)name;// unused
+	(void)ino;// unused
+	return 0;
+}
+
+/**
+ * Execute a recorded operation.
+ *
+ * @param i  index of the record; used to vary the written data.
+ * @return   the operation result.
+ */
+static int64_t execute(replay_ctx *ctx, const trace_rec *rec, uint64_t i)
+{
+	fs_ctx *fs = &ctx->fs;
+	const char *path = trace_path(rec);
+
+	switch ((stats_op)rec->op) {
+		case STATS_OP_LOOKUP: {
+			vsfs_ino_t ino;
+			return fs_lookup(fs, path, &ino);
+		}
+		case STATS_OP_STATFS: {
+			struct statvfs st;
+			return fs_statfs(fs, &st);
+		}
+		case STATS_OP_GETATTR: {
+			struct stat st;
+			return fs_getattr(fs, path, &st);
+		}
+		case STATS_OP_READDIR:
+			return fs_readdir(fs, path, skip_entry, NULL);
+		case STATS_OP_MKDIR:
+			return fs_mkdir(fs, path, rec->arg);
+		case STATS_OP_RMDIR:
+			return fs_rmdir(fs, path);
+		case STATS_OP_CREATE:
+			return fs_create(fs, path, rec->arg);
+		case STATS_OP_UNLINK:
+			return fs_unlink(fs, path);
+		case STATS_OP_UTIMENS: {
+			struct timespec times[2] = {
+				{ 0, UTIME_OMIT },
+				{ rec->offset, rec->size },
+			};
+			return fs_utimens(fs, path, times);
+		}
+		case STATS_OP_TRUNCATE:
+			return fs_truncate(fs, path, rec->offset);
+		case STATS_OP_READ:
+			return fs_read(fs, path, ctx->read_buf, rec->size,
+			               rec->offset);
+		case STATS_OP_WRITE: {
+			// Different data every time, in case deduplication is enabled
+			const char *data = ctx->buf + i * sizeof(uint64_t) %
+			                   VSFS_BLOCK_SIZE_MIN;
+			return fs_write(fs, path, data, rec->size, rec->offset);
+		}
+		case STATS_OP_FSYNC:
+			return fs_fsync(fs);
+		case STATS_OP_CLONE: {
+			struct vsfs_clone_args args = {
+				.src_offset = rec->arg,
+				.src_length = rec->size,
+				.dest_offset = rec->offset,
+			};
+			strcpy(args.src_path, trace_path2(rec));
+			return fs_clone(fs, path, &args);
+		}
+		case STATS_OP_GETFLAGS: {
+			uint32_t flags;
+			return fs_getflags(fs, path, &flags);
+		}
+		case STATS_OP_SETFLAGS:
+			return fs_setflags(fs, path, rec->arg);
+		case STATS_OP_COMPR_STATS: {
+			struct vsfs_compr_stats st;
+			fs_compr_stats(fs, &st);
+			return 0;
+		}
+		case STATS_OP_DEFRAG: {
+			struct vsfs_defrag_args args = { .flags = rec->arg };
+			return fs_defrag(fs, path, &args);
+		}
+		case STATS_OP_FREE_FRAG: {
+			struct vsfs_free_frag frag;
+			fs_free_frag(fs, &frag);
+			return 0;
+		}
+		case STATS_OP_GROW:
+			return fs_grow(fs, rec->offset);
+		case STATS_OP_TRIM: {
+			uint64_t discarded;
+			return fs_trim(fs, &discarded);
+		}
+		case STATS_OP_RELEASE:
+			return fs_release(fs, path);
+		case STATS_OP_GETXATTR:
+			return fs_getxattr(fs, path, trace_path2(rec), ctx->read_buf,
+			                   rec->size);
+		case STATS_OP_SETXATTR:
+			return fs_setxattr(fs, path, trace_path2(rec), ctx->buf,
+			                   rec->size, rec->arg);
+		case STATS_OP_LISTXATTR:
+			return fs_listxattr(fs, path, ctx->read_buf, rec->size);
+		case STATS_OP_REMOVEXATTR:
+			return fs_removexattr(fs, path, trace_path2(rec));
+		default:
+			assert(false);
+			return -EINVAL;
+	}
+}
+
+/** Sleep until a time relative to start (now_ns()), unless it has passed. */
+static void wait_until(uint64_t start, uint64_t time)
+{
+	uint64_t t = start + time;
+	if (now_ns() >= t) {
+		return;
+	}
+	struct timespec ts = { t / 1000000000, t % 1000000000 };
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL)
+	       == EINTR);
+}
+
+/**
+ * Replay all the records of a trace.
+ *
+ * @return  true on success; false if the trace is corrupted.
+ */
+static bool replay(replay_ctx *ctx, FILE *f, trace_rec *rec)
+{
+	uint64_t start = now_ns();
+	uint64_t first = 0, last = 0;
+	uint64_t i = 0;
+	int ret;
+
+	while ((ret = read_rec(f, rec)) > 0) {
+		if (i == 0) {
+			first = rec->time;
+		}
+		if (ctx->opts->timing) {
+			wait_until(start, rec->time - first);
+		}
+
+		uint64_t op_start = now_ns();
+		int64_t res = execute(ctx, rec, i++);
+		uint64_t lat = now_ns() - op_start;
+
+		op_result *r = &ctx->ops[rec->op];
+		lat_add(&r->rec, rec->duration);
+		lat_add(&r->lat, lat);
+		if (res < 0) {
+			++r->errors;
+		} else if (rec->op == STATS_OP_READ || rec->op == STATS_OP_WRITE) {
+			r->bytes += res;
+		}
+		if (res != rec->ret) {
+			++r->mismatches;
+		}
+		if (rec->time + rec->duration > last) {
+			last = rec->time + rec->duration;
+		}
+	}
+	ctx->wall = now_ns() - start;
+	ctx->rec_span = last - first;
+	return ret == 0;
+}
+
+
+/** Get the sum of the latencies in seconds. */
+static double lat_total(const lat_samples *s)
+{
+	uint64_t sum = 0;
+	for (size_t i = 0; i < s->n; ++i) {
+		sum += s->lat[i];
+	}
+	return sum / 1e9;
+}
+
+static void print_row(const replay_opts *opts, const char *name,
+                      const op_result *r)
+{
+	double rec_s = lat_total(&r->rec), s = lat_total(&r->lat);
+	if (opts->csv) {
+		printf("%s,%zu,%lu,%lu,%lu,%.6f,%.6f,%.3f,%.3f,%.3f,%.3f,%.3f,"
+		       "%.3f\n", name, r->lat.n, (unsigned long)r->errors,
+		       (unsigned long)r->mismatches, (unsigned long)r->bytes,
+		       rec_s, s,
+		       lat_percentile(&r->rec, 0.5), lat_percentile(&r->rec, 0.99),
+		       lat_percentile(&r->rec, 0.999),
+		       lat_percentile(&r->lat, 0.5), lat_percentile(&r->lat, 0.99),
+		       lat_percentile(&r->lat, 0.999));
+	} else {
+		printf("%-11s %8zu %7lu %8lu %11.3f %11.3f %9.2f %9.2f %9.2f "
+		       "%9.2f\n", name, r->lat.n, (unsigned long)r->errors,
+		       (unsigned long)r->mismatches, rec_s, s,
+		       lat_percentile(&r->rec, 0.5), lat_percentile(&r->rec, 0.99),
+		       lat_percentile(&r->lat, 0.5), lat_percentile(&r->lat, 0.99));
+	}
+}
+
+static void print_results(replay_ctx *ctx)
+{
+	const replay_opts *opts = ctx->opts;
+	op_result total = {0};
+
+	if (opts->csv) {
+		printf("op,count,errors,mismatches,bytes,rec_seconds,seconds,"
+		       "rec_p50_us,rec_p99_us,rec_p999_us,p50_us,p99_us,p999_us\n");
+	} else {
+		printf("%-11s %8s %7s %8s %11s %11s %9s %9s %9s %9s\n", "op",
+		       "count", "errors", "mismatch", "rec_time(s)", "time(s)",
+		       "rec_p50", "rec_p99", "p50(us)", "p99(us)");
+	}
+
+	for (int op = 0; op < STATS_OP_COUNT; ++op) {
+		op_result *r = &ctx->ops[op];
+		if (r->lat.n == 0) {
+			continue;
+		}
+		lat_sort(&r->rec);
+		lat_sort(&r->lat);
+		print_row(opts, stats_op_name(op), r);
+
+		total.errors += r->errors;
+		total.mismatches += r->mismatches;
+		total.bytes += r->bytes;
+		for (size_t i = 0; i < r->lat.n; ++i) {
+			lat_add(&total.rec, r->rec.lat[i]);
+			lat_add(&total.lat, r->lat.lat[i]);
+		}
+	}
+	lat_sort(&total.rec);
+	lat_sort(&total.lat);
+	print_row(opts, "total", &total);
+
+	if (!opts->csv) {
+		double rec_s = ctx->rec_span / 1e9, s = ctx->wall / 1e9;
+		double mib = (double)total.bytes / (1 << 20);
+		printf("\nrecorded: %.3f s, %.1f ops/s, %.1f MiB/s\n", rec_s,
+		       rec_s > 0 ? total.lat.n / rec_s : 0,
+		       rec_s > 0 ? mib / rec_s : 0);
+		printf("replayed: %.3f s, %.1f ops/s, %.1f MiB/s%s\n", s,
+		       s > 0 ? total.lat.n / s : 0, s > 0 ? mib / s : 0,
+		       opts->timing ? " (recorded timing)" : "");
+	}
+	lat_free(&total.rec);
+	lat_free(&total.lat);
+}
+
+int main(int argc, char *argv[])
+{
+	replay_opts opts = {
+		.tmp_dir = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp",
+		.size_mb = 128,
+	};
+	default_mkfs_path(opts.mkfs_path, sizeof(opts.mkfs_path), argv[0]);
+
+	if (!parse_args(argc, argv, &opts)) {
+		print_help(stderr, argv[0]);
+		return 1;
+	}
+	if (opts.help) {
+		print_help(stdout, argv[0]);
+		return 0;
+	}
+
+	trace_rec *rec = malloc(sizeof(*rec) + 2 * VSFS_PATH_MAX);
+	FILE *f = rec ? open_trace(opts.trace_path) : NULL;
+	if (f == NULL) {
+		free(rec);
+		return 1;
+	}
+	long recs_start = ftell(f);
+
+	unsigned long n_inodes;
+	size_t max_io;
+	replay_ctx ctx = { .opts = &opts };
+	int ret = 1;
+	if (!scan_trace(f, rec, &n_inodes, &max_io)) {
+		fprintf(stderr, "%s is corrupted\n", opts.trace_path);
+		goto out_trace;
+	}
+	if (!alloc_bufs(&ctx, max_io)) {
+		perror("malloc");
+		goto out_trace;
+	}
+
+	char img_path[PATH_MAX];
+	int fd;
+	if (opts.base_path != NULL) {
+		snprintf(img_path, sizeof(img_path), "%s/vsfs-replay.XXXXXX",
+		         opts.tmp_dir);
+		fd = mkstemp(img_path);
+		if (fd < 0) {
+			perror(img_path);
+			goto out_buf;
+		}
+		if (!copy_image(opts.base_path, fd)) {
+			goto out_image;
+		}
+	} else {
+		fd = format_image(opts.tmp_dir, "vsfs-replay", opts.mkfs_path,
+		                  opts.size_mb, VSFS_BLOCK_SIZE_MIN,
+		                  opts.n_inodes ? opts.n_inodes : n_inodes,
+		                  img_path);
+		if (fd < 0) {
+			goto out_buf;
+		}
+	}
+
+	if (!fs_mount(&ctx.fs, img_path, &opts.mount)) {
+		fprintf(stderr, "Failed to mount %s\n", img_path);
+		goto out_image;
+	}
+	fseek(f, recs_start, SEEK_SET);
+	bool ok = replay(&ctx, f, rec);
+	fs_unmount(&ctx.fs);
+	if (!ok) {
+		fprintf(stderr, "%s is corrupted\n", opts.trace_path);
+	}
+	print_results(&ctx);
+	ret = ok ? 0 : 1;
+
+	for (int op = 0; op < STATS_OP_COUNT; ++op) {
+		lat_free(&ctx.ops[op].rec);
+		lat_free(&ctx.ops[op].lat);
+	}
+out_image:
+	close(fd);
+	unlink(img_path);
+out_buf:
+	free(ctx.buf);
+	free(ctx.read_buf);
+out_trace:
+	fclose(f);
+	free(rec);
+	return ret;
+}
@@ -0,0 +1,81 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+/**
+ * CSC369 Assignment 4 - Online growth implementation.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "bitmap.h"
+#include "group.h"
+#include "lfs.h"
+#include "resize.h"
+
+
+int resize_grow(fs_ctx *fs, uint64_t size)
+{
+	vsfs_superblock *sb = fs->sb;
+	if (fs_block_offset(fs, size) != 0 || size <= sb->size) {
+		return -EINVAL;
+	}
+	if (fs_block_index(fs, size) > vsfs_max_blocks(sb)) {
+		return -EFBIG;
+	}
+	if (fs->fd < 0) {
+		return -EOPNOTSUPP;
+	}
+
+	if (ftruncate(fs->fd, size) != 0) {
+		return -errno;
+	}
+	// Try to keep the image at the same address first. This is only an
+	// optimization: all image accesses hold fs->lock and compute their
+	// pointers from fs->image, which fs_ctx_set_image() updates
+	void *image = mremap(fs->image, fs->size, size, 0);
+	if (image == MAP_FAILED) {
+		image = mremap(fs->image, fs->size, size, MREMAP_MAYMOVE);
+	}
+	if (image == MAP_FAILED) {
+		int ret = -errno;
+		if (ftruncate(fs->fd, fs->size) != 0) {
+			perror("ftruncate");
+		}
+		return ret;
+	}
+	fs_ctx_set_image(fs, image, size);
+	sb = fs->sb;
+
+	// The data bitmap has bits for vsfs_blk_max() blocks; the ones past the
+	// end of the file system are set
+	vsfs_blk_t old_blocks = sb->num_blocks;
+	vsfs_blk_t nblocks = fs_block_index(fs, size);
+	for (vsfs_blk_t blk = old_blocks; blk < nblocks; ++blk) {
+		bitmap_set(fs->dbmap, nblocks, blk, false);
+	}
+	sb->num_blocks = nblocks;
+	sb->size = size;
+	sb->free_blocks += nblocks - old_blocks;
+
+	group_grow(fs, old_blocks);
+	if (fs->lfs != NULL) {
+		lfs_grow(fs);
+	}
+	return 0;
+}
@@ -0,0 +1,46 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+/**
+ * CSC369 Assignment 4 - Online growth.
+ *
+ * A mounted file system can grow up to the number of blocks its refcount and
+ * checksum tables were sized for (max_blocks in the superblock, see
+ * vsfs_max_blocks()). The image file is extended with ftruncate() (the new
+ * blocks read as zeros without being written) and the mapping with mremap(),
+ * in place if the address space after it is free, or moved otherwise. All of
+ * it happens with the file system lock held, so operations only wait for the
+ * remap and the bitmap update, not for any data to be written. The inode
+ * table is not resized; the new blocks go to the last group and to new groups
+ * without inodes.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "fs_ctx.h"
+
+
+/**
+ * Grow the file system. Must be called with fs->lock held.
+ *
+ * @param fs    pointer to the file system context.
+ * @param size  new image size in bytes.
+ * @return      0 on success; -EINVAL if the size is not a multiple of the
+ *              block size or not larger than the current size; -EFBIG if it
+ *              is larger than max_blocks allows; -EOPNOTSUPP if the image is
+ *              not an open file; -errno if extending or remapping fails.
+ */
+int resize_grow(fs_ctx *fs, uint64_t size);
@@ -0,0 +1,188 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+/**
+ * CSC369 Assignment 4 - Read-only snapshots.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include "acache.h"
+#include "dir.h"
+#include "inode.h"
+#include "snapshot.h"
+#include "xattr.h"
+
+/** Snapshot files and directories have no write permission bits. */
+#define SNAP_MODE_MASK (~(mode_t)0222)
+
+
+/** Check if a directory entry is "." or "..". */
+static bool is_dot(const vsfs_dentry *entry)
+{
+	return strcmp(entry->name, ".") == 0 || strcmp(entry->name, "..") == 0;
+}
+
+static void release_tree(fs_ctx *fs, vsfs_ino_t dir_ino);
+
+/** dir_iterate() callback for release_tree(). */
+static int release_entry(void *data, const vsfs_dentry *entry)
+{
+	fs_ctx *fs = (fs_ctx *)data;
+
+	if (!is_dot(entry)) {
+		if (S_ISDIR(fs->itable[entry->ino].i_mode)) {
+			release_tree(fs, entry->ino);
+		} else {
+			inode_free(fs, entry->ino);
+		}
+	}
+	return 0;
+}
+
+/** Free a snapshot directory and everything under it. */
+static void release_tree(fs_ctx *fs, vsfs_ino_t dir_ino)
+{
+	dir_iterate(fs, &fs->itable[dir_ino], release_entry, fs);
+	inode_free(fs, dir_ino);
+}
+
+static int clone_tree(fs_ctx *fs, vsfs_ino_t src_ino, vsfs_ino_t dst_ino);
+
+/** State of clone_tree() passed to clone_entry(). */
+typedef struct clone_ctx {
+	fs_ctx *fs;
+	/** Directory that receives the copies. */
+	vsfs_ino_t dst_ino;
+} clone_ctx;
+
+/** dir_iterate() callback that copies one entry of the source directory. */
+static int clone_entry(void *data, const vsfs_dentry *entry)
+{
+	clone_ctx *ctx = (clone_ctx *)data;
+	fs_ctx *fs = ctx->fs;
+
+	if (is_dot(entry)) {
+		return 0;
+	}
+
+	const vsfs_inode *src = &fs->itable[entry->ino];
+	vsfs_ino_t ino;
+	int ret = inode_alloc(fs, src->i_mode & SNAP_MODE_MASK, ctx->dst_ino,
+	                      &ino);
+	if (ret != 0) {
+		return ret;
+	}
+	vsfs_inode *copy = &fs->itable[ino];
+
+	if (S_ISDIR(src->i_mode)) {
+		copy->i_nlink = 2;
+		ret = dir_init(fs, copy, ino, ctx->dst_ino);
+		if (ret == 0) {
+			ret = clone_tree(fs, entry->ino, ino);
+		}
+	} else {
+		// Share all data blocks; no data is copied
+		ret = inode_clone_blocks(fs, copy, 0, src, 0, src->i_blocks);
+		copy->i_size = src->i_size;
+		acache_update(fs, copy);
+	}
+	if (ret == 0) {
+		ret = xattr_share(fs, ino, entry->ino);
+	}
+	if (ret == 0) {
+		ret = dir_add_entry(fs, &fs->itable[ctx->dst_ino], entry->name,
+		                    ino);
+	}
+	if (ret != 0) {
+		if (S_ISDIR(src->i_mode)) {
+			release_tree(fs, ino);
+		} else {
+			// Releases the blocks cloned so far
+			inode_free(fs, ino);
+		}
+		return ret;
+	}
+
+	copy->i_mtime = src->i_mtime;
+	acache_update(fs, copy);
+	if (S_ISDIR(src->i_mode)) {
+		fs->itable[ctx->dst_ino].i_nlink++;
+		acache_update(fs, &fs->itable[ctx->dst_ino]);
+	}
+	return 0;
+}
+
+/** Copy the contents of directory src_ino into the empty directory dst_ino. */
+static int clone_tree(fs_ctx *fs, vsfs_ino_t src_ino, vsfs_ino_t dst_ino)
+{
+	clone_ctx ctx = { fs, dst_ino };
+	return dir_iterate(fs, &fs->itable[src_ino], clone_entry, &ctx);
+}
+
+
+int snapshot_create(fs_ctx *fs, const char *name)
+{
+	vsfs_inode *snap_dir = &fs->itable[VSFS_SNAP_INO];
+	vsfs_ino_t ino;
+
+	if (dir_lookup(fs, snap_dir, name, &ino) == 0) {
+		return -EEXIST;
+	}
+
+	int ret = inode_alloc(fs, (S_IFDIR | 0777) & SNAP_MODE_MASK,
+	                      VSFS_SNAP_INO, &ino);
+	if (ret != 0) {
+		return ret;
+	}
+	fs->itable[ino].i_nlink = 2;
+	acache_update(fs, &fs->itable[ino]);
+
+	ret = dir_init(fs, &fs->itable[ino], ino, VSFS_SNAP_INO);
+	if (ret == 0) {
+		ret = xattr_share(fs, ino, VSFS_ROOT_INO);
+	}
+	if (ret == 0) {
+		ret = clone_tree(fs, VSFS_ROOT_INO, ino);
+	}
+	if (ret == 0) {
+		ret = dir_add_entry(fs, snap_dir, name, ino);
+	}
+	if (ret != 0) {
+		release_tree(fs, ino);
+		return ret;
+	}
+
+	snap_dir->i_nlink++;
+	acache_update(fs, snap_dir);
+	return 0;
+}
+
+int snapshot_delete(fs_ctx *fs, const char *name)
+{
+	vsfs_inode *snap_dir = &fs->itable[VSFS_SNAP_INO];
+	vsfs_ino_t ino;
+
+	int ret = dir_lookup(fs, snap_dir, name, &ino);
+	if (ret != 0) {
+		return ret;
+	}
+
+	release_tree(fs, ino);
+	dir_remove_entry(fs, snap_dir, name);
+	snap_dir->i_nlink--;
+	acache_update(fs, snap_dir);
+	return 0;
+}
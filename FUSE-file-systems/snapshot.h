@@ -0,0 +1,49 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+/**
+ * CSC369 Assignment 4 - Read-only snapshots.
+ *
+ * A snapshot is a copy of the directory tree made of new inodes that share
+ * all data blocks with the live files (see refcount.h), so creating one takes
+ * time proportional to the amount of metadata, not data. Live files copy
+ * shared blocks on write, which keeps the snapshot contents frozen.
+ *
+ * Snapshots are directories in the hidden VSFS_SNAP_NAME directory (inode
+ * VSFS_SNAP_INO), which is not listed in the root directory.
+ */
+
+#pragma once
+
+#include "fs_ctx.h"
+
+
+/**
+ * Create a snapshot of the whole file system.
+ *
+ * @param fs    pointer to the file system context.
+ * @param name  snapshot name.
+ * @return      0 on success; -EEXIST if the snapshot already exists;
+ *              -ENOSPC if there are not enough free inodes or blocks.
+ */
+int snapshot_create(fs_ctx *fs, const char *name);
+
+/**
+ * Delete a snapshot. Blocks that are no longer referenced are freed.
+ *
+ * @param fs    pointer to the file system context.
+ * @param name  snapshot name.
+ * @return      0 on success; -ENOENT if there is no such snapshot.
+ */
+int snapshot_delete(fs_ctx *fs, const char *name);
@@ -0,0 +1,280 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+/**
+ * CSC369 Assignment 4 - Operation statistics.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "lfs.h"
+#include "stats.h"
+
+/**
+ * Number of latency histogram buckets. Bucket 0 counts latencies of 0 ns and
+ * bucket i counts latencies in [2^(i-1), 2^i) ns; the last bucket also counts
+ * all longer latencies.
+ */
+#define STATS_BUCKETS 40
+
+/** Statistics of one operation. */
+typedef struct op_stats {
+	uint64_t count;
+	uint64_t errors;
+	uint64_t bytes;
+	uint64_t total_ns;
+	uint64_t hist[STATS_BUCKETS];
+} op_stats;
+
+/** Statistics recorded by one thread. */
+typedef struct stats_shard {
+	struct stats_shard *next;
+	op_stats ops[STATS_OP_COUNT];
+} stats_shard;
+
+/** Statistics of a file system. */
+typedef struct fs_stats {
+	/** Shard of the calling thread. */
+	pthread_key_t key;
+	/** Protects the list of shards (not their contents). */
+	pthread_mutex_t lock;
+	/** All shards, including the ones of threads that have exited. */
+	stats_shard *shards;
+} fs_stats;
+
+static const char *op_names[STATS_OP_COUNT] = {
+	[STATS_OP_LOOKUP]      = "lookup",
+	[STATS_OP_STATFS]      = "statfs",
+	[STATS_OP_GETATTR]     = "getattr",
+	[STATS_OP_READDIR]     = "readdir",
+	[STATS_OP_MKDIR]       = "mkdir",
+	[STATS_OP_RMDIR]       = "rmdir",
+	[STATS_OP_CREATE]      = "create",
+	[STATS_OP_UNLINK]      = "unlink",
+	[STATS_OP_UTIMENS]     = "utimens",
+	[STATS_OP_TRUNCATE]    = "truncate",
+	[STATS_OP_READ]        = "read",
+	[STATS_OP_WRITE]       = "write",
+	[STATS_OP_FSYNC]       = "fsync",
+	[STATS_OP_CLONE]       = "clone",
+	[STATS_OP_GETFLAGS]    = "getflags",
+	[STATS_OP_SETFLAGS]    = "setflags",
+	[STATS_OP_COMPR_STATS] = "compr_stats",
+	[STATS_OP_DEFRAG]      = "defrag",
+	[STATS_OP_FREE_FRAG]   = "free_frag",
+	[STATS_OP_GROW]        = "grow",
+	[STATS_OP_TRIM]        = "trim",
+	[STATS_OP_RELEASE]     = "release",
+	[STATS_OP_GETXATTR]    = "getxattr",
+	[STATS_OP_SETXATTR]    = "setxattr",
+	[STATS_OP_LISTXATTR]   = "listxattr",
+	[STATS_OP_REMOVEXATTR] = "removexattr",
+};
+
+const char *stats_op_name(unsigned int op)
+{
+	return op < STATS_OP_COUNT ? op_names[op] : NULL;
+}
+
+
+bool stats_init(fs_ctx *fs)
+{
+	fs_stats *stats = calloc(1, sizeof(*stats));
+	if (stats == NULL) {
+		return false;
+	}
+	if (pthread_key_create(&stats->key, NULL) != 0) {
+		free(stats);
+		return false;
+	}
+	pthread_mutex_init(&stats->lock, NULL);
+	fs->stats = stats;
+	return true;
+}
+
+void stats_destroy(fs_ctx *fs)
+{
+	fs_stats *stats = fs->stats;
+	if (stats == NULL) {
+		return;
+	}
+
+	while (stats->shards != NULL) {
+		stats_shard *shard = stats->shards;
+		stats->shards = shard->next;
+		free(shard);
+	}
+	pthread_key_delete(stats->key);
+	pthread_mutex_destroy(&stats->lock);
+	free(stats);
+	fs->stats = NULL;
+}
+
+/** Get the shard of the calling thread, allocating it on first use. */
+static stats_shard *get_shard(fs_stats *stats)
+{
+	stats_shard *shard = pthread_getspecific(stats->key);
+	if (shard != NULL) {
+		return shard;
+	}
+
+	shard = calloc(1, sizeof(*shard));
+	if (shard == NULL || pthread_setspecific(stats->key, shard) != 0) {
+		free(shard);
+		return NULL;
+	}
+	pthread_mutex_lock(&stats->lock);
+	shard->next = stats->shards;
+	stats->shards = shard;
+	pthread_mutex_unlock(&stats->lock);
+	return shard;
+}
+
+/**
+ * Add to a counter of the calling thread's shard. Only the owner thread writes
+ * to the shard; the atomic store only keeps readers from seeing torn values.
+ */
+static inline void counter_add(uint64_t *counter, uint64_t value)
+{
+	__atomic_store_n(counter, *counter + value, __ATOMIC_RELAXED);
+}
+
+/** Get the histogram bucket of a latency. */
+static unsigned int bucket(uint64_t ns)
+{
+	unsigned int b = ns == 0 ? 0 : 64 - __builtin_clzll(ns);
+	return b < STATS_BUCKETS ? b : STATS_BUCKETS - 1;
+}
+
+void stats_record(fs_ctx *fs, stats_op op, uint64_t start, int64_t ret)
+{
+	if (fs->stats == NULL) {
+		return;
+	}
+	uint64_t ns = stats_now() - start;
+	stats_shard *shard = get_shard(fs->stats);
+	if (shard == NULL) {
+		return;
+	}
+
+	op_stats *s = &shard->ops[op];
+	counter_add(&s->count, 1);
+	if (ret < 0) {
+		counter_add(&s->errors, 1);
+	} else {
+		counter_add(&s->bytes, ret);
+	}
+	counter_add(&s->total_ns, ns);
+	counter_add(&s->hist[bucket(ns)], 1);
+}
+
+
+/** Sum up the statistics of an operation over all shards. */
+static void sum_shards(fs_stats *stats, stats_op op, op_stats *sum)
+{
+	pthread_mutex_lock(&stats->lock);
+	for (stats_shard *shard = stats->shards; shard; shard = shard->next) {
+		const op_stats *s = &shard->ops[op];
+		sum->count    += __atomic_load_n(&s->count, __ATOMIC_RELAXED);
+		sum->errors   += __atomic_load_n(&s->errors, __ATOMIC_RELAXED);
+		sum->bytes    += __atomic_load_n(&s->bytes, __ATOMIC_RELAXED);
+		sum->total_ns += __atomic_load_n(&s->total_ns, __ATOMIC_RELAXED);
+		for (int b = 0; b < STATS_BUCKETS; ++b) {
+			sum->hist[b] += __atomic_load_n(&s->hist[b],
+			                                __ATOMIC_RELAXED);
+		}
+	}
+	pthread_mutex_unlock(&stats->lock);
+}
+
+/**
+ * Estimate a latency percentile (0 < p <= 1) from a histogram: the upper
+ * bound of the bucket that contains it, in microseconds.
+ */
+static double hist_percentile(const op_stats *s, double p)
+{
+	uint64_t rank = (uint64_t)(p * s->count + 0.999999);
+	uint64_t seen = 0;
+	for (int b = 0; b < STATS_BUCKETS; ++b) {
+		seen += s->hist[b];
+		if (seen >= rank) {
+			return (double)(1ull << b) / 1000;
+		}
+	}
+	return (double)(1ull << (STATS_BUCKETS - 1)) / 1000;
+}
+
+char *stats_format(fs_ctx *fs, size_t *len)
+{
+	char *text;
+	FILE *f = open_memstream(&text, len);
+	if (f == NULL) {
+		return NULL;
+	}
+
+	op_stats sums[STATS_OP_COUNT] = {0};
+	for (int op = 0; fs->stats != NULL && op < STATS_OP_COUNT; ++op) {
+		sum_shards(fs->stats, op, &sums[op]);
+	}
+
+	fprintf(f, "# op count errors bytes total_us avg_us p50_us p99_us "
+	        "p999_us\n");
+	for (int op = 0; op < STATS_OP_COUNT; ++op) {
+		const op_stats *s = &sums[op];
+		if (s->count == 0) {
+			continue;
+		}
+		fprintf(f, "%s %lu %lu %lu %.1f %.3f %.3f %.3f %.3f\n",
+		        op_names[op], (unsigned long)s->count,
+		        (unsigned long)s->errors, (unsigned long)s->bytes,
+		        s->total_ns / 1000.0, s->total_ns / 1000.0 / s->count,
+		        hist_percentile(s, 0.5), hist_percentile(s, 0.99),
+		        hist_percentile(s, 0.999));
+	}
+
+	// Histograms: number of operations with latency below each bound
+	fprintf(f, "# op latency histogram: <bound_ns>:<count> ...\n");
+	for (int op = 0; op < STATS_OP_COUNT; ++op) {
+		const op_stats *s = &sums[op];
+		if (s->count == 0) {
+			continue;
+		}
+		fprintf(f, "%s", op_names[op]);
+		for (int b = 0; b < STATS_BUCKETS; ++b) {
+			if (s->hist[b] != 0) {
+				fprintf(f, " %llu:%lu", 1ull << b,
+				        (unsigned long)s->hist[b]);
+			}
+		}
+		fprintf(f, "\n");
+	}
+
+	if (fs->lfs != NULL) {
+		lfs_stats ls;
+		pthread_mutex_lock(&fs->lock);
+		lfs_get_stats(fs, &ls);
+		pthread_mutex_unlock(&fs->lock);
+		fprintf(f, "# log: free_segments segments cleaned moved_blocks\n");
+		fprintf(f, "log %u %u %lu %lu\n", ls.free_segments, ls.segments,
+		        (unsigned long)ls.cleaned, (unsigned long)ls.moved);
+	}
+
+	if (fclose(f) != 0) {
+		free(text);
+		return NULL;
+	}
+	return text;
+}
@@ -0,0 +1,104 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+/**
+ * CSC369 Assignment 4 - Operation statistics.
+ *
+ * Every file system operation records its count, errors, bytes transferred and
+ * latency (in a histogram with power of 2 buckets). Each thread records into
+ * its own shard, so recording takes no locks; the shards are only summed up
+ * when the statistics are formatted.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "fs_ctx.h"
+
+
+/** Operations with statistics. */
+typedef enum stats_op {
+	STATS_OP_LOOKUP,
+	STATS_OP_STATFS,
+	STATS_OP_GETATTR,
+	STATS_OP_READDIR,
+	STATS_OP_MKDIR,
+	STATS_OP_RMDIR,
+	STATS_OP_CREATE,
+	STATS_OP_UNLINK,
+	STATS_OP_UTIMENS,
+	STATS_OP_TRUNCATE,
+	STATS_OP_READ,
+	STATS_OP_WRITE,
+	STATS_OP_FSYNC,
+	STATS_OP_CLONE,
+	STATS_OP_GETFLAGS,
+	STATS_OP_SETFLAGS,
+	STATS_OP_COMPR_STATS,
+	STATS_OP_DEFRAG,
+	STATS_OP_FREE_FRAG,
+	STATS_OP_GROW,
+	STATS_OP_TRIM,
+	STATS_OP_RELEASE,
+	STATS_OP_GETXATTR,
+	STATS_OP_SETXATTR,
+	STATS_OP_LISTXATTR,
+	STATS_OP_REMOVEXATTR,
+	STATS_OP_COUNT
+} stats_op;
+
+/** Get the current time for stats_record() in nanoseconds. */
+static inline uint64_t stats_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/** Get the name of an operation; NULL if op is out of range. */
+const char *stats_op_name(unsigned int op);
+
+/**
+ * Allocate the statistics of a file system (fs->stats).
+ *
+ * @param fs  pointer to the file system context.
+ * @return    true on success; false if out of memory.
+ */
+bool stats_init(fs_ctx *fs);
+
+/**
+ * Record a completed operation. Does nothing if fs->stats is NULL.
+ *
+ * @param fs     pointer to the file system context.
+ * @param op     operation.
+ * @param start  stats_now() when the operation started.
+ * @param ret    operation result: -errno on error; number of bytes
+ *               transferred or 0 on success.
+ */
+void stats_record(fs_ctx *fs, stats_op op, uint64_t start, int64_t ret);
+
+/**
+ * Format the statistics as text.
+ *
+ * @param fs   pointer to the file system context.
+ * @param len  pointer to the variable that receives the text length.
+ * @return     text that must be freed by the caller; NULL if out of memory.
+ */
+char *stats_format(fs_ctx *fs, size_t *len);
+
+/** Free the statistics of a file system. */
+void stats_destroy(fs_ctx *fs);
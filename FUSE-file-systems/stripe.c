@@ -0,0 +1,193 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+
+/**
+ * CSC369 Assignment 4 - Striped images.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "map.h"
+#include "stripe.h"
+#include "vsfs.h"
+
+
+bool stripe_is_set(const char *path)
+{
+	// A missing member is reported by stripe_open()
+	return strchr(path, STRIPE_SEP) != NULL && access(path, F_OK) != 0;
+}
+
+stripe_set *stripe_open(const char *path)
+{
+	unsigned int count = 1;
+	for (const char *p = path; *p != '\0'; ++p) {
+		count += *p == STRIPE_SEP;
+	}
+	stripe_set *set = calloc(1, sizeof(*set) + count * sizeof(set->fds[0]));
+	char *paths = strdup(path);
+	if (set == NULL || paths == NULL) {
+		perror("malloc");
+		free(set);
+		free(paths);
+		return NULL;
+	}
+
+	char *next = paths;
+	const char sep[] = { STRIPE_SEP, '\0' };
+	for (char *member; (member = strsep(&next, sep)) != NULL;) {
+		int fd = member[0] != '\0' ? open(member, O_RDWR) : -1;
+		if (fd < 0) {
+			perror(member[0] != '\0' ? member : "empty member path");
+			stripe_close(set);
+			set = NULL;
+			break;
+		}
+		set->fds[set->count++] = fd;
+	}
+	free(paths);
+	return set;
+}
+
+void stripe_close(stripe_set *set)
+{
+	if (set == NULL) {
+		return;
+	}
+	for (unsigned int i = 0; i < set->count; ++i) {
+		close(set->fds[i]);
+	}
+	free(set);
+}
+
+/** Get the stripe unit and check that it matches the number of members. */
+static uint32_t sb_stripe_unit(const stripe_set *set)
+{
+	vsfs_superblock sb;
+	if (pread(set->fds[0], &sb, sizeof(sb), 0) != sizeof(sb) ||
+	    sb.magic != VSFS_MAGIC) {
+		fprintf(stderr, "Not a vsfs image\n");
+		return 0;
+	}
+	if (vsfs_stripe_count(&sb) != set->count) {
+		fprintf(stderr, "Image is striped over %u files, %u given\n",
+		        vsfs_stripe_count(&sb), set->count);
+		return 0;
+	}
+	return sb.stripe_unit;
+}
+
+void *stripe_map(const stripe_set *set, uint32_t unit, size_t *size)
+{
+	size_t member_size = 0;
+	for (unsigned int i = 0; i < set->count; ++i) {
+		struct stat st;
+		if (fstat(set->fds[i], &st) < 0) {
+			perror("fstat");
+			return NULL;
+		}
+		if (i > 0 && (size_t)st.st_size != member_size) {
+			fprintf(stderr, "Striped image files must have the same "
+			        "size\n");
+			return NULL;
+		}
+		member_size = st.st_size;
+	}
+
+	if (unit == 0 && (unit = sb_stripe_unit(set)) == 0) {
+		return NULL;
+	}
+	if (unit % VSFS_BLOCK_SIZE_MIN != 0 || unit % sysconf(_SC_PAGESIZE) != 0) {
+		fprintf(stderr, "Invalid stripe unit %u\n", unit);
+		return NULL;
+	}
+	if (member_size == 0 || member_size % unit != 0) {
+		fprintf(stderr, "Image file size is not a multiple of the stripe "
+		        "unit\n");
+		return NULL;
+	}
+
+	// Reserve the address range, then map each unit of it to its member
+	size_t total = member_size * set->count;
+	void *addr = mmap(NULL, total, PROT_NONE,
+	                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (addr == MAP_FAILED) {
+		perror("mmap");
+		return NULL;
+	}
+	for (size_t i = 0; i < total / unit; ++i) {
+		if (mmap(addr + i * unit, unit, PROT_READ | PROT_WRITE,
+		         MAP_SHARED | MAP_FIXED, set->fds[i % set->count],
+		         (off_t)(i / set->count) * unit) == MAP_FAILED) {
+			// Each unit is a separate mapping; see vm.max_map_count
+			perror("mmap");
+			munmap(addr, total);
+			return NULL;
+		}
+	}
+	*size = total;
+	return addr;
+}
+
+void *stripe_map_image(const char *path, size_t *size)
+{
+	if (!stripe_is_set(path)) {
+		return map_file(path, VSFS_BLOCK_SIZE_MIN, size);
+	}
+	stripe_set *set = stripe_open(path);
+	if (set == NULL) {
+		return NULL;
+	}
+	// Like map_file(), the mappings keep the files open
+	void *image = stripe_map(set, 0, size);
+	stripe_close(set);
+	return image;
+}
+
+int stripe_punch(const stripe_set *set, uint32_t unit, uint64_t offset,
+                 uint64_t len)
+{
+	while (len > 0) {
+		uint64_t idx = offset / unit;
+		uint64_t start = offset % unit;
+		uint64_t chunk = unit - start < len ? unit - start : len;
+		if (fallocate(set->fds[idx % set->count],
+		              FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+		              (off_t)(idx / set->count) * unit + start,
+		              chunk) != 0) {
+			return -errno;
+		}
+		offset += chunk;
+		len -= chunk;
+	}
+	return 0;
+}
+
+void stripe_writeback(const stripe_set *set)
+{
+	for (unsigned int i = 0; i < set->count; ++i) {
+		// Only starts the writeback; errors are reported by msync()
+		sync_file_range(set->fds[i], 0, 0, SYNC_FILE_RANGE_WRITE);
+	}
+}
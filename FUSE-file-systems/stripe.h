@@ -0,0 +1,115 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+
+/**
+ * CSC369 Assignment 4 - Striped images.
+ *
+ * A striped image (see vsfs_stripe_count() in vsfs.h) is named by the paths
+ * of its member files in stripe order, separated by STRIPE_SEP, e.g.
+ * "/disk0/img:/disk1/img". A path that names an existing file is always a
+ * single image, even if it contains STRIPE_SEP. The members are mapped into
+ * one contiguous range of memory, a stripe unit at a time, so the rest of the
+ * file system sees a single image: a large read or write that spans several
+ * units touches all the members, and the page cache reads and writes them
+ * independently.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/** Separator of the member file paths of a striped image. */
+#define STRIPE_SEP ':'
+
+/** Open member files of a striped image. */
+typedef struct stripe_set {
+	/** Number of member files. */
+	unsigned int count;
+	/** File descriptors of the members, in stripe order. */
+	int fds[];
+} stripe_set;
+
+
+/**
+ * Check if an image path names a striped image (more than one file): it
+ * contains STRIPE_SEP and is not the path of an existing file.
+ *
+ * @param path  image file path, or member file paths of a striped image.
+ * @return      true if the path names a striped image; false otherwise.
+ */
+bool stripe_is_set(const char *path);
+
+/**
+ * Open the member files of a striped image for reading and writing.
+ *
+ * @param path  member file paths separated by STRIPE_SEP.
+ * @return      pointer to the set on success; NULL on failure (reported on
+ *              stderr).
+ */
+stripe_set *stripe_open(const char *path);
+
+/**
+ * Close the member files of a striped image.
+ *
+ * @param set  pointer to the set; may be NULL.
+ */
+void stripe_close(stripe_set *set);
+
+/**
+ * Map the members of a striped image into one contiguous range of memory.
+ * The members must have the same size, a multiple of the stripe unit. The
+ * mapping can be unmapped with a single munmap() call.
+ *
+ * @param set   pointer to the set.
+ * @param unit  stripe unit in bytes; 0 to use the one in the superblock,
+ *              which must also match the number of members.
+ * @param size  pointer to the variable that receives the image size.
+ * @return      pointer to the mapping on success; NULL on failure (reported
+ *              on stderr).
+ */
+void *stripe_map(const stripe_set *set, uint32_t unit, size_t *size);
+
+/**
+ * Map a vsfs image, striped or a single file (see map_file()), for reading
+ * and writing. The files don't need to stay open.
+ *
+ * @param path  image file path, or member file paths of a striped image.
+ * @param size  pointer to the variable that receives the image size.
+ * @return      pointer to the mapping on success; NULL on failure.
+ */
+void *stripe_map_image(const char *path, size_t *size);
+
+/**
+ * Punch a range of a striped image out of its member files.
+ *
+ * @param set     pointer to the set.
+ * @param unit    stripe unit in bytes.
+ * @param offset  offset of the range in the image.
+ * @param len     length of the range in bytes.
+ * @return        0 on success; -errno on failure.
+ */
+int stripe_punch(const stripe_set *set, uint32_t unit, uint64_t offset,
+                 uint64_t len);
+
+/**
+ * Start writing back the dirty pages of all the member files, so that they
+ * are written to their disks in parallel rather than one file at a time.
+ *
+ * @param set  pointer to the set.
+ */
+void stripe_writeback(const stripe_set *set);
@@ -0,0 +1,111 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+
+/**
+ * CSC369 Assignment 4 - Tail packing.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include "compress.h"
+#include "csum.h"
+#include "dedup.h"
+#include "inode.h"
+#include "refcount.h"
+#include "tail.h"
+
+
+/**
+ * Get a tail block with at least len bytes of free space and take a reference
+ * to it for the caller, starting a new tail block if needed.
+ */
+static int tail_reserve(fs_ctx *fs, vsfs_inode *inode, uint32_t len)
+{
+	if (fs->tail_blk != 0 && fs->tail_used + len <= fs->block_size &&
+	    block_ref(fs, fs->tail_blk)) {
+		return 0;
+	}
+
+	vsfs_blk_t blk;
+	int ret = block_alloc(fs, inode_goal(fs, inode, inode->i_blocks - 1),
+	                      &blk);
+	if (ret != 0) {
+		return ret;
+	}
+	memset(block_addr(fs, blk), 0, fs->block_size);
+	csum_mark_dirty(fs, blk);
+	fs->tail_blk = blk;
+	fs->tail_used = 0;
+	return 0;
+}
+
+bool tail_pack(fs_ctx *fs, vsfs_inode *inode)
+{
+	if (!S_ISREG(inode->i_mode) || inode->i_blocks == 0 ||
+	    (inode->i_flags & VSFS_INODE_TAIL) ||
+	    !vsfs_tail_packable(fs->block_size, inode->i_size)) {
+		return false;
+	}
+	vsfs_blk_t idx = inode->i_blocks - 1;
+	vsfs_blk_t last = inode_get_block(fs, inode, idx);
+	// A shared block would not be freed, and the last block of a
+	// compressed cluster holds data of the whole cluster
+	if (last == 0 || rc_get(fs, last) > 1 ||
+	    compress_is_compressed(fs, inode, idx / VSFS_CLUSTER_BLOCKS)) {
+		return false;
+	}
+
+	uint32_t len = tail_length(fs, inode);
+	if (tail_reserve(fs, inode, len) != 0) {
+		return false;
+	}
+	vsfs_blk_t blk = fs->tail_blk;
+	uint32_t off = fs->tail_used;
+
+	// Tails are appended to space that no other tail refers to yet
+	if (fs->dedup != NULL) {
+		dedup_forget(fs, blk);
+	}
+	memcpy(block_addr(fs, blk) + off, block_addr(fs, last), len);
+	csum_mark_dirty(fs, blk);
+	fs->tail_used += len;
+
+	inode_replace_block(fs, inode, idx, blk);
+	inode->i_flags |= VSFS_INODE_TAIL;
+	inode->i_tail_off = off;
+	return true;
+}
+
+int tail_unpack(fs_ctx *fs, vsfs_inode *inode, vsfs_blk_t *blk)
+{
+	vsfs_blk_t idx = inode->i_blocks - 1;
+	assert(tail_is_packed(inode, idx));
+
+	vsfs_blk_t copy;
+	int ret = block_alloc(fs, inode_goal(fs, inode, idx), &copy);
+	if (ret != 0) {
+		return ret;
+	}
+	uint32_t len = tail_length(fs, inode);
+	const char *tail = block_addr(fs, inode_get_block(fs, inode, idx));
+	memcpy(block_addr(fs, copy), tail + inode->i_tail_off, len);
+	csum_mark_dirty(fs, copy);
+
+	// Clears the flag and drops the reference to the tail block
+	inode_replace_block(fs, inode, idx, copy);
+	*blk = copy;
+	return 0;
+}
@@ -0,0 +1,85 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+
+/**
+ * CSC369 Assignment 4 - Tail packing.
+ *
+ * A file that ends partway into its last block wastes the rest of that block,
+ * which is most of the space in a directory of small files. When a file that
+ * was open for writing is released, a tail of at most half a block (see
+ * vsfs_tail_packable()) is moved into a shared tail block (see
+ * VSFS_INODE_TAIL in vsfs.h) and its own block is freed. Reading the tails of
+ * many small files then reads a few shared blocks instead of a block per file.
+ *
+ * New tails are appended to the current tail block, and a new tail block is
+ * started when it is full (or after a remount). Packed tails are never
+ * modified in place: a write to the last block of a file, or extending the
+ * file, first moves its tail back into a block of its own (see
+ * inode_write_block()). The space of such a tail within the tail block is not
+ * reused; a tail block is freed when the last of its tails is gone.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "fs_ctx.h"
+#include "vsfs.h"
+
+
+/** Check if file block idx of an inode is a packed tail. */
+static inline bool tail_is_packed(const vsfs_inode *inode, vsfs_blk_t idx)
+{
+	return (inode->i_flags & VSFS_INODE_TAIL) && idx + 1 == inode->i_blocks;
+}
+
+/**
+ * Get the offset of the data of a file block within the block it is stored
+ * in: the tail offset for a packed tail, 0 for any other block.
+ */
+static inline uint32_t tail_offset(const vsfs_inode *inode, vsfs_blk_t idx)
+{
+	return tail_is_packed(inode, idx) ? inode->i_tail_off : 0;
+}
+
+/** Get the length of the data in the last block of a file (with blocks). */
+static inline uint32_t tail_length(const fs_ctx *fs, const vsfs_inode *inode)
+{
+	return inode->i_size - ((uint64_t)(inode->i_blocks - 1) << fs->block_shift);
+}
+
+/**
+ * Pack the tail of a regular file into the current tail block. Nothing is
+ * done if the tail is already packed or too large, or if the last block is
+ * shared with other files or is part of a compressed cluster.
+ *
+ * @param fs     pointer to the file system context.
+ * @param inode  pointer to the inode.
+ * @return       true if the tail was packed; false otherwise (including when
+ *               a new tail block can't be allocated).
+ */
+bool tail_pack(fs_ctx *fs, vsfs_inode *inode);
+
+/**
+ * Move a packed tail into a newly allocated block of its own (the rest of the
+ * block is undefined, like any data past the end of file) and drop the
+ * reference to the tail block.
+ *
+ * @param fs     pointer to the file system context.
+ * @param inode  pointer to the inode; the last block must be a packed tail.
+ * @param blk    pointer to the variable that receives the new block number.
+ * @return       0 on success; -ENOSPC if the block can't be allocated.
+ */
+int tail_unpack(fs_ctx *fs, vsfs_inode *inode, vsfs_blk_t *blk);
@@ -0,0 +1,251 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+/**
+ * CSC369 Assignment 4 - Operation trace recorder.
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "trace.h"
+#include "util.h"
+
+/** Size of the ring buffer in bytes; a power of 2. */
+#define TRACE_RING_SIZE (4 << 20)
+
+/** Interval between writes of the buffer to the log in nanoseconds. */
+#define TRACE_FLUSH_NS 10000000
+
+/** Op of the records that fill the end of the ring; never written out. */
+#define TRACE_OP_PAD 0xff
+
+/**
+ * Trace recorder state.
+ *
+ * The ring buffer is indexed by positions that only grow: a record at
+ * position p is at offset p % TRACE_RING_SIZE. Writers reserve space by
+ * advancing head and publish a record by storing its (nonzero) length last;
+ * the writer thread consumes the published records at tail, zeroes the space
+ * and advances tail. Records never wrap around the end of the ring; the space
+ * left at the end is filled with a pad record instead.
+ */
+typedef struct trace {
+	FILE *file;
+	/** stats_now() when recording started. */
+	uint64_t start;
+	/** Number of records that did not fit into the buffer. */
+	uint64_t dropped;
+	uint64_t head;
+	uint64_t tail;
+	char *ring;
+	/** Writer thread; only valid if started is true. */
+	pthread_t thread;
+	bool started;
+	bool stop;
+} trace;
+
+
+bool trace_init(fs_ctx *fs, const char *path)
+{
+	assert(fs->trace == NULL);
+
+	trace *t = calloc(1, sizeof(*t));
+	if (t == NULL) {
+		return false;
+	}
+	t->ring = calloc(1, TRACE_RING_SIZE);
+	if (t->ring == NULL) {
+		free(t);
+		return false;
+	}
+	t->file = fopen(path, "w");
+	if (t->file == NULL) {
+		perror(path);
+		free(t->ring);
+		free(t);
+		return false;
+	}
+
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	trace_header hdr = {0};
+	memcpy(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic));
+	hdr.start_time = (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+	if (fwrite(&hdr, sizeof(hdr), 1, t->file) != 1) {
+		perror(path);
+		fclose(t->file);
+		free(t->ring);
+		free(t);
+		return false;
+	}
+
+	t->start = stats_now();
+	fs->trace = t;
+	return true;
+}
+
+/**
+ * Write out the published records at the tail of the buffer.
+ *
+ * @return  false if writing to the log failed.
+ */
+static bool drain(trace *t)
+{
+	uint64_t tail = t->tail;
+	bool ok = true;
+
+	for (;;) {
+		trace_rec *rec = (trace_rec *)(t->ring + tail % TRACE_RING_SIZE);
+		uint32_t len = __atomic_load_n(&rec->len, __ATOMIC_ACQUIRE);
+		if (len == 0) {
+			break;
+		}
+		if (rec->op != TRACE_OP_PAD && ok) {
+			ok = fwrite(rec, len, 1, t->file) == 1;
+		}
+		memset(rec, 0, len);
+		tail += len;
+		__atomic_store_n(&t->tail, tail, __ATOMIC_RELEASE);
+	}
+	return ok;
+}
+
+static void *writer_main(void *arg)
+{
+	trace *t = arg;
+	struct timespec interval = { 0, TRACE_FLUSH_NS };
+
+	while (!__atomic_load_n(&t->stop, __ATOMIC_ACQUIRE)) {
+		if (!drain(t) || fflush(t->file) != 0) {
+			perror("trace");
+			break;
+		}
+		nanosleep(&interval, NULL);
+	}
+	return NULL;
+}
+
+bool trace_start(fs_ctx *fs)
+{
+	trace *t = fs->trace;
+	if (t == NULL) {
+		return true;
+	}
+	assert(!t->started);
+
+	if (pthread_create(&t->thread, NULL, writer_main, t) != 0) {
+		return false;
+	}
+	t->started = true;
+	return true;
+}
+
+void trace_destroy(fs_ctx *fs)
+{
+	trace *t = fs->trace;
+	if (t == NULL) {
+		return;
+	}
+
+	if (t->started) {
+		__atomic_store_n(&t->stop, true, __ATOMIC_RELEASE);
+		pthread_join(t->thread, NULL);
+	}
+	if (!drain(t)) {
+		perror("trace");
+	}
+	if (t->dropped != 0) {
+		fprintf(stderr, "trace: %lu records did not fit into the buffer "
+		        "and were dropped\n", (unsigned long)t->dropped);
+	}
+	if (fclose(t->file) != 0) {
+		perror("trace");
+	}
+	free(t->ring);
+	free(t);
+	fs->trace = NULL;
+}
+
+/**
+ * Reserve space for a record of len bytes.
+ *
+ * @return  pointer to the record; NULL if the buffer is full.
+ */
+static trace_rec *reserve(trace *t, uint32_t len)
+{
+	uint64_t head = __atomic_load_n(&t->head, __ATOMIC_RELAXED);
+	uint64_t pad;
+
+	do {
+		uint64_t tail = __atomic_load_n(&t->tail, __ATOMIC_ACQUIRE);
+		uint64_t off = head % TRACE_RING_SIZE;
+		pad = off + len > TRACE_RING_SIZE ? TRACE_RING_SIZE - off : 0;
+		if (head + pad + len - tail > TRACE_RING_SIZE) {
+			return NULL;
+		}
+	} while (!__atomic_compare_exchange_n(&t->head, &head, head + pad + len,
+	                                      true, __ATOMIC_RELAXED,
+	                                      __ATOMIC_RELAXED));
+
+	if (pad != 0) {
+		trace_rec *rec = (trace_rec *)(t->ring + head % TRACE_RING_SIZE);
+		rec->op = TRACE_OP_PAD;
+		__atomic_store_n(&rec->len, (uint32_t)pad, __ATOMIC_RELEASE);
+	}
+	return (trace_rec *)(t->ring + (head + pad) % TRACE_RING_SIZE);
+}
+
+void trace_record(fs_ctx *fs, stats_op op, uint64_t start, int64_t ret,
+                  const char *path, const char *path2, uint64_t offset,
+                  uint64_t size, uint64_t arg)
+{
+	trace *t = fs->trace;
+	if (t == NULL) {
+		return;
+	}
+	uint64_t now = stats_now();
+
+	size_t path_len = path ? strnlen(path, VSFS_PATH_MAX) : 0;
+	size_t path2_len = path2 ? strnlen(path2, VSFS_PATH_MAX) : 0;
+	uint32_t len = align_up(sizeof(trace_rec) + path_len + path2_len + 2,
+	                        sizeof(uint64_t));
+	trace_rec *rec = reserve(t, len);
+	if (rec == NULL) {
+		__atomic_fetch_add(&t->dropped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+
+	// The space is zeroed, so the paths are NUL-terminated and padded
+	rec->op = op;
+	rec->path_len = path_len;
+	rec->path2_len = path2_len;
+	rec->ret = ret;
+	rec->time = start - t->start;
+	rec->duration = now - start;
+	rec->offset = offset;
+	rec->size = size;
+	rec->arg = arg;
+	if (path != NULL) {
+		memcpy(rec->paths, path, path_len);
+	}
+	if (path2 != NULL) {
+		memcpy(rec->paths + path_len + 1, path2, path2_len);
+	}
+	__atomic_store_n(&rec->len, len, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,134 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+/**
+ * CSC369 Assignment 4 - Operation trace recorder.
+ *
+ * Every file system operation can be recorded to a binary log that
+ * vsfs-replay re-executes. Operations append records to an in-memory ring
+ * buffer without taking locks; a background thread writes them out. Records
+ * are dropped (and counted) if the writer falls behind.
+ *
+ * Log format (native byte order): a trace_header followed by trace_rec
+ * records. Operations record themselves before releasing the file system lock,
+ * so the records are in the order the operations ran in.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "fs_ctx.h"
+#include "stats.h"
+
+
+#define TRACE_MAGIC "VSFSTRC1"
+
+/** Log file header. */
+typedef struct trace_header {
+	/** TRACE_MAGIC without the terminating NUL. */
+	char magic[8];
+	/** Wall clock time when recording started, in ns since the epoch. */
+	uint64_t start_time;
+} trace_header;
+
+/**
+ * Log record of one operation.
+ *
+ * The meaning of offset, size and arg depends on the operation:
+ *   read, write  file offset, requested size; -
+ *   truncate     new size; -; -
+ *   create,mkdir -; -; mode
+ *   utimens      new mtime seconds; nanoseconds (or UTIME_NOW/UTIME_OMIT); -
+ *   clone        dest_offset; src_length; src_offset (path2 is src_path)
+ *   setflags     -; -; flags
+ *   getxattr     -; buffer size; - (path2 is the attribute name)
+ *   setxattr     -; value size; flags (path2 is the attribute name)
+ *   listxattr    -; buffer size; -
+ *   removexattr  -; -; - (path2 is the attribute name)
+ */
+typedef struct trace_rec {
+	/** Record length in bytes including the paths; a multiple of 8. */
+	uint32_t len;
+	/** Operation (stats_op). */
+	uint8_t op;
+	uint8_t reserved;
+	/** Length of the path, excluding the terminating NUL. */
+	uint16_t path_len;
+	/** Length of the second path, excluding the terminating NUL. */
+	uint16_t path2_len;
+	uint16_t reserved2;
+	/** Operation result: -errno or the return value. */
+	int32_t ret;
+	/** Start time in ns since recording started. */
+	uint64_t time;
+	/** Duration in ns. */
+	uint64_t duration;
+	uint64_t offset;
+	uint64_t size;
+	uint64_t arg;
+	/** path, NUL, path2, NUL; padded with NULs to a multiple of 8 bytes. */
+	char paths[];
+} trace_rec;
+
+/** Get the first path of a record. */
+static inline const char *trace_path(const trace_rec *rec)
+{
+	return rec->paths;
+}
+
+/** Get the second path of a record. */
+static inline const char *trace_path2(const trace_rec *rec)
+{
+	return rec->paths + rec->path_len + 1;
+}
+
+/**
+ * Open a trace log file and allocate the trace buffer (fs->trace). Nothing
+ * is written out until trace_start() is called.
+ *
+ * @param fs    pointer to the file system context.
+ * @param path  log file path; the file is created or truncated.
+ * @return      true on success; false on failure.
+ */
+bool trace_init(fs_ctx *fs, const char *path);
+
+/**
+ * Start the thread that writes the trace buffer to the log.
+ *
+ * @param fs  pointer to the file system context.
+ * @return    true on success; false on failure.
+ */
+bool trace_start(fs_ctx *fs);
+
+/** Stop the writer thread, write out the remaining records and close the log. */
+void trace_destroy(fs_ctx *fs);
+
+/**
+ * Record an operation. Does nothing if fs->trace is NULL.
+ *
+ * @param fs      pointer to the file system context.
+ * @param op      operation.
+ * @param start   stats_now() when the operation started.
+ * @param ret     operation result.
+ * @param path    path argument; NULL if none.
+ * @param path2   second path argument; NULL if none.
+ * @param offset  see trace_rec.
+ * @param size    see trace_rec.
+ * @param arg     see trace_rec.
+ */
+void trace_record(fs_ctx *fs, stats_op op, uint64_t start, int64_t ret,
+                  const char *path, const char *path2, uint64_t offset,
+                  uint64_t size, uint64_t arg);
@@ -22,20 +22,25 @@
 #pragma once
 
 #include <assert.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <limits.h>
+#include <sys/ioctl.h>
 #include <sys/stat.h>
 
 
 /**
- * vsfs block size in bytes. You are not allowed to change this value.
+ * vsfs block sizes in bytes. The block size is chosen by mkfs.vsfs (a power of
+ * two between VSFS_BLOCK_SIZE_MIN and VSFS_BLOCK_SIZE_MAX) and recorded in the
+ * superblock; see vsfs_block_size().
  *
  * The block size is the unit of space allocation. Each file (and directory)
  * must occupy an integral number of blocks. Each of the file systems metadata
  * partitions, e.g. superblock, inode/block bitmaps, inode table (but not an
  * individual inode) must also occupy an integral number of blocks.
  */
-#define VSFS_BLOCK_SIZE 4096
+#define VSFS_BLOCK_SIZE_MIN 4096
+#define VSFS_BLOCK_SIZE_MAX 65536
 #define VSFS_NUM_DIRECT 5
 
 /** Block number (block pointer) type. */
@@ -44,6 +49,12 @@ typedef uint32_t vsfs_blk_t;
 /** Inode number type. */
 typedef uint32_t vsfs_ino_t;
 
+/** Block reference count type (entry of the refcount table). */
+typedef uint16_t vsfs_rc_t;
+
+/** Maximum number of references to a single data block. */
+#define VSFS_RC_MAX UINT16_MAX
+
 
 /** Magic value that can be used to identify an vsfs image. */
 #define VSFS_MAGIC 0xC5C369A4C5C369A4ul
@@ -53,7 +64,10 @@ typedef uint32_t vsfs_ino_t;
  *   Block 1: inode bitmap
  *   Block 2: data bitmap
  *   Block 3: start of inode table
- *   First data block after inode table
+ *   Refcount table after inode table
+ *   Checksum table after refcount table
+ *   Extended attribute table after checksum table
+ *   First data block after extended attribute table
  */
 
 #define VSFS_SB_BLKNUM   0
@@ -70,13 +84,146 @@ typedef struct vsfs_superblock {
 	uint32_t   free_inodes; /* Number of available inodes */ 
 	vsfs_blk_t num_blocks;  /* File system size in blocks */
 	vsfs_blk_t free_blocks; /* Number of available blocks in file system */
-	vsfs_blk_t data_region; /* First block after inode table */ 
+	vsfs_blk_t data_region; /* First block after the metadata tables */
+	vsfs_blk_t rc_region;   /* First block of the refcount table */
+	vsfs_blk_t csum_region; /* First block of the checksum table */
+	uint32_t   blocks_per_group; /* Blocks in a block group (see below) */
+	uint32_t   inodes_per_group; /* Inodes in a block group */
+	uint32_t   itable_init; /* Initialized inode table blocks (see below) */
+	uint32_t   max_blocks;  /* Blocks the image can grow to (see below) */
+	uint32_t   block_size;  /* Block size in bytes (see below) */
+	vsfs_blk_t xattr_region;/* First block of the xattr table (see below) */
+	uint32_t   stripe_unit; /* Stripe unit in bytes; 0 if not striped */
+	uint32_t   stripe_count;/* Number of image files (see below) */
 } vsfs_superblock;
 
 // Superblock must fit into a single disk sector
-static_assert(sizeof(vsfs_superblock) <= VSFS_BLOCK_SIZE,
+static_assert(sizeof(vsfs_superblock) <= VSFS_BLOCK_SIZE_MIN,
               "superblock is too large");
 
+/**
+ * Block size of a file system. All block numbers, including the fixed ones
+ * above, are in units of this size. 0 means VSFS_BLOCK_SIZE_MIN (images
+ * formatted before the block size was configurable).
+ */
+static inline uint32_t vsfs_block_size(const vsfs_superblock *sb)
+{
+	return sb->block_size != 0 ? sb->block_size : VSFS_BLOCK_SIZE_MIN;
+}
+
+/** Check if a block size is supported: a power of two within the limits. */
+static inline bool vsfs_block_size_valid(uint32_t block_size)
+{
+	return block_size >= VSFS_BLOCK_SIZE_MIN &&
+	       block_size <= VSFS_BLOCK_SIZE_MAX &&
+	       (block_size & (block_size - 1)) == 0;
+}
+
+/**
+ * Block groups.
+ *
+ * The blocks are divided into groups of blocks_per_group consecutive blocks
+ * (the last group may be shorter), and the inodes into the same number of
+ * groups of inodes_per_group consecutive inode numbers. Group g owns blocks
+ * [g * blocks_per_group, (g + 1) * blocks_per_group) and the matching bits of
+ * the data bitmap, and inodes [g * inodes_per_group, ...) with their bits of
+ * the inode bitmap and their slice of the inode table. The metadata regions
+ * stay at the start of the image, so the first group(s) have fewer data
+ * blocks. The groups only guide allocation (see group.h): the inodes of a
+ * directory and the blocks of a file are kept in the same group.
+ *
+ * Both values are multiples of VSFS_GROUP_ALIGN, so that the groups don't
+ * share bitmap words or inode table blocks.
+ */
+#define VSFS_BLOCKS_PER_GROUP 4096
+#define VSFS_GROUP_ALIGN 64
+
+/**
+ * Lazy inode table initialization.
+ *
+ * Only the first itable_init blocks of the inode table are initialized; the
+ * rest may hold stale data, must not contain allocated inodes, and their
+ * checksums are not valid. mkfs.vsfs initializes just the first block (root
+ * and snapshot directories) unless the image is zeroed anyway; the mounted
+ * file system initializes the rest (see itable.h). 0 means that the whole
+ * table is initialized.
+ */
+
+/**
+ * Online growth.
+ *
+ * The refcount and checksum tables are sized for max_blocks blocks rather
+ * than num_blocks, so that a mounted image can be extended up to max_blocks
+ * without moving the data region. 0 means num_blocks (images formatted before
+ * growth was supported).
+ */
+static inline vsfs_blk_t vsfs_max_blocks(const vsfs_superblock *sb)
+{
+	return sb->max_blocks != 0 ? sb->max_blocks : sb->num_blocks;
+}
+
+/**
+ * Striping.
+ *
+ * An image can be striped over stripe_count files of the same size, RAID-0
+ * style, so that large reads and writes are spread over several disks. The
+ * image is divided into units of stripe_unit bytes (a multiple of the block
+ * size), and unit i is stored in file i % stripe_count at offset
+ * (i / stripe_count) * stripe_unit; the superblock is at the start of the
+ * first file. 0 means that the image is a single file (see stripe.h).
+ */
+static inline uint32_t vsfs_stripe_count(const vsfs_superblock *sb)
+{
+	return sb->stripe_count != 0 ? sb->stripe_count : 1;
+}
+
+/**
+ * Number of blocks in the refcount table.
+ *
+ * The refcount table holds one vsfs_rc_t per block in the file system. A data
+ * block that belongs to a file (or directory) has a count equal to the number
+ * of block pointers that refer to it; it is only returned to the data bitmap
+ * when the last reference is dropped. Metadata blocks and free blocks have a
+ * count of 0.
+ */
+static inline uint32_t vsfs_rc_blocks(vsfs_blk_t num_blocks,
+                                      uint32_t block_size)
+{
+	return (num_blocks * sizeof(vsfs_rc_t) + block_size - 1) / block_size;
+}
+
+/** Block checksum type (entry of the checksum table). */
+typedef uint32_t vsfs_csum_t;
+
+/**
+ * Number of blocks in the checksum table.
+ *
+ * The checksum table holds the CRC32C of the contents of every block in the
+ * file system, except for the blocks of the checksum table itself. Only the
+ * checksums of metadata blocks and allocated data blocks are meaningful.
+ */
+static inline uint32_t vsfs_csum_blocks(vsfs_blk_t num_blocks,
+                                        uint32_t block_size)
+{
+	return (num_blocks * sizeof(vsfs_csum_t) + block_size - 1)
+	       / block_size;
+}
+
+/**
+ * Number of blocks in the extended attribute table.
+ *
+ * The xattr table holds one vsfs_blk_t per inode: the block that stores the
+ * extended attributes of the inode (see vsfs_xattr_hdr), or 0 if it has none.
+ * xattr_region is 0 in images formatted before extended attributes were
+ * supported; they have no table, and the checksum table is followed by the
+ * data region.
+ */
+static inline uint32_t vsfs_xattr_blocks(uint32_t num_inodes,
+                                         uint32_t block_size)
+{
+	return (num_inodes * sizeof(vsfs_blk_t) + block_size - 1) / block_size;
+}
+
 /** vsfs inode. */
 typedef struct vsfs_inode {
 	/** File mode. */
@@ -94,7 +241,12 @@ typedef struct vsfs_inode {
 
 	/** File size in vsfs file system blocks */
 	vsfs_blk_t i_blocks;
-	
+
+	/** Inode flags (VSFS_INODE_*). */
+	uint16_t i_flags;
+	/** Offset of the packed tail in its tail block (see VSFS_INODE_TAIL). */
+	uint16_t i_tail_off;
+
 	/** File size in bytes. */
 	uint64_t i_size;
 
@@ -112,37 +264,154 @@ typedef struct vsfs_inode {
 	vsfs_blk_t i_indirect;
 } vsfs_inode;
 
+/** Compress the data written to the file (see VSFS_CLUSTER_BLOCKS). */
+#define VSFS_INODE_COMPRESS 0x1
+
+/**
+ * The last block of the file is a packed tail. Instead of a block of its own,
+ * the partial last block of a regular file can be stored in a shared tail
+ * block that holds the tails of many files: the last block map entry refers
+ * to the tail block (and holds a reference to it), and the data of the last
+ * block - i_size minus the size of the other blocks - starts at i_tail_off
+ * within it. Tails are never modified in place. Set by the file system, not
+ * by users.
+ */
+#define VSFS_INODE_TAIL 0x2
+
+/** Flags that users can set (see VSFS_IOC_SETFLAGS). */
+#define VSFS_INODE_USER_FLAGS VSFS_INODE_COMPRESS
+
+/**
+ * Check if the tail of a file of the given size can be packed (see
+ * VSFS_INODE_TAIL): a partial last block of at most half a block.
+ */
+static inline bool vsfs_tail_packable(uint32_t block_size, uint64_t size)
+{
+	uint32_t tail = size & (block_size - 1);
+	return tail != 0 && tail <= block_size / 2;
+}
+
 /** A single block must fit an integral number of inodes */
-static_assert(VSFS_BLOCK_SIZE % sizeof(vsfs_inode) == 0, "invalid inode size");
+static_assert(VSFS_BLOCK_SIZE_MIN % sizeof(vsfs_inode) == 0,
+              "invalid inode size");
+
+/**
+ * Inode groups must consist of whole inode table blocks. With larger blocks,
+ * mkfs.vsfs rounds inodes_per_group up to a multiple of the inodes per block.
+ */
+static_assert(VSFS_GROUP_ALIGN % (VSFS_BLOCK_SIZE_MIN / sizeof(vsfs_inode))
+              == 0, "invalid group alignment");
+
+/** Number of inodes in an inode table block. */
+static inline uint32_t vsfs_inodes_per_block(uint32_t block_size)
+{
+	return block_size / sizeof(vsfs_inode);
+}
 
 /**
  *  Since we only have 1 inode bitmap block, there can be at most 
- *  VSFS_BLOCK_SIZE * bits_per_byte inodes in the file system.
+ *  VSFS_BLOCK_SIZE_MIN * bits_per_byte inodes in the file system. The limit
+ *  does not grow with the block size: VSFS_INO_MAX also marks free directory
+ *  entries.
  */
-#define VSFS_INO_MAX VSFS_BLOCK_SIZE*CHAR_BIT
+#define VSFS_INO_MAX VSFS_BLOCK_SIZE_MIN*CHAR_BIT
 
 /** 
  * Define the inode number for the root directory.
  */
 #define VSFS_ROOT_INO 0
 
+/**
+ * Define the inode number for the hidden snapshot directory. It is reachable
+ * as VSFS_SNAP_NAME in the root directory but not listed there.
+ */
+#define VSFS_SNAP_INO 1
+#define VSFS_SNAP_NAME ".snapshots"
+
 /** The root inode must be in the first block of the inode table. */
-static_assert(VSFS_ROOT_INO < (VSFS_BLOCK_SIZE / sizeof(vsfs_inode)),
+static_assert(VSFS_ROOT_INO < (VSFS_BLOCK_SIZE_MIN / sizeof(vsfs_inode)),
 	      "invalid root inode number");
 
 /**
  *  Since we only have 1 data bitmap block, there can be at most 
- *  VSFS_BLOCK_SIZE * bits_per_byte blocks in the file system.
+ *  block_size * bits_per_byte blocks in the file system.
  */
-#define VSFS_BLK_MAX VSFS_BLOCK_SIZE*CHAR_BIT
+static inline vsfs_blk_t vsfs_blk_max(uint32_t block_size)
+{
+	return block_size * CHAR_BIT;
+}
 
 /**
  *  Since we have a fixed metadata layout, there must be at least
- *  5  blocks in the file system:
- *  superblock, inode bitmap, data bitmap, inode table, root directory data blk
+ *  8  blocks in the file system: superblock, inode bitmap, data bitmap,
+ *  inode table, refcount table, checksum table, root and snapshot
+ *  directory data blks
+ */
+#define VSFS_BLK_MIN 8
+
+/** Number of block pointers that fit into the indirect block. */
+static inline uint32_t vsfs_num_indirect(uint32_t block_size)
+{
+	return block_size / sizeof(vsfs_blk_t);
+}
+
+/** Maximum file size in blocks (direct blocks + indirect block entries). */
+static inline vsfs_blk_t vsfs_max_file_blocks(uint32_t block_size)
+{
+	return VSFS_NUM_DIRECT + vsfs_num_indirect(block_size);
+}
+
+/**
+ * Number of blocks in a compression cluster.
+ *
+ * File blocks are grouped into clusters of VSFS_CLUSTER_BLOCKS consecutive
+ * blocks. A cluster that lies entirely within the file can be stored
+ * compressed: the first block pointers of the cluster point to blocks that
+ * hold a vsfs_cluster_hdr followed by the LZ4-compressed data, and the
+ * remaining pointers are 0. A cluster is compressed iff its last block pointer
+ * is 0 (the compressed data always takes fewer blocks than the cluster).
+ */
+#define VSFS_CLUSTER_BLOCKS 4
+#define VSFS_CLUSTER_SIZE_MAX (VSFS_CLUSTER_BLOCKS * VSFS_BLOCK_SIZE_MAX)
+
+/** Header of a compressed cluster. */
+typedef struct vsfs_cluster_hdr {
+	/** Size of the compressed data that follows the header in bytes. */
+	uint32_t c_size;
+} vsfs_cluster_hdr;
+
+
+/**
+ * Extended attribute block.
+ *
+ * All the extended attributes of an inode are stored in a single data block
+ * (see vsfs_xattr_blocks()), so that they are found without touching any
+ * other block. The block starts with a vsfs_xattr_hdr, followed by x_count
+ * vsfs_xattr_entry descriptors sorted by name - bytewise, a prefix first - so
+ * that a lookup is a binary search. The names (not null-terminated) and the
+ * values are packed after the descriptors; their offsets are from the start
+ * of the block. Like data blocks, an xattr block can be shared by several
+ * inodes (snapshots) and is copied before it is modified.
  */
-#define VSFS_BLK_MIN 5
+typedef struct vsfs_xattr_hdr {
+	/** Must match VSFS_XATTR_MAGIC. */
+	uint32_t x_magic;
+	/** Number of attributes. */
+	uint32_t x_count;
+} vsfs_xattr_hdr;
+
+/** Descriptor of an extended attribute. */
+typedef struct vsfs_xattr_entry {
+	uint16_t e_name_off;
+	uint16_t e_name_len;
+	uint16_t e_value_off;
+	uint16_t e_value_len;
+} vsfs_xattr_entry;
 
+#define VSFS_XATTR_MAGIC 0x58A77A58u
+
+/** Maximum extended attribute name length. Excludes the null terminator. */
+#define VSFS_XATTR_NAME_MAX 255
 
 /** Maximum file name (path component) length. Includes the null terminator. */
 #define VSFS_NAME_MAX 252
@@ -160,3 +429,114 @@ typedef struct vsfs_dentry {
 } vsfs_dentry;
 
 static_assert(sizeof(vsfs_dentry) == 256, "invalid dentry size");
+
+/** Number of directory entries in a block. */
+static inline uint32_t vsfs_dentries_per_block(uint32_t block_size)
+{
+	return block_size / sizeof(vsfs_dentry);
+}
+
+
+/**
+ * Arguments of the VSFS_IOC_CLONE ioctl.
+ *
+ * The ioctl is issued on the destination file. The source range is shared
+ * with the destination (copy-on-write) instead of being copied, so cloning
+ * only touches metadata. Offsets must be multiples of the block size; the
+ * length may only be unaligned if the range ends at the source EOF.
+ */
+struct vsfs_clone_args {
+	/** Offset of the range in the source file. */
+	uint64_t src_offset;
+	/** Length of the range in bytes; 0 means "up to the source EOF". */
+	uint64_t src_length;
+	/** Offset of the range in the destination file. */
+	uint64_t dest_offset;
+	/** Source path within the vsfs file system (starts with a '/'). */
+	char src_path[VSFS_PATH_MAX];
+};
+
+/** Share blocks of another file on the same vsfs mount (reflink). */
+#define VSFS_IOC_CLONE _IOW('V', 1, struct vsfs_clone_args)
+
+/** Get the inode flags (VSFS_INODE_*) of a file. */
+#define VSFS_IOC_GETFLAGS _IOR('V', 2, uint32_t)
+
+/**
+ * Set the inode flags (VSFS_INODE_*) of a file. Setting VSFS_INODE_COMPRESS
+ * also compresses the existing data; clearing it leaves compressed data as is
+ * (it is stored uncompressed when it is rewritten).
+ */
+#define VSFS_IOC_SETFLAGS _IOW('V', 3, uint32_t)
+
+/** Result of the VSFS_IOC_COMPR_STATS ioctl. */
+struct vsfs_compr_stats {
+	/** Number of data blocks of all regular files (uncompressed size). */
+	uint64_t logical_blocks;
+	/** Number of blocks that store the data of all regular files. */
+	uint64_t stored_blocks;
+	/** Number of compressed clusters. */
+	uint64_t compressed_clusters;
+};
+
+/**
+ * Get the compression statistics of the whole file system. Blocks shared by
+ * several files are counted once per file. The compression ratio is
+ * logical_blocks / stored_blocks.
+ */
+#define VSFS_IOC_COMPR_STATS _IOR('V', 4, struct vsfs_compr_stats)
+
+/** Arguments and result of the VSFS_IOC_DEFRAG ioctl. */
+struct vsfs_defrag_args {
+	/** In: VSFS_DEFRAG_* flags. */
+	uint32_t flags;
+	/** Out: number of data blocks of the file. */
+	uint32_t blocks;
+	/** Out: number of fragments (runs of contiguous blocks) before and after. */
+	uint32_t fragments_before;
+	uint32_t fragments_after;
+	/** Out: number of blocks moved. */
+	uint32_t moved;
+};
+
+/** Only report the fragmentation of the file; don't move any blocks. */
+#define VSFS_DEFRAG_REPORT 0x1
+
+/**
+ * Defragment a regular file: move its blocks (and its indirect block, in front
+ * of them) into one contiguous run of free blocks. The block pointers of all
+ * the files that share the blocks are switched to the new copies at once, so
+ * the file contents never change; blocks are only freed after that.
+ */
+#define VSFS_IOC_DEFRAG _IOWR('V', 5, struct vsfs_defrag_args)
+
+/** Number of free extent size classes in struct vsfs_free_frag. */
+#define VSFS_FRAG_BUCKETS 16
+
+/** Result of the VSFS_IOC_FREE_FRAG ioctl. */
+struct vsfs_free_frag {
+	/** Number of free data blocks. */
+	uint32_t free_blocks;
+	/** Number of free extents (runs of free blocks). */
+	uint32_t extents;
+	/** Size of the largest free extent in blocks. */
+	uint32_t largest;
+	/** Number of free extents of [2^i, 2^(i+1)) blocks. */
+	uint32_t hist[VSFS_FRAG_BUCKETS];
+};
+
+/** Get the free space fragmentation of the whole file system. */
+#define VSFS_IOC_FREE_FRAG _IOR('V', 6, struct vsfs_free_frag)
+
+/**
+ * Grow the file system to a new size in bytes (a multiple of the block size,
+ * at most max_blocks blocks; see vsfs_max_blocks()). The image file is
+ * extended, and the new blocks become free data blocks.
+ */
+#define VSFS_IOC_GROW _IOW('V', 7, uint64_t)
+
+/**
+ * Discard all the free blocks: punch them out of the image file so that the
+ * host reclaims their storage. Receives the number of bytes discarded.
+ */
+#define VSFS_IOC_TRIM _IOR('V', 8, uint64_t)
@@ -0,0 +1,316 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+/**
+ * CSC369 Assignment 4 - vsfs control tool.
+ *
+ * Issues vsfs-specific ioctls on files in a mounted vsfs file system.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <unistd.h>
+
+#include "vsfs.h"
+
+static const char *help_str = "\
+Usage: %s command [options] args\n\
+\n\
+Commands:\n\
+    clone [-s off] [-l len] [-d off] src dst\n\
+            share the blocks of src with dst (copy-on-write reflink);\n\
+            both files must be on the same vsfs mount. Without range\n\
+            options dst is replaced by a clone of the whole src.\n\
+            -s  source offset (default 0)\n\
+            -l  length in bytes (default: up to the end of src)\n\
+            -d  destination offset (default 0)\n\
+    compress [-d] file...\n\
+            compress the data of the files, including future writes;\n\
+            -d  store future writes uncompressed instead\n\
+    df path\n\
+            print the compression statistics of the vsfs mount that\n\
+            contains path\n\
+    grow path size\n\
+            grow the vsfs mount that contains path to size bytes (a\n\
+            multiple of the block size; K, M and G suffixes are allowed)\n\
+    help    print help and exit\n\
+";
+
+static void print_help(FILE *f, const char *progname)
+{
+	fprintf(f, help_str, progname);
+}
+
+
+/**
+ * Translate a host path of a file on a vsfs mount into the path within vsfs.
+ *
+ * The mount point is found by walking up the directory tree until the device
+ * number changes.
+ *
+ * @param path      host path to an existing file.
+ * @param vsfs_path buffer of VSFS_PATH_MAX bytes that receives the result.
+ * @return          true on success; false on failure.
+ */
+static bool get_vsfs_path(const char *path, char *vsfs_path)
+{
+	char real[PATH_MAX];
+	if (realpath(path, real) == NULL) {
+		perror(path);
+		return false;
+	}
+
+	struct stat st;
+	if (stat(real, &st) < 0) {
+		perror(real);
+		return false;
+	}
+	dev_t dev = st.st_dev;
+
+	char dir[PATH_MAX];
+	strcpy(dir, real);
+	while (strcmp(dir, "/") != 0) {
+		char parent[PATH_MAX];
+		strcpy(parent, dir);
+		strcpy(parent, dirname(parent));
+		if (stat(parent, &st) < 0 || st.st_dev != dev) {
+			break;
+		}
+		strcpy(dir, parent);
+	}
+	// Strip the mount point prefix of the path
+	const char *rel = real + ((strcmp(dir, "/") == 0) ? 0 : strlen(dir));
+	if (*rel == '\0') {
+		rel = "/";
+	}
+	if (strlen(rel) >= VSFS_PATH_MAX) {
+		fprintf(stderr, "%s: path is too long\n", path);
+		return false;
+	}
+	strcpy(vsfs_path, rel);
+	return true;
+}
+
+static int cmd_clone(int argc, char *argv[])
+{
+	struct vsfs_clone_args args = {0};
+	bool range = false;
+	int o;
+
+	while ((o = getopt(argc, argv, "s:l:d:")) != -1) {
+		switch (o) {
+			case 's': args.src_offset  = strtoull(optarg, NULL, 0); break;
+			case 'l': args.src_length  = strtoull(optarg, NULL, 0); break;
+			case 'd': args.dest_offset = strtoull(optarg, NULL, 0); break;
+			case '?': return -1;
+			default : assert(false);
+		}
+		range = true;
+	}
+	if (argc - optind != 2) {
+		fprintf(stderr, "clone: expected source and destination paths\n");
+		return -1;
+	}
+	const char *src = argv[optind];
+	const char *dst = argv[optind + 1];
+
+	if (!get_vsfs_path(src, args.src_path)) {
+		return 1;
+	}
+
+	// Without a range the destination becomes an exact clone of the source
+	int fd = open(dst, O_WRONLY | O_CREAT | (range ? 0 : O_TRUNC), 0666);
+	if (fd < 0) {
+		perror(dst);
+		return 1;
+	}
+
+	struct stat src_st, dst_st;
+	if (stat(src, &src_st) < 0 || fstat(fd, &dst_st) < 0) {
+		perror("stat");
+		close(fd);
+		return 1;
+	}
+	if (src_st.st_dev != dst_st.st_dev) {
+		fprintf(stderr, "%s and %s are not on the same file system\n",
+		        src, dst);
+		close(fd);
+		return 1;
+	}
+
+	int ret = 0;
+	if (ioctl(fd, VSFS_IOC_CLONE, &args) < 0) {
+		fprintf(stderr, "clone %s -> %s: %s\n", src, dst, strerror(errno));
+		ret = 1;
+	}
+	close(fd);
+	return ret;
+}
+
+static int cmd_compress(int argc, char *argv[])
+{
+	bool disable = false;
+	int o;
+
+	while ((o = getopt(argc, argv, "d")) != -1) {
+		switch (o) {
+			case 'd': disable = true; break;
+			case '?': return -1;
+			default : assert(false);
+		}
+	}
+	if (optind >= argc) {
+		fprintf(stderr, "compress: expected file paths\n");
+		return -1;
+	}
+
+	int ret = 0;
+	for (int i = optind; i < argc; ++i) {
+		int fd = open(argv[i], O_RDONLY);
+		if (fd < 0) {
+			perror(argv[i]);
+			ret = 1;
+			continue;
+		}
+
+		uint32_t flags;
+		if (ioctl(fd, VSFS_IOC_GETFLAGS, &flags) < 0) {
+			fprintf(stderr, "%s: %s\n", argv[i], strerror(errno));
+			ret = 1;
+		} else {
+			if (disable) {
+				flags &= ~VSFS_INODE_COMPRESS;
+			} else {
+				flags |= VSFS_INODE_COMPRESS;
+			}
+			if (ioctl(fd, VSFS_IOC_SETFLAGS, &flags) < 0) {
+				fprintf(stderr, "%s: %s\n", argv[i],
+				        strerror(errno));
+				ret = 1;
+			}
+		}
+		close(fd);
+	}
+	return ret;
+}
+
+static int cmd_df(int argc, char *argv[])
+{
+	if (argc != 2) {
+		fprintf(stderr, "df: expected a path\n");
+		return -1;
+	}
+
+	int fd = open(argv[1], O_RDONLY);
+	if (fd < 0) {
+		perror(argv[1]);
+		return 1;
+	}
+	struct vsfs_compr_stats st;
+	struct statvfs vfs;
+	int ret = ioctl(fd, VSFS_IOC_COMPR_STATS, &st);
+	if (ret == 0) {
+		ret = fstatvfs(fd, &vfs);
+	}
+	close(fd);
+	if (ret < 0) {
+		fprintf(stderr, "%s: %s\n", argv[1], strerror(errno));
+		return 1;
+	}
+
+	printf("file data:           %llu blocks (%llu KiB)\n",
+	       (unsigned long long)st.logical_blocks,
+	       (unsigned long long)st.logical_blocks * vfs.f_bsize / 1024);
+	printf("stored in:           %llu blocks (%llu KiB)\n",
+	       (unsigned long long)st.stored_blocks,
+	       (unsigned long long)st.stored_blocks * vfs.f_bsize / 1024);
+	printf("compressed clusters: %llu\n",
+	       (unsigned long long)st.compressed_clusters);
+	printf("compression ratio:   %.2f\n", st.stored_blocks == 0 ? 1.0 :
+	       (double)st.logical_blocks / st.stored_blocks);
+	return 0;
+}
+
+static int cmd_grow(int argc, char *argv[])
+{
+	if (argc != 3) {
+		fprintf(stderr, "grow: expected a path and a size\n");
+		return -1;
+	}
+
+	char *end;
+	uint64_t size = strtoull(argv[2], &end, 0);
+	switch (*end) {
+		case 'K': size <<= 10; ++end; break;
+		case 'M': size <<= 20; ++end; break;
+		case 'G': size <<= 30; ++end; break;
+	}
+	if (end == argv[2] || *end != '\0') {
+		fprintf(stderr, "grow: invalid size %s\n", argv[2]);
+		return -1;
+	}
+
+	int fd = open(argv[1], O_RDONLY);
+	if (fd < 0) {
+		perror(argv[1]);
+		return 1;
+	}
+	int ret = ioctl(fd, VSFS_IOC_GROW, &size);
+	close(fd);
+	if (ret < 0) {
+		fprintf(stderr, "%s: %s\n", argv[1], strerror(errno));
+		return 1;
+	}
+	return 0;
+}
+
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2 || strcmp(argv[1], "help") == 0) {
+		print_help(argc < 2 ? stderr : stdout, argv[0]);
+		return argc < 2 ? 1 : 0;
+	}
+
+	int ret;
+	// Parse the command options as if the command was the program name
+	if (strcmp(argv[1], "clone") == 0) {
+		ret = cmd_clone(argc - 1, argv + 1);
+	} else if (strcmp(argv[1], "compress") == 0) {
+		ret = cmd_compress(argc - 1, argv + 1);
+	} else if (strcmp(argv[1], "df") == 0) {
+		ret = cmd_df(argc - 1, argv + 1);
+	} else if (strcmp(argv[1], "grow") == 0) {
+		ret = cmd_grow(argc - 1, argv + 1);
+	} else {
+		fprintf(stderr, "Unknown command: %s\n", argv[1]);
+		ret = -1;
+	}
+
+	if (ret < 0) {
+		// Invalid arguments, print help to stderr
+		print_help(stderr, argv[0]);
+		return 1;
+	}
+	return ret;
+}
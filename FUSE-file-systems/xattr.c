@@ -0,0 +1,372 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+
+/**
+ * CSC369 Assignment 4 - Extended attributes.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/xattr.h>
+
+#include "csum.h"
+#include "inode.h"
+#include "refcount.h"
+#include "xattr.h"
+
+
+/** Get the descriptors that follow the header of an xattr block. */
+static const vsfs_xattr_entry *xattr_entries(const vsfs_xattr_hdr *hdr)
+{
+	return (const vsfs_xattr_entry *)(hdr + 1);
+}
+
+/** Get the name of an attribute (not null-terminated). */
+static const char *entry_name(const vsfs_xattr_hdr *hdr,
+                              const vsfs_xattr_entry *entry)
+{
+	return (const char *)hdr + entry->e_name_off;
+}
+
+/** Check that a descriptor only refers to the inside of the block. */
+static bool entry_valid(const fs_ctx *fs, const vsfs_xattr_entry *entry)
+{
+	return entry->e_name_len > 0 &&
+	       entry->e_name_len <= VSFS_XATTR_NAME_MAX &&
+	       (uint32_t)entry->e_name_off + entry->e_name_len
+	       <= fs->block_size &&
+	       (uint32_t)entry->e_value_off + entry->e_value_len
+	       <= fs->block_size;
+}
+
+/**
+ * Get the xattr block of an inode; *hdr is set to NULL if the inode has no
+ * extended attributes.
+ */
+static int xattr_load(fs_ctx *fs, vsfs_ino_t ino, const vsfs_xattr_hdr **hdr)
+{
+	if (fs->xattrtable == NULL) {
+		return -ENOTSUP;
+	}
+	*hdr = NULL;
+	vsfs_blk_t blk = fs->xattrtable[ino];
+	if (blk == 0) {
+		return 0;
+	}
+	if (fs->verify && !csum_is_dirty(fs, blk) && !csum_verify(fs, blk)) {
+		return -EIO;
+	}
+
+	const vsfs_xattr_hdr *block = block_addr(fs, blk);
+	uint32_t max_count = (fs->block_size - sizeof(*block))
+	                     / sizeof(vsfs_xattr_entry);
+	if (block->x_magic != VSFS_XATTR_MAGIC || block->x_count > max_count) {
+		fprintf(stderr, "vsfs: invalid xattr block %u of inode %u\n",
+		        blk, ino);
+		return -EIO;
+	}
+	*hdr = block;
+	return 0;
+}
+
+/** Compare two names bytewise; a prefix of a name is ordered before it. */
+static int name_cmp(const char *a, size_t a_len, const char *b, size_t b_len)
+{
+	int ret = memcmp(a, b, a_len < b_len ? a_len : b_len);
+	if (ret != 0) {
+		return ret;
+	}
+	return (a_len > b_len) - (a_len < b_len);
+}
+
+/**
+ * Binary search for an attribute in an xattr block (NULL means no
+ * attributes). *pos receives the index of the attribute, or the index it
+ * would be inserted at if there is none.
+ *
+ * @return  0 if the attribute is found; -ENODATA if it is not; -EIO if the
+ *          block is corrupted.
+ */
+static int xattr_find(const fs_ctx *fs, const vsfs_xattr_hdr *hdr,
+                      const char *name, size_t len, uint32_t *pos)
+{
+	uint32_t lo = 0, hi = hdr != NULL ? hdr->x_count : 0;
+
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		const vsfs_xattr_entry *entry = &xattr_entries(hdr)[mid];
+		if (!entry_valid(fs, entry)) {
+			return -EIO;
+		}
+		int cmp = name_cmp(entry_name(hdr, entry), entry->e_name_len,
+		                   name, len);
+		if (cmp == 0) {
+			*pos = mid;
+			return 0;
+		}
+		if (cmp < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	*pos = lo;
+	return -ENODATA;
+}
+
+/** Check the length of an attribute name. */
+static int check_name(const char *name, size_t *len)
+{
+	*len = strlen(name);
+	if (*len == 0) {
+		return -EINVAL;
+	}
+	return *len <= VSFS_XATTR_NAME_MAX ? 0 : -ERANGE;
+}
+
+/** Append an attribute to an xattr block being built. */
+static void put_entry(void *block, uint32_t *data_off, const char *name,
+                      size_t name_len, const void *value, size_t value_len)
+{
+	vsfs_xattr_hdr *hdr = (vsfs_xattr_hdr *)block;
+	vsfs_xattr_entry *entry = (vsfs_xattr_entry *)(hdr + 1) + hdr->x_count++;
+
+	entry->e_name_off = *data_off;
+	entry->e_name_len = name_len;
+	memcpy(block + *data_off, name, name_len);
+	*data_off += name_len;
+	entry->e_value_off = *data_off;
+	entry->e_value_len = value_len;
+	memcpy(block + *data_off, value, value_len);
+	*data_off += value_len;
+}
+
+/** Make an inode use the contents of buf as its xattr block. */
+static int xattr_commit(fs_ctx *fs, vsfs_ino_t ino, const void *buf)
+{
+	vsfs_blk_t old = fs->xattrtable[ino];
+
+	// Like data blocks, a shared block (and in log mode, any block) is
+	// replaced rather than modified in place
+	if (old != 0 && rc_get(fs, old) == 1 && fs->lfs == NULL) {
+		memcpy(block_addr(fs, old), buf, fs->block_size);
+		csum_mark_dirty(fs, old);
+		return 0;
+	}
+
+	vsfs_blk_t blk;
+	int ret = block_alloc(fs, inode_goal(fs, &fs->itable[ino], 0), &blk);
+	if (ret != 0) {
+		return ret;
+	}
+	memcpy(block_addr(fs, blk), buf, fs->block_size);
+	csum_mark_dirty(fs, blk);
+	fs->xattrtable[ino] = blk;
+	if (old != 0) {
+		block_put(fs, old);
+	}
+	return 0;
+}
+
+/**
+ * Rebuild the xattr block of an inode: the attributes of the old block hdr
+ * (NULL if none) except for the one at index skip (x_count or more to keep
+ * all), plus the attribute name = value inserted at index pos if name is not
+ * NULL. The block is freed if no attributes are left.
+ */
+static int xattr_rebuild(fs_ctx *fs, vsfs_ino_t ino, const vsfs_xattr_hdr *hdr,
+                         uint32_t skip, uint32_t pos, const char *name,
+                         size_t name_len, const void *value, size_t value_len)
+{
+	uint32_t old_count = hdr != NULL ? hdr->x_count : 0;
+	uint32_t count = (name != NULL) + old_count - (skip < old_count);
+	const vsfs_xattr_entry *entries = hdr != NULL ? xattr_entries(hdr) : NULL;
+
+	if (count == 0) {
+		block_put(fs, fs->xattrtable[ino]);
+		fs->xattrtable[ino] = 0;
+		return 0;
+	}
+
+	uint64_t size = sizeof(vsfs_xattr_hdr) + count * sizeof(vsfs_xattr_entry);
+	if (name != NULL) {
+		size += name_len + value_len;
+	}
+	for (uint32_t i = 0; i < old_count; ++i) {
+		if (i != skip) {
+			size += entries[i].e_name_len + entries[i].e_value_len;
+		}
+	}
+	if (size > fs->block_size) {
+		return -ENOSPC;
+	}
+
+	// The old block may be rebuilt in place, so the new one is built in a
+	// separate buffer
+	void *buf = calloc(1, fs->block_size);
+	if (buf == NULL) {
+		return -ENOMEM;
+	}
+	((vsfs_xattr_hdr *)buf)->x_magic = VSFS_XATTR_MAGIC;
+	uint32_t data_off = sizeof(vsfs_xattr_hdr)
+	                    + count * sizeof(vsfs_xattr_entry);
+	for (uint32_t i = 0; i <= old_count; ++i) {
+		if (name != NULL && i == pos) {
+			put_entry(buf, &data_off, name, name_len, value,
+			          value_len);
+		}
+		if (i < old_count && i != skip) {
+			put_entry(buf, &data_off, entry_name(hdr, &entries[i]),
+			          entries[i].e_name_len,
+			          (const char *)hdr + entries[i].e_value_off,
+			          entries[i].e_value_len);
+		}
+	}
+
+	int ret = xattr_commit(fs, ino, buf);
+	free(buf);
+	return ret;
+}
+
+ssize_t xattr_get(fs_ctx *fs, vsfs_ino_t ino, const char *name, void *value,
+                  size_t size)
+{
+	const vsfs_xattr_hdr *hdr;
+	int ret = xattr_load(fs, ino, &hdr);
+	if (ret != 0) {
+		return ret;
+	}
+	uint32_t pos;
+	ret = xattr_find(fs, hdr, name, strlen(name), &pos);
+	if (ret != 0) {
+		return ret;
+	}
+
+	const vsfs_xattr_entry *entry = &xattr_entries(hdr)[pos];
+	if (size == 0) {
+		return entry->e_value_len;
+	}
+	if (size < entry->e_value_len) {
+		return -ERANGE;
+	}
+	memcpy(value, (const char *)hdr + entry->e_value_off,
+	       entry->e_value_len);
+	return entry->e_value_len;
+}
+
+ssize_t xattr_list(fs_ctx *fs, vsfs_ino_t ino, char *list, size_t size)
+{
+	const vsfs_xattr_hdr *hdr;
+	int ret = xattr_load(fs, ino, &hdr);
+	if (ret != 0 || hdr == NULL) {
+		return ret;
+	}
+
+	size_t len = 0;
+	const vsfs_xattr_entry *entries = xattr_entries(hdr);
+	for (uint32_t i = 0; i < hdr->x_count; ++i) {
+		if (!entry_valid(fs, &entries[i])) {
+			return -EIO;
+		}
+		len += entries[i].e_name_len + 1;
+	}
+	if (size == 0) {
+		return len;
+	}
+	if (size < len) {
+		return -ERANGE;
+	}
+
+	for (uint32_t i = 0; i < hdr->x_count; ++i) {
+		memcpy(list, entry_name(hdr, &entries[i]), entries[i].e_name_len);
+		list += entries[i].e_name_len;
+		*list++ = '\0';
+	}
+	return len;
+}
+
+int xattr_set(fs_ctx *fs, vsfs_ino_t ino, const char *name, const void *value,
+              size_t size, int flags)
+{
+	size_t len;
+	int ret = check_name(name, &len);
+	if (ret != 0) {
+		return ret;
+	}
+	const vsfs_xattr_hdr *hdr;
+	ret = xattr_load(fs, ino, &hdr);
+	if (ret != 0) {
+		return ret;
+	}
+	if (size > fs->block_size) {
+		return -ENOSPC;
+	}
+
+	uint32_t pos;
+	ret = xattr_find(fs, hdr, name, len, &pos);
+	if (ret == -EIO) {
+		return ret;
+	}
+	bool exists = ret == 0;
+	if ((flags & XATTR_CREATE) && exists) {
+		return -EEXIST;
+	}
+	if ((flags & XATTR_REPLACE) && !exists) {
+		return -ENODATA;
+	}
+	return xattr_rebuild(fs, ino, hdr, exists ? pos : UINT32_MAX, pos, name,
+	                     len, value, size);
+}
+
+int xattr_remove(fs_ctx *fs, vsfs_ino_t ino, const char *name)
+{
+	const vsfs_xattr_hdr *hdr;
+	int ret = xattr_load(fs, ino, &hdr);
+	if (ret != 0) {
+		return ret;
+	}
+	uint32_t pos;
+	ret = xattr_find(fs, hdr, name, strlen(name), &pos);
+	if (ret != 0) {
+		return ret;
+	}
+	return xattr_rebuild(fs, ino, hdr, pos, 0, NULL, 0, NULL, 0);
+}
+
+int xattr_share(fs_ctx *fs, vsfs_ino_t dst, vsfs_ino_t src)
+{
+	if (fs->xattrtable == NULL) {
+		return 0;
+	}
+	assert(fs->xattrtable[dst] == 0);
+
+	vsfs_blk_t blk = fs->xattrtable[src];
+	if (blk == 0 || block_ref(fs, blk)) {
+		fs->xattrtable[dst] = blk;
+		return 0;
+	}
+	// Too many references to this block - copy it instead
+	return xattr_commit(fs, dst, block_addr(fs, blk));
+}
+
+void xattr_release(fs_ctx *fs, vsfs_ino_t ino)
+{
+	if (fs->xattrtable != NULL && fs->xattrtable[ino] != 0) {
+		block_put(fs, fs->xattrtable[ino]);
+		fs->xattrtable[ino] = 0;
+	}
+}
@@ -0,0 +1,112 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid, Angela Demke Brown
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2022 Angela Demke Brown
+ */
+
+
+/**
+ * CSC369 Assignment 4 - Extended attributes.
+ *
+ * The extended attributes of an inode live in a single xattr block that the
+ * xattr table points to (see vsfs_xattr_hdr in vsfs.h). The descriptors are
+ * sorted by name, so a lookup is a binary search within one block; there is
+ * no room for attributes in the inode itself. A block is rebuilt whenever an
+ * attribute is set or removed: in place if the inode is its only user, or in
+ * a newly allocated block if it is shared with a snapshot (or in log mode).
+ * The block is freed when the last attribute is removed.
+ *
+ * Images formatted before extended attributes were supported have no xattr
+ * table; all the operations fail with -ENOTSUP on them.
+ */
+
+#pragma once
+
+#include <sys/types.h>
+
+#include "fs_ctx.h"
+#include "vsfs.h"
+
+
+/**
+ * Get the value of an extended attribute.
+ *
+ * @param fs     pointer to the file system context.
+ * @param ino    inode number.
+ * @param name   attribute name (null-terminated).
+ * @param value  buffer that receives the value; not used if size is 0.
+ * @param size   size of the buffer.
+ * @return       length of the value on success; -ENODATA if there is no such
+ *               attribute; -ERANGE if the buffer is too small; -EIO if the
+ *               xattr block is corrupted.
+ */
+ssize_t xattr_get(fs_ctx *fs, vsfs_ino_t ino, const char *name, void *value,
+                  size_t size);
+
+/**
+ * List the names of the extended attributes of an inode, each followed by a
+ * null terminator.
+ *
+ * @param fs     pointer to the file system context.
+ * @param ino    inode number.
+ * @param list   buffer that receives the names; not used if size is 0.
+ * @param size   size of the buffer.
+ * @return       total length of the names on success; -ERANGE if the buffer
+ *               is too small; -EIO if the xattr block is corrupted.
+ */
+ssize_t xattr_list(fs_ctx *fs, vsfs_ino_t ino, char *list, size_t size);
+
+/**
+ * Create or replace an extended attribute.
+ *
+ * @param fs     pointer to the file system context.
+ * @param ino    inode number.
+ * @param name   attribute name (null-terminated).
+ * @param value  attribute value.
+ * @param size   length of the value.
+ * @param flags  XATTR_CREATE, XATTR_REPLACE or 0 (see setxattr(2)).
+ * @return       0 on success; -EEXIST or -ENODATA if the flags don't allow
+ *               the operation; -ERANGE if the name is too long; -ENOSPC if
+ *               the attributes don't fit into a block or no block can be
+ *               allocated.
+ */
+int xattr_set(fs_ctx *fs, vsfs_ino_t ino, const char *name, const void *value,
+              size_t size, int flags);
+
+/**
+ * Remove an extended attribute.
+ *
+ * @param fs     pointer to the file system context.
+ * @param ino    inode number.
+ * @param name   attribute name (null-terminated).
+ * @return       0 on success; -ENODATA if there is no such attribute;
+ *               -ENOSPC if a shared xattr block can't be copied.
+ */
+int xattr_remove(fs_ctx *fs, vsfs_ino_t ino, const char *name);
+
+/**
+ * Give an inode the same extended attributes as another one by sharing its
+ * xattr block; the block is copied if it has too many references.
+ *
+ * @param fs     pointer to the file system context.
+ * @param dst    inode number of the copy; must have no extended attributes.
+ * @param src    inode number of the original.
+ * @return       0 on success; -ENOSPC if the block can't be copied.
+ */
+int xattr_share(fs_ctx *fs, vsfs_ino_t dst, vsfs_ino_t src);
+
+/**
+ * Drop all the extended attributes of an inode that is being freed.
+ *
+ * @param fs     pointer to the file system context.
+ * @param ino    inode number.
+ */
+void xattr_release(fs_ctx *fs, vsfs_ino_t ino);